@@ -0,0 +1,24 @@
+#include <stdio.h>
+
+static int steps(int start) {
+    int n = start;
+    int count = 0;
+    while (n > 1) {
+        if (n % 2 < 1) {
+            n = n / 2;
+        } else {
+            n = 3 * n + 1;
+        }
+        count += 1;
+    }
+    return count;
+}
+
+int main(void) {
+    int total = 0;
+    for (int i = 1; i < 100000; i += 1) {
+        total += steps(i);
+    }
+    printf("%d\n", total);
+    return 0;
+}
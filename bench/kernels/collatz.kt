@@ -0,0 +1,22 @@
+fun steps(start: Int): Int {
+    var n: Int = start
+    var count: Int = 0
+    while (n > 1) {
+        if (n % 2 < 1) {
+            n = n / 2
+        } else {
+            n = 3 * n + 1
+        }
+        count += 1
+    }
+    return count
+}
+
+fun main(): Int {
+    var total: Int = 0
+    for (i in 1 until 100000) {
+        total += steps(i)
+    }
+    println(total)
+    return 0
+}
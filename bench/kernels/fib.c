@@ -0,0 +1,14 @@
+#include <stdio.h>
+
+static int fib(int n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+int main(void) {
+    int total = 0;
+    for (int i = 33; i <= 35; i++) {
+        total += fib(i);
+    }
+    printf("%d\n", total);
+    return 0;
+}
@@ -0,0 +1,10 @@
+fun fib(n: Int): Int = if (n < 2) n else fib(n - 1) + fib(n - 2)
+
+fun main(): Int {
+    var total: Int = 0
+    for (i in 33..35) {
+        total += fib(i)
+    }
+    println(total)
+    return 0
+}
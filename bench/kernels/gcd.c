@@ -0,0 +1,16 @@
+#include <stdio.h>
+
+static int gcd(int a, int b) {
+    return b < 1 ? a : gcd(b, a % b);
+}
+
+int main(void) {
+    int sum = 0;
+    for (int i = 1; i < 2000; i += 1) {
+        for (int j = 1; j < 2000; j += 1) {
+            sum += gcd(i, j);
+        }
+    }
+    printf("%d\n", sum);
+    return 0;
+}
@@ -0,0 +1,12 @@
+fun gcd(a: Int, b: Int): Int = if (b < 1) a else gcd(b, a % b)
+
+fun main(): Int {
+    var sum: Int = 0
+    for (i in 1 until 2000) {
+        for (j in 1 until 2000) {
+            sum += gcd(i, j)
+        }
+    }
+    println(sum)
+    return 0
+}
@@ -0,0 +1,12 @@
+#include <stdio.h>
+
+int main(void) {
+    double x = 0.5;
+    double acc = 0.0;
+    for (int i = 0; i < 50000000; i += 1) {
+        x = 3.7 * x * (1.0 - x);
+        acc = acc + x;
+    }
+    printf("%f\n", acc);
+    return 0;
+}
@@ -0,0 +1,10 @@
+fun main(): Int {
+    var x: Double = 0.5
+    var acc: Double = 0.0
+    for (i in 0 until 50000000) {
+        x = 3.7 * x * (1.0 - x)
+        acc = acc + x
+    }
+    println(acc)
+    return 0
+}
@@ -0,0 +1,12 @@
+#include <stdio.h>
+
+int main(void) {
+    int sum = 0;
+    for (int i = 0; i < 4000; i += 1) {
+        for (int j = 0; j < 4000; j += 1) {
+            sum = (sum + i * j + (i ^ j)) % 1000003;
+        }
+    }
+    printf("%d\n", sum);
+    return 0;
+}
@@ -0,0 +1,10 @@
+fun main(): Int {
+    var sum: Int = 0
+    for (i in 0 until 4000) {
+        for (j in 0 until 4000) {
+            sum = (sum + i * j + (i xor j)) % 1000003
+        }
+    }
+    println(sum)
+    return 0
+}
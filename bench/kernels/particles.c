@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+struct particle {
+    int position;
+    int velocity;
+};
+
+static int advance(struct particle* p) {
+    p->position = p->position + p->velocity;
+    p->velocity = p->velocity - 1;
+    return p->position + p->velocity;
+}
+
+int main(void) {
+    int total = 0;
+    for (int i = 0; i < 10000000; i += 1) {
+        struct particle* p = malloc(sizeof(struct particle));
+        p->position = i % 100;
+        p->velocity = i % 7;
+        total += advance(p) % 10;
+        free(p);
+    }
+    printf("%d\n", total);
+    return 0;
+}
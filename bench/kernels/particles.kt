@@ -0,0 +1,17 @@
+class Particle(var position: Int, var velocity: Int)
+
+fun advance(p: Particle): Int {
+    p.position = p.position + p.velocity
+    p.velocity = p.velocity - 1
+    return p.position + p.velocity
+}
+
+fun main(): Int {
+    var total: Int = 0
+    for (i in 0 until 10000000) {
+        var p: Particle = Particle(i % 100, i % 7)
+        total += advance(p) % 10
+    }
+    println(total)
+    return 0
+}
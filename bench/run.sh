@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+#
+# Runtime benchmark for the code emitted by kotlin-llvm.
+#
+# Every kernel in bench/kernels/ exists as a Kotlin source (<name>.kt) and a
+# reference C implementation (<name>.c). For each optimization level both are
+# compiled ahead of time, run, checked for identical output and timed. The
+# report shows the slowdown of the Kotlin build relative to C.
+#
+# Usage: bench/run.sh [path/to/kotlin-llvm] [kernel...]
+#
+# Tools can be overridden through the environment:
+#   OPT, LLC  - LLVM tools used to optimize and lower the emitted IR
+#   CC        - C compiler for the references and for linking
+#   RUNTIME   - libkotlin-llvm-runtime.a, needed by kernels with heap classes
+#   LEVELS    - optimization levels to measure (default: "0 1 2 3")
+#   RUNS      - repetitions per binary, the fastest one is reported (default: 3)
+
+set -euo pipefail
+
+BENCH_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+COMPILER="${1:-./kotlin-llvm}"
+shift || true
+
+OPT="${OPT:-opt}"
+LLC="${LLC:-llc}"
+CC="${CC:-cc}"
+LEVELS="${LEVELS:-0 1 2 3}"
+RUNS="${RUNS:-3}"
+RUNTIME="${RUNTIME:-}"
+
+if [ "$#" -gt 0 ]; then
+    KERNELS="$*"
+else
+    KERNELS="$(cd "$BENCH_DIR/kernels" && ls *.kt | sed 's/\.kt$//')"
+fi
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# Runs a binary RUNS times and prints the fastest wall time in seconds.
+best_time() {
+    local binary="$1" best="" start end elapsed
+    for _ in $(seq "$RUNS"); do
+        start=$(date +%s.%N)
+        "$binary" > /dev/null
+        end=$(date +%s.%N)
+        elapsed=$(awk -v s="$start" -v e="$end" 'BEGIN { print e - s }')
+        if [ -z "$best" ] || awk -v a="$elapsed" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best="$elapsed"
+        fi
+    done
+    printf "%.4f" "$best"
+}
+
+printf "%-16s %-6s %12s %12s %10s\n" "kernel" "level" "kotlin (s)" "c (s)" "slowdown"
+
+status=0
+for kernel in $KERNELS; do
+    source_kt="$BENCH_DIR/kernels/$kernel.kt"
+    source_c="$BENCH_DIR/kernels/$kernel.c"
+
+    for level in $LEVELS; do
+        kt_binary="$WORK_DIR/$kernel-kt-O$level"
+        c_binary="$WORK_DIR/$kernel-c-O$level"
+
+        # The compiler's own passes (e.g. stack allocation of objects) only run with -O
+        "$COMPILER" -O"$level" "$source_kt" > "$WORK_DIR/$kernel-O$level.ll"
+        "$OPT" -O"$level" "$WORK_DIR/$kernel-O$level.ll" -o "$WORK_DIR/$kernel-O$level.bc"
+        "$LLC" -O"$level" -relocation-model=pic "$WORK_DIR/$kernel-O$level.bc" -o "$WORK_DIR/$kernel-O$level.s"
+        "$CC" "$WORK_DIR/$kernel-O$level.s" $RUNTIME -lpthread -o "$kt_binary"
+        "$CC" -O"$level" "$source_c" -o "$c_binary"
+
+        if [ "$("$kt_binary")" != "$("$c_binary")" ]; then
+            echo "$kernel: output differs from the C reference at -O$level" >&2
+            status=1
+            continue
+        fi
+
+        kt_time=$(best_time "$kt_binary")
+        c_time=$(best_time "$c_binary")
+        slowdown=$(awk -v k="$kt_time" -v c="$c_time" 'BEGIN { if (c > 0) printf "%.2fx", k / c; else print "n/a" }')
+        printf "%-16s %-6s %12s %12s %10s\n" "$kernel" "-O$level" "$kt_time" "$c_time" "$slowdown"
+    done
+done
+
+exit $status
@@ -0,0 +1,168 @@
+#!/usr/bin/env bash
+#
+# Runs one of the test_<name>.kt programs and compares its output with test_<name>.out.
+#
+# The program is compiled ahead of time and linked with the runtime, like a user would build it. Modules it
+# imports are looked up as test_<name>/<path>.kt next to it, compiled first and linked in.
+#
+# Usage: ./run_test.sh path/to/kotlin-llvm path/to/libkotlin-llvm-runtime.a test_<name>.kt [level] [mode]
+#
+# The mode tests a way of building the program besides the output:
+#   aot - the default, compiled ahead of time
+#   run - run by the compiler with --run --tier-threshold=1, so functions start in the interpreter and are
+#         JIT-compiled on their second call (programs that import modules cannot be run this way)
+#   debug - compiled with -g, every object file has to pass llvm-dwarfdump --verify
+#   stats - compiled with --stats=json, the report has to be JSON listing the functions and the IR has to be the
+#           same as without it
+#   daemon - compiled by kotlin-llvm-client through a kotlin-llvm --daemon started for the test, the IR has to be
+#            the same as from the compiler itself
+#   profile - compiled with -fprofile-generate and lowered by llc, then with -fprofile-use and a profile made up
+#             for the instrumented functions, which all have to get entry counts (the LLVM profile runtime is not
+#             needed to link the program)
+#
+# Tools can be overridden through the environment:
+#   LLC - LLVM tool used to lower the emitted IR
+#   CC  - C compiler used for linking
+#   DWARFDUMP - llvm-dwarfdump, for the debug mode
+#   PYTHON - Python 3, to parse the report of the stats mode
+#   CLIENT - kotlin-llvm-client, for the daemon mode (next to the compiler by default)
+#   PROFDATA - llvm-profdata, for the profile mode
+
+set -euo pipefail
+
+COMPILER="$1"
+RUNTIME="$2"
+SOURCE="$3"
+LEVEL="${4:-0}"
+MODE="${5:-aot}"
+
+LLC="${LLC:-llc}"
+CC="${CC:-cc}"
+DWARFDUMP="${DWARFDUMP:-llvm-dwarfdump}"
+PYTHON="${PYTHON:-python3}"
+CLIENT="${CLIENT:-$(dirname "$COMPILER")/kotlin-llvm-client}"
+PROFDATA="${PROFDATA:-llvm-profdata}"
+
+NAME="$(basename "$SOURCE" .kt)"
+SOURCE_DIR="$(cd "$(dirname "$SOURCE")" && pwd)"
+EXPECTED="$SOURCE_DIR/$NAME.out"
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+FLAGS=()
+case "$MODE" in
+    aot) ;;
+    debug) FLAGS=(-g) ;;
+    stats) FLAGS=(--stats=json) ;;
+    profile) ;;
+    daemon)
+        export KOTLIN_LLVM_SOCKET="$WORK_DIR/daemon.sock"
+        "$COMPILER" --daemon &
+        DAEMON_PID=$!
+        trap 'kill "$DAEMON_PID"; wait "$DAEMON_PID" || true; rm -rf "$WORK_DIR"' EXIT
+        for _ in $(seq 100); do
+            [ -S "$KOTLIN_LLVM_SOCKET" ] && break
+            sleep 0.1
+        done
+        ;;
+    run)
+        "$COMPILER" -O"$LEVEL" --run --tier-threshold=1 "$SOURCE" > "$WORK_DIR/$NAME.actual"
+        diff -u "$EXPECTED" "$WORK_DIR/$NAME.actual"
+        exit
+        ;;
+    *)
+        echo "Unknown mode: $MODE" >&2
+        exit 1
+        ;;
+esac
+
+# Writes a text profile that counts 1 for every counter of the instrumented IR in $1. The counters of a function
+# are described by @__profd_<name> = { name hash, CFG hash, counters, ..., counter count, value sites by kind }.
+write_profile() {
+    local source_file function linkage name hash counters indirect_sites memop_sites
+    local -A names
+    source_file="$(sed -n 's/^source_filename = "\(.*\)"$/\1/p' "$1")"
+    # The variable names replace the characters symbols cannot have, so they are matched with the functions
+    while IFS=$'\t' read -r linkage function; do
+        name="$function"
+        if [[ "$linkage" == *internal* || "$linkage" == *private* ]]; then
+            name="$source_file:$function"
+        fi
+        names["${name//[-:<>\/\"\']/_}"]="$name"
+    done < <(sed -nE 's/^define (.*) @"?([^"(]+)"?\(.*/\1\t\2/p' "$1")
+
+    echo ":ir"
+    sed -nE 's/^@"?__profd_([^"]*)"? = .*\{ i64 -?[0-9]+, i64 (-?[0-9]+), .*, i32 ([0-9]+), \[2 x i16\] (zeroinitializer|\[i16 ([0-9]+), i16 ([0-9]+)\]) .*/\1\t\2\t\3\t\5\t\6/p' "$1" |
+        while IFS=$'\t' read -r name hash counters indirect_sites memop_sites; do
+            printf '%s\n%u\n%s\n' "${names[$name]:-$name}" "$hash" "$counters"
+            for _ in $(seq "$counters"); do
+                echo 1
+            done
+            # Indirect call targets and memory operation sizes, without values
+            if [ "${indirect_sites:-0}" -gt 0 ] || [ "${memop_sites:-0}" -gt 0 ]; then
+                printf '2\n0\n%s\n' "${indirect_sites:-0}"
+                for _ in $(seq "${indirect_sites:-0}"); do
+                    echo 0
+                done
+                printf '1\n%s\n' "${memop_sites:-0}"
+                for _ in $(seq "${memop_sites:-0}"); do
+                    echo 0
+                done
+            fi
+            echo
+        done
+}
+
+# Compiles a module to an object file, writing its interface to $2 if given
+compile() {
+    local source="$1" interface="${2:-}" object="$WORK_DIR/$3"
+    local arguments=(-O"$LEVEL" -I"$WORK_DIR/interfaces")
+    if [ -n "$interface" ]; then
+        mkdir -p "$(dirname "$interface")"
+        arguments+=(--emit-interface="$interface")
+    fi
+    if [ "$MODE" = stats ]; then
+        "$COMPILER" "${arguments[@]}" "${FLAGS[@]}" "$source" > "$object.ll" 2> "$object.stats" ||
+            { cat "$object.stats" >&2; exit 1; }
+        "$PYTHON" -c 'import json, sys; assert json.load(sys.stdin)["functions"]' < "$object.stats"
+        "$COMPILER" "${arguments[@]}" "$source" | cmp - "$object.ll"
+    elif [ "$MODE" = daemon ]; then
+        "$CLIENT" "${arguments[@]}" "$source" > "$object.ll"
+        "$COMPILER" "${arguments[@]}" "$source" | cmp - "$object.ll"
+    elif [ "$MODE" = profile ]; then
+        "$COMPILER" "${arguments[@]}" -fprofile-generate "$source" > "$object.instrumented.ll"
+        "$LLC" -O"$LEVEL" -relocation-model=pic -filetype=obj "$object.instrumented.ll" -o "$object.instrumented"
+        write_profile "$object.instrumented.ll" > "$object.proftext"
+        "$PROFDATA" merge "$object.proftext" -o "$object.profdata"
+        # Warnings about stale or mismatched profiles fail the test as well
+        "$COMPILER" "${arguments[@]}" -fprofile-use="$object.profdata" "$source" > "$object.ll" 2> "$object.warnings" ||
+            { cat "$object.warnings" >&2; exit 1; }
+        [ ! -s "$object.warnings" ] || { cat "$object.warnings" >&2; exit 1; }
+        # Except for the helpers the coroutine passes add after instrumenting
+        if grep '^define' "$object.ll" | grep -v -e '!prof' -e '@coro\.'; then
+            echo "Functions without a profile in $object.ll" >&2
+            exit 1
+        fi
+    else
+        "$COMPILER" "${arguments[@]}" "${FLAGS[@]}" "$source" > "$object.ll"
+    fi
+    "$LLC" -O"$LEVEL" -relocation-model=pic -filetype=obj "$object.ll" -o "$object"
+    if [ "$MODE" = debug ]; then
+        "$DWARFDUMP" --verify "$object" > "$object.verify" || { cat "$object.verify"; exit 1; }
+        "$DWARFDUMP" --debug-info "$object" > "$object.dwarf"
+        grep -q DW_TAG_subprogram "$object.dwarf" || { echo "No functions in the debug info of $object" >&2; exit 1; }
+    fi
+}
+
+objects=()
+for path in $(sed -n 's/^import \([A-Za-z0-9_.]*\).*/\1/p' "$SOURCE"); do
+    file="${path//.//}"
+    compile "$SOURCE_DIR/$NAME/$file.kt" "$WORK_DIR/interfaces/$file.ktif" "${path}.o"
+    objects+=("$WORK_DIR/${path}.o")
+done
+compile "$SOURCE" "" "$NAME.o"
+"$CC" "$WORK_DIR/$NAME.o" "${objects[@]}" "$RUNTIME" -lpthread -lm -o "$WORK_DIR/$NAME"
+
+"$WORK_DIR/$NAME" > "$WORK_DIR/$NAME.actual"
+diff -u "$EXPECTED" "$WORK_DIR/$NAME.actual"
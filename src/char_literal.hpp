@@ -0,0 +1,47 @@
+#ifndef KOTLIN_LLVM_CHAR_LITERAL_HPP
+#define KOTLIN_LLVM_CHAR_LITERAL_HPP
+
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+
+// Length of the character literal starting at text (quotes included), 0 when there is none.
+// Accepts a single printable ASCII character, the escapes \t \b \n \r \' \" \\ \$ and \uXXXX.
+inline size_t char_literal_length(const char* text, const char* end) {
+    if (end - text < 3 || text[0] != '\'') {
+        return 0;
+    }
+    if (text[1] != '\\') {
+        return text[1] >= ' ' && text[1] <= '~' && text[1] != '\'' && text[2] == '\'' ? 3 : 0;
+    }
+    if (std::string("tbnr'\"\\$").find(text[2]) != std::string::npos) {
+        return end - text >= 4 && text[3] == '\'' ? 4 : 0;
+    }
+    if (text[2] != 'u' || end - text < 8 || text[7] != '\'') {
+        return 0;
+    }
+    for (int i = 3; i < 7; i++) {
+        if (!isxdigit(static_cast<unsigned char>(text[i]))) {
+            return 0;
+        }
+    }
+    return 8;
+}
+
+// UTF-16 code unit of a literal accepted by char_literal_length
+inline int decode_char_literal(const char* text) {
+    if (text[1] != '\\') {
+        return static_cast<unsigned char>(text[1]);
+    }
+    switch (text[2]) {
+        case 't': return '\t';
+        case 'b': return '\b';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'u': return static_cast<int>(strtol(std::string(text + 3, 4).c_str(), nullptr, 16));
+        default: return text[2];
+    }
+}
+
+#endif //KOTLIN_LLVM_CHAR_LITERAL_HPP
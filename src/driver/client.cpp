@@ -0,0 +1,48 @@
+// kotlin-llvm-client: forwards its command line to a running `kotlin-llvm --daemon` server and
+// exits with the status of the compilation. Takes exactly the same arguments as kotlin-llvm.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+int main(int argc, char** argv) {
+    std::string socket_path = default_socket_path();
+
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path is too long: " << socket_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Cannot connect to " << socket_path << ", start the server with kotlin-llvm --daemon" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    CompileRequest request;
+    char* working_directory = getcwd(nullptr, 0);
+    request.working_directory = working_directory;
+    free(working_directory);
+    for (int i = 0; i < argc; ++i) {
+        request.arguments.emplace_back(argv[i]);
+    }
+    request.fds[0] = STDIN_FILENO;
+    request.fds[1] = STDOUT_FILENO;
+    request.fds[2] = STDERR_FILENO;
+
+    int status = EXIT_FAILURE;
+    if (!send_request(connection, request) || !receive_exit_status(connection, status)) {
+        std::cerr << "Lost connection to the server at " << socket_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    return status;
+}
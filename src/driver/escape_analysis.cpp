@@ -0,0 +1,256 @@
+#include "escape_analysis.hpp"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include "sourcetree/allocation.hpp"
+
+// Everything the object can be reached through inside its function
+struct ObjectUses {
+    // The object and pointers derived from it (casts, property addresses, loads of the variables below)
+    std::set<llvm::Value*> aliases;
+    // Local variables (GC roots) the object is stored into
+    std::set<llvm::AllocaInst*> variables;
+};
+
+static bool is_gcroot_use(llvm::User* user) {
+    auto* cast = llvm::dyn_cast<llvm::BitCastInst>(user);
+    if (cast == nullptr) {
+        return false;
+    }
+    for (llvm::User* cast_user : cast->users()) {
+        auto* intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(cast_user);
+        if (intrinsic == nullptr || intrinsic->getIntrinsicID() != llvm::Intrinsic::gcroot) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class EscapeAnalysis {
+public:
+    explicit EscapeAnalysis(llvm::Module* module) {
+        // Optimistic start: every reference parameter of a defined function is assumed not to be kept,
+        // then assumptions are dropped until nothing changes
+        for (llvm::Function& function : *module) {
+            if (function.isDeclaration()) {
+                continue;
+            }
+            for (llvm::Argument& arg : function.args()) {
+                if (arg.getType()->isPointerTy()) {
+                    _kept[&arg] = false;
+                }
+            }
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto& entry : _kept) {
+                ObjectUses uses;
+                if (!entry.second && escapes(entry.first, uses)) {
+                    entry.second = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Follows every use of the object, collecting where it is stored on the way
+    bool escapes(llvm::Value* object, ObjectUses& uses) {
+        std::vector<llvm::Value*> worklist{object};
+        uses.aliases.insert(object);
+        while (!worklist.empty()) {
+            llvm::Value* value = worklist.back();
+            worklist.pop_back();
+
+            for (llvm::User* user : value->users()) {
+                if (llvm::isa<llvm::BitCastInst>(user) || llvm::isa<llvm::GetElementPtrInst>(user)) {
+                    if (uses.aliases.insert(user).second) {
+                        worklist.push_back(user);
+                    }
+                } else if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user)) {
+                    continue;
+                } else if (auto* store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+                    if (store->getValueOperand() != value) {
+                        continue;
+                    }
+                    auto* variable = llvm::dyn_cast<llvm::AllocaInst>(store->getPointerOperand());
+                    if (variable == nullptr) {
+                        return true;
+                    }
+                    if (uses.variables.insert(variable).second && !follow_variable(variable, uses, worklist)) {
+                        return true;
+                    }
+                } else if (auto* call = llvm::dyn_cast<llvm::CallInst>(user)) {
+                    for (unsigned i = 0; i < call->arg_size(); ++i) {
+                        if (call->getArgOperand(i) != value || call->paramHasAttr(i, llvm::Attribute::NoCapture)) {
+                            continue;
+                        }
+                        llvm::Function* callee = call->getCalledFunction();
+                        if (callee == nullptr || callee->isDeclaration()) {
+                            return true;
+                        }
+                        auto kept = _kept.find(callee->getArg(i));
+                        if (kept == _kept.end() || kept->second) {
+                            return true;
+                        }
+                    }
+                } else {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    // Loads from a variable holding the object are the object too
+    static bool follow_variable(llvm::AllocaInst* variable, ObjectUses& uses, std::vector<llvm::Value*>& worklist) {
+        for (llvm::User* user : variable->users()) {
+            if (auto* load = llvm::dyn_cast<llvm::LoadInst>(user)) {
+                if (uses.aliases.insert(load).second) {
+                    worklist.push_back(load);
+                }
+            } else if (auto* store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+                if (store->getPointerOperand() != variable) {
+                    return false;
+                }
+            } else if (!is_gcroot_use(user)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::map<llvm::Argument*, bool> _kept;
+};
+
+// Every store into the variables must store this object, and in a loop it must come after the allocation in its
+// block and store the allocation itself, so the variables always hold the newest instance. A copy from another
+// of the variables may be of the previous iteration's instance, whose slot is about to be reused.
+static bool variables_hold_newest(llvm::CallInst* allocation, const ObjectUses& uses, bool in_loop) {
+    for (llvm::AllocaInst* variable : uses.variables) {
+        for (llvm::User* user : variable->users()) {
+            auto* store = llvm::dyn_cast<llvm::StoreInst>(user);
+            if (store == nullptr) {
+                continue;
+            }
+            llvm::Value* value = store->getValueOperand();
+            if (uses.aliases.count(value) == 0) {
+                return false;
+            }
+            if (!in_loop) {
+                continue;
+            }
+            if (store->getParent() != allocation->getParent() || !allocation->comesBefore(store)) {
+                return false;
+            }
+            auto* load = llvm::dyn_cast<llvm::LoadInst>(value->stripPointerCasts());
+            if (load != nullptr && uses.variables.count(
+                    llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand()->stripPointerCasts())) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void replace_allocation(llvm::CallInst* allocation, const ObjectUses& uses, bool drop_roots) {
+    llvm::Function* function = allocation->getFunction();
+    llvm::LLVMContext& context = function->getContext();
+    auto* type_info = llvm::cast<llvm::GlobalVariable>(allocation->getArgOperand(0)->stripPointerCasts());
+
+    llvm::Type* object_type = nullptr;
+    for (llvm::User* user : allocation->users()) {
+        if (auto* cast = llvm::dyn_cast<llvm::BitCastInst>(user)) {
+            object_type = cast->getDestTy()->getPointerElementType();
+        }
+    }
+
+    // Same layout as the runtime's ObjectHeader, a size of 0 tells the collector it is not on the heap
+    llvm::Type* int32_type = llvm::Type::getInt32Ty(context);
+    llvm::Type* i8_ptr = llvm::Type::getInt8PtrTy(context);
+    llvm::StructType* slot_type = llvm::StructType::get(context, {i8_ptr, int32_type, int32_type, object_type});
+    llvm::AllocaInst* slot = create_entry_block_alloca(function, allocation->getName().str() + "_stack", slot_type);
+
+    llvm::IRBuilder<> builder(allocation);
+    builder.CreateStore(builder.CreateBitCast(type_info, i8_ptr), builder.CreateStructGEP(slot_type, slot, 0));
+    builder.CreateStore(llvm::ConstantInt::get(int32_type, 0), builder.CreateStructGEP(slot_type, slot, 1));
+    builder.CreateStore(llvm::ConstantInt::get(int32_type, 0), builder.CreateStructGEP(slot_type, slot, 2));
+    llvm::Value* object = builder.CreateStructGEP(slot_type, slot, 3);
+    builder.CreateStore(llvm::Constant::getNullValue(object_type), object);
+    allocation->replaceAllUsesWith(builder.CreateBitCast(object, i8_ptr));
+    allocation->eraseFromParent();
+
+    if (!drop_roots) {
+        return;
+    }
+    for (llvm::AllocaInst* variable : uses.variables) {
+        std::vector<llvm::Instruction*> root_uses;
+        for (llvm::User* user : variable->users()) {
+            if (is_gcroot_use(user)) {
+                root_uses.push_back(llvm::cast<llvm::Instruction>(user));
+            }
+        }
+        for (llvm::Instruction* cast : root_uses) {
+            while (!cast->use_empty()) {
+                llvm::cast<llvm::Instruction>(cast->user_back())->eraseFromParent();
+            }
+            cast->eraseFromParent();
+        }
+    }
+}
+
+unsigned stack_allocate_objects(llvm::Module* module) {
+    llvm::Function* kt_alloc = module->getFunction("kt_alloc");
+    if (kt_alloc == nullptr) {
+        return 0;
+    }
+
+    EscapeAnalysis analysis(module);
+    unsigned replaced = 0;
+    for (llvm::Function& function : *module) {
+        if (function.isDeclaration()) {
+            continue;
+        }
+        llvm::DominatorTree dominator_tree(function);
+        llvm::LoopInfo loop_info(dominator_tree);
+
+        std::vector<llvm::CallInst*> allocations;
+        for (llvm::BasicBlock& block : function) {
+            for (llvm::Instruction& instruction : block) {
+                auto* call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+                if (call != nullptr && call->getCalledFunction() == kt_alloc) {
+                    allocations.push_back(call);
+                }
+            }
+        }
+
+        for (llvm::CallInst* allocation : allocations) {
+            ObjectUses uses;
+            if (analysis.escapes(allocation, uses)) {
+                continue;
+            }
+            bool in_loop = loop_info.getLoopFor(allocation->getParent()) != nullptr;
+            bool holds_newest = variables_hold_newest(allocation, uses, in_loop);
+            if (in_loop && !holds_newest) {
+                continue;
+            }
+
+            // pointer_count of the kt_type_info constant
+            auto* type_info = llvm::cast<llvm::GlobalVariable>(allocation->getArgOperand(0)->stripPointerCasts());
+            auto* pointer_count = llvm::cast<llvm::ConstantInt>(type_info->getInitializer()->getAggregateElement(1));
+            replace_allocation(allocation, uses, holds_newest && pointer_count->isZero());
+            replaced++;
+        }
+    }
+    return replaced;
+}
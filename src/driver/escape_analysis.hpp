@@ -0,0 +1,18 @@
+#ifndef KOTLIN_LLVM_ESCAPE_ANALYSIS_HPP
+#define KOTLIN_LLVM_ESCAPE_ANALYSIS_HPP
+
+#include "llvm/IR/Module.h"
+
+// Replaces kt_alloc calls whose object never outlives the function that creates it by a stack slot in the
+// entry block, and returns how many were replaced.
+//
+// An object escapes when it is returned, stored anywhere but a local variable, or passed to a function that
+// may keep it; which parameters are kept is computed for all functions of the module together, and calls of
+// closures do not keep the closure they get as their nocapture first argument. Allocations
+// in loops only qualify when every variable holding the object is overwritten right where it is created, so
+// only the newest instance can ever be read. The slot carries the runtime's object header, so the collector
+// still traces the object's references. When the object has none and only lives in its own variables, those
+// stop being GC roots and the object is left to SROA.
+unsigned stack_allocate_objects(llvm::Module* module);
+
+#endif //KOTLIN_LLVM_ESCAPE_ANALYSIS_HPP
@@ -0,0 +1,122 @@
+#include "optimizer.hpp"
+#include "escape_analysis.hpp"
+#include "range_analysis.hpp"
+#include "target.hpp"
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Pass.h"
+#include "llvm/Transforms/Coroutines.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Instrumentation.h"
+
+bool has_coroutines(llvm::Module* module) {
+    return module->getFunction("llvm.coro.begin") != nullptr;
+}
+
+// The inliner copies the llvm.gcroot calls of a callee into the body of its caller, where loop unrolling can
+// duplicate them, but the shadow-stack lowering takes every call for a root of its own. The inlined allocas are
+// static, so each gets a single call in the entry block, where the lowering nulls it.
+static void hoist_gc_roots(llvm::Module* module) {
+    llvm::Function* gcroot = module->getFunction("llvm.gcroot");
+    if (gcroot == nullptr) {
+        return;
+    }
+    std::map<llvm::AllocaInst*, std::vector<llvm::CallInst*>> calls;
+    for (llvm::User* user : gcroot->users()) {
+        auto* call = llvm::dyn_cast<llvm::CallInst>(user);
+        auto* root = call != nullptr ? llvm::dyn_cast<llvm::AllocaInst>(call->getArgOperand(0)->stripPointerCasts())
+                                     : nullptr;
+        if (root != nullptr && root->isStaticAlloca()) {
+            calls[root].push_back(call);
+        }
+    }
+    for (auto& root_calls : calls) {
+        llvm::AllocaInst* root = root_calls.first;
+        std::vector<llvm::CallInst*>& root_call_list = root_calls.second;
+        llvm::BasicBlock* entry = &root->getFunction()->getEntryBlock();
+        if (root_call_list.size() == 1 && root_call_list[0]->getParent() == entry) {
+            continue;
+        }
+        llvm::IRBuilder<> entry_builder(root->getNextNode());
+        llvm::Value* slot = entry_builder.CreateBitCast(root, gcroot->getFunctionType()->getParamType(0));
+        entry_builder.CreateCall(gcroot, {slot, root_call_list[0]->getArgOperand(1)});
+        for (llvm::CallInst* call : root_call_list) {
+            call->eraseFromParent();
+        }
+    }
+}
+
+void optimize_module(llvm::Module* module, const Options& options) {
+    if (llvm::verifyModule(*module, &llvm::errs())) {
+        std::cerr << "Generated module is invalid, not optimizing it" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Profile instrumentation and consumption both run on the IR straight out of codegen,
+    // so the control flow graphs (and their hashes) match whatever -O level either build used
+    llvm::legacy::PassManager profile_passes;
+    if (options.profile_generate) {
+        profile_passes.add(llvm::createPGOInstrumentationGenLegacyPass());
+
+        llvm::InstrProfOptions profile_options;
+        profile_options.InstrProfileOutput = options.profile_generate_file;
+        profile_passes.add(llvm::createInstrProfilingLegacyPass(profile_options));
+    } else if (!options.profile_use_file.empty()) {
+        profile_passes.add(llvm::createPGOInstrumentationUseLegacyPass(options.profile_use_file));
+    }
+    profile_passes.run(*module);
+
+    if (options.opt_level > 0) {
+        stack_allocate_objects(module);
+    }
+
+    llvm::legacy::PassManager module_passes;
+    llvm::legacy::FunctionPassManager function_passes(module);
+
+    llvm::PassManagerBuilder pass_builder;
+    std::unique_ptr<llvm::TargetMachine> machine = create_target_machine(*module, options);
+    if (machine != nullptr) {
+        module_passes.add(llvm::createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+        function_passes.add(llvm::createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+        machine->adjustPassManager(pass_builder);
+    }
+    pass_builder.OptLevel = options.opt_level;
+    pass_builder.SizeLevel = 0;
+    if (options.opt_level > 0) {
+        pass_builder.Inliner = llvm::createFunctionInliningPass(options.opt_level, 0, false);
+    }
+    if (has_coroutines(module)) {
+        // Splits suspend functions into ramp, resume and destroy functions, and at -O1 and up elides the frames
+        // of coroutines inlined into the one that awaits them
+        llvm::addCoroutinePassesToExtensionPoints(pass_builder);
+    }
+    if (options.opt_level > 0) {
+        pass_builder.addExtension(llvm::PassManagerBuilder::EP_Peephole,
+                                  [](const llvm::PassManagerBuilder&, llvm::legacy::PassManagerBase& passes) {
+                                      passes.add(create_range_analysis_pass());
+                                  });
+    }
+    pass_builder.LoopVectorize = options.opt_level > 1;
+    pass_builder.SLPVectorize = options.opt_level > 1;
+
+    pass_builder.populateFunctionPassManager(function_passes);
+    pass_builder.populateModulePassManager(module_passes);
+
+    function_passes.doInitialization();
+    for (llvm::Function& function : *module) {
+        function_passes.run(function);
+    }
+    function_passes.doFinalization();
+
+    module_passes.run(*module);
+    hoist_gc_roots(module);
+}
@@ -0,0 +1,12 @@
+#ifndef KOTLIN_LLVM_OPTIMIZER_HPP
+#define KOTLIN_LLVM_OPTIMIZER_HPP
+
+#include "llvm/IR/Module.h"
+#include "options.hpp"
+
+void optimize_module(llvm::Module* module, const Options& options);
+
+// Coroutines of suspend functions have to be split by the optimizer even at -O0, the backend cannot lower them
+bool has_coroutines(llvm::Module* module);
+
+#endif //KOTLIN_LLVM_OPTIMIZER_HPP
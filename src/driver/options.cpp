@@ -0,0 +1,142 @@
+#include "options.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Host.h"
+
+static llvm::cl::opt<std::string> input_file_option(llvm::cl::Positional, llvm::cl::desc("<input file>"),
+                                                    llvm::cl::init("-"));
+
+static llvm::cl::opt<unsigned> opt_level_option("O", llvm::cl::Prefix, llvm::cl::init(0),
+                                                llvm::cl::desc("Optimization level (0-3)"));
+
+static llvm::cl::opt<bool> debug_info_option("g", llvm::cl::desc("Emit DWARF debug information"));
+
+static llvm::cl::opt<std::string> cpu_option("mcpu", llvm::cl::value_desc("cpu"),
+                                              llvm::cl::desc("Target CPU, native for the host's"));
+
+static llvm::cl::opt<std::string> features_option("mattr", llvm::cl::value_desc("+a,-b"),
+                                                  llvm::cl::desc("Target features to enable or disable"));
+
+// LLVM already registers -ffast-math (in the Hexagon backend), so it is taken out of argv
+// before the rest of the command line reaches llvm::cl
+static const char* const fast_math_flag = "-ffast-math";
+static llvm::cl::extrahelp fast_math_help("\n  -ffast-math - Allow reassociation, contraction and other unsafe Double optimizations\n");
+
+// LLVM registers -stats for its own counters, so --stats=<format> is also taken out of argv
+static const char* const stats_flag = "-stats=";
+static llvm::cl::extrahelp stats_help("\n  --stats=json - Report IR size and codegen statistics per function on stderr\n");
+
+// The format of a -stats=<format> or --stats=<format> argument, nullptr for any other argument
+static const char* stats_format(const char* argument) {
+    if (strncmp(argument, "--", 2) == 0) {
+        argument++;
+    }
+    if (strncmp(argument, stats_flag, strlen(stats_flag)) != 0) {
+        return nullptr;
+    }
+    return argument + strlen(stats_flag);
+}
+
+static llvm::cl::opt<FPContract> fp_contract_option("ffp-contract", llvm::cl::init(FPContract::Off),
+                                                    llvm::cl::desc("Fusion of Double multiply and add"),
+                                                    llvm::cl::values(
+                                                            clEnumValN(FPContract::Off, "off", "Never fuse"),
+                                                            clEnumValN(FPContract::On, "on", "Fuse within one expression"),
+                                                            clEnumValN(FPContract::Fast, "fast", "Fuse wherever possible")));
+
+static llvm::cl::opt<std::string> profile_generate_option("fprofile-generate", llvm::cl::ValueOptional,
+                                                          llvm::cl::value_desc("file"),
+                                                          llvm::cl::desc("Instrument the program to write a raw profile at exit"));
+
+static llvm::cl::opt<std::string> profile_use_option("fprofile-use", llvm::cl::value_desc("file"),
+                                                     llvm::cl::desc("Use a merged profile for branch weights and entry counts"));
+
+static llvm::cl::opt<std::string> emit_interface_option("emit-interface", llvm::cl::value_desc("file"),
+                                                        llvm::cl::desc("Write the interface that other files import"));
+
+static llvm::cl::list<std::string> import_dirs_option("I", llvm::cl::Prefix, llvm::cl::value_desc("dir"),
+                                                      llvm::cl::desc("Search the directory for imported interfaces"));
+
+static llvm::cl::opt<bool> run_option("run", llvm::cl::desc("Run main in a tiered JIT instead of printing the module"));
+
+static llvm::cl::opt<unsigned> tier_threshold_option("tier-threshold", llvm::cl::init(1000),
+                                                     llvm::cl::value_desc("n"),
+                                                     llvm::cl::desc("Calls and loop iterations before --run optimizes a function"));
+
+static llvm::cl::opt<std::string> daemon_option("daemon", llvm::cl::ValueOptional, llvm::cl::value_desc("socket"),
+                                                llvm::cl::desc("Serve compile requests from kotlin-llvm-client on a Unix socket"));
+
+Options parse_options(int argc, char** argv) {
+    Options result;
+
+    std::vector<const char*> arguments;
+    for (int i = 0; i < argc; ++i) {
+        const char* format = i > 0 ? stats_format(argv[i]) : nullptr;
+        if (i > 0 && strcmp(argv[i], fast_math_flag) == 0) {
+            result.fast_math = true;
+        } else if (format != nullptr) {
+            if (strcmp(format, "json") != 0) {
+                std::cerr << "Unknown statistics format: " << format << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            result.stats = StatsFormat::Json;
+        } else {
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    llvm::cl::ResetAllOptionOccurrences();
+    llvm::cl::ParseCommandLineOptions(static_cast<int>(arguments.size()), arguments.data(),
+                                      "Kotlin to LLVM IR compiler\n");
+
+    result.input_file = input_file_option;
+    result.opt_level = opt_level_option;
+    result.debug_info = debug_info_option;
+    result.cpu = cpu_option;
+    result.features = features_option;
+    if (result.cpu == "native") {
+        result.cpu = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> host_features;
+        std::string features;
+        if (llvm::sys::getHostCPUFeatures(host_features)) {
+            for (const auto& feature : host_features) {
+                features += std::string(features.empty() ? "" : ",") + (feature.getValue() ? "+" : "-") +
+                            feature.getKey().str();
+            }
+        }
+        // Features given with -mattr come last and win
+        result.features = result.features.empty() ? features : features + "," + result.features;
+    }
+    result.fp_contract = fp_contract_option;
+    if (result.fast_math && fp_contract_option.getNumOccurrences() == 0) {
+        result.fp_contract = FPContract::Fast;
+    }
+    result.profile_generate = profile_generate_option.getNumOccurrences() > 0;
+    result.profile_generate_file = profile_generate_option;
+    result.profile_use_file = profile_use_option;
+    result.emit_interface = emit_interface_option;
+    result.import_dirs.assign(import_dirs_option.begin(), import_dirs_option.end());
+    result.run = run_option;
+    result.tier_threshold = tier_threshold_option;
+    result.daemon = daemon_option.getNumOccurrences() > 0;
+    result.daemon_socket = daemon_option;
+
+    if (result.opt_level > 3) {
+        std::cerr << "Invalid optimization level: -O" << result.opt_level << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (result.profile_generate && !result.profile_use_file.empty()) {
+        std::cerr << "-fprofile-generate and -fprofile-use cannot be used together" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (result.run && (result.profile_generate || !result.profile_use_file.empty())) {
+        std::cerr << "--run cannot be used with -fprofile-generate or -fprofile-use" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return result;
+}
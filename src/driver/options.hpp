@@ -0,0 +1,63 @@
+#ifndef KOTLIN_LLVM_OPTIONS_HPP
+#define KOTLIN_LLVM_OPTIONS_HPP
+
+#include <string>
+#include <vector>
+
+enum class FPContract {
+    Off, On, Fast
+};
+
+enum class StatsFormat {
+    None, Json
+};
+
+struct Options {
+    std::string input_file;
+    unsigned opt_level = 0;
+
+    // -g: DWARF line tables, subprograms and variables
+    bool debug_info = false;
+
+    // -mcpu=<cpu> and -mattr=<+feature,-feature>: the CPU functions are optimized and compiled for, which also sets
+    // the module's triple and data layout to the host's. -mcpu=native is the host's CPU with all of its features.
+    std::string cpu;
+    std::string features;
+
+    // -ffast-math: all fast-math flags on Double arithmetic (implies -ffp-contract=fast)
+    bool fast_math = false;
+    // -ffp-contract: off keeps Kotlin's strict semantics, on fuses a*b+c within an expression
+    // through llvm.fmuladd, fast lets the backend fuse any multiply and add
+    FPContract fp_contract = FPContract::Off;
+
+    // -fprofile-generate[=<file>]: instrument the module, raw profile is written at exit
+    bool profile_generate = false;
+    std::string profile_generate_file;
+    // -fprofile-use=<file>: merged (.profdata) profile used for branch weights and entry counts
+    std::string profile_use_file;
+
+    // --run: execute main in the JIT, hot functions are recompiled with the -O level in the background
+    bool run = false;
+    // --tier-threshold=<n>: calls and loop iterations after which a function is optimized, 0 optimizes everything
+    // before main starts
+    unsigned tier_threshold = 1000;
+
+    // --emit-interface=<file>: also write the interface other files import, see imports.hpp
+    std::string emit_interface;
+    // -I<dir>: where `import` looks for interfaces after the directory of the input file
+    std::vector<std::string> import_dirs;
+
+    // --stats=json: per function IR size and codegen counts, before and after every -O level, written to stderr
+    StatsFormat stats = StatsFormat::None;
+
+    // --daemon[=<socket>]: serve compile requests from kotlin-llvm-client instead of compiling
+    bool daemon = false;
+    std::string daemon_socket;
+};
+
+extern Options options;
+
+// Can be called again for every request a daemon serves
+Options parse_options(int argc, char** argv);
+
+#endif //KOTLIN_LLVM_OPTIONS_HPP
@@ -0,0 +1,152 @@
+#include "protocol.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+std::string default_socket_path() {
+    const char* path = getenv("KOTLIN_LLVM_SOCKET");
+    if (path != nullptr && *path != '\0') {
+        return path;
+    }
+    return "/tmp/kotlin-llvm-" + std::to_string(getuid()) + ".sock";
+}
+
+static bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = read(fd, data, size);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+static void append_u32(std::string& buffer, uint32_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static bool take_u32(const std::string& buffer, size_t& offset, uint32_t& value) {
+    if (offset + sizeof(value) > buffer.size()) {
+        return false;
+    }
+    memcpy(&value, buffer.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+// Layout: [total size + the three fds as SCM_RIGHTS] [string count] ([length] [bytes])*
+// where the first string is the working directory and the rest are the arguments
+bool send_request(int socket_fd, const CompileRequest& request) {
+    std::string payload;
+    append_u32(payload, request.arguments.size() + 1);
+    append_u32(payload, request.working_directory.size());
+    payload += request.working_directory;
+    for (const std::string& argument : request.arguments) {
+        append_u32(payload, argument.size());
+        payload += argument;
+    }
+
+    uint32_t size = payload.size();
+    iovec io{};
+    io.iov_base = &size;
+    io.iov_len = sizeof(size);
+
+    char control[CMSG_SPACE(sizeof(request.fds))];
+    memset(control, 0, sizeof(control));
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(request.fds));
+    memcpy(CMSG_DATA(header), request.fds, sizeof(request.fds));
+
+    if (sendmsg(socket_fd, &message, 0) != sizeof(size)) {
+        return false;
+    }
+    return write_all(socket_fd, payload.data(), payload.size());
+}
+
+bool receive_request(int socket_fd, CompileRequest& request) {
+    uint32_t size = 0;
+    iovec io{};
+    io.iov_base = &size;
+    io.iov_len = sizeof(size);
+
+    char control[CMSG_SPACE(sizeof(request.fds))];
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket_fd, &message, MSG_WAITALL) != sizeof(size)) {
+        return false;
+    }
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(request.fds))) {
+        return false;
+    }
+    memcpy(request.fds, CMSG_DATA(header), sizeof(request.fds));
+
+    std::string payload(size, '\0');
+    if (!read_all(socket_fd, &payload[0], size)) {
+        return false;
+    }
+
+    size_t offset = 0;
+    uint32_t count = 0;
+    if (!take_u32(payload, offset, count) || count == 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t length = 0;
+        if (!take_u32(payload, offset, length) || offset + length > payload.size()) {
+            return false;
+        }
+        std::string value = payload.substr(offset, length);
+        offset += length;
+        if (i == 0) {
+            request.working_directory = value;
+        } else {
+            request.arguments.push_back(value);
+        }
+    }
+    return true;
+}
+
+bool send_exit_status(int socket_fd, int status) {
+    int32_t value = status;
+    return write_all(socket_fd, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool receive_exit_status(int socket_fd, int& status) {
+    int32_t value = 0;
+    if (!read_all(socket_fd, reinterpret_cast<char*>(&value), sizeof(value))) {
+        return false;
+    }
+    status = value;
+    return true;
+}
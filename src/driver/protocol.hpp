@@ -0,0 +1,24 @@
+#ifndef KOTLIN_LLVM_PROTOCOL_HPP
+#define KOTLIN_LLVM_PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+
+// A compile request sent by kotlin-llvm-client to a kotlin-llvm --daemon server. The client's
+// standard input, output and error travel with it, so the compiler writes straight to them.
+struct CompileRequest {
+    std::string working_directory;
+    std::vector<std::string> arguments;
+    int fds[3] = {-1, -1, -1};
+};
+
+// $KOTLIN_LLVM_SOCKET, or a per-user socket in /tmp
+std::string default_socket_path();
+
+bool send_request(int socket_fd, const CompileRequest& request);
+bool receive_request(int socket_fd, CompileRequest& request);
+
+bool send_exit_status(int socket_fd, int status);
+bool receive_exit_status(int socket_fd, int& status);
+
+#endif //KOTLIN_LLVM_PROTOCOL_HPP
@@ -0,0 +1,209 @@
+#include "range_analysis.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LazyValueInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/InitializePasses.h"
+
+#define DEBUG_TYPE "kotlin-ranges"
+
+STATISTIC(FoldedComparisons, "Comparisons folded to a constant");
+STATISTIC(RemovedMasks, "Masks of values already in range removed");
+STATISTIC(NoSignedWrapFlags, "Arithmetic instructions marked nsw");
+STATISTIC(NoUnsignedWrapFlags, "Arithmetic instructions marked nuw");
+
+class RangeAnalysis : public llvm::FunctionPass {
+public:
+    static char ID;
+
+    RangeAnalysis() : llvm::FunctionPass(ID) {
+        llvm::PassRegistry& registry = *llvm::PassRegistry::getPassRegistry();
+        llvm::initializeLazyValueInfoWrapperPassPass(registry);
+        llvm::initializeScalarEvolutionWrapperPassPass(registry);
+        llvm::initializeDominatorTreeWrapperPassPass(registry);
+    }
+
+    llvm::StringRef getPassName() const override {
+        return "Kotlin value-range analysis";
+    }
+
+    void getAnalysisUsage(llvm::AnalysisUsage& usage) const override {
+        usage.addRequired<llvm::LazyValueInfoWrapperPass>();
+        usage.addRequired<llvm::ScalarEvolutionWrapperPass>();
+        usage.addRequired<llvm::DominatorTreeWrapperPass>();
+        usage.setPreservesCFG();
+    }
+
+    bool runOnFunction(llvm::Function& function) override {
+        if (skipFunction(function)) {
+            return false;
+        }
+        _values = &getAnalysis<llvm::LazyValueInfoWrapperPass>().getLVI();
+        _evolution = &getAnalysis<llvm::ScalarEvolutionWrapperPass>().getSE();
+        _dominators = &getAnalysis<llvm::DominatorTreeWrapperPass>().getDomTree();
+
+        bool changed = false;
+        for (llvm::BasicBlock& block : function) {
+            for (llvm::Instruction& instruction : llvm::make_early_inc_range(block)) {
+                if (auto* compare = llvm::dyn_cast<llvm::ICmpInst>(&instruction)) {
+                    changed |= fold_comparison(compare);
+                } else if (auto* binary = llvm::dyn_cast<llvm::BinaryOperator>(&instruction)) {
+                    changed |= binary->getOpcode() == llvm::Instruction::And ? remove_mask(binary)
+                                                                             : add_no_wrap_flags(binary);
+                }
+            }
+        }
+        return changed;
+    }
+
+private:
+    llvm::LazyValueInfo* _values = nullptr;
+    llvm::ScalarEvolution* _evolution = nullptr;
+    llvm::DominatorTree* _dominators = nullptr;
+
+    // The values the integer can have where the instruction uses it
+    llvm::ConstantRange range(llvm::Value* value, llvm::Instruction* user) {
+        llvm::ConstantRange range = _values->getConstantRange(value, user, false);
+        if (_evolution->isSCEVable(value->getType())) {
+            const llvm::SCEV* evolution = _evolution->getSCEV(value);
+            range = range.intersectWith(_evolution->getSignedRange(evolution))
+                         .intersectWith(_evolution->getUnsignedRange(evolution));
+        }
+        return range;
+    }
+
+    static void replace(llvm::Instruction* instruction, llvm::Value* value) {
+        instruction->replaceAllUsesWith(value);
+        instruction->eraseFromParent();
+    }
+
+    bool fold_comparison(llvm::ICmpInst* compare) {
+        llvm::Value* first = compare->getOperand(0);
+        llvm::Value* second = compare->getOperand(1);
+        if (!first->getType()->isIntegerTy()) {
+            return false;
+        }
+        llvm::ConstantRange first_range = range(first, compare);
+        llvm::ConstantRange second_range = range(second, compare);
+        llvm::ICmpInst::Predicate predicate = compare->getPredicate();
+
+        llvm::Optional<bool> result;
+        if (llvm::ConstantRange::makeSatisfyingICmpRegion(predicate, second_range).contains(first_range)) {
+            result = true;
+        } else if (llvm::ConstantRange::makeSatisfyingICmpRegion(compare->getInversePredicate(), second_range)
+                       .contains(first_range)) {
+            result = false;
+        } else {
+            result = implied_by_branches(compare, first_range.isAllNonNegative() && second_range.isAllNonNegative());
+        }
+        if (!result.hasValue()) {
+            return false;
+        }
+        replace(compare, llvm::ConstantInt::getBool(compare->getType(), *result));
+        FoldedComparisons++;
+        return true;
+    }
+
+    // The result of the comparison when a branch on the same two values decides it for every path to it. Both
+    // operands being non-negative makes signed and unsigned comparisons interchangeable, as for an index that
+    // was compared to the size with `<` and is checked with an unsigned compare.
+    llvm::Optional<bool> implied_by_branches(llvm::ICmpInst* compare, bool non_negative) {
+        llvm::DomTreeNode* node = _dominators->getNode(compare->getParent());
+        if (node == nullptr) {
+            return llvm::None;
+        }
+        for (node = node->getIDom(); node != nullptr; node = node->getIDom()) {
+            auto* branch = llvm::dyn_cast<llvm::BranchInst>(node->getBlock()->getTerminator());
+            if (branch == nullptr || !branch->isConditional()) {
+                continue;
+            }
+            auto* condition = llvm::dyn_cast<llvm::ICmpInst>(branch->getCondition());
+            if (condition == nullptr || condition == compare) {
+                continue;
+            }
+            llvm::ICmpInst::Predicate known;
+            if (condition->getOperand(0) == compare->getOperand(0) && condition->getOperand(1) == compare->getOperand(1)) {
+                known = condition->getPredicate();
+            } else if (condition->getOperand(0) == compare->getOperand(1) &&
+                       condition->getOperand(1) == compare->getOperand(0)) {
+                known = condition->getSwappedPredicate();
+            } else {
+                continue;
+            }
+            for (unsigned successor = 0; successor < 2; ++successor) {
+                llvm::BasicBlockEdge edge(node->getBlock(), branch->getSuccessor(successor));
+                if (!_dominators->dominates(edge, compare->getParent())) {
+                    continue;
+                }
+                llvm::ICmpInst::Predicate holds = successor == 0 ? known : llvm::ICmpInst::getInversePredicate(known);
+                if (non_negative && llvm::ICmpInst::isSigned(holds)) {
+                    holds = llvm::ICmpInst::getUnsignedPredicate(holds);
+                }
+                if (llvm::ICmpInst::isImpliedTrueByMatchingCmp(holds, compare->getPredicate())) {
+                    return true;
+                }
+                if (llvm::ICmpInst::isImpliedFalseByMatchingCmp(holds, compare->getPredicate())) {
+                    return false;
+                }
+            }
+        }
+        return llvm::None;
+    }
+
+    // x & (2^n - 1) is x when x is in [0, 2^n)
+    bool remove_mask(llvm::BinaryOperator* binary) {
+        auto* mask = llvm::dyn_cast<llvm::ConstantInt>(binary->getOperand(1));
+        if (mask == nullptr || !mask->getValue().isMask()) {
+            return false;
+        }
+        llvm::Value* value = binary->getOperand(0);
+        if (range(value, binary).getUnsignedMax().ugt(mask->getValue())) {
+            return false;
+        }
+        replace(binary, value);
+        RemovedMasks++;
+        return true;
+    }
+
+    bool add_no_wrap_flags(llvm::BinaryOperator* binary) {
+        llvm::Instruction::BinaryOps opcode = binary->getOpcode();
+        if (opcode != llvm::Instruction::Add && opcode != llvm::Instruction::Sub &&
+            opcode != llvm::Instruction::Mul && opcode != llvm::Instruction::Shl) {
+            return false;
+        }
+        if (binary->hasNoSignedWrap() && binary->hasNoUnsignedWrap()) {
+            return false;
+        }
+        llvm::ConstantRange first_range = range(binary->getOperand(0), binary);
+        llvm::ConstantRange second_range = range(binary->getOperand(1), binary);
+        bool changed = false;
+        if (!binary->hasNoSignedWrap() &&
+            llvm::ConstantRange::makeGuaranteedNoWrapRegion(opcode, second_range,
+                                                            llvm::OverflowingBinaryOperator::NoSignedWrap)
+                .contains(first_range)) {
+            binary->setHasNoSignedWrap(true);
+            NoSignedWrapFlags++;
+            changed = true;
+        }
+        if (!binary->hasNoUnsignedWrap() &&
+            llvm::ConstantRange::makeGuaranteedNoWrapRegion(opcode, second_range,
+                                                            llvm::OverflowingBinaryOperator::NoUnsignedWrap)
+                .contains(first_range)) {
+            binary->setHasNoUnsignedWrap(true);
+            NoUnsignedWrapFlags++;
+            changed = true;
+        }
+        return changed;
+    }
+};
+
+char RangeAnalysis::ID = 0;
+
+llvm::Pass* create_range_analysis_pass() {
+    return new RangeAnalysis();
+}
@@ -0,0 +1,19 @@
+#ifndef KOTLIN_LLVM_RANGE_ANALYSIS_HPP
+#define KOTLIN_LLVM_RANGE_ANALYSIS_HPP
+
+#include "llvm/Pass.h"
+
+// Value-range analysis run with the peephole passes at -O1 and up, after SROA turned the variables into SSA values.
+//
+// The range of an integer is what LazyValueInfo derives from constants, arithmetic and the branches that dominate
+// its use, narrowed by the range ScalarEvolution gives loop induction variables from their start, step and trip
+// count, so the counter of `for (i in 0 until 10)` is known to stay in [0, 10) throughout the body. With them the
+// pass
+// - folds comparisons that always have the same result, which removes the zero and -1 checks of integer division
+//   and the index checks of ArrayList, also when a dominating `i < list.size` with a non-negative i implies them;
+// - drops the `and` that takes shift amounts modulo the bit width when the amount is already in range;
+// - marks add, sub, mul and shl nsw and nuw when they provably do not overflow, so the loop passes can widen and
+//   vectorize the induction variables although Kotlin's arithmetic wraps.
+llvm::Pass* create_range_analysis_pass();
+
+#endif //KOTLIN_LLVM_RANGE_ANALYSIS_HPP
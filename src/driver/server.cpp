@@ -0,0 +1,106 @@
+#include "server.hpp"
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "llvm/Support/raw_ostream.h"
+
+// The compiler reports errors by calling exit(), so the compilation itself runs in a separate
+// worker process and the connection handler only reports how it ended.
+static int handle_connection(int connection, CompileFunction compile) {
+    CompileRequest request;
+    if (!receive_request(connection, request)) {
+        return EXIT_FAILURE;
+    }
+
+    pid_t worker = fork();
+    if (worker < 0) {
+        send_exit_status(connection, EXIT_FAILURE);
+        return EXIT_FAILURE;
+    }
+    if (worker == 0) {
+        close(connection);
+        for (int fd = 0; fd < 3; ++fd) {
+            dup2(request.fds[fd], fd);
+            close(request.fds[fd]);
+        }
+        if (chdir(request.working_directory.c_str()) != 0) {
+            std::cerr << "Cannot change to directory: " << request.working_directory << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::vector<char*> argv;
+        for (std::string& argument : request.arguments) {
+            argv.push_back(&argument[0]);
+        }
+        argv.push_back(nullptr);
+
+        int status = compile(static_cast<int>(request.arguments.size()), argv.data());
+        llvm::outs().flush();
+        exit(status);
+    }
+
+    for (int fd : request.fds) {
+        close(fd);
+    }
+
+    int status = 0;
+    waitpid(worker, &status, 0);
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    send_exit_status(connection, exit_code);
+    return EXIT_SUCCESS;
+}
+
+int run_server(const std::string& socket_path, CompileFunction compile) {
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path is too long: " << socket_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return EXIT_FAILURE;
+    }
+    unlink(socket_path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        perror(socket_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Connection handlers are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            return EXIT_FAILURE;
+        }
+
+        pid_t handler = fork();
+        if (handler == 0) {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL);
+            _exit(handle_connection(connection, compile));
+        }
+        close(connection);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef KOTLIN_LLVM_SERVER_HPP
+#define KOTLIN_LLVM_SERVER_HPP
+
+#include <string>
+
+// Runs one compilation with the given command line and returns its exit status
+typedef int (*CompileFunction)(int argc, char** argv);
+
+// Accepts requests from kotlin-llvm-client on a Unix domain socket until killed. Every request
+// is compiled in a process forked from this one, so it starts with LLVM already initialized.
+int run_server(const std::string& socket_path, CompileFunction compile);
+
+#endif //KOTLIN_LLVM_SERVER_HPP
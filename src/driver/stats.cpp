@@ -0,0 +1,163 @@
+#include "stats.hpp"
+#include "optimizer.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+struct IRCounts {
+    unsigned functions = 0;
+    unsigned basic_blocks = 0;
+    unsigned instructions = 0;
+    unsigned allocas = 0;
+    unsigned alloca_loads = 0;
+    unsigned alloca_stores = 0;
+    std::map<std::string, unsigned> opcodes;
+
+    void add(const llvm::Function& function) {
+        functions++;
+        for (const llvm::BasicBlock& block : function) {
+            basic_blocks++;
+            for (const llvm::Instruction& instruction : block) {
+                instructions++;
+                opcodes[instruction.getOpcodeName()]++;
+                if (llvm::isa<llvm::AllocaInst>(instruction)) {
+                    allocas++;
+                } else if (auto* load = llvm::dyn_cast<llvm::LoadInst>(&instruction)) {
+                    alloca_loads += llvm::isa<llvm::AllocaInst>(load->getPointerOperand()->stripPointerCasts());
+                } else if (auto* store = llvm::dyn_cast<llvm::StoreInst>(&instruction)) {
+                    alloca_stores += llvm::isa<llvm::AllocaInst>(store->getPointerOperand()->stripPointerCasts());
+                }
+            }
+        }
+    }
+
+    void write(llvm::json::OStream& json) const {
+        json.object([&] {
+            json.attribute("llvm_functions", functions);
+            json.attribute("basic_blocks", basic_blocks);
+            json.attribute("instructions", instructions);
+            json.attribute("allocas", allocas);
+            json.attribute("alloca_loads", alloca_loads);
+            json.attribute("alloca_stores", alloca_stores);
+            json.attributeObject("opcodes", [&] {
+                for (const auto& opcode : opcodes) {
+                    json.attribute(opcode.first, opcode.second);
+                }
+            });
+        });
+    }
+};
+
+// The module at one point of the pipeline
+struct Snapshot {
+    std::string name;
+    std::map<std::string, IRCounts> functions;
+    IRCounts total;
+    // Only for the optimization levels
+    double milliseconds = 0;
+    std::string llvm_statistics;
+};
+
+static Snapshot take_snapshot(const std::string& name, const llvm::Module& module,
+                              const std::vector<SourceFunction>& functions) {
+    Snapshot snapshot;
+    snapshot.name = name;
+    for (const SourceFunction& function : functions) {
+        snapshot.functions[function.name];
+    }
+    for (const llvm::Function& function : module) {
+        if (function.isDeclaration()) {
+            continue;
+        }
+        snapshot.total.add(function);
+        std::string owner = function.getName().split('.').first.str();
+        auto counts = snapshot.functions.find(owner);
+        if (counts != snapshot.functions.end()) {
+            counts->second.add(function);
+        }
+    }
+    return snapshot;
+}
+
+void write_stats(const llvm::Module& module, const std::vector<SourceFunction>& functions, const Options& options) {
+    // Counters of LLVM's passes, only collected when LLVM was built with assertions or LLVM_ENABLE_STATS
+    llvm::EnableStatistics(false);
+
+    // Every copy is read back into a context of its own: CloneModule leaves the ifuncs of multiversioned functions
+    // behind, and the types the passes create would otherwise take the names of the emitted module's types
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream bitcode_stream(bitcode);
+    llvm::WriteBitcodeToFile(module, bitcode_stream);
+
+    std::vector<Snapshot> snapshots{take_snapshot("generated", module, functions)};
+    for (unsigned level = 0; level <= 3; ++level) {
+        Options level_options = options;
+        level_options.opt_level = level;
+        llvm::LLVMContext copy_context;
+        llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), module.getModuleIdentifier());
+        llvm::Expected<std::unique_ptr<llvm::Module>> copy = llvm::parseBitcodeFile(buffer, copy_context);
+        if (!copy) {
+            llvm::logAllUnhandledErrors(copy.takeError(), llvm::errs(), "kotlin-llvm: ");
+            exit(EXIT_FAILURE);
+        }
+
+        llvm::ResetStatistics();
+        auto start = std::chrono::steady_clock::now();
+        optimize_module(copy->get(), level_options);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        Snapshot snapshot = take_snapshot("O" + std::to_string(level), **copy, functions);
+        snapshot.milliseconds = elapsed.count();
+        llvm::raw_string_ostream statistics(snapshot.llvm_statistics);
+        llvm::PrintStatisticsJSON(statistics);
+        statistics.flush();
+        snapshots.push_back(std::move(snapshot));
+    }
+
+    llvm::json::OStream json(llvm::errs(), 2);
+    json.object([&] {
+        json.attribute("input", options.input_file);
+        json.attributeArray("functions", [&] {
+            for (const SourceFunction& function : functions) {
+                json.object([&] {
+                    json.attribute("name", function.name);
+                    json.attribute("inline", function.is_inline);
+                    json.attribute("ast_nodes", static_cast<int64_t>(function.ast_nodes));
+                    for (const Snapshot& snapshot : snapshots) {
+                        json.attributeBegin(snapshot.name);
+                        snapshot.functions.at(function.name).write(json);
+                        json.attributeEnd();
+                    }
+                });
+            }
+        });
+        json.attributeObject("module", [&] {
+            for (const Snapshot& snapshot : snapshots) {
+                json.attributeBegin(snapshot.name);
+                snapshot.total.write(json);
+                json.attributeEnd();
+            }
+        });
+        json.attributeObject("optimization_ms", [&] {
+            for (size_t i = 1; i < snapshots.size(); ++i) {
+                json.attribute(snapshots[i].name, snapshots[i].milliseconds);
+            }
+        });
+        json.attributeObject("llvm_statistics", [&] {
+            for (size_t i = 1; i < snapshots.size(); ++i) {
+                json.attributeBegin(snapshots[i].name);
+                json.rawValue(snapshots[i].llvm_statistics);
+                json.attributeEnd();
+            }
+        });
+    });
+    llvm::errs() << "\n";
+}
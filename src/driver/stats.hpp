@@ -0,0 +1,28 @@
+#ifndef KOTLIN_LLVM_STATS_HPP
+#define KOTLIN_LLVM_STATS_HPP
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Module.h"
+#include "options.hpp"
+
+// A `fun` of the program, recorded before codegen frees its statement
+struct SourceFunction {
+    std::string name;
+    // Expressions and statements the parser created for it
+    unsigned long ast_nodes;
+    // Expanded at its calls, so it has no LLVM function of its own
+    bool is_inline;
+};
+
+// Writes the --stats=json report to stderr, the module itself is left as codegen generated it.
+//
+// The counts (LLVM functions, basic blocks, instructions by opcode, allocas, and loads and stores of allocas,
+// which are the slots of named_values and temporaries) are taken from the generated module and from copies of it
+// optimized at -O0 to -O3, with the time each level took and the LLVM statistics its passes collected. A source
+// function also counts the LLVM functions generated for it, named `name.*` (lambdas, parallel bodies and
+// coroutine parts); the module totals include everything else, such as collection methods.
+void write_stats(const llvm::Module& module, const std::vector<SourceFunction>& functions, const Options& options);
+
+#endif //KOTLIN_LLVM_STATS_HPP
@@ -0,0 +1,37 @@
+#include "target.hpp"
+
+#include <iostream>
+
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+
+bool has_target_options(const Options& options) {
+    return !options.cpu.empty() || !options.features.empty();
+}
+
+static std::unique_ptr<llvm::TargetMachine> target_machine(const std::string& triple, const Options& options) {
+    llvm::InitializeNativeTarget();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr) {
+        std::cerr << "Cannot target " << triple << ": " << error << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::string cpu = options.cpu.empty() ? "generic" : options.cpu;
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+            triple, cpu, options.features, llvm::TargetOptions(), llvm::Reloc::PIC_));
+}
+
+void set_module_target(llvm::Module* module, const Options& options) {
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    module->setTargetTriple(triple);
+    module->setDataLayout(target_machine(triple, options)->createDataLayout());
+}
+
+std::unique_ptr<llvm::TargetMachine> create_target_machine(const llvm::Module& module, const Options& options) {
+    if (module.getTargetTriple().empty()) {
+        return nullptr;
+    }
+    return target_machine(module.getTargetTriple(), options);
+}
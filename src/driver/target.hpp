@@ -0,0 +1,22 @@
+#ifndef KOTLIN_LLVM_TARGET_HPP
+#define KOTLIN_LLVM_TARGET_HPP
+
+#include <memory>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+#include "options.hpp"
+
+// Modules are only tied to a target when -mcpu or -mattr is given or a function is multiversioned, otherwise they
+// have no triple or data layout and llc picks them
+
+bool has_target_options(const Options& options);
+
+// The host's triple with the data layout of the -mcpu CPU
+void set_module_target(llvm::Module* module, const Options& options);
+
+// For the module's triple, so the optimizer sees the vector widths and costs of each function's target-cpu and
+// target-features. nullptr when the module has no triple.
+std::unique_ptr<llvm::TargetMachine> create_target_machine(const llvm::Module& module, const Options& options);
+
+#endif //KOTLIN_LLVM_TARGET_HPP
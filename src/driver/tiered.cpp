@@ -0,0 +1,437 @@
+#include "tiered.hpp"
+#include "optimizer.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/BuiltinGCs.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include "runtime/runtime.hpp"
+
+// Defined by the runtime for programs compiled without heap classes
+extern "C" void* llvm_gc_root_chain;
+
+// Modules compiled with optimization are named after the function they were compiled for
+static const std::string tier1_prefix = "tier1:";
+
+static llvm::CodeGenOpt::Level codegen_level(unsigned opt_level) {
+    switch (opt_level) {
+        case 0:
+            return llvm::CodeGenOpt::None;
+        case 1:
+            return llvm::CodeGenOpt::Less;
+        case 2:
+            return llvm::CodeGenOpt::Default;
+        default:
+            return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+// Baseline modules go through the backend without optimization (and with FastISel), the optimized ones at the -O level
+class TierCompiler : public llvm::orc::IRCompileLayer::IRCompiler {
+public:
+    TierCompiler(llvm::orc::JITTargetMachineBuilder machine_builder, unsigned opt_level)
+            : IRCompiler(llvm::orc::irManglingOptionsFromTargetOptions(machine_builder.getOptions())),
+              _machine_builder(std::move(machine_builder)), _opt_level(opt_level) {}
+
+    llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(llvm::Module& module) override {
+        bool tier1 = module.getModuleIdentifier().compare(0, tier1_prefix.size(), tier1_prefix) == 0;
+        llvm::orc::JITTargetMachineBuilder machine_builder = _machine_builder;
+        machine_builder.setCodeGenOptLevel(codegen_level(tier1 ? _opt_level : 0));
+        auto machine = machine_builder.createTargetMachine();
+        if (!machine) {
+            return machine.takeError();
+        }
+        return llvm::orc::SimpleCompiler(**machine)(module);
+    }
+
+private:
+    llvm::orc::JITTargetMachineBuilder _machine_builder;
+    unsigned _opt_level;
+};
+
+// Appends the functions of every loaded object to /tmp/perf-<pid>.map, which perf uses to name samples in JIT code
+class PerfMapListener : public llvm::JITEventListener {
+public:
+    PerfMapListener() {
+        std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        _file = fopen(path.c_str(), "w");
+        if (_file == nullptr) {
+            std::cerr << "Cannot open " << path << std::endl;
+        }
+    }
+
+    ~PerfMapListener() override {
+        if (_file != nullptr) {
+            fclose(_file);
+        }
+    }
+
+    void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile& object,
+                            const llvm::RuntimeDyld::LoadedObjectInfo& info) override {
+        if (_file == nullptr) {
+            return;
+        }
+        // Its sections are at the addresses they were loaded to
+        llvm::object::OwningBinary<llvm::object::ObjectFile> loaded = info.getObjectForDebug(object);
+        if (loaded.getBinary() == nullptr) {
+            return;
+        }
+        for (const auto& symbol_size : llvm::object::computeSymbolSizes(*loaded.getBinary())) {
+            const llvm::object::SymbolRef& symbol = symbol_size.first;
+            llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+            llvm::Expected<llvm::StringRef> name = symbol.getName();
+            llvm::Expected<uint64_t> address = symbol.getAddress();
+            if (!type || !name || !address || *type != llvm::object::SymbolRef::ST_Function) {
+                llvm::consumeError(type.takeError());
+                llvm::consumeError(name.takeError());
+                llvm::consumeError(address.takeError());
+                continue;
+            }
+            fprintf(_file, "%llx %llx %s\n", static_cast<unsigned long long>(*address),
+                    static_cast<unsigned long long>(symbol_size.second), name->str().c_str());
+        }
+        fflush(_file);
+    }
+
+private:
+    FILE* _file;
+};
+
+struct TieredState {
+    std::unique_ptr<PerfMapListener> perf_map;
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    Options options;
+    // The module as it came out of codegen, every tier parses its own copy
+    llvm::SmallVector<char, 0> bitcode;
+    // Indexed by the id passed to kt_tier_up
+    std::vector<std::string> functions;
+    std::vector<void**> slots;
+    std::vector<bool> requested;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<unsigned> queue;
+    bool stopping = false;
+    bool print_statistics = false;
+};
+
+static TieredState* state = nullptr;
+
+static void fail(llvm::Error error) {
+    llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "kotlin-llvm: ");
+    exit(EXIT_FAILURE);
+}
+
+template<typename T>
+static T check(llvm::Expected<T> value) {
+    if (!value) {
+        fail(value.takeError());
+    }
+    return std::move(*value);
+}
+
+static llvm::orc::ThreadSafeModule load_copy(const std::string& name) {
+    auto copy_context = std::make_unique<llvm::LLVMContext>();
+    llvm::MemoryBufferRef buffer(llvm::StringRef(state->bitcode.data(), state->bitcode.size()), name);
+    std::unique_ptr<llvm::Module> copy = check(llvm::parseBitcodeFile(buffer, *copy_context));
+    copy->setModuleIdentifier(name);
+    copy->setDataLayout(state->jit->getDataLayout());
+    copy->setTargetTriple(state->jit->getTargetTriple().str());
+    return llvm::orc::ThreadSafeModule(std::move(copy), std::move(copy_context));
+}
+
+// Called by the baseline code of a function when its counter reaches the threshold, possibly from a parallel loop
+static void kt_tier_up(int32_t id) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->requested[id]) {
+        state->requested[id] = true;
+        state->queue.push_back(id);
+        state->wake.notify_one();
+    }
+}
+
+static bool is_tiered(const llvm::Function& function) {
+    return !function.isDeclaration() && !function.hasLocalLinkage() && function.getName() != "main" &&
+           !function.hasFnAttribute("coroutine.presplit");
+}
+
+// Calls of the function through the slot, and an atomic increment of its counter on entry and on every back-edge
+static void instrument(llvm::Module& module) {
+    llvm::LLVMContext& module_context = module.getContext();
+    llvm::IRBuilder<> instrumentation(module_context);
+    std::map<llvm::Function*, llvm::GlobalVariable*> slots;
+    for (llvm::Function& function : module) {
+        if (is_tiered(function)) {
+            slots[&function] = new llvm::GlobalVariable(module, function.getType(), false,
+                                                        llvm::GlobalValue::ExternalLinkage, &function,
+                                                        function.getName() + ".slot");
+            state->functions.push_back(function.getName().str());
+        }
+    }
+
+    // Invokes too, the calls in try blocks
+    std::vector<llvm::CallBase*> calls;
+    for (llvm::Function& function : module) {
+        for (llvm::BasicBlock& block : function) {
+            for (llvm::Instruction& instruction : block) {
+                auto* call = llvm::dyn_cast<llvm::CallBase>(&instruction);
+                if (call != nullptr && slots.count(call->getCalledFunction()) > 0) {
+                    calls.push_back(call);
+                }
+            }
+        }
+    }
+    for (llvm::CallBase* call : calls) {
+        llvm::GlobalVariable* slot = slots[call->getCalledFunction()];
+        instrumentation.SetInsertPoint(call);
+        llvm::LoadInst* target = instrumentation.CreateAlignedLoad(slot->getValueType(), slot, llvm::Align(8), "target");
+        target->setAtomic(llvm::AtomicOrdering::Acquire);
+        call->setCalledOperand(target);
+    }
+
+    llvm::Type* int32_type = instrumentation.getInt32Ty();
+    auto* counters_type = llvm::ArrayType::get(int32_type, state->functions.size());
+    auto* counters = new llvm::GlobalVariable(module, counters_type, false, llvm::GlobalValue::InternalLinkage,
+                                              llvm::Constant::getNullValue(counters_type), "kt.tier.counters");
+    llvm::FunctionCallee tier_up = module.getOrInsertFunction(
+            "kt_tier_up", llvm::FunctionType::get(instrumentation.getVoidTy(), {int32_type}, false));
+    unsigned threshold = state->options.tier_threshold;
+
+    unsigned id = 0;
+    for (llvm::Function& function : module) {
+        if (slots.count(&function) == 0) {
+            continue;
+        }
+        llvm::DominatorTree dominators(function);
+        std::vector<llvm::BasicBlock*> counted = {&function.getEntryBlock()};
+        for (llvm::BasicBlock& block : function) {
+            for (llvm::BasicBlock* successor : llvm::successors(&block)) {
+                if (dominators.dominates(successor, &block)) {
+                    counted.push_back(&block);
+                    break;
+                }
+            }
+        }
+        for (llvm::BasicBlock* block : counted) {
+            llvm::Instruction* terminator = block->getTerminator();
+            instrumentation.SetInsertPoint(terminator);
+            llvm::Value* counter = instrumentation.CreateConstInBoundsGEP2_32(counters_type, counters, 0, id);
+            llvm::Value* count = instrumentation.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter,
+                                                                 instrumentation.getInt32(1), llvm::Align(4),
+                                                                 llvm::AtomicOrdering::Monotonic);
+            llvm::Value* hot = instrumentation.CreateICmpEQ(count, instrumentation.getInt32(threshold - 1), "hot");
+            instrumentation.SetInsertPoint(llvm::SplitBlockAndInsertIfThen(hot, terminator, false));
+            instrumentation.CreateCall(tier_up, {instrumentation.getInt32(id)});
+        }
+        id++;
+    }
+}
+
+// The copy keeps the other functions as internal definitions, so they can be inlined into the hot one
+static void compile_tier1(unsigned id) {
+    const std::string& name = state->functions[id];
+    llvm::orc::ThreadSafeModule copy = load_copy(tier1_prefix + name);
+    copy.withModuleDo([&](llvm::Module& module) {
+        for (llvm::Function& function : module) {
+            if (function.isDeclaration()) {
+                continue;
+            }
+            if (function.getName() == name) {
+                function.setName(name + ".tier1");
+            } else {
+                function.setLinkage(llvm::GlobalValue::InternalLinkage);
+            }
+        }
+        optimize_module(&module, state->options);
+    });
+    if (llvm::Error error = state->jit->addIRModule(std::move(copy))) {
+        fail(std::move(error));
+    }
+    llvm::JITTargetAddress address = check(state->jit->lookup(name + ".tier1")).getAddress();
+    __atomic_store_n(state->slots[id], reinterpret_cast<void*>(address), __ATOMIC_RELEASE);
+    if (state->print_statistics) {
+        fprintf(stderr, "kotlin-llvm: tier-up of %s\n", name.c_str());
+    }
+}
+
+static void run_worker() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        state->wake.wait(lock, [] { return state->stopping || !state->queue.empty(); });
+        if (state->stopping) {
+            return;
+        }
+        unsigned id = state->queue.front();
+        state->queue.pop_front();
+        lock.unlock();
+        compile_tier1(id);
+        lock.lock();
+    }
+}
+
+int run_tiered(llvm::Module* module, const Options& options) {
+    if (llvm::verifyModule(*module, &llvm::errs())) {
+        std::cerr << "Generated module is invalid, not running it" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::linkAllBuiltinGCs();
+
+    TieredState tiered_state;
+    state = &tiered_state;
+    state->options = options;
+    state->print_statistics = getenv("KOTLIN_LLVM_TIER_STATS") != nullptr;
+    llvm::raw_svector_ostream bitcode_stream(state->bitcode);
+    llvm::WriteBitcodeToFile(*module, bitcode_stream);
+    bool main_returns_int = module->getFunction("main") != nullptr &&
+                            module->getFunction("main")->getReturnType()->isIntegerTy(32);
+
+    llvm::orc::LLJITBuilder jit_builder;
+    jit_builder.setCompileFunctionCreator(
+            [&](llvm::orc::JITTargetMachineBuilder machine_builder)
+                    -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                return std::make_unique<TierCompiler>(std::move(machine_builder), options.opt_level);
+            });
+    if (options.debug_info) {
+        // With -g the generated code shows up in gdb, through its JIT interface, and in perf report
+        state->perf_map = std::make_unique<PerfMapListener>();
+        jit_builder.setObjectLinkingLayerCreator([&](llvm::orc::ExecutionSession& session, const llvm::Triple&) {
+            auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+                    session, [] { return std::make_unique<llvm::SectionMemoryManager>(); });
+            layer->registerJITEventListener(*llvm::JITEventListener::createGDBRegistrationListener());
+            layer->registerJITEventListener(*state->perf_map);
+            return layer;
+        });
+    }
+    state->jit = check(jit_builder.create());
+    llvm::orc::JITDylib& library = state->jit->getMainJITDylib();
+    // Every module would otherwise bring its own llvm_gc_root_chain, the collector walks the one of the process
+    const std::pair<const char*, void*> runtime_functions[] = {
+            {"kt_alloc", reinterpret_cast<void*>(&kt_alloc)},
+            {"kt_alloc_array", reinterpret_cast<void*>(&kt_alloc_array)},
+            {"kt_gc_collect", reinterpret_cast<void*>(&kt_gc_collect)},
+            {"kt_list_new", reinterpret_cast<void*>(&kt_list_new)},
+            {"kt_list_grow", reinterpret_cast<void*>(&kt_list_grow)},
+            {"kt_hash_table_new", reinterpret_cast<void*>(&kt_hash_table_new)},
+            {"kt_hash_table_grow", reinterpret_cast<void*>(&kt_hash_table_grow)},
+            {"kt_allocate_exception", reinterpret_cast<void*>(&kt_allocate_exception)},
+            {"kt_throw", reinterpret_cast<void*>(&kt_throw)},
+            {"kt_begin_catch", reinterpret_cast<void*>(&kt_begin_catch)},
+            {"kt_end_catch", reinterpret_cast<void*>(&kt_end_catch)},
+            {"kt_exception_message", reinterpret_cast<void*>(&kt_exception_message)},
+            {"kt_personality", reinterpret_cast<void*>(&kt_personality)},
+            {"kt_exception_Exception", const_cast<kt_exception_type*>(&kt_exception_Exception)},
+            {"kt_exception_RuntimeException", const_cast<kt_exception_type*>(&kt_exception_RuntimeException)},
+            {"kt_exception_ArithmeticException", const_cast<kt_exception_type*>(&kt_exception_ArithmeticException)},
+            {"kt_exception_IndexOutOfBoundsException",
+                    const_cast<kt_exception_type*>(&kt_exception_IndexOutOfBoundsException)},
+            {"kt_exception_NoSuchElementException",
+                    const_cast<kt_exception_type*>(&kt_exception_NoSuchElementException)},
+            {"kt_exception_IllegalArgumentException",
+                    const_cast<kt_exception_type*>(&kt_exception_IllegalArgumentException)},
+            {"kt_exception_IllegalStateException",
+                    const_cast<kt_exception_type*>(&kt_exception_IllegalStateException)},
+            {"kt_division_by_zero", reinterpret_cast<void*>(&kt_division_by_zero)},
+            {"kt_index_out_of_bounds", reinterpret_cast<void*>(&kt_index_out_of_bounds)},
+            {"kt_no_such_element", reinterpret_cast<void*>(&kt_no_such_element)},
+            {"kt_coro_schedule", reinterpret_cast<void*>(&kt_coro_schedule)},
+            {"kt_coro_delay", reinterpret_cast<void*>(&kt_coro_delay)},
+            {"kt_coro_run", reinterpret_cast<void*>(&kt_coro_run)},
+            {"kt_parallel_for", reinterpret_cast<void*>(&kt_parallel_for)},
+            {"llvm_gc_root_chain", reinterpret_cast<void*>(&llvm_gc_root_chain)},
+            {"kt_tier_up", reinterpret_cast<void*>(&kt_tier_up)},
+    };
+    llvm::orc::SymbolMap runtime_symbols;
+    for (const auto& function : runtime_functions) {
+        runtime_symbols[state->jit->mangleAndIntern(function.first)] = llvm::JITEvaluatedSymbol(
+                llvm::pointerToJITTargetAddress(function.second), llvm::JITSymbolFlags::Exported);
+    }
+    if (llvm::Error error = library.define(llvm::orc::absoluteSymbols(std::move(runtime_symbols)))) {
+        fail(std::move(error));
+    }
+    library.addGenerator(check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            state->jit->getDataLayout().getGlobalPrefix())));
+
+    // Profiles cannot be used, the functions of the optimized copies are internal and their names change
+    state->options.profile_use_file.clear();
+    if (state->options.tier_threshold == 0 && options.opt_level > 0) {
+        // Everything optimized before main starts
+        llvm::orc::ThreadSafeModule whole = load_copy(tier1_prefix + "main");
+        whole.withModuleDo([&](llvm::Module& copy) { optimize_module(&copy, state->options); });
+        if (llvm::Error error = state->jit->addIRModule(std::move(whole))) {
+            fail(std::move(error));
+        }
+    } else {
+        Options baseline_options = state->options;
+        baseline_options.opt_level = 0;
+        llvm::orc::ThreadSafeModule baseline = load_copy("baseline");
+        baseline.withModuleDo([&](llvm::Module& copy) {
+            if (options.opt_level > 0) {
+                instrument(copy);
+            }
+            if (has_coroutines(&copy)) {
+                optimize_module(&copy, baseline_options);
+            }
+        });
+        if (llvm::Error error = state->jit->addIRModule(std::move(baseline))) {
+            fail(std::move(error));
+        }
+        for (const std::string& name : state->functions) {
+            auto slot = check(state->jit->lookup(name + ".slot")).getAddress();
+            state->slots.push_back(reinterpret_cast<void**>(slot));
+        }
+        state->requested.assign(state->functions.size(), false);
+    }
+
+    llvm::JITTargetAddress main_address = check(state->jit->lookup("main")).getAddress();
+    std::thread worker(run_worker);
+    int result = 0;
+    if (main_returns_int) {
+        result = reinterpret_cast<int (*)()>(main_address)();
+    } else {
+        reinterpret_cast<void (*)()>(main_address)();
+    }
+    fflush(stdout);
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+    }
+    state->wake.notify_one();
+    worker.join();
+    state->jit.reset();
+    state = nullptr;
+    return result;
+}
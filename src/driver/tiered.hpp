@@ -0,0 +1,16 @@
+#ifndef KOTLIN_LLVM_TIERED_HPP
+#define KOTLIN_LLVM_TIERED_HPP
+
+#include "llvm/IR/Module.h"
+#include "options.hpp"
+
+// Runs main in the JIT instead of printing the module (--run) and returns its result.
+//
+// The module starts as baseline code, compiled without optimization so main runs right away. Every function but
+// main is called through a slot, and counts its calls and loop back-edges; when the count reaches
+// --tier-threshold the function is compiled at the -O level on a background thread, with copies of its callees
+// to inline, and its slot is pointed at the optimized code. A loop that is already running keeps running the
+// baseline code. With -O0 only the baseline is used, with --tier-threshold=0 only the optimized code.
+int run_tiered(llvm::Module* module, const Options& options);
+
+#endif //KOTLIN_LLVM_TIERED_HPP
@@ -0,0 +1,400 @@
+// Hand-written replacement for the Flex lexer in lexer.lex, selected with -DKOTLIN_LLVM_FAST_LEXER=ON.
+//
+// The input is memory-mapped instead of being copied through YY_INPUT, and the hot loops (blanks,
+// identifiers, digits) classify 32 (AVX2) or 16 (SSE4.2) bytes at a time, with a scalar fallback when
+// the compiler is not allowed to use those instructions (e.g. build with -march=native to enable them).
+// It returns exactly the same tokens as lexer.lex, including Flex's longest-match behaviour.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include "sourcetree/ast.hpp"
+#include "sourcetree/statement.hpp"
+#include "char_literal.hpp"
+
+#include "parser.tab.hpp"
+
+FILE* yyin = nullptr;
+
+static const char* input_begin = nullptr;
+static const char* input_end = nullptr;
+static const char* cursor = nullptr;
+static std::vector<char> input_copy;
+
+// Location of the current token for the parser, see yylex
+static int line = 1;
+static const char* line_start = nullptr;
+
+// Maps regular files, anything else (pipes, terminals) is read into memory once.
+static void load_input() {
+    if (yyin == nullptr) {
+        yyin = stdin;
+    }
+
+    struct stat file_stat{};
+    int fd = fileno(yyin);
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        void* mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, file_stat.st_size, MADV_SEQUENTIAL);
+            input_begin = static_cast<const char*>(mapped);
+            input_end = input_begin + file_stat.st_size;
+            cursor = input_begin;
+            return;
+        }
+    }
+
+    char chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), yyin)) > 0) {
+        input_copy.insert(input_copy.end(), chunk, chunk + read);
+    }
+    input_begin = input_copy.data();
+    input_end = input_begin + input_copy.size();
+    cursor = input_begin;
+}
+
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_identifier_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline bool is_identifier_char(char c) {
+    return is_identifier_start(c) || is_digit(c);
+}
+
+#if defined(__AVX2__)
+
+static inline __m256i in_range(__m256i chars, char low, char high) {
+    // Bytes >= 0x80 compare as negative and therefore never fall into an ASCII range
+    return _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8(low - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chars));
+}
+
+static const char* skip_blanks(const char* p) {
+    while (p + 32 <= input_end) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')),
+                                        _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t')));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(blank));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    while (p < input_end && is_blank(*p)) p++;
+    return p;
+}
+
+static const char* skip_identifier_chars(const char* p) {
+    while (p + 32 <= input_end) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+        __m256i accepted = _mm256_or_si256(_mm256_or_si256(in_range(lower, 'a', 'z'), in_range(chars, '0', '9')),
+                                           _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_')));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(accepted));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    while (p < input_end && is_identifier_char(*p)) p++;
+    return p;
+}
+
+static const char* skip_digits(const char* p) {
+    while (p + 32 <= input_end) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(in_range(chars, '0', '9')));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    while (p < input_end && is_digit(*p)) p++;
+    return p;
+}
+
+#elif defined(__SSE4_2__)
+
+// PCMPESTRI with negative polarity returns the index of the first byte that is not in the set (16 if none)
+static const int first_outside_ranges = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY;
+static const int first_outside_set = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_NEGATIVE_POLARITY;
+
+static const char* skip_blanks(const char* p) {
+    const __m128i set = _mm_setr_epi8(' ', '\t', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (p + 16 <= input_end) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(set, 2, chars, 16, first_outside_set);
+        if (index < 16) {
+            return p + index;
+        }
+        p += 16;
+    }
+    while (p < input_end && is_blank(*p)) p++;
+    return p;
+}
+
+static const char* skip_identifier_chars(const char* p) {
+    const __m128i ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', '0', '9', '_', '_', 0, 0, 0, 0, 0, 0, 0, 0);
+    while (p + 16 <= input_end) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(ranges, 8, chars, 16, first_outside_ranges);
+        if (index < 16) {
+            return p + index;
+        }
+        p += 16;
+    }
+    while (p < input_end && is_identifier_char(*p)) p++;
+    return p;
+}
+
+static const char* skip_digits(const char* p) {
+    const __m128i ranges = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (p + 16 <= input_end) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int index = _mm_cmpestri(ranges, 2, chars, 16, first_outside_ranges);
+        if (index < 16) {
+            return p + index;
+        }
+        p += 16;
+    }
+    while (p < input_end && is_digit(*p)) p++;
+    return p;
+}
+
+#else
+
+static const char* skip_blanks(const char* p) {
+    while (p < input_end && is_blank(*p)) p++;
+    return p;
+}
+
+static const char* skip_identifier_chars(const char* p) {
+    while (p < input_end && is_identifier_char(*p)) p++;
+    return p;
+}
+
+static const char* skip_digits(const char* p) {
+    while (p < input_end && is_digit(*p)) p++;
+    return p;
+}
+
+#endif
+
+struct Keyword {
+    const char* text;
+    size_t length;
+    int token;
+};
+
+static const Keyword keywords[] = {
+        {"val", 3, val_token},
+        {"var", 3, var_token},
+        {"fun", 3, fun_token},
+        {"class", 5, class_token},
+        {"external", 8, external_token},
+        {"import", 6, import_token},
+        {"return", 6, return_token},
+        {"in", 2, in_token},
+        {"until", 5, until_token},
+        {"step", 4, step_token},
+        {"if", 2, if_token},
+        {"else", 4, else_token},
+        {"println", 7, print_token},
+        {"while", 5, while_token},
+        {"do", 2, do_token},
+        {"for", 3, for_token},
+        {"when", 4, when_token},
+        {"throw", 5, throw_token},
+        {"try", 3, try_token},
+        {"catch", 5, catch_token},
+        {"finally", 7, finally_token},
+        {"shl", 3, shl_token},
+        {"shr", 3, shr_token},
+        {"ushr", 4, ushr_token},
+        {"and", 3, and_token},
+        {"or", 2, or_token},
+        {"xor", 3, xor_token},
+        {"inv", 3, inv_token},
+        {"Int", 3, int_type_token},
+        {"Double", 6, double_type_token},
+        {"String", 6, string_type_token},
+        {"Long", 4, long_type_token},
+        {"Float", 5, float_type_token},
+        {"Short", 5, short_type_token},
+        {"Byte", 4, byte_type_token},
+        {"Boolean", 7, boolean_type_token},
+        {"Char", 4, char_type_token},
+        {"Unit", 4, unit_type_token},
+};
+
+static int identifier_or_keyword(const char* begin, const char* end) {
+    size_t length = end - begin;
+    for (const Keyword& keyword : keywords) {
+        if (keyword.length == length && memcmp(keyword.text, begin, length) == 0) {
+            return keyword.token;
+        }
+    }
+    if ((length == 9 && memcmp(begin, "ArrayList", 9) == 0) || (length == 7 && memcmp(begin, "HashSet", 7) == 0) ||
+        (length == 7 && memcmp(begin, "HashMap", 7) == 0)) {
+        yylval.string_value = new std::string(begin, end);
+        return collection_token;
+    }
+    if (length == 4 && memcmp(begin, "true", 4) == 0) {
+        yylval.boolean_value = true;
+        return boolean_token;
+    }
+    if (length == 5 && memcmp(begin, "false", 5) == 0) {
+        yylval.boolean_value = false;
+        return boolean_token;
+    }
+    yylval.string_value = new std::string(begin, end);
+    return id_token;
+}
+
+static int number(const char* begin) {
+    const char* end = skip_digits(begin);
+    bool fraction = end + 1 < input_end && *end == '.' && is_digit(end[1]);
+    if (fraction) {
+        end = skip_digits(end + 1);
+    }
+    if (end < input_end && (*end == 'f' || *end == 'F')) {
+        yylval.float_value = strtof(std::string(begin, end).c_str(), nullptr);
+        cursor = end + 1;
+        return float_token;
+    }
+    if (fraction) {
+        yylval.double_value = atof(std::string(begin, end).c_str());
+        cursor = end;
+        return double_token;
+    }
+    if (end < input_end && *end == 'L') {
+        yylval.long_value = atoll(std::string(begin, end).c_str());
+        cursor = end + 1;
+        return long_token;
+    }
+    yylval.int_value = atoi(std::string(begin, end).c_str());
+    cursor = end;
+    return int_token;
+}
+
+// Flex reads \"[^"\n]*\": a literal ends at the next quote on the same line.
+static int string_literal(const char* begin) {
+    const char* line_end = static_cast<const char*>(memchr(begin + 1, '\n', input_end - begin - 1));
+    if (line_end == nullptr) {
+        line_end = input_end;
+    }
+    const char* closing_quote = static_cast<const char*>(memchr(begin + 1, '"', line_end - begin - 1));
+    if (closing_quote == nullptr) {
+        return -1;
+    }
+    yylval.string_value = new std::string(begin, closing_quote + 1);
+    cursor = closing_quote + 1;
+    return str_token;
+}
+
+static int two_char_operator(char first, char second) {
+    switch (first) {
+        case '.': return second == '.' ? range_token : 0;
+        case '<': return second == '=' ? le_token : 0;
+        case '>': return second == '=' ? ge_token : 0;
+        case '+': return second == '=' ? pa_token : 0;
+        case '-': return second == '=' ? ma_token : second == '>' ? arrow_token : 0;
+        case '*': return second == '=' ? ta_token : 0;
+        case '/': return second == '=' ? da_token : 0;
+        case '%': return second == '=' ? moda_token : 0;
+        case '&': return second == '&' ? andl_token : 0;
+        case '|': return second == '|' ? orl_token : 0;
+        default: return 0;
+    }
+}
+
+static int next_token() {
+    if (cursor >= input_end) {
+        return 0;
+    }
+
+    const char* begin = cursor;
+    char c = *begin;
+
+    if (is_identifier_start(c)) {
+        cursor = skip_identifier_chars(begin + 1);
+        return identifier_or_keyword(begin, cursor);
+    }
+    if (is_digit(c)) {
+        return number(begin);
+    }
+    if (c == '\'') {
+        size_t length = char_literal_length(begin, input_end);
+        if (length > 0) {
+            yylval.int_value = decode_char_literal(begin);
+            cursor = begin + length;
+            return char_token;
+        }
+    }
+    if (c == '"') {
+        int token = string_literal(begin);
+        if (token > 0) {
+            return token;
+        }
+    }
+    if (begin + 1 < input_end) {
+        int token = two_char_operator(c, begin[1]);
+        if (token != 0) {
+            cursor = begin + 2;
+            return token;
+        }
+    }
+    if (c == '!') {
+        cursor = begin + 1;
+        return notl_token;
+    }
+    if (c != '\0' && strchr("-=(),;%+*/<>{}\n:.[]@", c) != nullptr) {
+        cursor = begin + 1;
+        return c;
+    }
+
+    std::cerr << "Lexical error, unknown character: '" << c << "'" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// Newlines are tokens and cannot appear inside one, so the line only changes after a '\n' is returned
+int yylex() {
+    if (input_begin == nullptr) {
+        load_input();
+        line_start = input_begin;
+    }
+
+    cursor = skip_blanks(cursor);
+    yylloc.first_line = line;
+    yylloc.first_column = static_cast<int>(cursor - line_start) + 1;
+    int token = next_token();
+    yylloc.last_line = line;
+    yylloc.last_column = static_cast<int>(cursor - line_start);
+    if (token == '\n') {
+        line++;
+        line_start = cursor;
+    }
+    return token;
+}
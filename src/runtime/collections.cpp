@@ -0,0 +1,129 @@
+// The slow paths of ArrayList, HashSet and HashMap. Lookups, insertions and removals are generated by the compiler
+// for each element type (see sourcetree/collections.cpp) and only call in here when a buffer is full.
+//
+// Collection objects are heap objects whose only reference is their buffer. A buffer is replaced by a new one
+// in a single allocation, so the collection stays reachable through its caller's GC root and the old buffer
+// through the collection until the new one is stored.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "runtime.hpp"
+
+static const uint32_t buffer_offset[] = {0};
+static const kt_type_info list_type = {sizeof(kt_list), 1, buffer_offset, "ArrayList"};
+static const kt_type_info hash_table_type = {sizeof(kt_hash_table), 1, buffer_offset, "HashMap"};
+
+static const int32_t group_size = 16;
+static const int32_t max_capacity = 1 << 30;
+
+static const kt_type_info empty_group_type = {0, 0, nullptr, "Array"};
+
+// The control bytes of every new table, laid out like a heap object that the compiler placed on the stack
+// (an object header with size 0), so the collector can mark it without freeing it
+static struct {
+    const kt_type_info* type;
+    uint32_t mark;
+    uint32_t size;
+    int8_t control[group_size];
+} empty_group = {&empty_group_type, 0, 0, {kt_hash_empty, kt_hash_empty, kt_hash_empty, kt_hash_empty,
+                                           kt_hash_empty, kt_hash_empty, kt_hash_empty, kt_hash_empty,
+                                           kt_hash_empty, kt_hash_empty, kt_hash_empty, kt_hash_empty,
+                                           kt_hash_empty, kt_hash_empty, kt_hash_empty, kt_hash_empty}};
+
+static void too_large() {
+    fputs("kotlin-llvm runtime: collection too large\n", stderr);
+    abort();
+}
+
+extern "C" void* kt_list_new() {
+    return kt_alloc(&list_type);
+}
+
+extern "C" void kt_list_grow(kt_list* list, int32_t element_size) {
+    if (list->capacity >= max_capacity) {
+        too_large();
+    }
+    int32_t capacity = list->capacity == 0 ? 8 : list->capacity * 2;
+    void* data = kt_alloc_array(static_cast<size_t>(capacity) * element_size);
+    memcpy(data, list->data, static_cast<size_t>(list->size) * element_size);
+    list->data = data;
+    list->capacity = capacity;
+}
+
+extern "C" void* kt_hash_table_new() {
+    auto* table = static_cast<kt_hash_table*>(kt_alloc(&hash_table_type));
+    table->control = empty_group.control;
+    table->keys = empty_group.control;
+    table->values = empty_group.control;
+    return table;
+}
+
+static size_t align(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+static int32_t first_empty(const int8_t* control, int32_t position, int32_t mask) {
+    for (int32_t i = 0; i < group_size; i++) {
+        if (control[(position + i) & mask] == kt_hash_empty) {
+            return (position + i) & mask;
+        }
+    }
+    return -1;
+}
+
+extern "C" void kt_hash_table_grow(kt_hash_table* table, int32_t key_size, int32_t value_size) {
+    int32_t old_capacity = table->mask == 0 ? 0 : table->mask + 1;
+    // Tables that are full of deleted slots are only rehashed at the same size
+    int32_t capacity = group_size;
+    while (capacity - capacity / 8 <= table->size) {
+        if (capacity >= max_capacity) {
+            too_large();
+        }
+        capacity *= 2;
+    }
+
+    size_t keys_offset = align(capacity + group_size);
+    size_t values_offset = keys_offset + align(static_cast<size_t>(capacity) * key_size);
+    auto* buffer = static_cast<char*>(kt_alloc_array(values_offset + static_cast<size_t>(capacity) * value_size));
+    auto* control = reinterpret_cast<int8_t*>(buffer);
+    char* keys = buffer + keys_offset;
+    char* values = buffer + values_offset;
+    memset(control, kt_hash_empty, capacity + group_size);
+
+    int32_t mask = capacity - 1;
+    auto* old_keys = static_cast<const char*>(table->keys);
+    auto* old_values = static_cast<const char*>(table->values);
+    for (int32_t i = 0; i < old_capacity; i++) {
+        if (table->control[i] < 0) {
+            continue;
+        }
+        uint64_t bits = 0;
+        memcpy(&bits, old_keys + static_cast<size_t>(i) * key_size, key_size);
+        uint64_t hash = kt_hash_bits(bits);
+        // The keys are distinct, so each one goes into the first empty slot of the first group of its probe
+        // sequence that has one, where the generated lookups stop
+        int32_t position = static_cast<int32_t>(hash >> 7) & mask;
+        for (int32_t stride = group_size;; stride += group_size) {
+            int32_t slot = first_empty(control, position, mask);
+            if (slot >= 0) {
+                position = slot;
+                break;
+            }
+            position = (position + stride) & mask;
+        }
+        int8_t h2 = static_cast<int8_t>(hash & 0x7f);
+        control[position] = h2;
+        control[((position - group_size) & mask) + group_size] = h2;
+        memcpy(keys + static_cast<size_t>(position) * key_size, old_keys + static_cast<size_t>(i) * key_size, key_size);
+        memcpy(values + static_cast<size_t>(position) * value_size, old_values + static_cast<size_t>(i) * value_size,
+               value_size);
+    }
+
+    table->control = control;
+    table->keys = keys;
+    table->values = values;
+    table->mask = mask;
+    table->growth_left = capacity - capacity / 8 - table->size;
+}
@@ -0,0 +1,141 @@
+// Single-threaded event loop for the coroutines of suspend functions.
+//
+// A handle is the frame of an LLVM switched-resume coroutine, which starts with pointers to its resume and
+// destroy functions. The compiler awaits and destroys coroutines itself, the loop only resumes the ones that
+// were scheduled: queued coroutines run in FIFO order, delayed ones wait in a binary heap ordered by deadline.
+// While nothing is queued the thread sleeps until the next deadline.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "runtime.hpp"
+
+struct CoroutineFrame {
+    void (*resume)(CoroutineFrame*);
+    void (*destroy)(CoroutineFrame*);
+};
+
+struct Timer {
+    uint64_t deadline;
+    // Keeps coroutines with the same deadline in the order they were delayed
+    uint64_t sequence;
+    CoroutineFrame* frame;
+};
+
+// Ring buffer of queued coroutines
+static CoroutineFrame** queue = nullptr;
+static size_t queue_capacity = 0;
+static size_t queue_head = 0;
+static size_t queue_size = 0;
+
+static Timer* timers = nullptr;
+static size_t timer_capacity = 0;
+static size_t timer_count = 0;
+static uint64_t timer_sequence = 0;
+
+static void* grow(void* items, size_t& capacity, size_t item_size) {
+    capacity = capacity == 0 ? 64 : capacity * 2;
+    items = realloc(items, capacity * item_size);
+    if (items == nullptr) {
+        fputs("kotlin-llvm runtime: out of memory\n", stderr);
+        abort();
+    }
+    return items;
+}
+
+static uint64_t now() {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+static bool earlier(const Timer& first, const Timer& second) {
+    return first.deadline != second.deadline ? first.deadline < second.deadline : first.sequence < second.sequence;
+}
+
+static void push_timer(Timer timer) {
+    if (timer_count == timer_capacity) {
+        timers = static_cast<Timer*>(grow(timers, timer_capacity, sizeof(Timer)));
+    }
+    size_t index = timer_count++;
+    while (index > 0 && earlier(timer, timers[(index - 1) / 2])) {
+        timers[index] = timers[(index - 1) / 2];
+        index = (index - 1) / 2;
+    }
+    timers[index] = timer;
+}
+
+static Timer pop_timer() {
+    Timer first = timers[0];
+    Timer last = timers[--timer_count];
+    size_t index = 0;
+    for (;;) {
+        size_t child = index * 2 + 1;
+        if (child >= timer_count) {
+            break;
+        }
+        if (child + 1 < timer_count && earlier(timers[child + 1], timers[child])) {
+            child++;
+        }
+        if (!earlier(timers[child], last)) {
+            break;
+        }
+        timers[index] = timers[child];
+        index = child;
+    }
+    timers[index] = last;
+    return first;
+}
+
+extern "C" void kt_coro_schedule(void* handle) {
+    if (queue_size == queue_capacity) {
+        // Unwraps the ring into the front of the larger buffer
+        size_t old_capacity = queue_capacity;
+        queue = static_cast<CoroutineFrame**>(grow(queue, queue_capacity, sizeof(CoroutineFrame*)));
+        for (size_t i = 0; i < queue_head; i++) {
+            queue[old_capacity + i] = queue[i];
+        }
+    }
+    queue[(queue_head + queue_size++) % queue_capacity] = static_cast<CoroutineFrame*>(handle);
+}
+
+extern "C" void kt_coro_delay(void* handle, int64_t milliseconds) {
+    if (milliseconds <= 0) {
+        kt_coro_schedule(handle);
+        return;
+    }
+    push_timer(Timer{now() + static_cast<uint64_t>(milliseconds) * 1000000, timer_sequence++,
+                     static_cast<CoroutineFrame*>(handle)});
+}
+
+extern "C" void kt_coro_run() {
+    for (;;) {
+        if (timer_count > 0) {
+            uint64_t time = now();
+            if (queue_size == 0 && timers[0].deadline > time) {
+                uint64_t wait = timers[0].deadline - time;
+                timespec duration{static_cast<time_t>(wait / 1000000000), static_cast<long>(wait % 1000000000)};
+                nanosleep(&duration, nullptr);
+                time = now();
+            }
+            while (timer_count > 0 && timers[0].deadline <= time) {
+                kt_coro_schedule(pop_timer().frame);
+            }
+        }
+        if (queue_size == 0) {
+            if (timer_count == 0) {
+                return;
+            }
+            continue;
+        }
+
+        // Only the coroutines queued so far, so the timers are checked again after every round
+        for (size_t round = queue_size; round > 0; round--) {
+            CoroutineFrame* frame = queue[queue_head];
+            queue_head = (queue_head + 1) % queue_capacity;
+            queue_size--;
+            frame->resume(frame);
+        }
+    }
+}
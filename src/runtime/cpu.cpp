@@ -0,0 +1,28 @@
+// CPU detection for the ifunc resolvers of multiversioned functions.
+//
+// The levels follow the x86-64 psABI, checked by their defining features that the compiler's CPU detection knows;
+// every CPU with AVX2, FMA and BMI2 also has the rest of x86-64-v3 (MOVBE, F16C, LZCNT, ...).
+
+#include "runtime.hpp"
+
+int32_t kt_cpu_level() {
+#if defined(__x86_64__)
+    // Resolvers run before constructors, so the detection is initialized here
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("ssse3") || !__builtin_cpu_supports("popcnt")) {
+        return 1;
+    }
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma") || !__builtin_cpu_supports("bmi") ||
+        !__builtin_cpu_supports("bmi2")) {
+        return 2;
+    }
+    if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw") ||
+        !__builtin_cpu_supports("avx512cd") || !__builtin_cpu_supports("avx512dq") ||
+        !__builtin_cpu_supports("avx512vl")) {
+        return 3;
+    }
+    return 4;
+#else
+    return 1;
+#endif
+}
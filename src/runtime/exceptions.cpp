@@ -0,0 +1,336 @@
+// Exceptions on top of the Itanium C++ ABI's unwinder (_Unwind_RaiseException from libgcc_s or libunwind).
+//
+// Code that does not throw pays nothing: calls in try blocks are LLVM invokes, whose landing pads are only
+// found through the call-site tables LLVM emits (.gcc_except_table) when an exception passes through. The
+// unwinder first searches for a frame whose personality routine, kt_personality, has a catch for the class of the
+// value, then unwinds to it, entering every landing pad on the way with selector 0 to run its finally blocks.
+//
+// The landing pads of a try block list the catches of the enclosing try blocks of the same function too, so a
+// frame is found as the handler even if an outer try block catches, and each landing pad passes exceptions it
+// does not catch on to the enclosing one. A catch of Exception is a catch-all, which only matches Kotlin
+// exceptions.
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "runtime.hpp"
+
+const kt_exception_type kt_exception_Exception = {"kotlin.Exception", 0};
+const kt_exception_type kt_exception_RuntimeException = {"kotlin.RuntimeException", 0};
+const kt_exception_type kt_exception_ArithmeticException = {"kotlin.ArithmeticException", 0};
+const kt_exception_type kt_exception_IndexOutOfBoundsException = {"kotlin.IndexOutOfBoundsException", 0};
+const kt_exception_type kt_exception_NoSuchElementException = {"kotlin.NoSuchElementException", 0};
+const kt_exception_type kt_exception_IllegalArgumentException = {"kotlin.IllegalArgumentException", 0};
+const kt_exception_type kt_exception_IllegalStateException = {"kotlin.IllegalStateException", 0};
+
+// "KTLN" "KT\0\0", tells Kotlin exceptions from those of other languages
+static const uint64_t kotlin_exception_class = 0x4b544c4e4b540000ull;
+
+// Precedes the thrown value, which starts 16 byte aligned like the header
+struct ExceptionHeader {
+    const kt_exception_type* type;
+    _Unwind_Exception unwind;
+};
+
+static ExceptionHeader* header_of(void* unwind_exception) {
+    return reinterpret_cast<ExceptionHeader*>(static_cast<char*>(unwind_exception) - offsetof(ExceptionHeader, unwind));
+}
+
+static void delete_exception(_Unwind_Reason_Code, _Unwind_Exception* unwind_exception) {
+    free(header_of(unwind_exception));
+}
+
+static const char* message_of(const ExceptionHeader* header) {
+    if (header->type->message_offset < 0) {
+        return nullptr;
+    }
+    return *reinterpret_cast<const char* const*>(reinterpret_cast<const char*>(header + 1) +
+                                                 header->type->message_offset);
+}
+
+[[noreturn]] static void report(const ExceptionHeader* header) {
+    fflush(stdout);
+    const char* message = message_of(header);
+    if (message != nullptr) {
+        fprintf(stderr, "%s: %s\n", header->type->name, message);
+    } else {
+        fprintf(stderr, "%s\n", header->type->name);
+    }
+    exit(EXIT_FAILURE);
+}
+
+void* kt_allocate_exception(size_t size) {
+    auto* header = static_cast<ExceptionHeader*>(calloc(1, sizeof(ExceptionHeader) + size));
+    if (header == nullptr) {
+        fprintf(stderr, "Out of memory\n");
+        abort();
+    }
+    return header + 1;
+}
+
+void kt_throw(void* value, const kt_exception_type* type) {
+    ExceptionHeader* header = static_cast<ExceptionHeader*>(value) - 1;
+    header->type = type;
+    header->unwind.exception_class = kotlin_exception_class;
+    header->unwind.exception_cleanup = delete_exception;
+    _Unwind_RaiseException(&header->unwind);
+    // Nothing catches it, or it would have to unwind through the runtime (a parallel loop or the event loop)
+    report(header);
+}
+
+void* kt_begin_catch(void* exception) {
+    return header_of(exception) + 1;
+}
+
+void kt_end_catch(void* exception) {
+    free(header_of(exception));
+}
+
+const char* kt_exception_message(void* exception) {
+    const ExceptionHeader* header = header_of(exception);
+    const char* message = message_of(header);
+    return message != nullptr ? message : header->type->name;
+}
+
+[[noreturn]] static void throw_message(const kt_exception_type* type, const char* message) {
+    auto* value = static_cast<const char**>(kt_allocate_exception(sizeof(const char*)));
+    *value = message;
+    kt_throw(value, type);
+}
+
+void kt_division_by_zero() {
+    throw_message(&kt_exception_ArithmeticException, "/ by zero");
+}
+
+void kt_index_out_of_bounds(int32_t index, int32_t size) {
+    // Freed with the program, like the other strings
+    char* message = static_cast<char*>(malloc(64));
+    snprintf(message, 64, "Index %d out of bounds for length %d", index, size);
+    throw_message(&kt_exception_IndexOutOfBoundsException, message);
+}
+
+void kt_no_such_element(const char* message) {
+    throw_message(&kt_exception_NoSuchElementException, message);
+}
+
+// DWARF pointer encodings of the LSDA
+enum {
+    DW_EH_PE_absptr = 0x00,
+    DW_EH_PE_uleb128 = 0x01,
+    DW_EH_PE_udata2 = 0x02,
+    DW_EH_PE_udata4 = 0x03,
+    DW_EH_PE_udata8 = 0x04,
+    DW_EH_PE_sleb128 = 0x09,
+    DW_EH_PE_sdata2 = 0x0a,
+    DW_EH_PE_sdata4 = 0x0b,
+    DW_EH_PE_sdata8 = 0x0c,
+    DW_EH_PE_pcrel = 0x10,
+    DW_EH_PE_indirect = 0x80,
+    DW_EH_PE_omit = 0xff
+};
+
+static uintptr_t read_uleb128(const uint8_t** data) {
+    uintptr_t result = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = *(*data)++;
+        result |= static_cast<uintptr_t>(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return result;
+}
+
+static intptr_t read_sleb128(const uint8_t** data) {
+    uintptr_t result = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = *(*data)++;
+        result |= static_cast<uintptr_t>(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    if ((byte & 0x40) && shift < sizeof(result) * 8) {
+        result |= ~static_cast<uintptr_t>(0) << shift;
+    }
+    return static_cast<intptr_t>(result);
+}
+
+template<typename T>
+static T read_value(const uint8_t** data) {
+    T value;
+    memcpy(&value, *data, sizeof(T));
+    *data += sizeof(T);
+    return value;
+}
+
+static uintptr_t read_encoded_pointer(const uint8_t** data, uint8_t encoding) {
+    if (encoding == DW_EH_PE_omit) {
+        return 0;
+    }
+    const uint8_t* start = *data;
+    uintptr_t result;
+    switch (encoding & 0x0f) {
+        case DW_EH_PE_absptr:
+            result = read_value<uintptr_t>(data);
+            break;
+        case DW_EH_PE_uleb128:
+            result = read_uleb128(data);
+            break;
+        case DW_EH_PE_udata2:
+            result = read_value<uint16_t>(data);
+            break;
+        case DW_EH_PE_udata4:
+            result = read_value<uint32_t>(data);
+            break;
+        case DW_EH_PE_udata8:
+            result = read_value<uint64_t>(data);
+            break;
+        case DW_EH_PE_sleb128:
+            result = read_sleb128(data);
+            break;
+        case DW_EH_PE_sdata2:
+            result = read_value<int16_t>(data);
+            break;
+        case DW_EH_PE_sdata4:
+            result = read_value<int32_t>(data);
+            break;
+        case DW_EH_PE_sdata8:
+            result = read_value<int64_t>(data);
+            break;
+        default:
+            abort();
+    }
+    // LLVM only uses absolute and pc-relative pointers on the targets we support
+    if ((encoding & 0x70) == DW_EH_PE_pcrel) {
+        if (result != 0) {
+            result += reinterpret_cast<uintptr_t>(start);
+        }
+    } else if ((encoding & 0x70) != 0) {
+        abort();
+    }
+    if (result != 0 && (encoding & DW_EH_PE_indirect)) {
+        result = *reinterpret_cast<const uintptr_t*>(result);
+    }
+    return result;
+}
+
+static size_t encoded_size(uint8_t encoding) {
+    switch (encoding & 0x0f) {
+        case DW_EH_PE_udata2:
+        case DW_EH_PE_sdata2:
+            return 2;
+        case DW_EH_PE_udata4:
+        case DW_EH_PE_sdata4:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+struct LandingPad {
+    uintptr_t address;
+    // Of the first catch that matches, 0 when none does
+    intptr_t selector;
+    bool cleanup;
+};
+
+// Looks the call site the frame is at up in the function's LSDA. False when the call has no landing pad.
+static bool find_landing_pad(_Unwind_Context* context, const kt_exception_type* thrown, bool is_kotlin,
+                             LandingPad& pad) {
+    const auto* data = static_cast<const uint8_t*>(_Unwind_GetLanguageSpecificData(context));
+    if (data == nullptr) {
+        return false;
+    }
+    int before_instruction = 0;
+    uintptr_t ip = _Unwind_GetIPInfo(context, &before_instruction);
+    if (!before_instruction) {
+        // The return address, which may already be outside of the call's range
+        ip--;
+    }
+    uintptr_t function_start = _Unwind_GetRegionStart(context);
+
+    uint8_t landing_pad_base_encoding = *data++;
+    uintptr_t landing_pad_base = function_start;
+    if (landing_pad_base_encoding != DW_EH_PE_omit) {
+        landing_pad_base = read_encoded_pointer(&data, landing_pad_base_encoding);
+    }
+    uint8_t type_encoding = *data++;
+    const uint8_t* types = nullptr;
+    if (type_encoding != DW_EH_PE_omit) {
+        uintptr_t offset = read_uleb128(&data);
+        types = data + offset;
+    }
+    uint8_t call_site_encoding = *data++;
+    uintptr_t call_sites_length = read_uleb128(&data);
+    const uint8_t* actions = data + call_sites_length;
+
+    while (data < actions) {
+        uintptr_t start = read_encoded_pointer(&data, call_site_encoding);
+        uintptr_t length = read_encoded_pointer(&data, call_site_encoding);
+        uintptr_t landing_pad = read_encoded_pointer(&data, call_site_encoding);
+        uintptr_t action = read_uleb128(&data);
+        if (ip < function_start + start) {
+            // The call sites are sorted, calls of nounwind functions have none
+            return false;
+        }
+        if (ip >= function_start + start + length) {
+            continue;
+        }
+        if (landing_pad == 0) {
+            return false;
+        }
+        pad = {landing_pad_base + landing_pad, 0, action == 0};
+        if (action == 0) {
+            return true;
+        }
+        const uint8_t* record = actions + action - 1;
+        while (true) {
+            intptr_t filter = read_sleb128(&record);
+            const uint8_t* next = record;
+            intptr_t displacement = read_sleb128(&record);
+            if (filter > 0 && is_kotlin) {
+                const uint8_t* entry = types - filter * encoded_size(type_encoding);
+                auto* type = reinterpret_cast<const kt_exception_type*>(read_encoded_pointer(&entry, type_encoding));
+                // Null is the catch-all of Exception
+                if (type == nullptr || type == thrown) {
+                    pad.selector = filter;
+                    return true;
+                }
+            } else if (filter == 0) {
+                pad.cleanup = true;
+            }
+            if (displacement == 0) {
+                return true;
+            }
+            record = next + displacement;
+        }
+    }
+    return false;
+}
+
+_Unwind_Reason_Code kt_personality(int version, _Unwind_Action actions, uint64_t exception_class,
+                                   _Unwind_Exception* unwind_exception, _Unwind_Context* context) {
+    if (version != 1 || unwind_exception == nullptr || context == nullptr) {
+        return _URC_FATAL_PHASE1_ERROR;
+    }
+    bool is_kotlin = exception_class == kotlin_exception_class;
+    const kt_exception_type* thrown = is_kotlin ? header_of(unwind_exception)->type : nullptr;
+    LandingPad pad{};
+    if (!find_landing_pad(context, thrown, is_kotlin, pad)) {
+        return _URC_CONTINUE_UNWIND;
+    }
+    if (actions & _UA_SEARCH_PHASE) {
+        return pad.selector > 0 && !(actions & _UA_FORCE_UNWIND) ? _URC_HANDLER_FOUND : _URC_CONTINUE_UNWIND;
+    }
+    intptr_t selector = (actions & _UA_HANDLER_FRAME) ? pad.selector : 0;
+    if (selector == 0 && !pad.cleanup) {
+        return _URC_CONTINUE_UNWIND;
+    }
+    _Unwind_SetGR(context, __builtin_eh_return_data_regno(0), reinterpret_cast<uintptr_t>(unwind_exception));
+    _Unwind_SetGR(context, __builtin_eh_return_data_regno(1), static_cast<uintptr_t>(selector));
+    _Unwind_SetIP(context, pad.address);
+    return _URC_INSTALL_CONTEXT;
+}
@@ -0,0 +1,367 @@
+// Garbage collected heap for objects of heap classes.
+//
+// Memory is split into 32 KiB blocks of 128 byte lines (mark-region, after Immix). Every thread bump-allocates
+// through runs of free lines ("holes") in its own block, so allocating is a pointer increment and only taking a
+// new block needs the global lock. Objects above 8 KiB get their own malloc'd chunk.
+//
+// Collection is non-moving: live objects are marked from the roots on LLVM's shadow stack (llvm.gcroot
+// with the "shadow-stack" strategy, emitted by the compiler), which also marks the lines they occupy. Blocks
+// without marked lines become free again, blocks with some free lines are reused hole by hole. A collection
+// runs when the memory handed out since the last one exceeds twice the live data; it assumes that no other
+// thread is allocating at the same time, which is why the compiler keeps heap objects out of parallel loops and
+// allocating in one aborts (the compiler cannot see into the functions of other modules).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+
+#include "runtime.hpp"
+
+static const size_t block_size = 32 * 1024;
+static const size_t line_size = 128;
+static const size_t lines_per_block = block_size / line_size;
+static const size_t max_medium_size = 8 * 1024;
+static const size_t min_heap_budget = 4 * 1024 * 1024;
+
+struct ObjectHeader {
+    const kt_type_info* type;
+    uint32_t mark;
+    // Including the header, objects larger than max_medium_size live outside of the blocks and objects the
+    // compiler placed on the stack have a size of 0
+    uint32_t size;
+};
+
+struct LargeObject {
+    LargeObject* next;
+    ObjectHeader header;
+};
+
+struct BlockHeader {
+    uint8_t line_marks[lines_per_block];
+};
+
+static const size_t first_line = (sizeof(BlockHeader) + line_size - 1) / line_size;
+
+struct Allocator {
+    char* cursor;
+    char* limit;
+    BlockHeader* block;
+    size_t line;
+    Allocator* next;
+    bool registered;
+};
+
+// Layout of LLVM's shadow stack, one entry per active function with roots
+struct FrameMap {
+    int32_t num_roots;
+    int32_t num_meta;
+};
+
+struct StackEntry {
+    StackEntry* next;
+    const FrameMap* map;
+};
+
+extern "C" {
+// Defined by every module with shadow-stack functions, this definition is for programs without any
+__attribute__((weak)) StackEntry* llvm_gc_root_chain = nullptr;
+}
+
+// Array of pointers that only uses malloc, so the runtime does not need the C++ library
+struct PointerStack {
+    void** items;
+    size_t size;
+    size_t capacity;
+
+    void push(void* item) {
+        if (size == capacity) {
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            items = static_cast<void**>(realloc(items, capacity * sizeof(void*)));
+            if (items == nullptr) {
+                fputs("kotlin-llvm runtime: out of memory\n", stderr);
+                abort();
+            }
+        }
+        items[size++] = item;
+    }
+
+    void* pop() {
+        return items[--size];
+    }
+};
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static PointerStack all_blocks;
+static PointerStack free_blocks;
+static PointerStack recyclable_blocks;
+static LargeObject* large_objects = nullptr;
+static Allocator* allocators = nullptr;
+static thread_local Allocator allocator;
+
+static size_t allocated_since_collection = 0;
+static size_t heap_budget = min_heap_budget;
+static uint32_t mark_epoch = 0;
+static size_t collections = 0;
+
+// Unlinks the allocator of an exiting thread, the collector must not walk it afterwards. The block it was
+// filling is swept by the next collection like any other. A pthread key rather than a C++ destructor, so the
+// runtime still only needs libc.
+static pthread_key_t allocator_key;
+static pthread_once_t allocator_key_once = PTHREAD_ONCE_INIT;
+
+static void unregister_allocator(void* exiting) {
+    pthread_mutex_lock(&heap_lock);
+    Allocator** link = &allocators;
+    while (*link != exiting) {
+        link = &(*link)->next;
+    }
+    *link = (*link)->next;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+static void create_allocator_key() {
+    pthread_key_create(&allocator_key, unregister_allocator);
+}
+
+static void print_statistics() {
+    fprintf(stderr, "kotlin-llvm runtime: %zu collections, %zu blocks, budget %zu bytes\n",
+            collections, all_blocks.size, heap_budget);
+}
+
+// Runs when the program first uses the heap rather than in a constructor: the compiler links the runtime for
+// --run, and must not print statistics of its own when it only emits code.
+static pthread_once_t heap_start_once = PTHREAD_ONCE_INIT;
+
+static void start_heap() {
+    if (getenv("KOTLIN_LLVM_GC_STATS") != nullptr) {
+        atexit(print_statistics);
+    }
+}
+
+static void* checked(void* memory) {
+    if (memory == nullptr) {
+        fputs("kotlin-llvm runtime: out of memory\n", stderr);
+        abort();
+    }
+    return memory;
+}
+
+static BlockHeader* block_of(const void* address) {
+    return reinterpret_cast<BlockHeader*>(reinterpret_cast<uintptr_t>(address) & ~(block_size - 1));
+}
+
+static void mark_object(void* object, PointerStack& mark_stack, size_t& live_bytes) {
+    if (object == nullptr) {
+        return;
+    }
+    ObjectHeader* header = static_cast<ObjectHeader*>(object) - 1;
+    // Nothing to free or trace, and the closures of lambdas without captures are read-only constants
+    if (header->size == 0 && header->type->pointer_count == 0) {
+        return;
+    }
+    if (header->mark == mark_epoch) {
+        return;
+    }
+    header->mark = mark_epoch;
+    live_bytes += header->size;
+
+    if (header->size != 0 && header->size <= max_medium_size) {
+        BlockHeader* block = block_of(header);
+        size_t offset = reinterpret_cast<char*>(header) - reinterpret_cast<char*>(block);
+        size_t last_line = (offset + header->size - 1) / line_size;
+        for (size_t line = offset / line_size; line <= last_line; line++) {
+            block->line_marks[line] = 1;
+        }
+    }
+    mark_stack.push(object);
+}
+
+static void collect_locked() {
+    mark_epoch++;
+    collections++;
+
+    // Threads start over with a new block, the one they were filling is swept like all others
+    for (Allocator* thread_allocator = allocators; thread_allocator != nullptr; thread_allocator = thread_allocator->next) {
+        thread_allocator->cursor = nullptr;
+        thread_allocator->limit = nullptr;
+        thread_allocator->block = nullptr;
+    }
+    for (size_t i = 0; i < all_blocks.size; i++) {
+        memset(static_cast<BlockHeader*>(all_blocks.items[i])->line_marks, 0, lines_per_block);
+    }
+
+    PointerStack mark_stack{};
+    size_t live_bytes = 0;
+    for (StackEntry* entry = llvm_gc_root_chain; entry != nullptr; entry = entry->next) {
+        void** roots = reinterpret_cast<void**>(entry + 1);
+        for (int32_t i = 0; i < entry->map->num_roots; i++) {
+            mark_object(roots[i], mark_stack, live_bytes);
+        }
+    }
+    while (mark_stack.size > 0) {
+        char* object = static_cast<char*>(mark_stack.pop());
+        const kt_type_info* type = (reinterpret_cast<ObjectHeader*>(object) - 1)->type;
+        for (uint32_t i = 0; i < type->pointer_count; i++) {
+            mark_object(*reinterpret_cast<void**>(object + type->pointer_offsets[i]), mark_stack, live_bytes);
+        }
+    }
+    free(mark_stack.items);
+
+    free_blocks.size = 0;
+    recyclable_blocks.size = 0;
+    for (size_t i = 0; i < all_blocks.size; i++) {
+        auto* block = static_cast<BlockHeader*>(all_blocks.items[i]);
+        size_t free_lines = 0;
+        for (size_t line = first_line; line < lines_per_block; line++) {
+            free_lines += block->line_marks[line] == 0;
+        }
+        if (free_lines == lines_per_block - first_line) {
+            free_blocks.push(block);
+        } else if (free_lines > 0) {
+            recyclable_blocks.push(block);
+        }
+    }
+
+    LargeObject** link = &large_objects;
+    while (*link != nullptr) {
+        LargeObject* large = *link;
+        if (large->header.mark != mark_epoch) {
+            *link = large->next;
+            free(large);
+        } else {
+            link = &large->next;
+        }
+    }
+
+    allocated_since_collection = 0;
+    heap_budget = live_bytes * 2 > min_heap_budget ? live_bytes * 2 : min_heap_budget;
+}
+
+// Moves the allocator to the next run of free lines in its block
+static bool next_hole() {
+    BlockHeader* block = allocator.block;
+    size_t line = allocator.line;
+    while (line < lines_per_block && block->line_marks[line] != 0) {
+        line++;
+    }
+    if (line == lines_per_block) {
+        return false;
+    }
+    size_t end = line;
+    while (end < lines_per_block && block->line_marks[end] == 0) {
+        end++;
+    }
+    allocator.cursor = reinterpret_cast<char*>(block) + line * line_size;
+    allocator.limit = reinterpret_cast<char*>(block) + end * line_size;
+    allocator.line = end;
+    memset(allocator.cursor, 0, allocator.limit - allocator.cursor);
+    return true;
+}
+
+static void take_block() {
+    if (!allocator.registered) {
+        pthread_once(&heap_start_once, start_heap);
+        pthread_once(&allocator_key_once, create_allocator_key);
+        pthread_setspecific(allocator_key, &allocator);
+    }
+    pthread_mutex_lock(&heap_lock);
+    if (!allocator.registered) {
+        allocator.registered = true;
+        allocator.next = allocators;
+        allocators = &allocator;
+    }
+    if (allocated_since_collection >= heap_budget) {
+        collect_locked();
+    }
+
+    BlockHeader* block;
+    if (recyclable_blocks.size > 0) {
+        block = static_cast<BlockHeader*>(recyclable_blocks.pop());
+    } else if (free_blocks.size > 0) {
+        block = static_cast<BlockHeader*>(free_blocks.pop());
+    } else {
+        block = static_cast<BlockHeader*>(checked(aligned_alloc(block_size, block_size)));
+        memset(block->line_marks, 0, lines_per_block);
+        all_blocks.push(block);
+    }
+    allocated_since_collection += block_size;
+    pthread_mutex_unlock(&heap_lock);
+
+    allocator.block = block;
+    allocator.line = first_line;
+}
+
+static char* refill(size_t size) {
+    for (;;) {
+        while (allocator.block != nullptr && next_hole()) {
+            if (static_cast<size_t>(allocator.limit - allocator.cursor) >= size) {
+                return allocator.cursor;
+            }
+        }
+        take_block();
+    }
+}
+
+static void* allocate_large(const kt_type_info* type, size_t size) {
+    auto* large = static_cast<LargeObject*>(checked(calloc(1, sizeof(LargeObject) - sizeof(ObjectHeader) + size)));
+    large->header.type = type;
+    large->header.size = static_cast<uint32_t>(size);
+
+    pthread_once(&heap_start_once, start_heap);
+    pthread_mutex_lock(&heap_lock);
+    if (allocated_since_collection >= heap_budget) {
+        collect_locked();
+    }
+    allocated_since_collection += size;
+    large->next = large_objects;
+    large_objects = large;
+    pthread_mutex_unlock(&heap_lock);
+    return &large->header + 1;
+}
+
+// Payload sizes are rounded up to 8 bytes, so every payload is 8 byte aligned
+static void* allocate(const kt_type_info* type, size_t payload_size) {
+    if (kt_in_parallel_body()) {
+        fputs("kotlin-llvm runtime: heap objects cannot be allocated in a parallel loop\n", stderr);
+        abort();
+    }
+    size_t size = (sizeof(ObjectHeader) + payload_size + 7) & ~static_cast<size_t>(7);
+    if (size > UINT32_MAX) {
+        fputs("kotlin-llvm runtime: object too large\n", stderr);
+        abort();
+    }
+    if (size > max_medium_size) {
+        return allocate_large(type, size);
+    }
+
+    char* start = allocator.cursor;
+    if (start == nullptr || static_cast<size_t>(allocator.limit - start) < size) {
+        start = refill(size);
+    }
+    allocator.cursor = start + size;
+
+    auto* header = reinterpret_cast<ObjectHeader*>(start);
+    header->type = type;
+    header->mark = 0;
+    header->size = static_cast<uint32_t>(size);
+    return header + 1;
+}
+
+extern "C" void* kt_alloc(const kt_type_info* type) {
+    return allocate(type, type->size);
+}
+
+// Arrays have no references and their size is only recorded in the object header
+static const kt_type_info array_type = {0, 0, nullptr, "Array"};
+
+extern "C" void* kt_alloc_array(size_t size) {
+    return allocate(&array_type, size);
+}
+
+extern "C" void kt_gc_collect() {
+    pthread_mutex_lock(&heap_lock);
+    collect_locked();
+    pthread_mutex_unlock(&heap_lock);
+}
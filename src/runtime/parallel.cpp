@@ -0,0 +1,206 @@
+// Work-stealing thread pool for parallelFor and parallelSum.
+//
+// The compiler outlines a parallel loop into a function that runs one chunk of the range, and kt_parallel_for splits
+// the range into a fixed number of equal chunks. Every worker owns a deque of chunk intervals: it takes the newest
+// interval from its own end, halves it until a single chunk is left and pushes the other halves back, while idle
+// workers steal the oldest (largest) intervals from the other end of someone else's deque. The calling thread works
+// as worker 0, the others are started the first time a loop runs, one per online core (or KOTLIN_LLVM_THREADS).
+// Loops nested in a parallel body run serially on the worker that reaches them.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "runtime.hpp"
+
+typedef void (*kt_parallel_body)(void* context, int64_t start, int64_t end, int32_t chunk);
+
+// Splitting by halves keeps at most log2(chunks) + 1 intervals in a deque
+static const int deque_capacity = 64;
+
+struct Interval {
+    int32_t first;
+    int32_t last;
+};
+
+struct Worker {
+    pthread_mutex_t lock;
+    Interval intervals[deque_capacity];
+    // Thieves take from head, the owner pushes and pops at tail
+    int head;
+    int tail;
+};
+
+struct Job {
+    kt_parallel_body body;
+    void* context;
+    int64_t start;
+    int64_t count;
+    int32_t chunks;
+    int32_t remaining;
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static Worker* workers = nullptr;
+static int worker_count = 1;
+
+static Job job;
+static bool job_running = false;
+static uint64_t job_generation = 0;
+// Workers inside run_job, the caller waits for them to leave before the job can be reused
+static int busy_workers = 0;
+
+static thread_local bool in_parallel_body = false;
+
+extern "C" bool kt_in_parallel_body() {
+    return in_parallel_body;
+}
+
+static void push(Worker& worker, Interval interval) {
+    pthread_mutex_lock(&worker.lock);
+    if (worker.tail == deque_capacity) {
+        // Only stolen-from deques drift, move what is left back to the front
+        for (int i = worker.head; i < worker.tail; i++) {
+            worker.intervals[i - worker.head] = worker.intervals[i];
+        }
+        worker.tail -= worker.head;
+        worker.head = 0;
+    }
+    worker.intervals[worker.tail++] = interval;
+    pthread_mutex_unlock(&worker.lock);
+}
+
+static bool pop(Worker& worker, Interval& interval) {
+    pthread_mutex_lock(&worker.lock);
+    bool found = worker.tail > worker.head;
+    if (found) {
+        interval = worker.intervals[--worker.tail];
+    }
+    pthread_mutex_unlock(&worker.lock);
+    return found;
+}
+
+static bool steal(Worker& worker, Interval& interval) {
+    pthread_mutex_lock(&worker.lock);
+    bool found = worker.tail > worker.head;
+    if (found) {
+        interval = worker.intervals[worker.head++];
+    }
+    pthread_mutex_unlock(&worker.lock);
+    return found;
+}
+
+static void run_chunk(int32_t chunk) {
+    int64_t start = job.start + job.count * chunk / job.chunks;
+    int64_t end = job.start + job.count * (chunk + 1) / job.chunks;
+    job.body(job.context, start, end, chunk);
+    __atomic_sub_fetch(&job.remaining, 1, __ATOMIC_ACQ_REL);
+}
+
+// Works on the current job until all of its chunks are done
+static void run_job(int self) {
+    in_parallel_body = true;
+    while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+        Interval interval;
+        bool found = pop(workers[self], interval);
+        for (int i = 1; !found && i < worker_count; i++) {
+            found = steal(workers[(self + i) % worker_count], interval);
+        }
+        if (!found) {
+            sched_yield();
+            continue;
+        }
+        while (interval.last - interval.first > 1) {
+            int32_t middle = interval.first + (interval.last - interval.first) / 2;
+            push(workers[self], Interval{middle, interval.last});
+            interval.last = middle;
+        }
+        run_chunk(interval.first);
+    }
+    in_parallel_body = false;
+}
+
+static void* worker_main(void* argument) {
+    int self = static_cast<int>(reinterpret_cast<intptr_t>(argument));
+    uint64_t seen_generation = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!job_running || job_generation == seen_generation) {
+            pthread_cond_wait(&pool_wakeup, &pool_lock);
+        }
+        seen_generation = job_generation;
+        __atomic_add_fetch(&busy_workers, 1, __ATOMIC_ACQ_REL);
+        pthread_mutex_unlock(&pool_lock);
+
+        run_job(self);
+        __atomic_sub_fetch(&busy_workers, 1, __ATOMIC_ACQ_REL);
+    }
+    return nullptr;
+}
+
+static void start_pool() {
+    const char* threads = getenv("KOTLIN_LLVM_THREADS");
+    long count = threads != nullptr ? atol(threads) : sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = count > 1 ? static_cast<int>(count) : 1;
+
+    workers = static_cast<Worker*>(calloc(worker_count, sizeof(Worker)));
+    if (workers == nullptr) {
+        fputs("kotlin-llvm runtime: out of memory\n", stderr);
+        abort();
+    }
+    for (int i = 0; i < worker_count; i++) {
+        pthread_mutex_init(&workers[i].lock, nullptr);
+    }
+    for (int i = 1; i < worker_count; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, worker_main, reinterpret_cast<void*>(static_cast<intptr_t>(i))) != 0) {
+            worker_count = i;
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+extern "C" void kt_parallel_for(int64_t start, int64_t end, int32_t chunks, kt_parallel_body body, void* context) {
+    if (chunks <= 0) {
+        return;
+    }
+    pthread_once(&pool_once, start_pool);
+    if (in_parallel_body || worker_count == 1 || chunks == 1) {
+        // Held to the same rules as on the pool, whatever the thread count
+        bool nested = in_parallel_body;
+        in_parallel_body = true;
+        for (int32_t chunk = 0; chunk < chunks; chunk++) {
+            body(context, start + (end - start) * chunk / chunks, start + (end - start) * (chunk + 1) / chunks, chunk);
+        }
+        in_parallel_body = nested;
+        return;
+    }
+
+    // One loop at a time, when several threads start one
+    pthread_mutex_lock(&job_lock);
+    job = Job{body, context, start, end - start, chunks, chunks};
+    push(workers[0], Interval{0, chunks});
+
+    pthread_mutex_lock(&pool_lock);
+    job_running = true;
+    job_generation++;
+    pthread_cond_broadcast(&pool_wakeup);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_job(0);
+
+    pthread_mutex_lock(&pool_lock);
+    job_running = false;
+    pthread_mutex_unlock(&pool_lock);
+    while (__atomic_load_n(&busy_workers, __ATOMIC_ACQUIRE) > 0) {
+        sched_yield();
+    }
+    pthread_mutex_unlock(&job_lock);
+}
@@ -0,0 +1,148 @@
+#ifndef KOTLIN_LLVM_RUNTIME_HPP
+#define KOTLIN_LLVM_RUNTIME_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <unwind.h>
+
+// Interface between the code emitted by kotlin-llvm and libkotlin-llvm-runtime.
+// Programs that use heap classes, suspend functions, parallel loops or exceptions (which includes the checks of
+// integer division by a variable and of collection indices) have to be linked against the runtime library.
+
+extern "C" {
+
+// Emitted by the compiler as a constant for every heap class
+struct kt_type_info {
+    uint32_t size;
+    uint32_t pointer_count;
+    // Offsets of the fields holding references, relative to the start of the object
+    const uint32_t* pointer_offsets;
+    const char* name;
+};
+
+// Objects are preceded by a 16 byte header: the kt_type_info pointer, a 32 bit mark and a 32 bit size. The
+// compiler gives objects that do not escape their function a header with size 0 and keeps them on the stack.
+
+// Returns a zeroed object of the given type, collecting garbage first when the heap budget is used up
+void* kt_alloc(const kt_type_info* type);
+
+// Returns a zeroed object of the given number of bytes without references, for the buffers of collections
+void* kt_alloc_array(size_t size);
+
+// Forces a full collection
+void kt_gc_collect();
+
+// ArrayList<T>, HashSet<T> and HashMap<K, V>, see collections.cpp. The compiler generates their operations for the
+// element types and only calls into the runtime to create them, to grow them and to report errors.
+
+struct kt_list {
+    // kt_alloc_array buffer of capacity elements
+    void* data;
+    int32_t size;
+    int32_t capacity;
+};
+
+// Open addressing with SwissTable control bytes: one byte per slot, which is kt_hash_empty, kt_hash_deleted or
+// the low 7 bits of the hash of the key in the slot. The control bytes of the first 16 slots are repeated after
+// the last one, so a group of 16 can be loaded at any slot.
+struct kt_hash_table {
+    // kt_alloc_array buffer of capacity + 16 control bytes followed by the keys and the values, which the
+    // other two fields point to
+    int8_t* control;
+    void* keys;
+    void* values;
+    int32_t size;
+    // capacity - 1, capacity is a power of two of at least 16. New tables have a mask of 0 and share a single
+    // empty group.
+    int32_t mask;
+    // Slots that can still be filled before the table has to grow, to keep it at most 7/8 full
+    int32_t growth_left;
+};
+
+enum {
+    kt_hash_empty = -128,
+    kt_hash_deleted = -2
+};
+
+void* kt_list_new();
+// Makes room for at least one more element
+void kt_list_grow(kt_list* list, int32_t element_size);
+
+void* kt_hash_table_new();
+// Rehashes into a table with room for at least one more key, sets have a value_size of 0. Keys are hashed by
+// their bits, zero extended to 64 bits, with kt_hash_bits.
+void kt_hash_table_grow(kt_hash_table* table, int32_t key_size, int32_t value_size);
+
+static inline uint64_t kt_hash_bits(uint64_t bits) {
+    uint64_t hash = bits * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+// Exceptions, see exceptions.cpp. A thrown value is copied into an exception object, unwound to with the Itanium
+// C++ ABI's two-phase unwinder and copied out again by the catch that matches its class.
+
+// Identifies the class of thrown values, one constant per class. The built-in exception classes are defined
+// here, the compiler emits the others.
+struct kt_exception_type {
+    // Printed for an exception nobody catches
+    const char* name;
+    // Offset of the `message: String` property in the value, -1 when the class has none
+    int32_t message_offset;
+};
+
+extern const kt_exception_type kt_exception_Exception;
+extern const kt_exception_type kt_exception_RuntimeException;
+extern const kt_exception_type kt_exception_ArithmeticException;
+extern const kt_exception_type kt_exception_IndexOutOfBoundsException;
+extern const kt_exception_type kt_exception_NoSuchElementException;
+extern const kt_exception_type kt_exception_IllegalArgumentException;
+extern const kt_exception_type kt_exception_IllegalStateException;
+
+// Returns the storage for the value of a new exception, which is thrown by kt_throw once the value is stored
+void* kt_allocate_exception(size_t size);
+// Unwinds to the innermost catch for the type, running the finally blocks on the way. Without one the exception
+// is reported and the program exits.
+[[noreturn]] void kt_throw(void* value, const kt_exception_type* type);
+
+// Used by the landing pads with the exception object they receive: the value of the exception, freeing it
+// once the value is copied out, and its message (or the name of its class) for `catch (e: Exception)`
+void* kt_begin_catch(void* exception);
+void kt_end_catch(void* exception);
+const char* kt_exception_message(void* exception);
+
+// Personality routine of the functions with try blocks
+_Unwind_Reason_Code kt_personality(int version, _Unwind_Action actions, uint64_t exception_class,
+                                   _Unwind_Exception* unwind_exception, _Unwind_Context* context);
+
+// Throw the built-in exceptions of the checks in generated code
+[[noreturn]] void kt_division_by_zero();
+[[noreturn]] void kt_index_out_of_bounds(int32_t index, int32_t size);
+[[noreturn]] void kt_no_such_element(const char* message);
+
+// Coroutine handles are the frames of LLVM's switched-resume coroutines, see coroutines.cpp
+
+// Queues the coroutine to be resumed by the event loop
+void kt_coro_schedule(void* handle);
+
+// Queues the coroutine to be resumed once the given time has passed
+void kt_coro_delay(void* handle, int64_t milliseconds);
+
+// Runs the event loop until no coroutine is queued or waiting for a delay
+void kt_coro_run();
+
+// Splits [start, end) into `chunks` contiguous parts of nearly equal size and calls body for each of them, with the
+// chunk's index, on the worker pool. Returns when all chunks are done.
+void kt_parallel_for(int64_t start, int64_t end, int32_t chunks,
+                     void (*body)(void* context, int64_t start, int64_t end, int32_t chunk), void* context);
+
+// Whether the calling thread is running the body of a parallel loop, for the heap to refuse allocations
+bool kt_in_parallel_body();
+
+// The x86-64 microarchitecture level of the CPU (1 to 4), which picks the clone of a multiversioned function. Called
+// by ifunc resolvers, before the program's constructors have run.
+int32_t kt_cpu_level();
+
+}
+
+#endif //KOTLIN_LLVM_RUNTIME_HPP
@@ -1,6 +1,48 @@
 #include "allocation.hpp"
 
+#include "llvm/IR/Intrinsics.h"
+
+#include "coroutine.hpp"
+#include "parallel.hpp"
+
+extern llvm::IRBuilder<> builder;
+
+extern void yyerror(std::string msg);
+
 llvm::AllocaInst *create_entry_block_alloca(llvm::Function *function, const std::string &var_name, llvm::Type* type) {
     llvm::IRBuilder<> tmp_builder(&function->getEntryBlock(), function->getEntryBlock().begin());
     return tmp_builder.CreateAlloca(type, nullptr, var_name);
 }
+
+llvm::AllocaInst *create_gc_root(llvm::Function *function, const std::string &var_name, llvm::Type* type) {
+    llvm::AllocaInst* alloca = create_entry_block_alloca(function, var_name, type);
+    register_gc_root(alloca);
+    return alloca;
+}
+
+void register_gc_root(llvm::AllocaInst* alloca) {
+    llvm::Function* function = alloca->getFunction();
+    // Roots moved into a coroutine frame would not be on the shadow stack while it is suspended
+    if (current_coroutine != nullptr) {
+        yyerror("Heap objects cannot be used in suspend function " + function->getName().str());
+    }
+    // The collector only scans the shadow stack of the thread that triggers it
+    if (parallel_body_depth > 0) {
+        yyerror("Heap objects cannot be used in parallel loops");
+    }
+    llvm::IRBuilder<> tmp_builder(alloca->getParent(), std::next(alloca->getIterator()));
+
+    // The shadow-stack strategy links a frame of all roots into llvm_gc_root_chain and nulls them on entry
+    function->setGC("shadow-stack");
+    llvm::Type* i8_ptr = llvm::Type::getInt8PtrTy(function->getContext());
+    llvm::Value* root = tmp_builder.CreateBitCast(alloca, i8_ptr->getPointerTo());
+    llvm::Function* gcroot = llvm::Intrinsic::getDeclaration(function->getParent(), llvm::Intrinsic::gcroot);
+    tmp_builder.CreateCall(gcroot, {root, llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8_ptr))});
+}
+
+llvm::Value* root_temporary(llvm::Value* reference) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    llvm::AllocaInst* root = create_gc_root(function, "tmproot", reference->getType());
+    builder.CreateStore(reference, root);
+    return reference;
+}
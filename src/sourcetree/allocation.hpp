@@ -9,4 +9,13 @@
 
 llvm::AllocaInst* create_entry_block_alloca(llvm::Function* function, const std::string& var_name, llvm::Type* type);
 
+// Entry block alloca registered with llvm.gcroot, for variables that point into the garbage collected heap
+llvm::AllocaInst* create_gc_root(llvm::Function* function, const std::string& var_name, llvm::Type* type);
+// Makes an entry block alloca a GC root
+void register_gc_root(llvm::AllocaInst* alloca);
+
+// Keeps a reference that is not stored in a variable (a new object, a call result, a loaded property)
+// reachable until the current function returns, so it survives allocations while it is still in use
+llvm::Value* root_temporary(llvm::Value* reference);
+
 #endif //KOTLIN_LLVM_ALLOCATION_HPP
@@ -3,19 +3,36 @@
 #include "ast.hpp"
 #include "statement.hpp"
 #include "parser.tab.hpp"
+#include "conversion.hpp"
+#include "classes.hpp"
+#include "allocation.hpp"
+#include "coroutine.hpp"
+#include "parallel.hpp"
+#include "interpreter.hpp"
+#include "intrinsics.hpp"
+#include "collections.hpp"
+#include "lambdas.hpp"
+#include "imports.hpp"
+#include "exceptions.hpp"
+#include "driver/options.hpp"
 
 #include "llvm/IR/Value.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 
 extern llvm::LLVMContext context;
 extern std::map<std::string, llvm::AllocaInst*> named_values;
+extern std::map<std::string, Type> named_types;
 extern llvm::IRBuilder<> builder;
 extern llvm::Module* module;
 
 extern void yyerror(std::string msg);
 
+unsigned long created_ast_nodes = 0;
+
 llvm::Type* type_to_llvm_type(Type type) {
     switch (type) {
         case INT:
@@ -24,6 +41,21 @@ llvm::Type* type_to_llvm_type(Type type) {
             return llvm::Type::getDoubleTy(context);
         case STRING:
             return llvm::Type::getInt8PtrTy(context);
+        case LONG:
+            return llvm::Type::getInt64Ty(context);
+        case FLOAT:
+            return llvm::Type::getFloatTy(context);
+        case SHORT:
+        case CHAR:
+            return llvm::Type::getInt16Ty(context);
+        case BYTE:
+            return llvm::Type::getInt8Ty(context);
+        case BOOLEAN:
+            return llvm::Type::getInt1Ty(context);
+        case UNIT:
+            return llvm::Type::getVoidTy(context);
+        default:
+            return class_info(type).llvm_type;
     }
 }
 
@@ -31,10 +63,22 @@ llvm::Value *IntExprAST::codegen() {
     return llvm::ConstantInt::get(context, llvm::APInt(32, _value));
 }
 
+llvm::Value *LongExprAST::codegen() {
+    return llvm::ConstantInt::get(context, llvm::APInt(64, _value, true));
+}
+
 llvm::Value *DoubleExprAST::codegen() {
     return llvm::ConstantFP::get(context, llvm::APFloat(_value));
 }
 
+llvm::Value *FloatExprAST::codegen() {
+    return llvm::ConstantFP::get(context, llvm::APFloat(_value));
+}
+
+llvm::Value *CharExprAST::codegen() {
+    return llvm::ConstantInt::get(context, llvm::APInt(16, _value));
+}
+
 llvm::Value* ConstStringExprAST::codegen() {
     return builder.CreateGlobalStringPtr(llvm::StringRef(_value));
 }
@@ -44,12 +88,37 @@ llvm::Value *ConstBooleanExprAST::codegen() {
 }
 
 llvm::Value *VarExprAST::codegen() {
-    llvm::Value* value = named_values[_id];
+    auto inlined = inline_functions.find(_id);
+    if (inlined != inline_functions.end()) {
+        return function_value(*inlined->second);
+    }
+    llvm::AllocaInst* value = named_values[_id];
+    const ConstValue* constant = value == nullptr ? find_const(_id) : nullptr;
+    if (constant != nullptr) {
+        return constant->value;
+    }
     if (value == nullptr) {
         std::cerr << "Unknown variable name: " << _id << std::endl;
         exit(EXIT_FAILURE);
     }
-    return builder.CreateLoad(value, _id);
+    return builder.CreateLoad(value->getAllocatedType(), value, _id);
+}
+
+llvm::Value *VarExprAST::address() {
+    return named_values[_id];
+}
+
+Type VarExprAST::type() {
+    auto found = named_types.find(_id);
+    const ConstValue* constant = found == named_types.end() ? find_const(_id) : nullptr;
+    if (constant != nullptr) {
+        return constant->type;
+    }
+    if (found == named_types.end()) {
+        std::cerr << "Unknown variable name: " << _id << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return found->second;
 }
 
 UnaryExprAST::~UnaryExprAST() {
@@ -57,19 +126,128 @@ UnaryExprAST::~UnaryExprAST() {
 }
 
 llvm::Value *InvExprAST::codegen() {
+    Type operation_type = type();
     llvm::Value *value_first = _first->codegen();
     if (value_first == nullptr) {
         yyerror("Error");
     }
-    return builder.CreateNot(value_first, "invtmp");
+    return builder.CreateNot(convert_value(value_first, _first->type(), operation_type), "invtmp");
+}
+
+Type InvExprAST::type() {
+    Type operation_type = arithmetic_type(_first->type(), INT);
+    if (!is_integral(operation_type)) {
+        yyerror("inv() is not defined for " + type_name(_first->type()));
+    }
+    return operation_type;
 }
 
 llvm::Value *NotLExprAST::codegen() {
+    if (_first->type() != BOOLEAN) {
+        yyerror("Must be boolean");
+    }
     llvm::Value *value_first = _first->codegen();
     if (value_first == nullptr) {
         yyerror("Error");
     }
-    return llvm::ConstantInt::get(context, llvm::APInt(1, value_first ? 0 : 1));
+    return builder.CreateNot(value_first, "nottmp");
+}
+
+// With -ffp-contract=on, a product that feeds an addition in the same expression is emitted as
+// llvm.fmuladd, so the backend may fuse it into an FMA
+static llvm::BinaryOperator* contractible_product(llvm::Value* value) {
+    if (options.fp_contract != FPContract::On) {
+        return nullptr;
+    }
+    auto* product = llvm::dyn_cast<llvm::BinaryOperator>(value);
+    if (product == nullptr || product->getOpcode() != llvm::Instruction::FMul || !product->use_empty()) {
+        return nullptr;
+    }
+    return product;
+}
+
+static llvm::Value* create_fmuladd(llvm::BinaryOperator* product, llvm::Value* addend, const std::string& name) {
+    llvm::Function* fmuladd = llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::fmuladd, product->getType());
+    llvm::Value* result = builder.CreateCall(fmuladd, {product->getOperand(0), product->getOperand(1), addend}, name);
+    product->eraseFromParent();
+    return result;
+}
+
+// Comparisons of two Chars or two Booleans are unsigned, everything else is promoted like arithmetic
+static Type comparison_type(Type first, Type second) {
+    if (first == second && is_unsigned(first)) {
+        return first;
+    }
+    return arithmetic_type(first, second);
+}
+
+// and/or/xor work on two Booleans or on integers (Int or Long after promotion)
+static Type bitwise_type(Type first, Type second) {
+    if (first == BOOLEAN && second == BOOLEAN) {
+        return BOOLEAN;
+    }
+    Type operation_type = arithmetic_type(first, second);
+    if (!is_integral(operation_type)) {
+        yyerror("Bitwise operations are not defined for " + type_name(first) + " and " + type_name(second));
+    }
+    return operation_type;
+}
+
+// Shift amounts are taken modulo the bit width, as on the JVM
+static llvm::Value* shift_amount(llvm::Value* amount, Type operation_type) {
+    unsigned bits = type_to_llvm_type(operation_type)->getIntegerBitWidth();
+    return builder.CreateAnd(amount, llvm::ConstantInt::get(type_to_llvm_type(operation_type), bits - 1), "shamt");
+}
+
+// Throws ArithmeticException, the runtime keeps it out of line so the checks only cost a compare and a branch
+static llvm::FunctionCallee division_by_zero_function() {
+    llvm::FunctionCallee function = module->getOrInsertFunction("kt_division_by_zero", builder.getVoidTy());
+    auto* declaration = llvm::cast<llvm::Function>(function.getCallee());
+    declaration->addFnAttr(llvm::Attribute::NoReturn);
+    declaration->addFnAttr(llvm::Attribute::Cold);
+    return function;
+}
+
+llvm::Value* integer_division(llvm::Value* dividend, llvm::Value* divisor, bool remainder, const std::string& name) {
+    auto divided_by_minus_one = [&] {
+        return remainder ? llvm::ConstantInt::get(dividend->getType(), 0) : builder.CreateNeg(dividend);
+    };
+    if (auto* constant = llvm::dyn_cast<llvm::ConstantInt>(divisor)) {
+        if (constant->isMinusOne()) {
+            return divided_by_minus_one();
+        }
+        // Folded by the builder when the dividend is a constant too, which the interpreter relies on
+        if (!constant->isZero()) {
+            return remainder ? builder.CreateSRem(dividend, divisor, name) : builder.CreateSDiv(dividend, divisor, name);
+        }
+    }
+    // Both checks stay in the IR, the range analysis of the optimizer removes them where the divisor can
+    // provably be neither 0 nor -1
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock* zero_block = llvm::BasicBlock::Create(context, "div_by_zero", function);
+    llvm::BasicBlock* nonzero_block = llvm::BasicBlock::Create(context, "div_nonzero", function);
+    builder.CreateCondBr(builder.CreateICmpEQ(divisor, llvm::ConstantInt::get(divisor->getType(), 0), "is_zero"),
+                         zero_block, nonzero_block, llvm::MDBuilder(context).createBranchWeights(1, 2000));
+    builder.SetInsertPoint(zero_block);
+    builder.CreateCall(division_by_zero_function());
+    builder.CreateUnreachable();
+    builder.SetInsertPoint(nonzero_block);
+
+    llvm::Value* is_minus_one = builder.CreateICmpEQ(divisor, llvm::ConstantInt::getSigned(divisor->getType(), -1),
+                                                     "is_minus_one");
+    llvm::Value* safe_divisor = builder.CreateSelect(is_minus_one, llvm::ConstantInt::get(divisor->getType(), 1),
+                                                     divisor);
+    llvm::Value* result = remainder ? builder.CreateSRem(dividend, safe_divisor, name)
+                                    : builder.CreateSDiv(dividend, safe_divisor, name);
+    return builder.CreateSelect(is_minus_one, divided_by_minus_one(), result, name);
+}
+
+static Type shift_type(Type first, Type second) {
+    Type operation_type = arithmetic_type(first, INT);
+    if (!is_integral(operation_type) || !is_integral(second) || second == CHAR) {
+        yyerror("Shifts are not defined for " + type_name(first) + " and " + type_name(second));
+    }
+    return operation_type;
 }
 
 BinaryExprAST::~BinaryExprAST() {
@@ -77,217 +255,483 @@ BinaryExprAST::~BinaryExprAST() {
     delete _second;
 }
 
-llvm::Value *AddExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
+void BinaryExprAST::codegen_operands(Type operation_type, llvm::Value*& value_first, llvm::Value*& value_second) {
+    value_first = _first->codegen();
+    value_second = _second->codegen();
     if (value_first == nullptr || value_second == nullptr) {
         yyerror("Error");
     }
-    else if(value_first->getType() == llvm::Type::getInt32Ty(context) &&
-    value_second->getType() == llvm::Type::getInt32Ty(context))
-        return builder.CreateAdd(value_first, value_second, "addtmp");
-    else
-        return builder.CreateFAdd(value_first, value_second, "addtmp");
+    value_first = convert_value(value_first, _first->type(), operation_type);
+    value_second = convert_value(value_second, _second->type(), operation_type);
+}
+
+llvm::Value *AddExprAST::codegen() {
+    llvm::Value *value_first, *value_second;
+    Type operation_type = arithmetic_type(_first->type(), _second->type());
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_integral(operation_type))
+        return convert_value(builder.CreateAdd(value_first, value_second, "addtmp"), operation_type, type());
+
+    if (llvm::BinaryOperator* product = contractible_product(value_first))
+        return create_fmuladd(product, value_second, "addtmp");
+    if (llvm::BinaryOperator* product = contractible_product(value_second))
+        return create_fmuladd(product, value_first, "addtmp");
+    return builder.CreateFAdd(value_first, value_second, "addtmp");
+}
+
+// Char + Int is the Char that many code points further
+Type AddExprAST::type() {
+    if (_first->type() == CHAR && is_integral(_second->type()) && _second->type() != CHAR) {
+        return CHAR;
+    }
+    return arithmetic_type(_first->type(), _second->type());
 }
 
 llvm::Value *SubExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
+    llvm::Value *value_first, *value_second;
+    Type operation_type = arithmetic_type(_first->type(), _second->type());
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_integral(operation_type))
+        return convert_value(builder.CreateSub(value_first, value_second, "subtmp"), operation_type, type());
+
+    if (llvm::BinaryOperator* product = contractible_product(value_first))
+        return create_fmuladd(product, builder.CreateFNeg(value_second), "subtmp");
+    return builder.CreateFSub(value_first, value_second, "subtmp");
+}
+
+// Char - Int is a Char, Char - Char the Int distance between the two
+Type SubExprAST::type() {
+    if (_first->type() == CHAR && is_integral(_second->type()) && _second->type() != CHAR) {
+        return CHAR;
     }
-    else if(value_first->getType() == llvm::Type::getInt32Ty(context) &&
-            value_second->getType() == llvm::Type::getInt32Ty(context))
-        return builder.CreateSub(value_first, value_second, "subtmp");
-    else
-        return builder.CreateFSub(value_first, value_second, "subtmp");
+    return arithmetic_type(_first->type(), _second->type());
 }
 
 llvm::Value *MulExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
-    else if(value_first->getType() == llvm::Type::getInt32Ty(context) &&
-            value_second->getType() == llvm::Type::getInt32Ty(context))
+    llvm::Value *value_first, *value_second;
+    Type operation_type = type();
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_integral(operation_type))
         return builder.CreateMul(value_first, value_second, "multmp");
-    else
-        return builder.CreateFMul(value_first, value_second, "subtmp");
+    return builder.CreateFMul(value_first, value_second, "multmp");
+}
+
+Type MulExprAST::type() {
+    return arithmetic_type(_first->type(), _second->type());
 }
 
 llvm::Value *DivExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
-    else if(value_first->getType() == llvm::Type::getInt32Ty(context) &&
-            value_second->getType() == llvm::Type::getInt32Ty(context))
-        return builder.CreateSDiv(value_first, value_second, "divtmp");
-    else
-        return builder.CreateFAdd(value_first, value_second, "divtmp");
+    llvm::Value *value_first, *value_second;
+    Type operation_type = type();
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_integral(operation_type))
+        return integer_division(value_first, value_second, false, "divtmp");
+    return builder.CreateFDiv(value_first, value_second, "divtmp");
+}
+
+Type DivExprAST::type() {
+    return arithmetic_type(_first->type(), _second->type());
 }
 
 llvm::Value *ModExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
-    else if(value_first->getType() == llvm::Type::getInt32Ty(context) &&
-            value_second->getType() == llvm::Type::getInt32Ty(context))
-        return builder.CreateSRem(value_first, value_second, "modtmp");
-    else
-        return builder.CreateFRem(value_first, value_second, "modtmp");
+    llvm::Value *value_first, *value_second;
+    Type operation_type = type();
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_integral(operation_type))
+        return integer_division(value_first, value_second, true, "modtmp");
+    return builder.CreateFRem(value_first, value_second, "modtmp");
+}
+
+Type ModExprAST::type() {
+    return arithmetic_type(_first->type(), _second->type());
 }
 
 llvm::Value *LessExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    Type operation_type = comparison_type(_first->type(), _second->type());
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_floating_point(operation_type))
+        return builder.CreateFCmpOLT(value_first, value_second, "lesstmp");
+    if (is_unsigned(operation_type))
+        return builder.CreateICmpULT(value_first, value_second, "lesstmp");
     return builder.CreateICmpSLT(value_first, value_second, "lesstmp");
 }
 
 llvm::Value *GrtExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    Type operation_type = comparison_type(_first->type(), _second->type());
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_floating_point(operation_type))
+        return builder.CreateFCmpOGT(value_first, value_second, "grttmp");
+    if (is_unsigned(operation_type))
+        return builder.CreateICmpUGT(value_first, value_second, "grttmp");
     return builder.CreateICmpSGT(value_first, value_second, "grttmp");
 }
 
 llvm::Value *LEExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    Type operation_type = comparison_type(_first->type(), _second->type());
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_floating_point(operation_type))
+        return builder.CreateFCmpOLE(value_first, value_second, "leetmp");
+    if (is_unsigned(operation_type))
+        return builder.CreateICmpULE(value_first, value_second, "leetmp");
     return builder.CreateICmpSLE(value_first, value_second, "leetmp");
 }
 
 llvm::Value *GEExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    Type operation_type = comparison_type(_first->type(), _second->type());
+    codegen_operands(operation_type, value_first, value_second);
+    if (is_floating_point(operation_type))
+        return builder.CreateFCmpOGE(value_first, value_second, "geetmp");
+    if (is_unsigned(operation_type))
+        return builder.CreateICmpUGE(value_first, value_second, "geetmp");
     return builder.CreateICmpSGE(value_first, value_second, "geetmp");
 }
 
 llvm::Value *AndExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    codegen_operands(type(), value_first, value_second);
     return builder.CreateAnd(value_first, value_second, "andtmp");
 }
 
+Type AndExprAST::type() {
+    return bitwise_type(_first->type(), _second->type());
+}
+
 llvm::Value *OrExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    codegen_operands(type(), value_first, value_second);
     return builder.CreateOr(value_first, value_second, "ortmp");
 }
 
+Type OrExprAST::type() {
+    return bitwise_type(_first->type(), _second->type());
+}
+
 llvm::Value *XorExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
+    llvm::Value *value_first, *value_second;
+    codegen_operands(type(), value_first, value_second);
     return builder.CreateXor(value_first, value_second, "xortmp");
 }
 
+Type XorExprAST::type() {
+    return bitwise_type(_first->type(), _second->type());
+}
+
 llvm::Value *ShlExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
-    return builder.CreateShl(value_first, value_second, "shltmp");
+    llvm::Value *value_first, *value_second;
+    Type operation_type = type();
+    codegen_operands(operation_type, value_first, value_second);
+    return builder.CreateShl(value_first, shift_amount(value_second, operation_type), "shltmp");
+}
+
+Type ShlExprAST::type() {
+    return shift_type(_first->type(), _second->type());
 }
 
 llvm::Value *ShrExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
-    }
-    return builder.CreateLShr(value_first, value_second, "shrtmp");
+    llvm::Value *value_first, *value_second;
+    Type operation_type = type();
+    codegen_operands(operation_type, value_first, value_second);
+    return builder.CreateAShr(value_first, shift_amount(value_second, operation_type), "shrtmp");
 }
 
-llvm::Value *AndLExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
-        yyerror("Error");
+Type ShrExprAST::type() {
+    return shift_type(_first->type(), _second->type());
+}
+
+llvm::Value *UShrExprAST::codegen() {
+    llvm::Value *value_first, *value_second;
+    Type operation_type = type();
+    codegen_operands(operation_type, value_first, value_second);
+    return builder.CreateLShr(value_first, shift_amount(value_second, operation_type), "ushrtmp");
+}
+
+Type UShrExprAST::type() {
+    return shift_type(_first->type(), _second->type());
+}
+
+// && and || only evaluate the right operand when the left one does not decide the result
+static llvm::Value* short_circuit(ExprAST* first, ExprAST* second, bool is_and, const std::string& name) {
+    if (first->type() != BOOLEAN || second->type() != BOOLEAN) {
+        yyerror("Must be boolean");
     }
-    else if (value_first->getType() != llvm::Type::getInt1Ty(context)
-        || value_second->getType() != llvm::Type::getInt1Ty(context)) {
-            yyerror("Must be boolean");
+    llvm::Value *value_first = first->codegen();
+    if (value_first == nullptr) {
+        yyerror("Error");
     }
-    // TODO Fix
-    llvm::Value *lhs = llvm::ConstantInt::get(context, llvm::APInt(1, value_first ? 1 : 0));
-    llvm::Value *rhs = llvm::ConstantInt::get(context, llvm::APInt(1, value_second ? 1 : 0));
-    if(lhs && rhs)
-        return llvm::ConstantInt::get(context, llvm::APInt(1, 1));
+
+    llvm::Function *function = builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock *first_block = builder.GetInsertBlock();
+    llvm::BasicBlock *second_block = llvm::BasicBlock::Create(context, name + "rhs", function);
+    llvm::BasicBlock *merge_block = llvm::BasicBlock::Create(context, name + "cont");
+
+    if (is_and)
+        builder.CreateCondBr(value_first, second_block, merge_block);
     else
-        return llvm::ConstantInt::get(context, llvm::APInt(1, 0));
-}
+        builder.CreateCondBr(value_first, merge_block, second_block);
 
-llvm::Value *OrLExprAST::codegen() {
-    llvm::Value *value_first = _first->codegen();
-    llvm::Value *value_second = _second->codegen();
-    if (value_first == nullptr || value_second == nullptr) {
+    builder.SetInsertPoint(second_block);
+    llvm::Value *value_second = second->codegen();
+    if (value_second == nullptr) {
         yyerror("Error");
     }
-    else if (value_first->getType() != llvm::Type::getInt1Ty(context)
-        || value_second->getType() != llvm::Type::getInt1Ty(context)) {
-        yyerror("Must be boolean");
+    second_block = builder.GetInsertBlock();
+    builder.CreateBr(merge_block);
+
+    function->getBasicBlockList().push_back(merge_block);
+    builder.SetInsertPoint(merge_block);
+    llvm::PHINode* phi_node = builder.CreatePHI(llvm::Type::getInt1Ty(context), 2, name + "tmp");
+    phi_node->addIncoming(llvm::ConstantInt::get(context, llvm::APInt(1, is_and ? 0 : 1)), first_block);
+    phi_node->addIncoming(value_second, second_block);
+    return phi_node;
+}
+
+llvm::Value *AndLExprAST::codegen() {
+    return short_circuit(_first, _second, true, "andl");
+}
+
+llvm::Value *OrLExprAST::codegen() {
+    return short_circuit(_first, _second, false, "orl");
+}
+
+static std::vector<CallExprAST*> created_calls;
+
+CallExprAST::CallExprAST(std::string callee_id, std::vector<ExprAST*> args)
+        : _callee_id(std::move(callee_id)), _args(std::move(args)) {
+    created_calls.push_back(this);
+}
+
+std::vector<CallExprAST*> take_created_calls() {
+    std::vector<CallExprAST*> calls;
+    calls.swap(created_calls);
+    return calls;
+}
+
+void bind_calls(std::vector<CallExprAST*>& calls, std::vector<const FunctionAST*>& inline_callees, bool at_end) {
+    std::vector<CallExprAST*> unbound;
+    for (size_t i = 0; i < calls.size(); ++i) {
+        CallExprAST* call = calls[i];
+        auto found = function_signatures.find(call->_callee_id);
+        if (found == function_signatures.end() && import_function(call->_callee_id)) {
+            found = function_signatures.find(call->_callee_id);
+            // Importing an inline function parses its body, whose calls are bound with these
+            std::vector<CallExprAST*> imported_calls = take_created_calls();
+            calls.insert(calls.end(), imported_calls.begin(), imported_calls.end());
+        }
+        if (found != function_signatures.end()) {
+            call->_callee = &found->second;
+            if (found->second.inline_function != nullptr) {
+                inline_callees.push_back(found->second.inline_function);
+            }
+        } else if (!at_end && !is_intrinsic(call->_callee_id) && !is_repeat_call(call->_callee_id)) {
+            unbound.push_back(call);
+        }
     }
-    // TODO Fix
-    llvm::Value *lhs = builder.CreateICmpEQ(value_first, llvm::ConstantInt::get(context, llvm::APInt(8, 1)), "ifcondl");
-    llvm::Value *rhs = builder.CreateICmpEQ(value_first, llvm::ConstantInt::get(context, llvm::APInt(8, 1)), "ifcondl");
-    if(lhs && rhs)
-        return llvm::ConstantInt::get(context, llvm::APInt(1, 0));
-    else
-        return llvm::ConstantInt::get(context, llvm::APInt(1, 1));
+    calls.swap(unbound);
+}
+
+bool CallExprAST::calls_function_value() {
+    return is_function_value(_callee_id);
+}
+
+bool CallExprAST::is_intrinsic_call() {
+    return _callee == nullptr && is_intrinsic(_callee_id) && !calls_function_value();
 }
 
 llvm::Value *CallExprAST::codegen() {
-    llvm::Function *callee_function = module->getFunction(_callee_id);
-    if (callee_function == nullptr) {
-        yyerror("Function " + _callee_id + " doesn't exist");
+    if (calls_function_value()) {
+        return call_function_value(_callee_id, _args);
+    }
+    if (is_intrinsic_call()) {
+        return intrinsic_codegen(_callee_id, _args);
     }
+    if (_callee == nullptr && is_repeat_call(_callee_id)) {
+        return repeat_codegen(_args);
+    }
+    if (is_suspend()) {
+        if (current_coroutine == nullptr) {
+            yyerror("Suspend function " + _callee_id + " can only be called from a suspend function, launch, async or runBlocking");
+        }
+        return await_coroutine(create_call(), type(), true);
+    }
+    if (options.opt_level > 0) {
+        if (llvm::Constant* value = evaluate()) {
+            return value;
+        }
+    }
+    if (_callee != nullptr && _callee->inline_function != nullptr) {
+        return inline_call(_callee_id, *_callee, _args);
+    }
+    llvm::Value* result = create_call();
+    return is_reference(type()) ? root_temporary(result) : result;
+}
 
+bool CallExprAST::is_suspend() {
+    return _callee != nullptr && _callee->is_suspend && !calls_function_value();
+}
+
+llvm::Value* CallExprAST::start() {
+    if (!is_suspend()) {
+        yyerror(_callee_id + " is not a suspend function");
+    }
+    return create_call();
+}
+
+llvm::Value* CallExprAST::create_call() {
+    if (_callee == nullptr) {
+        yyerror("Function " + _callee_id + " doesn't exist");
+    }
+    llvm::Function* callee_function = _callee->function;
     unsigned arg_size = callee_function->arg_size();
 
     if (arg_size != _args.size()) {
         yyerror("Wrong number of arguments: " + _callee_id);
     }
 
+    const FunctionSignature& signature = *_callee;
     std::vector<llvm::Value*> generated_args;
     for (unsigned i = 0; i < arg_size; ++i) {
+        expect_function(_args[i], signature.param_types[i]);
         llvm::Value* arg_value = _args[i]->codegen();
         if (arg_value == nullptr) {
             return nullptr;
         }
-        generated_args.push_back(arg_value);
+        generated_args.push_back(convert_value(arg_value, _args[i]->type(), signature.param_types[i]));
     }
 
-    return builder.CreateCall(callee_function, generated_args, "calltmp");
+    return builder.CreateCall(callee_function, generated_args, signature.return_type == UNIT ? "" : "calltmp");
+}
+
+Type CallExprAST::type() {
+    if (calls_function_value()) {
+        return function_value_type(_callee_id);
+    }
+    if (_callee == nullptr && is_repeat_call(_callee_id)) {
+        return UNIT;
+    }
+    if (is_intrinsic_call()) {
+        return intrinsic_type(_callee_id, _args);
+    }
+    if (_callee == nullptr) {
+        yyerror("Function " + _callee_id + " doesn't exist");
+    }
+    return _callee->return_type;
 }
 
 void ReturnStatement::codegen() {
-    llvm::Value* expression_value = _expr->codegen();
-    builder.CreateRet(expression_value);
+    if (codegen_inline_return(_expr)) {
+        return;
+    }
+    if (parallel_body_depth > 0) {
+        yyerror("Cannot return from a parallel loop");
+    }
+    llvm::Function *function = builder.GetInsertBlock()->getParent();
+    Type return_type = function_signatures[function->getName().str()].return_type;
+    if (_expr == nullptr || return_type == UNIT) {
+        if (_expr != nullptr) {
+            yyerror("A function returning Unit cannot return a value");
+        }
+        if (return_type != UNIT) {
+            yyerror("Missing return value");
+        }
+        codegen_finally_blocks();
+        builder.CreateRetVoid();
+    } else {
+        expect_function(_expr, return_type);
+        llvm::Value* expression_value = _expr->codegen();
+        llvm::Value* return_value = convert_value(expression_value, _expr->type(), return_type);
+        codegen_finally_blocks();
+        if (current_coroutine != nullptr) {
+            coroutine_return(return_value);
+            return;
+        }
+        builder.CreateRet(return_value);
+    }
+    // Statements after the return are unreachable
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "afterreturn", function));
+}
+
+// Value instances are immutable SSA aggregates, so small ones stay in registers and SROA splits locals up.
+// Heap instances come from kt_alloc in the runtime library and are zeroed before their properties are stored.
+llvm::Value *ConstructExprAST::codegen() {
+    const ClassInfo& info = class_info(_class_type);
+    if (_args.size() != info.fields.size()) {
+        yyerror("Wrong number of arguments: " + info.name);
+    }
+
+    if (info.kind == VALUE_CLASS) {
+        return convert_value(_args[0]->codegen(), _args[0]->type(), info.fields[0].type);
+    }
+
+    std::vector<llvm::Value*> fields;
+    for (unsigned i = 0; i < _args.size(); ++i) {
+        fields.push_back(convert_value(_args[i]->codegen(), _args[i]->type(), info.fields[i].type));
+    }
+
+    if (!info.heap) {
+        llvm::Value* object = llvm::UndefValue::get(info.llvm_type);
+        for (unsigned i = 0; i < fields.size(); ++i) {
+            object = builder.CreateInsertValue(object, fields[i], i, info.name);
+        }
+        return object;
+    }
+
+    llvm::Type* i8_ptr = llvm::Type::getInt8PtrTy(context);
+    llvm::FunctionCallee alloc = module->getOrInsertFunction("kt_alloc", i8_ptr, info.type_info->getType());
+    llvm::Value* memory = builder.CreateCall(alloc, {info.type_info}, info.name + "_memory");
+    llvm::Value* object = root_temporary(builder.CreateBitCast(memory, info.llvm_type, info.name));
+    for (unsigned i = 0; i < fields.size(); ++i) {
+        builder.CreateStore(fields[i], builder.CreateStructGEP(info.struct_type, object, i));
+    }
+    return object;
+}
+
+Type FieldExprAST::type() {
+    Type object_type = _object->type();
+    if (is_collection(object_type) && _name == "size") {
+        return INT;
+    }
+    if (!is_class(object_type)) {
+        yyerror(type_name(object_type) + " has no property " + _name);
+    }
+    const ClassInfo& info = class_info(object_type);
+    return info.fields[field_index(info, _name)].type;
+}
+
+llvm::Value *FieldExprAST::address() {
+    if (is_collection(_object->type())) {
+        return nullptr;
+    }
+    const ClassInfo& info = class_info(_object->type());
+    if (info.heap) {
+        return builder.CreateStructGEP(info.struct_type, _object->codegen(), field_index(info, _name), _name + "_addr");
+    }
+    llvm::Value* object_address = _object->address();
+    if (object_address == nullptr || info.kind == VALUE_CLASS) {
+        return object_address;
+    }
+    return builder.CreateStructGEP(info.struct_type, object_address, field_index(info, _name), _name + "_addr");
+}
+
+llvm::Value *FieldExprAST::codegen() {
+    Type field_type = type();
+    if (is_collection(_object->type())) {
+        return collection_size(_object);
+    }
+    const ClassInfo& info = class_info(_object->type());
+    if (llvm::Value* field_address = address()) {
+        llvm::Value* field = builder.CreateLoad(type_to_llvm_type(field_type), field_address, _name);
+        return is_reference(field_type) ? root_temporary(field) : field;
+    }
+
+    llvm::Value* object = _object->codegen();
+    if (info.kind == VALUE_CLASS) {
+        return object;
+    }
+    return builder.CreateExtractValue(object, field_index(info, _name), _name);
 }
 
 llvm::Value *IfElseExprAST::codegen() {
@@ -324,6 +768,8 @@ llvm::Value *IfElseExprAST::codegen() {
 
     builder.CreateBr(merge_block);
 
+    else_block = builder.GetInsertBlock();
+
     if (then_value->getType() != else_value->getType()) {
         yyerror("If branches must have the same value");
     }
@@ -335,4 +781,8 @@ llvm::Value *IfElseExprAST::codegen() {
     phi_node->addIncoming(then_value, then_block);
     phi_node->addIncoming(else_value, else_block);
     return phi_node;
+}
+
+Type IfElseExprAST::type() {
+    return _then_expr->type();
 }
\ No newline at end of file
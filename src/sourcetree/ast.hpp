@@ -5,17 +5,28 @@
 #include <vector>
 #include <string>
 
+#include "llvm/IR/Constant.h"
 #include "llvm/IR/Value.h"
 
 enum Type {
-    INT, DOUBLE, STRING
+    INT, DOUBLE, STRING, LONG, FLOAT, SHORT, BYTE, BOOLEAN, CHAR,
+    // Only the result of functions and function types, it has no values
+    UNIT,
+    // User-defined classes follow, see classes.hpp
+    FIRST_CLASS
 };
 
 llvm::Type* type_to_llvm_type(Type type);
 
+// Where a statement starts in the source, line 0 when it is not known
+struct SourceLocation {
+    int line = 0;
+    int column = 0;
+};
+
 class Param {
 public:
-    Param(std::string id, Type type) : _id(std::move(id)), _type(type) {};
+    Param(std::string id, Type type, bool is_var = false) : _id(std::move(id)), _type(type), _is_var(is_var) {};
 
     const std::string &getId() const {
         return _id;
@@ -25,37 +36,103 @@ public:
         return _type;
     }
 
+    bool isVar() const {
+        return _is_var;
+    }
+
 private:
     std::string _id;
     Type _type;
+    bool _is_var;
 };
 
+// Expressions and statements created so far, which the parser attributes to top-level statements for --stats
+extern unsigned long created_ast_nodes;
+
 class ExprAST {
 public:
+    ExprAST() { ++created_ast_nodes; }
     virtual ~ExprAST() = default;
     virtual llvm::Value* codegen() = 0;
+    // Static Kotlin type of the expression, decides signedness and conversions during codegen
+    virtual Type type() = 0;
+    // Memory the value lives in (a local or a property of one), so parts of it can be loaded directly
+    virtual llvm::Value* address() { return nullptr; }
+    // Value computed at compile time, or nullptr when it is only known at run time, see interpreter.hpp
+    virtual llvm::Constant* evaluate() { return nullptr; }
 };
 
 class IntExprAST : public ExprAST {
 public:
     llvm::Value* codegen() override;
+    llvm::Constant* evaluate() override;
+    Type type() override { return INT; }
     explicit IntExprAST(int value) : _value(value) {}
+
+    int getValue() const {
+        return _value;
+    }
 private:
     int _value;
 };
 
+class LongExprAST : public ExprAST {
+public:
+    llvm::Value* codegen() override;
+    llvm::Constant* evaluate() override;
+    Type type() override { return LONG; }
+    explicit LongExprAST(long long value) : _value(value) {}
+
+    long long getValue() const {
+        return _value;
+    }
+private:
+    long long _value;
+};
+
 class DoubleExprAST : public ExprAST {
 public:
     llvm::Value* codegen() override;
+    llvm::Constant* evaluate() override;
+    Type type() override { return DOUBLE; }
     explicit DoubleExprAST(double value) : _value(value) {}
 private:
     double _value;
 };
 
+class FloatExprAST : public ExprAST {
+public:
+    llvm::Value* codegen() override;
+    llvm::Constant* evaluate() override;
+    Type type() override { return FLOAT; }
+    explicit FloatExprAST(float value) : _value(value) {}
+private:
+    float _value;
+};
+
+class CharExprAST : public ExprAST {
+public:
+    llvm::Value* codegen() override;
+    llvm::Constant* evaluate() override;
+    Type type() override { return CHAR; }
+    explicit CharExprAST(int value) : _value(value) {}
+
+    int getValue() const {
+        return _value;
+    }
+private:
+    int _value;
+};
+
 class ConstStringExprAST : public ExprAST {
 public:
     llvm::Value* codegen() override;
+    Type type() override { return STRING; }
     explicit ConstStringExprAST(std::string value) : _value(std::move(value)) {}
+
+    const std::string& getValue() const {
+        return _value;
+    }
 private:
     std::string _value;
 };
@@ -63,7 +140,13 @@ private:
 class ConstBooleanExprAST : public ExprAST {
 public:
     llvm::Value* codegen() override;
+    llvm::Constant* evaluate() override;
+    Type type() override { return BOOLEAN; }
     explicit ConstBooleanExprAST(bool value) : _value(value) {};
+
+    bool getValue() const {
+        return _value;
+    }
 private:
     bool _value;
 };
@@ -71,15 +154,36 @@ private:
 class VarExprAST : public ExprAST {
 public:
     llvm::Value* codegen() override;
+    Type type() override;
+    llvm::Value* address() override;
+    llvm::Constant* evaluate() override;
     explicit VarExprAST(std::string id) : _id(std::move(id)) {}
+
+    const std::string& getId() const {
+        return _id;
+    }
 private:
     std::string _id;
 };
 
+// A value the interpreter computed, generated as the constant itself
+class ConstantExprAST : public ExprAST {
+public:
+    ConstantExprAST(llvm::Constant* value, Type type) : _value(value), _type(type) {}
+    llvm::Value* codegen() override;
+    Type type() override { return _type; }
+    llvm::Constant* evaluate() override { return _value; }
+private:
+    llvm::Constant* _value;
+    Type _type;
+};
+
 class UnaryExprAST : public ExprAST {
 public:
     UnaryExprAST(ExprAST* first)
             : _first(first) {};
+    // Generates the operation on the constant operand, which the IRBuilder folds
+    llvm::Constant* evaluate() override;
     ~UnaryExprAST() override;
 protected:
     ExprAST *_first;
@@ -89,20 +193,31 @@ class InvExprAST : public UnaryExprAST {
 public:
     InvExprAST(ExprAST* first) : UnaryExprAST(first) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class NotLExprAST : public UnaryExprAST {
 public:
     NotLExprAST(ExprAST* first) : UnaryExprAST(first) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
 };
 
 class BinaryExprAST : public ExprAST {
 public:
     BinaryExprAST(ExprAST* first, ExprAST* second)
     : _first(first), _second(second) {};
+    // Generates the operation on the constant operands, which the IRBuilder folds
+    llvm::Constant* evaluate() override;
     ~BinaryExprAST() override;
 protected:
+    // Generates both operands and converts them to the type the operation is done in
+    void codegen_operands(Type operation_type, llvm::Value*& value_first, llvm::Value*& value_second);
+    // Generates the operation on the given constants in place of the operands
+    llvm::Constant* fold(llvm::Constant* first, llvm::Constant* second);
+    // Like evaluate(), but gives up on an integer division by zero, which throws at run time
+    llvm::Constant* evaluate_division();
+
     ExprAST *_first, *_second;
 };
 
@@ -110,106 +225,263 @@ class AddExprAST : public BinaryExprAST {
 public:
     AddExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class SubExprAST : public BinaryExprAST {
 public:
     SubExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class MulExprAST : public BinaryExprAST {
 public:
     MulExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class DivExprAST : public BinaryExprAST {
 public:
     DivExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
+    llvm::Constant* evaluate() override;
 };
 
 class ModExprAST : public BinaryExprAST {
 public:
     ModExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
+    llvm::Constant* evaluate() override;
 };
 
 class LessExprAST : public BinaryExprAST {
 public:
     LessExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
 };
 
 class GrtExprAST : public BinaryExprAST {
 public:
     GrtExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
 };
 
 class LEExprAST : public BinaryExprAST {
 public:
     LEExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
 };
 
 class GEExprAST : public BinaryExprAST {
 public:
     GEExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
 };
 
 class AndExprAST : public BinaryExprAST {
 public:
     AndExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class OrExprAST : public BinaryExprAST {
 public:
     OrExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class XorExprAST : public BinaryExprAST {
 public:
     XorExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class ShlExprAST : public BinaryExprAST {
 public:
     ShlExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class ShrExprAST : public BinaryExprAST {
 public:
     ShrExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override;
+};
+
+class UShrExprAST : public BinaryExprAST {
+public:
+    UShrExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
+    llvm::Value* codegen() override;
+    Type type() override;
 };
 
 class AndLExprAST : public BinaryExprAST {
 public:
     AndLExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
+    llvm::Constant* evaluate() override;
 };
 
 class OrLExprAST : public BinaryExprAST {
 public:
     OrLExprAST(ExprAST* first, ExprAST* second) : BinaryExprAST(first, second) {};
     llvm::Value* codegen() override;
+    Type type() override { return BOOLEAN; }
+    llvm::Constant* evaluate() override;
 };
 
+struct FunctionSignature;
+class FunctionAST;
+
 class CallExprAST : public ExprAST {
 public:
-    explicit CallExprAST(std::string callee_id, std::vector<ExprAST *> args) : _callee_id(std::move(callee_id)),
-                                                                               _args(std::move(args)) {};
+    CallExprAST(std::string callee_id, std::vector<ExprAST *> args);
     llvm::Value* codegen() override;
+    Type type() override;
+    llvm::Constant* evaluate() override;
+
+    bool is_suspend();
+    // Creates the coroutine of a suspend function call without running it and returns its handle
+    llvm::Value* start();
+
+    ~CallExprAST() override {
+        for(auto &i : _args)
+            delete i;
+    }
 private:
+    llvm::Value* create_call();
+    // Calls a variable or parameter of a function type instead of a declared function
+    bool calls_function_value();
+    // Not bound to a declared function, and named like one of the built-ins of intrinsics.hpp
+    bool is_intrinsic_call();
+
+    friend void bind_calls(std::vector<CallExprAST*>& calls, std::vector<const FunctionAST*>& inline_callees,
+                           bool at_end);
+
     std::string _callee_id;
     std::vector<ExprAST*> _args;
+    // Set by bind_calls, nullptr when no function has that name
+    const FunctionSignature* _callee = nullptr;
+};
+
+// The calls created since the last time, those of the top-level statement that was just parsed
+std::vector<CallExprAST*> take_created_calls();
+
+// Binds the calls whose callee is declared, or can be imported, to its signature and removes them from the list,
+// adding the inline functions among the callees to inline_callees. The calls of built-ins are removed unbound. The
+// others are kept until their callee is declared, or until the end of the file, where they are all removed.
+// Calls are only generated once bound, so they do not have to look their callee up by name.
+void bind_calls(std::vector<CallExprAST*>& calls, std::vector<const FunctionAST*>& inline_callees, bool at_end);
+
+class ConstructExprAST : public ExprAST {
+public:
+    ConstructExprAST(Type class_type, std::vector<ExprAST*> args) : _class_type(class_type), _args(std::move(args)) {};
+    llvm::Value* codegen() override;
+    Type type() override { return _class_type; }
+
+    ~ConstructExprAST() override {
+        for(auto &i : _args)
+            delete i;
+    }
+private:
+    Type _class_type;
+    std::vector<ExprAST*> _args;
+};
+
+class FieldExprAST : public ExprAST {
+public:
+    FieldExprAST(ExprAST* object, std::string name) : _object(object), _name(std::move(name)) {};
+    llvm::Value* codegen() override;
+    Type type() override;
+    llvm::Value* address() override;
+
+    ~FieldExprAST() override {
+        delete _object;
+    }
+private:
+    ExprAST* _object;
+    std::string _name;
+};
+
+// ArrayList<T>(), HashSet<T>() and HashMap<K, V>(), generated in collections.cpp
+class NewCollectionExprAST : public ExprAST {
+public:
+    explicit NewCollectionExprAST(Type collection_type) : _collection_type(collection_type) {};
+    llvm::Value* codegen() override;
+    Type type() override { return _collection_type; }
+private:
+    Type _collection_type;
+};
+
+// `object.name(args)`, only collections have methods. `object[index]` is a call of get.
+class MethodCallExprAST : public ExprAST {
+public:
+    MethodCallExprAST(ExprAST* object, std::string name, std::vector<ExprAST*> args)
+            : _object(object), _name(std::move(name)), _args(std::move(args)) {};
+    llvm::Value* codegen() override;
+    Type type() override;
+
+    ~MethodCallExprAST() override {
+        delete _object;
+        for(auto &i : _args)
+            delete i;
+    }
+private:
+    ExprAST* _object;
+    std::string _name;
+    std::vector<ExprAST*> _args;
+};
+
+class Statement;
+
+// A parameter of a lambda, which can leave out its type when the lambda is used as a known function type
+struct LambdaParam {
+    std::string id;
+    Type type;
+    bool typed;
+};
+
+// `{ a: Int, b -> statements }` or `{ statements }`, generated in lambdas.cpp. The result is the expression
+// statement the body ends with, a lambda without parameters that is used as a function of one calls it `it`.
+class LambdaExprAST : public ExprAST {
+public:
+    LambdaExprAST(std::vector<LambdaParam> params, std::vector<Statement*>* body)
+            : _params(std::move(params)), _body(body) {};
+    // The closure
+    llvm::Value* codegen() override;
+    Type type() override;
+    // Types the parameters without a declared type, and the result is converted to the expected one
+    void expect(Type function_type);
+    // Generates the body in place, with the parameters bound to the arguments in the current scope
+    llvm::Value* codegen_inline(const std::vector<llvm::Value*>& args);
+
+    ~LambdaExprAST() override;
+private:
+    // The parameter names, `it` when there are none and the function type has one
+    std::vector<std::string> param_names();
+    // Binds the parameters to new variables of the current function
+    void bind_params(const std::vector<llvm::Value*>& values);
+    // Generates the body into the current block and returns the result converted to the result type
+    llvm::Value* codegen_body();
+
+    std::vector<LambdaParam> _params;
+    std::vector<Statement*>* _body;
+    Type _expected = UNIT;
+    bool _has_expected = false;
 };
 
 class IfElseExprAST : public ExprAST {
@@ -217,6 +489,8 @@ public:
     IfElseExprAST(ExprAST* cond, ExprAST* then_expr, ExprAST* else_expr)
     : _cond(cond), _then_expr(then_expr), _else_expr(else_expr) {};
     llvm::Value* codegen() override;
+    Type type() override;
+    llvm::Constant* evaluate() override;
 
     ~IfElseExprAST() override {
         delete _cond;
@@ -230,4 +504,81 @@ private:
     ExprAST* _else_expr;
 };
 
+// launch, async, await, runBlocking, yield and delay, generated in coroutine.cpp
+class CoroutineBuiltinExprAST : public ExprAST {
+public:
+    CoroutineBuiltinExprAST(std::string name, std::vector<ExprAST*> args) : _name(std::move(name)), _args(std::move(args)) {};
+    llvm::Value* codegen() override;
+    Type type() override;
+
+    ~CoroutineBuiltinExprAST() override {
+        for(auto &i : _args)
+            delete i;
+    }
+private:
+    // The single argument, which has to be a call of a suspend function
+    CallExprAST* suspend_call();
+
+    std::string _name;
+    std::vector<ExprAST*> _args;
+};
+
+// A condition of a `when` branch: a value the subject is compared with, `in value..range_end`, `in value until
+// range_end`, or a Boolean expression when there is no subject
+struct WhenCondition {
+    ExprAST* value;
+    ExprAST* range_end;
+    bool inclusive;
+};
+
+struct WhenBranch {
+    // Empty for the else branch
+    std::vector<WhenCondition> conditions;
+    // A single statement or a block, whose value is the expression statement it ends with
+    std::vector<Statement*>* body;
+};
+
+// Generated in when.cpp
+class WhenExprAST : public ExprAST {
+public:
+    WhenExprAST(ExprAST* subject, std::vector<WhenBranch*> branches) : _subject(subject), _branches(std::move(branches)) {};
+    llvm::Value* codegen() override;
+    Type type() override;
+
+    ~WhenExprAST() override;
+private:
+    // With an else branch and a value in every branch, the when is an expression, otherwise only a statement
+    bool has_value();
+
+    ExprAST* _subject;
+    std::vector<WhenBranch*> _branches;
+};
+
+// `id in start until end` or `id in start..end`
+struct LoopRange {
+    std::string id;
+    ExprAST* start;
+    ExprAST* end;
+    bool inclusive;
+};
+
+// parallelFor and parallelSum, generated in parallel.cpp. The block of parallelSum ends with the expression
+// that is added up.
+class ParallelLoopExprAST : public ExprAST {
+public:
+    ParallelLoopExprAST(std::string name, LoopRange* range, std::vector<Statement*>* block)
+            : _name(std::move(name)), _range(range), _block(block) {};
+    llvm::Value* codegen() override;
+    Type type() override;
+
+    ~ParallelLoopExprAST() override;
+private:
+    // The expression statement at the end of a parallelSum block
+    ExprAST* summand();
+
+    std::string _name;
+    LoopRange* _range;
+    std::vector<Statement*>* _block;
+};
+
 #endif //KOTLIN_LLVM_AST_HPP
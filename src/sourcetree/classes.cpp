@@ -0,0 +1,198 @@
+#include "classes.hpp"
+#include "conversion.hpp"
+#include "exceptions.hpp"
+#include "imports.hpp"
+
+#include <deque>
+#include <map>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+extern void yyerror(std::string msg);
+
+// A deque, so the references class_info returns stay valid when generating code registers more classes
+static std::deque<ClassInfo> classes;
+static std::map<std::string, Type> class_types;
+
+// Sizes and offsets stay constant expressions, they are only folded once the target's data layout is known
+llvm::GlobalVariable* create_type_info(const std::string& name, llvm::StructType* struct_type,
+                                       const std::vector<unsigned>& reference_fields) {
+    llvm::Type* int32_type = llvm::Type::getInt32Ty(context);
+    std::vector<llvm::Constant*> pointer_offsets;
+    for (unsigned field : reference_fields) {
+        llvm::Constant* offset = llvm::ConstantExpr::getOffsetOf(struct_type, field);
+        pointer_offsets.push_back(llvm::ConstantExpr::getTrunc(offset, int32_type));
+    }
+
+    llvm::ArrayType* offsets_type = llvm::ArrayType::get(int32_type, pointer_offsets.size());
+    auto* offsets = new llvm::GlobalVariable(*module, offsets_type, true, llvm::GlobalValue::PrivateLinkage,
+                                             llvm::ConstantArray::get(offsets_type, pointer_offsets),
+                                             name + ".pointer_offsets");
+    llvm::Constant* zero = llvm::ConstantInt::get(int32_type, 0);
+    llvm::Constant* name_string = builder.CreateGlobalStringPtr(name, name + ".name", 0, module);
+
+    llvm::StructType* type_info_type = llvm::StructType::get(
+            context, {int32_type, int32_type, int32_type->getPointerTo(), name_string->getType()});
+    llvm::Constant* type_info = llvm::ConstantStruct::get(type_info_type, {
+            llvm::ConstantExpr::getTrunc(llvm::ConstantExpr::getSizeOf(struct_type), int32_type),
+            llvm::ConstantInt::get(int32_type, pointer_offsets.size()),
+            llvm::ConstantExpr::getInBoundsGetElementPtr(offsets_type, offsets, llvm::ArrayRef<llvm::Constant*>{zero, zero}),
+            name_string});
+    return new llvm::GlobalVariable(*module, type_info_type, true, llvm::GlobalValue::PrivateLinkage, type_info,
+                                    name + ".type_info");
+}
+
+Type declare_class_name(const std::string& name) {
+    if (class_types.count(name) != 0) {
+        yyerror("Cannot redeclare class: " + name);
+    }
+    // The struct gets its body once the properties are known, until then llvm_type marks the class as pending
+    ClassInfo info{name, PLAIN_CLASS, {}, false, llvm::StructType::create(context, name), nullptr, nullptr};
+    Type type = static_cast<Type>(FIRST_CLASS + classes.size());
+    classes.push_back(info);
+    class_types[name] = type;
+    return type;
+}
+
+Type declare_class(const std::string& name, ClassKind kind, const std::vector<Param*>& properties) {
+    auto found = class_types.find(name);
+    Type type = found != class_types.end() && class_info(found->second).llvm_type == nullptr
+                ? found->second : declare_class_name(name);
+    if (kind == VALUE_CLASS && properties.size() != 1) {
+        yyerror("Value class " + name + " must have exactly one property");
+    }
+
+    ClassInfo& info = classes[type - FIRST_CLASS];
+    info.kind = kind;
+    for (Param* property : properties) {
+        for (const ClassField& field : info.fields) {
+            if (field.name == property->getId()) {
+                yyerror("Duplicate property " + field.name + " in class " + name);
+            }
+        }
+        info.fields.push_back(ClassField{property->getId(), property->getType(), property->isVar()});
+        // A class containing itself can only do so through a reference
+        info.heap = info.heap || property->isVar() || property->getType() == type ||
+                    is_reference(property->getType());
+    }
+
+    if (kind == VALUE_CLASS) {
+        if (info.fields[0].is_var) {
+            yyerror("Value class " + name + " cannot have a var property");
+        }
+        if (info.fields[0].type == type) {
+            yyerror("Value class " + name + " cannot contain itself");
+        }
+        info.heap = false;
+        info.struct_type = nullptr;
+        info.llvm_type = type_to_llvm_type(info.fields[0].type);
+        return type;
+    }
+
+    // Set before the fields are lowered, which may have the class's own type
+    info.llvm_type = info.struct_type;
+    if (info.heap) {
+        info.llvm_type = info.struct_type->getPointerTo();
+    }
+    std::vector<llvm::Type*> field_types;
+    for (const ClassField& field : info.fields) {
+        field_types.push_back(type_to_llvm_type(field.type));
+    }
+    info.struct_type->setBody(field_types);
+    if (info.heap) {
+        std::vector<unsigned> reference_fields;
+        for (unsigned i = 0; i < info.fields.size(); i++) {
+            if (is_reference(info.fields[i].type)) {
+                reference_fields.push_back(i);
+            }
+        }
+        info.type_info = create_type_info(name, info.struct_type, reference_fields);
+    }
+    return type;
+}
+
+Type deferred_type(Type result_type) {
+    std::string name = "Deferred<" + type_name(result_type) + ">";
+    auto found = class_types.find(name);
+    if (found != class_types.end()) {
+        return found->second;
+    }
+
+    // The property has no name, so it can only be read through await
+    ClassInfo info{name, DEFERRED_CLASS, {ClassField{"", result_type, false}}, false, nullptr,
+                   llvm::Type::getInt8PtrTy(context), nullptr};
+    Type type = static_cast<Type>(FIRST_CLASS + classes.size());
+    classes.push_back(info);
+    class_types[name] = type;
+    return type;
+}
+
+Type generic_class_type(const std::string& name, ClassKind kind, const std::vector<Type>& arguments,
+                        llvm::StructType* struct_type) {
+    auto found = class_types.find(name);
+    if (found != class_types.end()) {
+        return found->second;
+    }
+
+    // The runtime allocates collections with its own type info, and each lambda has one for its closure
+    ClassInfo info{name, kind, {}, true, struct_type, struct_type->getPointerTo(), nullptr};
+    for (Type argument : arguments) {
+        info.fields.push_back(ClassField{"", argument, false});
+    }
+    Type type = static_cast<Type>(FIRST_CLASS + classes.size());
+    classes.push_back(info);
+    class_types[name] = type;
+    return type;
+}
+
+const std::deque<ClassInfo>& registered_classes() {
+    return classes;
+}
+
+bool is_class(Type type) {
+    return type >= FIRST_CLASS;
+}
+
+bool is_reference(Type type) {
+    if (!is_class(type)) {
+        return false;
+    }
+    const ClassInfo& info = class_info(type);
+    return info.heap || (info.kind == VALUE_CLASS && is_reference(info.fields[0].type));
+}
+
+bool is_class_name(const std::string& name) {
+    return class_types.count(name) > 0 || declare_builtin_exception(name) || import_class(name);
+}
+
+Type find_class(const std::string& name) {
+    auto found = class_types.find(name);
+    if (found == class_types.end() && (declare_builtin_exception(name) || import_class(name))) {
+        found = class_types.find(name);
+    }
+    if (found == class_types.end()) {
+        yyerror("Unknown type: " + name);
+    }
+    return found->second;
+}
+
+const ClassInfo& class_info(Type type) {
+    return classes[type - FIRST_CLASS];
+}
+
+unsigned field_index(const ClassInfo& info, const std::string& name) {
+    for (unsigned i = 0; i < info.fields.size(); i++) {
+        if (info.fields[i].name == name) {
+            return i;
+        }
+    }
+    yyerror("Class " + info.name + " has no property " + name);
+    return 0;
+}
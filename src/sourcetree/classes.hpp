@@ -0,0 +1,79 @@
+#ifndef KOTLIN_LLVM_CLASSES_HPP
+#define KOTLIN_LLVM_CLASSES_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+
+#include "ast.hpp"
+
+enum ClassKind {
+    PLAIN_CLASS, DATA_CLASS, VALUE_CLASS,
+    // Deferred<T> returned by async, the handle of a coroutine with a single unnamed property of type T
+    DEFERRED_CLASS,
+    // ArrayList<T>, HashSet<T> and HashMap<K, V> with the element, key and value types as unnamed properties,
+    // see collections.hpp
+    LIST_CLASS, SET_CLASS, MAP_CLASS,
+    // A function type with the parameter types and then the result type as unnamed properties, see lambdas.hpp
+    FUNCTION_CLASS
+};
+
+struct ClassField {
+    std::string name;
+    Type type;
+    bool is_var;
+};
+
+struct ClassInfo {
+    std::string name;
+    ClassKind kind;
+    std::vector<ClassField> fields;
+    // Classes with var properties or references to heap objects need identity and live on the garbage
+    // collected heap, all others are immutable values
+    bool heap;
+    llvm::StructType* struct_type;
+    // The struct itself, a pointer to it for heap classes, or the property type for a value class
+    llvm::Type* llvm_type;
+    // kt_type_info constant passed to kt_alloc for heap classes
+    llvm::GlobalVariable* type_info;
+};
+
+// Registers a class declared with the given properties and returns its Type, which is
+// FIRST_CLASS plus the index of the class. Classes are declared while parsing, so later
+// declarations can use the name as a type and as a constructor.
+Type declare_class(const std::string& name, ClassKind kind, const std::vector<Param*>& properties);
+// Registers only the name, before the properties are parsed, so they can have the class's own type.
+// declare_class then completes the class.
+Type declare_class_name(const std::string& name);
+
+// Deferred<result_type>, registered the first time it is used
+Type deferred_type(Type result_type);
+
+// A collection or function class with the given name (e.g. "HashMap<Int, Long>") and type arguments, registered
+// the first time it is used
+Type generic_class_type(const std::string& name, ClassKind kind, const std::vector<Type>& arguments,
+                        llvm::StructType* struct_type);
+
+// kt_type_info constant for heap objects of the struct type, which have references in the given fields
+llvm::GlobalVariable* create_type_info(const std::string& name, llvm::StructType* struct_type,
+                                       const std::vector<unsigned>& reference_fields);
+
+// Every class registered so far, in the order of their Types
+const std::deque<ClassInfo>& registered_classes();
+
+bool is_class(Type type);
+// Values of the type point into the garbage collected heap and have to be reachable from a GC root
+bool is_reference(Type type);
+// Both look the name up in the built-in exception classes and the imported interfaces too, see exceptions.hpp
+// and imports.hpp
+bool is_class_name(const std::string& name);
+Type find_class(const std::string& name);
+const ClassInfo& class_info(Type type);
+
+// Index of the property in the class, reports an error when it has none with that name
+unsigned field_index(const ClassInfo& info, const std::string& name);
+
+#endif //KOTLIN_LLVM_CLASSES_HPP
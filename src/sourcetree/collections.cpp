@@ -0,0 +1,720 @@
+#include "collections.hpp"
+
+#include <cstring>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+
+#include "allocation.hpp"
+#include "conversion.hpp"
+#include "lambdas.hpp"
+#include "statement.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+extern void yyerror(std::string msg);
+
+// Has to match runtime.hpp
+enum ListField { LIST_DATA, LIST_SIZE, LIST_CAPACITY };
+enum TableField { TABLE_CONTROL, TABLE_KEYS, TABLE_VALUES, TABLE_SIZE, TABLE_MASK, TABLE_GROWTH_LEFT };
+static const int group_size = 16;
+static const int hash_empty = -128;
+static const int hash_deleted = -2;
+static const uint64_t hash_multiplier = 0x9E3779B97F4A7C15ull;
+
+bool is_collection(Type type) {
+    if (!is_class(type)) {
+        return false;
+    }
+    ClassKind kind = class_info(type).kind;
+    return kind == LIST_CLASS || kind == SET_CLASS || kind == MAP_CLASS;
+}
+
+llvm::StructType* collection_struct_type(ClassKind kind) {
+    const char* name = kind == LIST_CLASS ? "kt.list" : "kt.hash_table";
+    if (llvm::StructType* existing = llvm::StructType::getTypeByName(context, name)) {
+        return existing;
+    }
+    llvm::Type* i8_ptr = llvm::Type::getInt8PtrTy(context);
+    llvm::Type* int32_type = llvm::Type::getInt32Ty(context);
+    if (kind == LIST_CLASS) {
+        return llvm::StructType::create(context, {i8_ptr, int32_type, int32_type}, name);
+    }
+    return llvm::StructType::create(context, {i8_ptr, i8_ptr, i8_ptr, int32_type, int32_type, int32_type}, name);
+}
+
+Type collection_type(const std::string& name, const std::vector<Type>& arguments) {
+    ClassKind kind = name == "ArrayList" ? LIST_CLASS : name == "HashSet" ? SET_CLASS : MAP_CLASS;
+    if (arguments.size() != (kind == MAP_CLASS ? 2 : 1)) {
+        yyerror("Wrong number of type arguments: " + name);
+    }
+    std::string full_name = name + "<";
+    for (unsigned i = 0; i < arguments.size(); i++) {
+        // Strings would be compared by address and references would have to be traced in the buffers
+        if (arguments[i] == STRING || is_class(arguments[i])) {
+            yyerror(name + " can only hold numbers, Char and Boolean, not " + type_name(arguments[i]));
+        }
+        full_name += (i > 0 ? ", " : "") + type_name(arguments[i]);
+    }
+    return generic_class_type(full_name + ">", kind, arguments, collection_struct_type(kind));
+}
+
+static llvm::Type* element_type(const ClassInfo& info, unsigned index) {
+    return type_to_llvm_type(info.fields[index].type);
+}
+
+// In bytes, Boolean elements take one
+static llvm::Constant* element_size(const ClassInfo& info, unsigned index) {
+    return builder.getInt32((element_type(info, index)->getPrimitiveSizeInBits() + 7) / 8);
+}
+
+static llvm::FunctionCallee runtime_function(const char* name, llvm::Type* return_type,
+                                             const std::vector<llvm::Type*>& params, bool no_return = false) {
+    llvm::FunctionCallee function = module->getOrInsertFunction(
+            name, llvm::FunctionType::get(return_type, params, false));
+    if (no_return) {
+        llvm::cast<llvm::Function>(function.getCallee())->setDoesNotReturn();
+    }
+    return function;
+}
+
+// The operation `<collection name>.<name>`, which has no body yet when it is first declared
+static llvm::Function* operation(const ClassInfo& info, const std::string& name, llvm::Type* return_type,
+                                 std::vector<llvm::Type*> params) {
+    std::string function_name = info.name + "." + name;
+    if (llvm::Function* existing = module->getFunction(function_name)) {
+        return existing;
+    }
+    params.insert(params.begin(), info.llvm_type);
+    llvm::Function* function = llvm::Function::Create(llvm::FunctionType::get(return_type, params, false),
+                                                      llvm::Function::InternalLinkage, function_name, module);
+    set_function_attributes(function);
+    function->getArg(0)->setName("collection");
+    return function;
+}
+
+static llvm::Value* field_address(llvm::IRBuilder<>& b, const ClassInfo& info, llvm::Value* collection,
+                                  unsigned field) {
+    return b.CreateStructGEP(info.struct_type, collection, field);
+}
+
+static llvm::Value* load_field(llvm::IRBuilder<>& b, const ClassInfo& info, llvm::Value* collection, unsigned field,
+                               const std::string& name) {
+    return b.CreateLoad(info.struct_type->getElementType(field), field_address(b, info, collection, field), name);
+}
+
+// A pointer field of the collection as an array of the given element type
+static llvm::Value* load_array(llvm::IRBuilder<>& b, const ClassInfo& info, llvm::Value* collection, unsigned field,
+                               llvm::Type* element, const std::string& name) {
+    return b.CreateBitCast(load_field(b, info, collection, field, name), element->getPointerTo(), name);
+}
+
+static llvm::Value* element_address(llvm::IRBuilder<>& b, llvm::Type* element, llvm::Value* array, llvm::Value* index) {
+    return b.CreateInBoundsGEP(element, array, b.CreateZExt(index, b.getInt64Ty()));
+}
+
+static void branch_unlikely(llvm::IRBuilder<>& b, llvm::Value* condition, llvm::BasicBlock* unlikely,
+                            llvm::BasicBlock* likely) {
+    b.CreateCondBr(condition, unlikely, likely, llvm::MDBuilder(context).createBranchWeights(1, 2000));
+}
+
+// ArrayList
+
+// Fails unless 0 <= index < size, a negative index is a large unsigned one
+static void check_index(llvm::IRBuilder<>& b, llvm::Value* index, llvm::Value* size) {
+    llvm::Function* function = b.GetInsertBlock()->getParent();
+    llvm::BasicBlock* out_of_bounds = llvm::BasicBlock::Create(context, "out_of_bounds", function);
+    llvm::BasicBlock* in_bounds = llvm::BasicBlock::Create(context, "in_bounds", function);
+    branch_unlikely(b, b.CreateICmpUGE(index, size), out_of_bounds, in_bounds);
+    b.SetInsertPoint(out_of_bounds);
+    b.CreateCall(runtime_function("kt_index_out_of_bounds", b.getVoidTy(), {b.getInt32Ty(), b.getInt32Ty()}, true),
+                 {index, size});
+    b.CreateUnreachable();
+    b.SetInsertPoint(in_bounds);
+}
+
+static void no_such_element(llvm::IRBuilder<>& b, const std::string& message) {
+    b.CreateCall(runtime_function("kt_no_such_element", b.getVoidTy(), {b.getInt8PtrTy()}, true),
+                 {b.CreateGlobalStringPtr(message, "kt.no_such_element", 0, module)});
+    b.CreateUnreachable();
+}
+
+static llvm::Function* list_add(const ClassInfo& info) {
+    llvm::Type* element = element_type(info, 0);
+    llvm::Function* function = operation(info, "add", builder.getInt1Ty(), {element});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* list = function->getArg(0);
+    llvm::BasicBlock* grow = llvm::BasicBlock::Create(context, "grow", function);
+    llvm::BasicBlock* store = llvm::BasicBlock::Create(context, "store", function);
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function, grow));
+    llvm::Value* size = load_field(b, info, list, LIST_SIZE, "size");
+    llvm::Value* capacity = load_field(b, info, list, LIST_CAPACITY, "capacity");
+    branch_unlikely(b, b.CreateICmpEQ(size, capacity), grow, store);
+
+    b.SetInsertPoint(grow);
+    b.CreateCall(runtime_function("kt_list_grow", b.getVoidTy(), {b.getInt8PtrTy(), b.getInt32Ty()}),
+                 {b.CreateBitCast(list, b.getInt8PtrTy()), element_size(info, 0)});
+    b.CreateBr(store);
+
+    b.SetInsertPoint(store);
+    llvm::Value* data = load_array(b, info, list, LIST_DATA, element, "data");
+    b.CreateStore(function->getArg(1), element_address(b, element, data, size));
+    b.CreateStore(b.CreateAdd(size, b.getInt32(1)), field_address(b, info, list, LIST_SIZE));
+    b.CreateRet(b.getTrue());
+    return function;
+}
+
+static llvm::Function* list_get(const ClassInfo& info) {
+    llvm::Type* element = element_type(info, 0);
+    llvm::Function* function = operation(info, "get", element, {builder.getInt32Ty()});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* list = function->getArg(0);
+    llvm::Value* index = function->getArg(1);
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function));
+    check_index(b, index, load_field(b, info, list, LIST_SIZE, "size"));
+    llvm::Value* data = load_array(b, info, list, LIST_DATA, element, "data");
+    b.CreateRet(b.CreateLoad(element, element_address(b, element, data, index), "element"));
+    return function;
+}
+
+// Returns the element it replaces, like Kotlin's set
+static llvm::Function* list_set(const ClassInfo& info) {
+    llvm::Type* element = element_type(info, 0);
+    llvm::Function* function = operation(info, "set", element, {builder.getInt32Ty(), element});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* list = function->getArg(0);
+    llvm::Value* index = function->getArg(1);
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function));
+    check_index(b, index, load_field(b, info, list, LIST_SIZE, "size"));
+    llvm::Value* address = element_address(b, element, load_array(b, info, list, LIST_DATA, element, "data"), index);
+    llvm::Value* previous = b.CreateLoad(element, address, "previous");
+    b.CreateStore(function->getArg(2), address);
+    b.CreateRet(previous);
+    return function;
+}
+
+static llvm::Function* list_remove_last(const ClassInfo& info) {
+    llvm::Type* element = element_type(info, 0);
+    llvm::Function* function = operation(info, "removeLast", element, {});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* list = function->getArg(0);
+    llvm::BasicBlock* empty = llvm::BasicBlock::Create(context, "empty", function);
+    llvm::BasicBlock* remove = llvm::BasicBlock::Create(context, "remove", function);
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function, empty));
+    llvm::Value* size = load_field(b, info, list, LIST_SIZE, "size");
+    branch_unlikely(b, b.CreateICmpEQ(size, b.getInt32(0)), empty, remove);
+
+    b.SetInsertPoint(empty);
+    no_such_element(b, "List is empty.");
+
+    b.SetInsertPoint(remove);
+    llvm::Value* last = b.CreateSub(size, b.getInt32(1), "last");
+    llvm::Value* data = load_array(b, info, list, LIST_DATA, element, "data");
+    llvm::Value* removed = b.CreateLoad(element, element_address(b, element, data, last), "removed");
+    b.CreateStore(last, field_address(b, info, list, LIST_SIZE));
+    b.CreateRet(removed);
+    return function;
+}
+
+// HashSet and HashMap
+
+// Keys are hashed and compared by their bits, so Double keys behave like boxed ones on the JVM: NaN equals NaN
+// and 0.0 differs from -0.0
+static llvm::Value* key_bits(llvm::IRBuilder<>& b, llvm::Value* key) {
+    llvm::Type* type = key->getType();
+    return type->isFloatingPointTy() ? b.CreateBitCast(key, b.getIntNTy(type->getPrimitiveSizeInBits())) : key;
+}
+
+// Same as kt_hash_bits in the runtime, which rehashes the keys when the table grows
+static llvm::Value* hash_key(llvm::IRBuilder<>& b, llvm::Value* key) {
+    llvm::Value* hash = b.CreateMul(b.CreateZExt(key_bits(b, key), b.getInt64Ty()), b.getInt64(hash_multiplier));
+    return b.CreateXor(hash, b.CreateLShr(hash, 32), "hash");
+}
+
+// The low 7 bits of the hash are stored in the control byte of the slot, the others choose the first group
+static llvm::Value* control_byte(llvm::IRBuilder<>& b, llvm::Value* hash) {
+    return b.CreateTrunc(b.CreateAnd(hash, 0x7f), b.getInt8Ty(), "h2");
+}
+
+static llvm::Value* first_position(llvm::IRBuilder<>& b, llvm::Value* hash, llvm::Value* mask) {
+    return b.CreateAnd(b.CreateTrunc(b.CreateLShr(hash, 7), b.getInt32Ty()), mask, "position");
+}
+
+static llvm::Value* load_group(llvm::IRBuilder<>& b, llvm::Value* control, llvm::Value* position) {
+    llvm::Type* group_type = llvm::FixedVectorType::get(b.getInt8Ty(), group_size);
+    llvm::Value* address = b.CreateBitCast(element_address(b, b.getInt8Ty(), control, position),
+                                           group_type->getPointerTo());
+    return b.CreateAlignedLoad(group_type, address, llvm::MaybeAlign(1), "group");
+}
+
+// One bit per control byte of the group for which the comparison holds, a single PMOVMSKB on x86
+static llvm::Value* group_mask(llvm::IRBuilder<>& b, llvm::Value* comparison) {
+    return b.CreateZExt(b.CreateBitCast(comparison, b.getIntNTy(group_size)), b.getInt32Ty(), "matches");
+}
+
+static llvm::Value* splat(llvm::IRBuilder<>& b, llvm::Value* byte) {
+    return b.CreateVectorSplat(group_size, byte);
+}
+
+static llvm::Value* slot_at(llvm::IRBuilder<>& b, llvm::Value* position, llvm::Value* bits, llvm::Value* mask) {
+    llvm::Function* cttz = llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::cttz, {b.getInt32Ty()});
+    return b.CreateAnd(b.CreateAdd(position, b.CreateCall(cttz, {bits, b.getTrue()})), mask, "slot");
+}
+
+// The control bytes of the first group are repeated after the last slot
+static void set_control(llvm::IRBuilder<>& b, llvm::Value* control, llvm::Value* mask, llvm::Value* slot,
+                        llvm::Value* byte) {
+    b.CreateStore(byte, element_address(b, b.getInt8Ty(), control, slot));
+    llvm::Value* mirror = b.CreateAdd(b.CreateAnd(b.CreateSub(slot, b.getInt32(group_size)), mask),
+                                      b.getInt32(group_size));
+    b.CreateStore(byte, element_address(b, b.getInt8Ty(), control, mirror));
+}
+
+// The groups of a probe sequence are a triangular number of groups apart, which visits every group of a power
+// of two sized table
+static llvm::Value* next_position(llvm::IRBuilder<>& b, llvm::PHINode* position, llvm::PHINode* stride,
+                                  llvm::Value* mask, llvm::BasicBlock* probe) {
+    llvm::Value* next_stride = b.CreateAdd(stride, b.getInt32(group_size), "next_stride");
+    llvm::Value* next = b.CreateAnd(b.CreateAdd(position, next_stride), mask, "next_position");
+    position->addIncoming(next, b.GetInsertBlock());
+    stride->addIncoming(next_stride, b.GetInsertBlock());
+    b.CreateBr(probe);
+    return next;
+}
+
+// The slot of the key or -1. Every group with a matching control byte is checked, the search ends at the first
+// group with an empty slot, which a table that is at most 7/8 full always has.
+static llvm::Function* table_find(const ClassInfo& info) {
+    llvm::Type* key_type = element_type(info, 0);
+    llvm::Function* function = operation(info, "find", builder.getInt32Ty(), {key_type});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* table = function->getArg(0);
+    llvm::Value* key = function->getArg(1);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* probe = llvm::BasicBlock::Create(context, "probe", function);
+    llvm::BasicBlock* candidates = llvm::BasicBlock::Create(context, "candidates", function);
+    llvm::BasicBlock* compare = llvm::BasicBlock::Create(context, "compare", function);
+    llvm::BasicBlock* found = llvm::BasicBlock::Create(context, "found", function);
+    llvm::BasicBlock* no_match = llvm::BasicBlock::Create(context, "no_match", function);
+    llvm::BasicBlock* missing = llvm::BasicBlock::Create(context, "missing", function);
+    llvm::BasicBlock* next_group = llvm::BasicBlock::Create(context, "next_group", function);
+
+    llvm::IRBuilder<> b(entry);
+    llvm::Value* hash = hash_key(b, key);
+    llvm::Value* h2 = splat(b, control_byte(b, hash));
+    llvm::Value* control = load_field(b, info, table, TABLE_CONTROL, "control");
+    llvm::Value* keys = load_array(b, info, table, TABLE_KEYS, key_type, "keys");
+    llvm::Value* mask = load_field(b, info, table, TABLE_MASK, "mask");
+    llvm::Value* start = first_position(b, hash, mask);
+    b.CreateBr(probe);
+
+    b.SetInsertPoint(probe);
+    llvm::PHINode* position = b.CreatePHI(b.getInt32Ty(), 2, "position");
+    llvm::PHINode* stride = b.CreatePHI(b.getInt32Ty(), 2, "stride");
+    position->addIncoming(start, entry);
+    stride->addIncoming(b.getInt32(0), entry);
+    llvm::Value* group = load_group(b, control, position);
+    llvm::Value* matches = group_mask(b, b.CreateICmpEQ(group, h2));
+    b.CreateBr(candidates);
+
+    b.SetInsertPoint(candidates);
+    llvm::PHINode* remaining = b.CreatePHI(b.getInt32Ty(), 2, "remaining");
+    remaining->addIncoming(matches, probe);
+    b.CreateCondBr(b.CreateICmpNE(remaining, b.getInt32(0)), compare, no_match);
+
+    b.SetInsertPoint(compare);
+    llvm::Value* slot = slot_at(b, position, remaining, mask);
+    llvm::Value* candidate = b.CreateLoad(key_type, element_address(b, key_type, keys, slot), "candidate");
+    remaining->addIncoming(b.CreateAnd(remaining, b.CreateSub(remaining, b.getInt32(1))), compare);
+    b.CreateCondBr(b.CreateICmpEQ(key_bits(b, candidate), key_bits(b, key)), found, candidates);
+
+    b.SetInsertPoint(found);
+    b.CreateRet(slot);
+
+    b.SetInsertPoint(no_match);
+    llvm::Value* empty = group_mask(b, b.CreateICmpEQ(group, splat(b, b.getInt8(hash_empty))));
+    b.CreateCondBr(b.CreateICmpNE(empty, b.getInt32(0)), missing, next_group);
+
+    b.SetInsertPoint(missing);
+    b.CreateRet(b.getInt32(-1));
+
+    b.SetInsertPoint(next_group);
+    next_position(b, position, stride, mask, probe);
+    return function;
+}
+
+// The slot of the key, which is inserted when it is missing. The slot of an inserted key is returned as
+// -1 - slot, the caller stores the value.
+static llvm::Function* table_insert(const ClassInfo& info) {
+    llvm::Type* key_type = element_type(info, 0);
+    llvm::Function* function = operation(info, "insert", builder.getInt32Ty(), {key_type});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* table = function->getArg(0);
+    llvm::Value* key = function->getArg(1);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* existing = llvm::BasicBlock::Create(context, "existing", function);
+    llvm::BasicBlock* missing = llvm::BasicBlock::Create(context, "missing", function);
+    llvm::BasicBlock* grow = llvm::BasicBlock::Create(context, "grow", function);
+    llvm::BasicBlock* insert = llvm::BasicBlock::Create(context, "insert", function);
+    llvm::BasicBlock* probe = llvm::BasicBlock::Create(context, "probe", function);
+    llvm::BasicBlock* next_group = llvm::BasicBlock::Create(context, "next_group", function);
+    llvm::BasicBlock* claim = llvm::BasicBlock::Create(context, "claim", function);
+
+    llvm::IRBuilder<> b(entry);
+    llvm::Value* found = b.CreateCall(table_find(info), {table, key}, "found");
+    b.CreateCondBr(b.CreateICmpSGE(found, b.getInt32(0)), existing, missing);
+
+    b.SetInsertPoint(existing);
+    b.CreateRet(found);
+
+    b.SetInsertPoint(missing);
+    llvm::Value* growth_left = load_field(b, info, table, TABLE_GROWTH_LEFT, "growth_left");
+    branch_unlikely(b, b.CreateICmpEQ(growth_left, b.getInt32(0)), grow, insert);
+
+    b.SetInsertPoint(grow);
+    llvm::Constant* value_size = info.kind == MAP_CLASS ? element_size(info, 1) : b.getInt32(0);
+    b.CreateCall(runtime_function("kt_hash_table_grow", b.getVoidTy(), {b.getInt8PtrTy(), b.getInt32Ty(), b.getInt32Ty()}),
+                 {b.CreateBitCast(table, b.getInt8PtrTy()), element_size(info, 0), value_size});
+    b.CreateBr(insert);
+
+    // Deleted slots can be reused, so the key goes into the first slot of its probe sequence that is not full
+    b.SetInsertPoint(insert);
+    llvm::Value* hash = hash_key(b, key);
+    llvm::Value* control = load_field(b, info, table, TABLE_CONTROL, "control");
+    llvm::Value* mask = load_field(b, info, table, TABLE_MASK, "mask");
+    llvm::Value* start = first_position(b, hash, mask);
+    b.CreateBr(probe);
+
+    b.SetInsertPoint(probe);
+    llvm::PHINode* position = b.CreatePHI(b.getInt32Ty(), 2, "position");
+    llvm::PHINode* stride = b.CreatePHI(b.getInt32Ty(), 2, "stride");
+    position->addIncoming(start, insert);
+    stride->addIncoming(b.getInt32(0), insert);
+    llvm::Value* group = load_group(b, control, position);
+    // Empty and deleted control bytes are the negative ones
+    llvm::Value* free = group_mask(b, b.CreateICmpSLT(group, llvm::Constant::getNullValue(group->getType())));
+    b.CreateCondBr(b.CreateICmpNE(free, b.getInt32(0)), claim, next_group);
+
+    b.SetInsertPoint(next_group);
+    next_position(b, position, stride, mask, probe);
+
+    b.SetInsertPoint(claim);
+    llvm::Value* slot = slot_at(b, position, free, mask);
+    llvm::Value* previous = b.CreateLoad(b.getInt8Ty(), element_address(b, b.getInt8Ty(), control, slot), "previous");
+    set_control(b, control, mask, slot, control_byte(b, hash));
+    llvm::Value* keys = load_array(b, info, table, TABLE_KEYS, key_type, "keys");
+    b.CreateStore(key, element_address(b, key_type, keys, slot));
+    llvm::Value* size = load_field(b, info, table, TABLE_SIZE, "size");
+    b.CreateStore(b.CreateAdd(size, b.getInt32(1)), field_address(b, info, table, TABLE_SIZE));
+    llvm::Value* was_empty = b.CreateZExt(b.CreateICmpEQ(previous, b.getInt8(hash_empty)), b.getInt32Ty());
+    growth_left = load_field(b, info, table, TABLE_GROWTH_LEFT, "growth_left");
+    b.CreateStore(b.CreateSub(growth_left, was_empty), field_address(b, info, table, TABLE_GROWTH_LEFT));
+    b.CreateRet(b.CreateSub(b.getInt32(-1), slot));
+    return function;
+}
+
+// Removed keys leave a deleted control byte behind, so the searches for other keys go on past their slot.
+// Deleted slots are reused by insertions and dropped when the table grows.
+static llvm::Function* table_remove(const ClassInfo& info) {
+    llvm::Type* key_type = element_type(info, 0);
+    llvm::Function* function = operation(info, "remove", builder.getInt1Ty(), {key_type});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* table = function->getArg(0);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* missing = llvm::BasicBlock::Create(context, "missing", function);
+    llvm::BasicBlock* remove = llvm::BasicBlock::Create(context, "remove", function);
+
+    llvm::IRBuilder<> b(entry);
+    llvm::Value* slot = b.CreateCall(table_find(info), {table, function->getArg(1)}, "slot");
+    b.CreateCondBr(b.CreateICmpSLT(slot, b.getInt32(0)), missing, remove);
+
+    b.SetInsertPoint(missing);
+    b.CreateRet(b.getFalse());
+
+    b.SetInsertPoint(remove);
+    llvm::Value* control = load_field(b, info, table, TABLE_CONTROL, "control");
+    llvm::Value* mask = load_field(b, info, table, TABLE_MASK, "mask");
+    set_control(b, control, mask, slot, b.getInt8(hash_deleted));
+    llvm::Value* size = load_field(b, info, table, TABLE_SIZE, "size");
+    b.CreateStore(b.CreateSub(size, b.getInt32(1)), field_address(b, info, table, TABLE_SIZE));
+    b.CreateRet(b.getTrue());
+    return function;
+}
+
+static llvm::Function* set_add(const ClassInfo& info) {
+    llvm::Function* function = operation(info, "add", builder.getInt1Ty(), {element_type(info, 0)});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function));
+    llvm::Value* slot = b.CreateCall(table_insert(info), {function->getArg(0), function->getArg(1)}, "slot");
+    b.CreateRet(b.CreateICmpSLT(slot, b.getInt32(0), "added"));
+    return function;
+}
+
+static llvm::Function* table_contains(const ClassInfo& info, const std::string& name) {
+    llvm::Function* function = operation(info, name, builder.getInt1Ty(), {element_type(info, 0)});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function));
+    llvm::Value* slot = b.CreateCall(table_find(info), {function->getArg(0), function->getArg(1)}, "slot");
+    b.CreateRet(b.CreateICmpSGE(slot, b.getInt32(0), "contains"));
+    return function;
+}
+
+// get fails for a missing key like getValue, getOrDefault returns its second argument
+static llvm::Function* map_get(const ClassInfo& info, bool with_default) {
+    llvm::Type* value_type = element_type(info, 1);
+    std::vector<llvm::Type*> params = {element_type(info, 0)};
+    if (with_default) {
+        params.push_back(value_type);
+    }
+    llvm::Function* function = operation(info, with_default ? "getOrDefault" : "get", value_type, params);
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* map = function->getArg(0);
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* missing = llvm::BasicBlock::Create(context, "missing", function);
+    llvm::BasicBlock* found = llvm::BasicBlock::Create(context, "found", function);
+
+    llvm::IRBuilder<> b(entry);
+    llvm::Value* slot = b.CreateCall(table_find(info), {map, function->getArg(1)}, "slot");
+    llvm::Value* is_missing = b.CreateICmpSLT(slot, b.getInt32(0));
+    if (with_default) {
+        b.CreateCondBr(is_missing, missing, found);
+        b.SetInsertPoint(missing);
+        b.CreateRet(function->getArg(2));
+    } else {
+        branch_unlikely(b, is_missing, missing, found);
+        b.SetInsertPoint(missing);
+        no_such_element(b, "Key is missing in the map.");
+    }
+
+    b.SetInsertPoint(found);
+    llvm::Value* values = load_array(b, info, map, TABLE_VALUES, value_type, "values");
+    b.CreateRet(b.CreateLoad(value_type, element_address(b, value_type, values, slot), "value"));
+    return function;
+}
+
+// `map[key] = value`, returns the value
+static llvm::Function* map_set(const ClassInfo& info) {
+    llvm::Type* value_type = element_type(info, 1);
+    llvm::Function* function = operation(info, "set", value_type, {element_type(info, 0), value_type});
+    if (!function->empty()) {
+        return function;
+    }
+    llvm::Value* map = function->getArg(0);
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(context, "entry", function));
+    llvm::Value* slot = b.CreateCall(table_insert(info), {map, function->getArg(1)}, "slot");
+    slot = b.CreateSelect(b.CreateICmpSLT(slot, b.getInt32(0)), b.CreateSub(b.getInt32(-1), slot), slot, "slot");
+    llvm::Value* values = load_array(b, info, map, TABLE_VALUES, value_type, "values");
+    b.CreateStore(function->getArg(2), element_address(b, value_type, values, slot));
+    b.CreateRet(function->getArg(2));
+    return function;
+}
+
+// Methods
+
+struct Method {
+    const char* name;
+    // Kinds of the argument types: 'e' the element or key, 'v' the value, 'i' an Int index, 'f' a function of
+    // the element or of the key and the value
+    const char* params;
+    // The same kinds for the result, or 'b' Boolean, or 'u' Unit
+    char result;
+};
+
+static const std::vector<Method>& methods(ClassKind kind) {
+    static const std::vector<Method> list_methods = {
+            {"add", "e", 'b'}, {"get", "i", 'e'}, {"set", "ie", 'e'}, {"removeLast", "", 'e'}, {"isEmpty", "", 'b'},
+            {"forEach", "f", 'u'}};
+    static const std::vector<Method> set_methods = {
+            {"add", "e", 'b'}, {"contains", "e", 'b'}, {"remove", "e", 'b'}, {"isEmpty", "", 'b'}, {"forEach", "f", 'u'}};
+    static const std::vector<Method> map_methods = {
+            {"get", "e", 'v'}, {"getOrDefault", "ev", 'v'}, {"set", "ev", 'v'}, {"containsKey", "e", 'b'},
+            {"remove", "e", 'b'}, {"isEmpty", "", 'b'}, {"forEach", "f", 'u'}};
+    return kind == LIST_CLASS ? list_methods : kind == SET_CLASS ? set_methods : map_methods;
+}
+
+static Type kind_type(const ClassInfo& info, char kind) {
+    switch (kind) {
+        case 'e': return info.fields[0].type;
+        case 'v': return info.fields[1].type;
+        case 'i': return INT;
+        case 'f':
+            if (info.kind == MAP_CLASS) {
+                return function_type({info.fields[0].type, info.fields[1].type}, UNIT);
+            }
+            return function_type({info.fields[0].type}, UNIT);
+        case 'u': return UNIT;
+        default: return BOOLEAN;
+    }
+}
+
+static const Method& find_method(const ClassInfo& info, const std::string& name, const std::vector<ExprAST*>& args) {
+    for (const Method& method : methods(info.kind)) {
+        if (method.name == name) {
+            if (args.size() != strlen(method.params)) {
+                yyerror("Wrong number of arguments: " + info.name + "." + name);
+            }
+            return method;
+        }
+    }
+    yyerror(info.name + " has no method " + name);
+    return methods(info.kind)[0];
+}
+
+Type collection_method_type(Type collection, const std::string& name, const std::vector<ExprAST*>& args) {
+    const ClassInfo& info = class_info(collection);
+    return kind_type(info, find_method(info, name, args).result);
+}
+
+static llvm::Function* method_function(const ClassInfo& info, const std::string& name) {
+    if (info.kind == LIST_CLASS) {
+        if (name == "add") return list_add(info);
+        if (name == "get") return list_get(info);
+        if (name == "set") return list_set(info);
+        return list_remove_last(info);
+    }
+    if (name == "add") return set_add(info);
+    if (name == "contains" || name == "containsKey") return table_contains(info, name);
+    if (name == "remove") return table_remove(info);
+    if (name == "set") return map_set(info);
+    return map_get(info, name == "getOrDefault");
+}
+
+llvm::Value* collection_size(ExprAST* collection) {
+    const ClassInfo& info = class_info(collection->type());
+    unsigned field = info.kind == LIST_CLASS ? static_cast<unsigned>(LIST_SIZE) : static_cast<unsigned>(TABLE_SIZE);
+    return load_field(builder, info, collection->codegen(), field, "size");
+}
+
+// Generated in the caller, so the action is inlined like the lambda of an inline function. The size, buffers and
+// mask are loaded again for every element, the action may change the collection.
+static void for_each(const ClassInfo& info, ExprAST* collection, ExprAST* action) {
+    llvm::Value* object = collection->codegen();
+    InlinedFunction function = bind_function(action, kind_type(info, 'f'));
+    llvm::Function* parent = builder.GetInsertBlock()->getParent();
+    llvm::AllocaInst* index = create_entry_block_alloca(parent, "index", builder.getInt32Ty());
+    builder.CreateStore(builder.getInt32(0), index);
+    llvm::BasicBlock* cond_block = llvm::BasicBlock::Create(context, "foreach.cond", parent);
+    llvm::BasicBlock* loop_block = llvm::BasicBlock::Create(context, "foreach.loop", parent);
+    llvm::BasicBlock* next_block = llvm::BasicBlock::Create(context, "foreach.next", parent);
+    llvm::BasicBlock* after_loop_block = llvm::BasicBlock::Create(context, "foreach.end", parent);
+    builder.CreateBr(cond_block);
+
+    builder.SetInsertPoint(cond_block);
+    llvm::Value* current = builder.CreateLoad(builder.getInt32Ty(), index, "index");
+    llvm::Value* in_range;
+    if (info.kind == LIST_CLASS) {
+        in_range = builder.CreateICmpSLT(current, load_field(builder, info, object, LIST_SIZE, "size"));
+    } else {
+        // The slots of a table are 0 to mask, an empty one has a mask of 0 and a single empty slot
+        in_range = builder.CreateICmpSLE(current, load_field(builder, info, object, TABLE_MASK, "mask"));
+    }
+    builder.CreateCondBr(in_range, loop_block, after_loop_block);
+
+    builder.SetInsertPoint(loop_block);
+    llvm::Type* element = element_type(info, 0);
+    if (info.kind == LIST_CLASS) {
+        llvm::Value* data = load_array(builder, info, object, LIST_DATA, element, "data");
+        llvm::Value* value = builder.CreateLoad(element, element_address(builder, element, data, current), "element");
+        invoke_function(function, {value});
+    } else {
+        // Full slots have a control byte of 0 to 127
+        llvm::Value* control = load_field(builder, info, object, TABLE_CONTROL, "control");
+        llvm::Value* byte = builder.CreateLoad(builder.getInt8Ty(),
+                                               element_address(builder, builder.getInt8Ty(), control, current));
+        llvm::BasicBlock* full_block = llvm::BasicBlock::Create(context, "foreach.full", parent, next_block);
+        builder.CreateCondBr(builder.CreateICmpSGE(byte, builder.getInt8(0)), full_block, next_block);
+
+        builder.SetInsertPoint(full_block);
+        llvm::Value* keys = load_array(builder, info, object, TABLE_KEYS, element, "keys");
+        std::vector<llvm::Value*> values = {
+                builder.CreateLoad(element, element_address(builder, element, keys, current), "key")};
+        if (info.kind == MAP_CLASS) {
+            llvm::Type* value_type = element_type(info, 1);
+            llvm::Value* table_values = load_array(builder, info, object, TABLE_VALUES, value_type, "values");
+            values.push_back(builder.CreateLoad(value_type, element_address(builder, value_type, table_values, current),
+                                                "value"));
+        }
+        invoke_function(function, values);
+    }
+    builder.CreateBr(next_block);
+
+    builder.SetInsertPoint(next_block);
+    builder.CreateStore(builder.CreateAdd(current, builder.getInt32(1), "nextvar"), index);
+    builder.CreateBr(cond_block);
+
+    after_loop_block->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(after_loop_block);
+}
+
+llvm::Value* collection_method_codegen(ExprAST* collection, const std::string& name, const std::vector<ExprAST*>& args) {
+    const ClassInfo& info = class_info(collection->type());
+    const Method& method = find_method(info, name, args);
+    if (name == "isEmpty") {
+        return builder.CreateICmpEQ(collection_size(collection), builder.getInt32(0), "is_empty");
+    }
+    if (name == "forEach") {
+        for_each(info, collection, args[0]);
+        return nullptr;
+    }
+
+    std::vector<llvm::Value*> values = {collection->codegen()};
+    for (unsigned i = 0; i < args.size(); i++) {
+        values.push_back(convert_value(args[i]->codegen(), args[i]->type(), kind_type(info, method.params[i])));
+    }
+    return builder.CreateCall(method_function(info, name), values, name);
+}
+
+// The runtime returns lists without a buffer and tables that share an empty group
+llvm::Value* NewCollectionExprAST::codegen() {
+    const ClassInfo& info = class_info(_collection_type);
+    llvm::FunctionCallee create = runtime_function(info.kind == LIST_CLASS ? "kt_list_new" : "kt_hash_table_new",
+                                                   builder.getInt8PtrTy(), {});
+    llvm::Value* memory = builder.CreateCall(create, {}, "collection_memory");
+    return root_temporary(builder.CreateBitCast(memory, info.llvm_type, "collection"));
+}
+
+Type MethodCallExprAST::type() {
+    Type object_type = _object->type();
+    if (!is_collection(object_type)) {
+        yyerror(type_name(object_type) + " has no method " + _name);
+    }
+    return collection_method_type(object_type, _name, _args);
+}
+
+llvm::Value* MethodCallExprAST::codegen() {
+    type();
+    return collection_method_codegen(_object, _name, _args);
+}
+
+void IndexAssignStatement::codegen() {
+    Type object_type = _object->type();
+    if (!is_collection(object_type) || class_info(object_type).kind == SET_CLASS) {
+        yyerror(type_name(object_type) + " has no set operator");
+    }
+    collection_method_codegen(_object, "set", {_index, _expr});
+}
@@ -0,0 +1,31 @@
+#ifndef KOTLIN_LLVM_COLLECTIONS_HPP
+#define KOTLIN_LLVM_COLLECTIONS_HPP
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/DerivedTypes.h"
+
+#include "ast.hpp"
+#include "classes.hpp"
+
+// ArrayList<T>, HashSet<T> and HashMap<K, V> of numbers, Char and Boolean. Every instantiation is a class of its
+// own whose elements are stored unboxed, and its operations are generated for the element types as internal
+// functions (e.g. `HashMap<Int, Long>.get`) that the inliner can fold into their callers. Only creating, growing
+// and reporting errors call into the runtime, see runtime.hpp for the layout of the tables.
+
+bool is_collection(Type type);
+
+// The runtime's kt_list for LIST_CLASS and kt_hash_table for SET_CLASS and MAP_CLASS
+llvm::StructType* collection_struct_type(ClassKind kind);
+
+// Registers the instantiation the first time it is used, reports an error for unsupported element types
+Type collection_type(const std::string& name, const std::vector<Type>& arguments);
+
+// The size property, the only one collections have
+llvm::Value* collection_size(ExprAST* collection);
+
+Type collection_method_type(Type collection, const std::string& name, const std::vector<ExprAST*>& args);
+llvm::Value* collection_method_codegen(ExprAST* collection, const std::string& name, const std::vector<ExprAST*>& args);
+
+#endif //KOTLIN_LLVM_COLLECTIONS_HPP
@@ -0,0 +1,80 @@
+#include "conversion.hpp"
+#include "classes.hpp"
+
+#include "llvm/IR/Intrinsics.h"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+extern void yyerror(std::string msg);
+
+std::string type_name(Type type) {
+    switch (type) {
+        case INT: return "Int";
+        case DOUBLE: return "Double";
+        case STRING: return "String";
+        case LONG: return "Long";
+        case FLOAT: return "Float";
+        case SHORT: return "Short";
+        case BYTE: return "Byte";
+        case BOOLEAN: return "Boolean";
+        case CHAR: return "Char";
+        case UNIT: return "Unit";
+        default: return class_info(type).name;
+    }
+}
+
+bool is_integral(Type type) {
+    return type == INT || type == LONG || type == SHORT || type == BYTE || type == CHAR;
+}
+
+bool is_floating_point(Type type) {
+    return type == DOUBLE || type == FLOAT;
+}
+
+bool is_unsigned(Type type) {
+    return type == CHAR || type == BOOLEAN;
+}
+
+Type arithmetic_type(Type first, Type second) {
+    if (!(is_integral(first) || is_floating_point(first)) || !(is_integral(second) || is_floating_point(second))) {
+        yyerror("Arithmetic is not defined for " + type_name(first) + " and " + type_name(second));
+    }
+    if (first == DOUBLE || second == DOUBLE) {
+        return DOUBLE;
+    }
+    if (first == FLOAT || second == FLOAT) {
+        return FLOAT;
+    }
+    if (first == LONG || second == LONG) {
+        return LONG;
+    }
+    return INT;
+}
+
+llvm::Value* convert_value(llvm::Value* value, Type from, Type to) {
+    if (from == to) {
+        return value;
+    }
+    if (from == STRING || to == STRING || from == BOOLEAN || to == BOOLEAN || from == UNIT || to == UNIT ||
+        is_class(from) || is_class(to)) {
+        yyerror("Type mismatch: cannot convert " + type_name(from) + " to " + type_name(to));
+    }
+
+    llvm::Type* target = type_to_llvm_type(to);
+    if (is_integral(from) && is_integral(to)) {
+        return builder.CreateIntCast(value, target, !is_unsigned(from), "conv");
+    }
+    if (is_integral(from)) {
+        return is_unsigned(from) ? builder.CreateUIToFP(value, target, "conv")
+                                 : builder.CreateSIToFP(value, target, "conv");
+    }
+    if (is_floating_point(to)) {
+        return builder.CreateFPCast(value, target, "conv");
+    }
+    // Like toInt() on the JVM: out of range values saturate and NaN becomes 0
+    llvm::Intrinsic::ID saturating = is_unsigned(to) ? llvm::Intrinsic::fptoui_sat : llvm::Intrinsic::fptosi_sat;
+    llvm::Function* convert = llvm::Intrinsic::getDeclaration(module, saturating, {target, value->getType()});
+    return builder.CreateCall(convert, {value}, "conv");
+}
@@ -0,0 +1,30 @@
+#ifndef KOTLIN_LLVM_CONVERSION_HPP
+#define KOTLIN_LLVM_CONVERSION_HPP
+
+#include <string>
+
+#include "llvm/IR/Value.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/IRBuilder.h"
+
+#include "ast.hpp"
+
+std::string type_name(Type type);
+
+bool is_integral(Type type);
+bool is_floating_point(Type type);
+// Char and Boolean are stored zero-extended, every other integer type is signed
+bool is_unsigned(Type type);
+
+// Kotlin numeric promotion: the type a binary arithmetic operation is done in. Double wins over Float,
+// Float over Long and everything narrower (Short, Byte, Char) is widened to Int.
+Type arithmetic_type(Type first, Type second);
+
+// Integer `/` and `%` as in Kotlin: a zero divisor fails with an ArithmeticException, and MIN_VALUE / -1 wraps
+// around to MIN_VALUE instead of being undefined like sdiv
+llvm::Value* integer_division(llvm::Value* dividend, llvm::Value* divisor, bool remainder, const std::string& name);
+
+// Converts a value between two Kotlin types, reporting an error for String and Boolean
+llvm::Value* convert_value(llvm::Value* value, Type from, Type to);
+
+#endif //KOTLIN_LLVM_CONVERSION_HPP
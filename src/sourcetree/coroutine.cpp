@@ -0,0 +1,280 @@
+#include "coroutine.hpp"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "allocation.hpp"
+#include "classes.hpp"
+#include "conversion.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+extern void yyerror(std::string msg);
+
+CoroutineState* current_coroutine = nullptr;
+
+// Passed to coro.id and coro.promise, enough for every type a function can return
+static const unsigned promise_alignment = 8;
+
+static llvm::Function* intrinsic(llvm::Intrinsic::ID id, llvm::ArrayRef<llvm::Type*> types = {}) {
+    return llvm::Intrinsic::getDeclaration(module, id, types);
+}
+
+static llvm::FunctionCallee runtime_function(const std::string& name, llvm::Type* return_type,
+                                             llvm::ArrayRef<llvm::Type*> param_types) {
+    return module->getOrInsertFunction(name, llvm::FunctionType::get(return_type, param_types, false));
+}
+
+llvm::StructType* promise_type(Type result_type) {
+    return llvm::StructType::get(context, {type_to_llvm_type(result_type), llvm::Type::getInt8PtrTy(context),
+                                           llvm::Type::getInt1Ty(context)});
+}
+
+static llvm::Value* promise_of(llvm::Value* handle, Type result_type) {
+    llvm::Value* promise = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_promise), {
+            handle, builder.getInt32(promise_alignment), builder.getFalse()});
+    return builder.CreateBitCast(promise, promise_type(result_type)->getPointerTo(), "promise");
+}
+
+// Suspends the current coroutine, execution continues at resume_block once it is resumed
+static void suspend(llvm::BasicBlock* resume_block) {
+    llvm::Value* result = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_suspend), {
+            llvm::ConstantTokenNone::get(context), builder.getFalse()});
+    llvm::SwitchInst* dispatch = builder.CreateSwitch(result, current_coroutine->suspend_block, 2);
+    dispatch->addCase(builder.getInt8(0), resume_block);
+    dispatch->addCase(builder.getInt8(1), current_coroutine->cleanup_block);
+}
+
+void begin_coroutine(llvm::Function* function, Type result_type) {
+    llvm::PointerType* i8_ptr = llvm::Type::getInt8PtrTy(context);
+    auto* state = new CoroutineState();
+    current_coroutine = state;
+    // Tells CoroEarly and CoroSplit that this function still has to be split
+    function->addFnAttr("coroutine.presplit", "0");
+
+    state->promise = create_entry_block_alloca(function, "promise", promise_type(result_type));
+    state->promise->setAlignment(llvm::Align(promise_alignment));
+    state->id = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_id), {
+            builder.getInt32(promise_alignment), builder.CreateBitCast(state->promise, i8_ptr),
+            llvm::ConstantPointerNull::get(i8_ptr), llvm::ConstantPointerNull::get(i8_ptr)}, "id");
+
+    // coro.alloc is false when CoroElide placed the frame in the caller's
+    llvm::BasicBlock* entry_block = builder.GetInsertBlock();
+    llvm::BasicBlock* alloc_block = llvm::BasicBlock::Create(context, "coro.alloc", function);
+    llvm::BasicBlock* begin_block = llvm::BasicBlock::Create(context, "coro.begin", function);
+    builder.CreateCondBr(builder.CreateCall(intrinsic(llvm::Intrinsic::coro_alloc), {state->id}), alloc_block, begin_block);
+
+    builder.SetInsertPoint(alloc_block);
+    llvm::Value* size = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_size, {builder.getInt64Ty()}), {});
+    llvm::Value* memory = builder.CreateCall(runtime_function("malloc", i8_ptr, {builder.getInt64Ty()}), {size}, "frame");
+    builder.CreateBr(begin_block);
+
+    builder.SetInsertPoint(begin_block);
+    llvm::PHINode* frame = builder.CreatePHI(i8_ptr, 2);
+    frame->addIncoming(llvm::ConstantPointerNull::get(i8_ptr), entry_block);
+    frame->addIncoming(memory, alloc_block);
+    state->handle = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_begin), {state->id, frame}, "handle");
+
+    llvm::Type* promise = state->promise->getAllocatedType();
+    builder.CreateStore(llvm::ConstantPointerNull::get(i8_ptr), builder.CreateStructGEP(promise, state->promise, 1));
+    builder.CreateStore(builder.getFalse(), builder.CreateStructGEP(promise, state->promise, 2));
+
+    state->final_block = llvm::BasicBlock::Create(context, "coro.final");
+    state->cleanup_block = llvm::BasicBlock::Create(context, "coro.cleanup");
+    state->suspend_block = llvm::BasicBlock::Create(context, "coro.suspend");
+
+    // Started lazily, so the caller can fill in the promise first
+    llvm::BasicBlock* body_block = llvm::BasicBlock::Create(context, "body", function);
+    suspend(body_block);
+    builder.SetInsertPoint(body_block);
+}
+
+void coroutine_return(llvm::Value* value) {
+    llvm::Type* promise = current_coroutine->promise->getAllocatedType();
+    builder.CreateStore(value, builder.CreateStructGEP(promise, current_coroutine->promise, 0));
+    builder.CreateBr(current_coroutine->final_block);
+}
+
+void finish_coroutine() {
+    CoroutineState* state = current_coroutine;
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    llvm::PointerType* i8_ptr = llvm::Type::getInt8PtrTy(context);
+    llvm::Type* promise = state->promise->getAllocatedType();
+    if (builder.GetInsertBlock()->getTerminator() == nullptr) {
+        yyerror("Suspend function " + function->getName().str() + " must end with a return");
+    }
+
+    // Wakes up the awaiting coroutine through the event loop, launched coroutines free themselves instead of
+    // waiting at the final suspend point for a coro.destroy that never comes
+    function->getBasicBlockList().push_back(state->final_block);
+    builder.SetInsertPoint(state->final_block);
+    llvm::Value* continuation = builder.CreateLoad(i8_ptr, builder.CreateStructGEP(promise, state->promise, 1), "continuation");
+    llvm::BasicBlock* wake_block = llvm::BasicBlock::Create(context, "coro.wake", function);
+    llvm::BasicBlock* detached_block = llvm::BasicBlock::Create(context, "coro.detached", function);
+    builder.CreateCondBr(builder.CreateIsNull(continuation), detached_block, wake_block);
+
+    builder.SetInsertPoint(wake_block);
+    builder.CreateCall(runtime_function("kt_coro_schedule", builder.getVoidTy(), {i8_ptr}), {continuation});
+    builder.CreateBr(detached_block);
+
+    builder.SetInsertPoint(detached_block);
+    llvm::Value* detached = builder.CreateLoad(builder.getInt1Ty(), builder.CreateStructGEP(promise, state->promise, 2), "detached");
+    llvm::BasicBlock* final_suspend_block = llvm::BasicBlock::Create(context, "coro.final.suspend", function);
+    builder.CreateCondBr(detached, state->cleanup_block, final_suspend_block);
+
+    builder.SetInsertPoint(final_suspend_block);
+    llvm::Value* result = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_suspend), {
+            llvm::ConstantTokenNone::get(context), builder.getTrue()});
+    llvm::BasicBlock* unreachable_block = llvm::BasicBlock::Create(context, "coro.final.resumed", function);
+    llvm::SwitchInst* dispatch = builder.CreateSwitch(result, state->suspend_block, 2);
+    dispatch->addCase(builder.getInt8(0), unreachable_block);
+    dispatch->addCase(builder.getInt8(1), state->cleanup_block);
+    builder.SetInsertPoint(unreachable_block);
+    builder.CreateUnreachable();
+
+    // coro.free is null when the frame was elided
+    function->getBasicBlockList().push_back(state->cleanup_block);
+    builder.SetInsertPoint(state->cleanup_block);
+    llvm::Value* memory = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_free), {state->id, state->handle}, "memory");
+    llvm::BasicBlock* free_block = llvm::BasicBlock::Create(context, "coro.free", function);
+    builder.CreateCondBr(builder.CreateIsNull(memory), state->suspend_block, free_block);
+
+    builder.SetInsertPoint(free_block);
+    builder.CreateCall(runtime_function("free", builder.getVoidTy(), {i8_ptr}), {memory});
+    builder.CreateBr(state->suspend_block);
+
+    function->getBasicBlockList().push_back(state->suspend_block);
+    builder.SetInsertPoint(state->suspend_block);
+    builder.CreateCall(intrinsic(llvm::Intrinsic::coro_end), {state->handle, builder.getFalse()});
+    builder.CreateRet(state->handle);
+
+    delete state;
+    current_coroutine = nullptr;
+}
+
+llvm::Value* await_coroutine(llvm::Value* handle, Type result_type, bool resume) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    llvm::Value* promise = promise_of(handle, result_type);
+    if (resume) {
+        builder.CreateCall(intrinsic(llvm::Intrinsic::coro_resume), {handle});
+    }
+
+    llvm::BasicBlock* wait_block = llvm::BasicBlock::Create(context, "await.wait", function);
+    llvm::BasicBlock* destroy_block = llvm::BasicBlock::Create(context, "await.destroy", function);
+    llvm::BasicBlock* ready_block = llvm::BasicBlock::Create(context, "await.ready", function);
+    builder.CreateCondBr(builder.CreateCall(intrinsic(llvm::Intrinsic::coro_done), {handle}), ready_block, wait_block);
+
+    // The awaited coroutine schedules this one when it completes
+    builder.SetInsertPoint(wait_block);
+    llvm::StructType* type = promise_type(result_type);
+    builder.CreateStore(current_coroutine->handle, builder.CreateStructGEP(type, promise, 1));
+    llvm::Value* result = builder.CreateCall(intrinsic(llvm::Intrinsic::coro_suspend), {
+            llvm::ConstantTokenNone::get(context), builder.getFalse()});
+    llvm::SwitchInst* dispatch = builder.CreateSwitch(result, current_coroutine->suspend_block, 2);
+    dispatch->addCase(builder.getInt8(0), ready_block);
+    dispatch->addCase(builder.getInt8(1), destroy_block);
+
+    // Destroying this coroutine while it waits destroys the awaited one too
+    builder.SetInsertPoint(destroy_block);
+    builder.CreateCall(intrinsic(llvm::Intrinsic::coro_destroy), {handle});
+    builder.CreateBr(current_coroutine->cleanup_block);
+
+    builder.SetInsertPoint(ready_block);
+    llvm::Value* value = builder.CreateLoad(type->getElementType(0), builder.CreateStructGEP(type, promise, 0), "awaited");
+    builder.CreateCall(intrinsic(llvm::Intrinsic::coro_destroy), {handle});
+    return value;
+}
+
+bool is_coroutine_builtin(const std::string& name) {
+    return name == "launch" || name == "async" || name == "await" || name == "runBlocking" ||
+           name == "yield" || name == "delay";
+}
+
+CallExprAST* CoroutineBuiltinExprAST::suspend_call() {
+    auto* call = _args.size() == 1 ? dynamic_cast<CallExprAST*>(_args[0]) : nullptr;
+    if (call == nullptr || !call->is_suspend()) {
+        yyerror(_name + " takes a single call of a suspend function");
+    }
+    return call;
+}
+
+Type CoroutineBuiltinExprAST::type() {
+    if (_name == "async") {
+        return deferred_type(suspend_call()->type());
+    }
+    if (_name == "await") {
+        Type deferred = _args.size() == 1 ? _args[0]->type() : INT;
+        if (!is_class(deferred) || class_info(deferred).kind != DEFERRED_CLASS) {
+            yyerror("await takes a single Deferred");
+        }
+        return class_info(deferred).fields[0].type;
+    }
+    if (_name == "runBlocking") {
+        return suspend_call()->type();
+    }
+    // There is no Unit, launch, yield and delay evaluate to 0
+    return INT;
+}
+
+// Everything but runBlocking needs a coroutine to suspend or to run the new one in, like Kotlin's CoroutineScope
+llvm::Value* CoroutineBuiltinExprAST::codegen() {
+    Type result_type = type();
+    llvm::PointerType* i8_ptr = llvm::Type::getInt8PtrTy(context);
+    llvm::FunctionCallee schedule = runtime_function("kt_coro_schedule", builder.getVoidTy(), {i8_ptr});
+
+    if (_name == "runBlocking") {
+        if (current_coroutine != nullptr) {
+            yyerror("runBlocking cannot be called from a suspend function");
+        }
+        llvm::Value* handle = suspend_call()->start();
+        llvm::Value* promise = promise_of(handle, result_type);
+        builder.CreateCall(schedule, {handle});
+        builder.CreateCall(runtime_function("kt_coro_run", builder.getVoidTy(), {}), {});
+        llvm::StructType* type = promise_type(result_type);
+        llvm::Value* value = builder.CreateLoad(type->getElementType(0), builder.CreateStructGEP(type, promise, 0), "result");
+        builder.CreateCall(intrinsic(llvm::Intrinsic::coro_destroy), {handle});
+        return value;
+    }
+
+    if (current_coroutine == nullptr) {
+        yyerror(_name + " can only be called from a suspend function");
+    }
+
+    if (_name == "launch" || _name == "async") {
+        CallExprAST* call = suspend_call();
+        llvm::Value* handle = call->start();
+        if (_name == "launch") {
+            builder.CreateStore(builder.getTrue(), builder.CreateStructGEP(promise_type(call->type()),
+                                                                         promise_of(handle, call->type()), 2));
+        }
+        builder.CreateCall(schedule, {handle});
+        return _name == "launch" ? builder.getInt32(0) : handle;
+    }
+
+    if (_name == "await") {
+        return await_coroutine(_args[0]->codegen(), result_type, false);
+    }
+
+    if (_name == "yield") {
+        if (!_args.empty()) {
+            yyerror("yield takes no arguments");
+        }
+        builder.CreateCall(schedule, {current_coroutine->handle});
+    } else {
+        if (_args.size() != 1 || !is_integral(_args[0]->type())) {
+            yyerror("delay takes the time in milliseconds");
+        }
+        llvm::Value* milliseconds = convert_value(_args[0]->codegen(), _args[0]->type(), LONG);
+        builder.CreateCall(runtime_function("kt_coro_delay", builder.getVoidTy(), {i8_ptr, builder.getInt64Ty()}),
+                           {current_coroutine->handle, milliseconds});
+    }
+    llvm::BasicBlock* resume_block = llvm::BasicBlock::Create(context, "resume", builder.GetInsertBlock()->getParent());
+    suspend(resume_block);
+    builder.SetInsertPoint(resume_block);
+    return builder.getInt32(0);
+}
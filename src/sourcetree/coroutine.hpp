@@ -0,0 +1,46 @@
+#ifndef KOTLIN_LLVM_COROUTINE_HPP
+#define KOTLIN_LLVM_COROUTINE_HPP
+
+#include <string>
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include "ast.hpp"
+
+// Suspend functions are lowered to LLVM's switched-resume coroutines. Calling one allocates its frame and
+// returns the handle without running anything, whoever called it then fills in the promise and starts it.
+struct CoroutineState {
+    llvm::Value* id;
+    llvm::Value* handle;
+    llvm::AllocaInst* promise;
+    // Branched to by return statements
+    llvm::BasicBlock* final_block;
+    // Frees the frame
+    llvm::BasicBlock* cleanup_block;
+    // Returns to whoever resumed the coroutine
+    llvm::BasicBlock* suspend_block;
+};
+
+// State of the suspend function being generated, nullptr in ordinary functions
+extern CoroutineState* current_coroutine;
+
+// {result, continuation, detached}: the value of the return statement, the coroutine awaiting it (or null), and
+// whether it was launched, so nobody awaits it and it frees itself once it completes
+llvm::StructType* promise_type(Type result_type);
+
+// Emits the frame allocation and the initial suspend point, the builder is left at the start of the body
+void begin_coroutine(llvm::Function* function, Type result_type);
+// Emits the final suspend point and the cleanup, then resets current_coroutine
+void finish_coroutine();
+// Stores the result and completes the coroutine
+void coroutine_return(llvm::Value* value);
+
+// Suspends the current coroutine until the one behind the handle completes, then returns its result and destroys
+// it. With resume, the handle is run right here first, so a callee that never suspends costs a call.
+llvm::Value* await_coroutine(llvm::Value* handle, Type result_type, bool resume);
+
+bool is_coroutine_builtin(const std::string& name);
+
+#endif //KOTLIN_LLVM_COROUTINE_HPP
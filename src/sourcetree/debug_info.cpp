@@ -0,0 +1,178 @@
+#include "debug_info.hpp"
+
+#include <map>
+#include <vector>
+
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+
+#include "classes.hpp"
+#include "statement.hpp"
+#include "driver/options.hpp"
+
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+static llvm::DIBuilder* debug_builder = nullptr;
+static llvm::DICompileUnit* compile_unit = nullptr;
+static llvm::DIFile* file = nullptr;
+static std::map<Type, llvm::DIType*> debug_types;
+
+void initialize_debug_info(const std::string& input_file) {
+    if (!options.debug_info) {
+        return;
+    }
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+
+    llvm::SmallString<128> directory;
+    llvm::sys::fs::current_path(directory);
+    std::string name = input_file == "-" ? "<stdin>" : input_file;
+    debug_builder = new llvm::DIBuilder(*module);
+    file = debug_builder->createFile(name, directory);
+    // DWARF has no language code for Kotlin yet
+    compile_unit = debug_builder->createCompileUnit(llvm::dwarf::DW_LANG_C, file, "kotlin-llvm",
+                                                    options.opt_level > 0, "", 0);
+    debug_types.clear();
+}
+
+void finalize_debug_info() {
+    if (debug_builder == nullptr) {
+        return;
+    }
+    debug_builder->finalize();
+    delete debug_builder;
+    debug_builder = nullptr;
+}
+
+static llvm::DIType* debug_type(Type type);
+
+static llvm::DIType* class_debug_type(Type type) {
+    const ClassInfo& info = class_info(type);
+    if (info.kind == VALUE_CLASS) {
+        return debug_builder->createTypedef(debug_type(info.fields[0].type), info.name, file, 0, compile_unit);
+    }
+    if (info.kind == DEFERRED_CLASS || info.kind == LIST_CLASS || info.kind == SET_CLASS || info.kind == MAP_CLASS ||
+        info.kind == FUNCTION_CLASS) {
+        return debug_builder->createPointerType(debug_builder->createUnspecifiedType(info.name), 64);
+    }
+
+    // A heap class can have properties of its own type, which refer to it through a forward declaration
+    llvm::DICompositeType* forward = nullptr;
+    llvm::DIType* pointer = nullptr;
+    if (info.heap) {
+        forward = debug_builder->createReplaceableCompositeType(llvm::dwarf::DW_TAG_structure_type, info.name,
+                                                                compile_unit, file, 0);
+        pointer = debug_builder->createPointerType(forward, 64);
+        debug_types[type] = pointer;
+    }
+
+    const llvm::DataLayout& layout = module->getDataLayout();
+    const llvm::StructLayout* struct_layout = layout.getStructLayout(info.struct_type);
+    std::vector<llvm::Metadata*> members;
+    for (unsigned i = 0; i < info.fields.size(); i++) {
+        llvm::Type* field_type = info.struct_type->getElementType(i);
+        members.push_back(debug_builder->createMemberType(
+                compile_unit, info.fields[i].name, file, 0, layout.getTypeSizeInBits(field_type),
+                layout.getABITypeAlign(field_type).value() * 8, struct_layout->getElementOffsetInBits(i),
+                llvm::DINode::FlagZero, debug_type(info.fields[i].type)));
+    }
+    llvm::DIType* struct_type = debug_builder->createStructType(
+            compile_unit, info.name, file, 0, struct_layout->getSizeInBits(),
+            struct_layout->getAlignment().value() * 8, llvm::DINode::FlagZero, nullptr,
+            debug_builder->getOrCreateArray(members));
+    if (forward == nullptr) {
+        return struct_type;
+    }
+    debug_builder->replaceTemporary(llvm::TempDIType(forward), struct_type);
+    return pointer;
+}
+
+static llvm::DIType* debug_type(Type type) {
+    auto cached = debug_types.find(type);
+    if (cached != debug_types.end()) {
+        return cached->second;
+    }
+    llvm::DIType* result;
+    switch (type) {
+        case INT: result = debug_builder->createBasicType("Int", 32, llvm::dwarf::DW_ATE_signed); break;
+        case LONG: result = debug_builder->createBasicType("Long", 64, llvm::dwarf::DW_ATE_signed); break;
+        case SHORT: result = debug_builder->createBasicType("Short", 16, llvm::dwarf::DW_ATE_signed); break;
+        case BYTE: result = debug_builder->createBasicType("Byte", 8, llvm::dwarf::DW_ATE_signed); break;
+        case CHAR: result = debug_builder->createBasicType("Char", 16, llvm::dwarf::DW_ATE_UTF); break;
+        case BOOLEAN: result = debug_builder->createBasicType("Boolean", 8, llvm::dwarf::DW_ATE_boolean); break;
+        case DOUBLE: result = debug_builder->createBasicType("Double", 64, llvm::dwarf::DW_ATE_float); break;
+        case FLOAT: result = debug_builder->createBasicType("Float", 32, llvm::dwarf::DW_ATE_float); break;
+        // void
+        case UNIT: result = nullptr; break;
+        case STRING:
+            result = debug_builder->createPointerType(
+                    debug_builder->createBasicType("char", 8, llvm::dwarf::DW_ATE_signed_char), 64, 0, llvm::None,
+                    "String");
+            break;
+        default: result = class_debug_type(type); break;
+    }
+    debug_types[type] = result;
+    return result;
+}
+
+void begin_function_debug_info(llvm::Function* function, SourceLocation location) {
+    if (debug_builder == nullptr) {
+        return;
+    }
+    const FunctionSignature& signature = function_signatures[function->getName().str()];
+    std::vector<llvm::Metadata*> types = {signature.is_suspend ? nullptr : debug_type(signature.return_type)};
+    for (Type param_type : signature.param_types) {
+        types.push_back(debug_type(param_type));
+    }
+    llvm::DISubprogram* subprogram = debug_builder->createFunction(
+            file, function->getName(), llvm::StringRef(), file, location.line,
+            debug_builder->createSubroutineType(debug_builder->getOrCreateTypeArray(types)), location.line,
+            llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition);
+    function->setSubprogram(subprogram);
+    builder.SetCurrentDebugLocation(llvm::DILocation::get(function->getContext(), location.line, location.column,
+                                                          subprogram));
+}
+
+void begin_outlined_function_debug_info(llvm::Function* function) {
+    if (debug_builder == nullptr) {
+        return;
+    }
+    unsigned line = builder.getCurrentDebugLocation() ? builder.getCurrentDebugLocation().getLine() : 0;
+    llvm::DISubprogram* subprogram = debug_builder->createFunction(
+            file, function->getName(), llvm::StringRef(), file, line,
+            debug_builder->createSubroutineType(debug_builder->getOrCreateTypeArray({})), line,
+            llvm::DINode::FlagArtificial, llvm::DISubprogram::SPFlagDefinition | llvm::DISubprogram::SPFlagLocalToUnit);
+    function->setSubprogram(subprogram);
+    builder.SetCurrentDebugLocation(llvm::DILocation::get(function->getContext(), line, 0, subprogram));
+}
+
+void set_debug_location(SourceLocation location) {
+    if (debug_builder == nullptr || location.line == 0) {
+        return;
+    }
+    llvm::DISubprogram* subprogram = builder.GetInsertBlock()->getParent()->getSubprogram();
+    if (subprogram == nullptr) {
+        builder.SetCurrentDebugLocation(llvm::DebugLoc());
+        return;
+    }
+    builder.SetCurrentDebugLocation(llvm::DILocation::get(subprogram->getContext(), location.line, location.column,
+                                                          subprogram));
+}
+
+void declare_debug_variable(llvm::AllocaInst* alloca, const std::string& name, Type type, unsigned arg_number) {
+    llvm::DILocation* location = builder.getCurrentDebugLocation().get();
+    if (debug_builder == nullptr || location == nullptr) {
+        return;
+    }
+    llvm::DILocalVariable* variable =
+            arg_number > 0 ? debug_builder->createParameterVariable(location->getScope(), name, arg_number, file,
+                                                                    location->getLine(), debug_type(type), true)
+                           : debug_builder->createAutoVariable(location->getScope(), name, file, location->getLine(),
+                                                               debug_type(type), true);
+    debug_builder->insertDeclare(alloca, variable, debug_builder->createExpression(), location,
+                                 builder.GetInsertBlock());
+}
@@ -0,0 +1,32 @@
+#ifndef KOTLIN_LLVM_DEBUG_INFO_HPP
+#define KOTLIN_LLVM_DEBUG_INFO_HPP
+
+#include <string>
+
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include "ast.hpp"
+
+// DWARF for -g. Every function gets a DISubprogram, statements attach their line and column to the code
+// generated for them, and parameters and variables are described by llvm.dbg.declare on their allocas.
+// Nothing is emitted (and these functions do nothing) without -g.
+
+// Called for every new module
+void initialize_debug_info(const std::string& input_file);
+// Resolves the compile unit, has to be called before the module is optimized or printed
+void finalize_debug_info();
+
+// Creates the subprogram of a function declared at the given line and points the builder at it
+void begin_function_debug_info(llvm::Function* function, SourceLocation location);
+// For a function outlined from the code being generated, e.g. a parallel loop body
+void begin_outlined_function_debug_info(llvm::Function* function);
+
+// Points the builder at the given location of the current function. Does nothing for an unknown location (line 0),
+// and clears the builder's location in functions without a subprogram.
+void set_debug_location(SourceLocation location);
+
+void declare_debug_variable(llvm::AllocaInst* alloca, const std::string& name, Type type, unsigned arg_number = 0);
+
+#endif //KOTLIN_LLVM_DEBUG_INFO_HPP
@@ -0,0 +1,490 @@
+#include "exceptions.hpp"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueMap.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include "allocation.hpp"
+#include "classes.hpp"
+#include "conversion.hpp"
+#include "coroutine.hpp"
+#include "lambdas.hpp"
+#include "statement.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+extern std::map<std::string, llvm::AllocaInst*> named_values;
+extern std::map<std::string, Type> named_types;
+
+extern void yyerror(std::string msg);
+
+// Defined by the runtime as kt_exception_<name>
+static const char* const builtin_exception_names[] = {
+        "Exception", "RuntimeException", "ArithmeticException", "IndexOutOfBoundsException",
+        "NoSuchElementException", "IllegalArgumentException", "IllegalStateException"};
+
+// The runtime functions that throw, every other function of the runtime and of C is nounwind
+static const char* const throwing_runtime_functions[] = {
+        "kt_throw", "kt_division_by_zero", "kt_index_out_of_bounds", "kt_no_such_element"};
+
+static std::set<Type> builtin_exceptions;
+
+// A try block, or a catch block with a finally block, that code is being generated in
+struct Handler {
+    llvm::Function* function;
+    const std::vector<Statement*>* finally_block;
+    // Of the catches, nullptr for Exception
+    std::vector<llvm::Constant*> tags;
+    llvm::BasicBlock* landing_pad;
+    // Where the landing pad, and the landing pads of the try blocks inside that do not catch the exception, pick
+    // the catch that does
+    llvm::BasicBlock* dispatch;
+    llvm::AllocaInst* exception_slot;
+    llvm::AllocaInst* selector_slot;
+};
+
+// From the outermost. The try blocks of a function are on top of those of the functions its lambdas are
+// generated in.
+static std::vector<Handler> handlers;
+
+// The landing pad of the try block each call was generated in, nullptr outside of them
+static llvm::ValueMap<const llvm::Value*, llvm::BasicBlock*> unwind_destinations;
+
+bool declare_builtin_exception(const std::string& name) {
+    for (const char* builtin : builtin_exception_names) {
+        if (name == builtin) {
+            Param message("message", STRING);
+            builtin_exceptions.insert(declare_class(name, PLAIN_CLASS, {&message}));
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t handler_depth() {
+    return handlers.size();
+}
+
+static llvm::StructType* exception_type_struct() {
+    if (llvm::StructType* type = llvm::StructType::getTypeByName(context, "kt.exception_type")) {
+        return type;
+    }
+    return llvm::StructType::create(context, {builder.getInt8PtrTy(), builder.getInt32Ty()}, "kt.exception_type");
+}
+
+// The kt_exception_type of the class, emitted with every module that throws or catches it
+static llvm::Constant* exception_tag(Type type) {
+    const ClassInfo& info = class_info(type);
+    llvm::StructType* tag_type = exception_type_struct();
+    if (builtin_exceptions.count(type) != 0) {
+        return module->getOrInsertGlobal("kt_exception_" + info.name, tag_type);
+    }
+    std::string name = "kt.exception_type." + info.name;
+    if (llvm::GlobalVariable* tag = module->getNamedGlobal(name)) {
+        return tag;
+    }
+    llvm::Constant* message_offset = builder.getInt32(-1);
+    for (unsigned i = 0; i < info.fields.size(); i++) {
+        if (info.fields[i].name != "message" || info.fields[i].type != STRING) {
+            continue;
+        }
+        message_offset = info.kind == VALUE_CLASS ? builder.getInt32(0) : llvm::ConstantExpr::getTrunc(
+                llvm::ConstantExpr::getOffsetOf(info.struct_type, i), builder.getInt32Ty());
+    }
+    llvm::Constant* class_name = builder.CreateGlobalStringPtr(info.name, name + ".name", 0, module);
+    return new llvm::GlobalVariable(*module, tag_type, true, llvm::GlobalValue::LinkOnceODRLinkage,
+                                    llvm::ConstantStruct::get(tag_type, {class_name, message_offset}), name);
+}
+
+static void check_exception_class(Type type, const std::string& action) {
+    ClassKind kind = is_class(type) ? class_info(type).kind : FUNCTION_CLASS;
+    if (is_reference(type) || (kind != PLAIN_CLASS && kind != DATA_CLASS && kind != VALUE_CLASS)) {
+        yyerror("Only classes without identity can be " + action + ": " + type_name(type));
+    }
+}
+
+static llvm::BasicBlock* innermost_landing_pad(llvm::Function* function) {
+    for (auto handler = handlers.rbegin(); handler != handlers.rend(); ++handler) {
+        if (handler->function == function) {
+            return handler->landing_pad;
+        }
+    }
+    return nullptr;
+}
+
+// The calls generated since the handlers of the function last changed are in its innermost try block, this has
+// to run before every change
+static void assign_calls(llvm::Function* function) {
+    llvm::BasicBlock* landing_pad = innermost_landing_pad(function);
+    for (llvm::BasicBlock& block : *function) {
+        for (llvm::Instruction& instruction : block) {
+            if (llvm::isa<llvm::CallInst>(instruction) && unwind_destinations.count(&instruction) == 0) {
+                unwind_destinations[&instruction] = landing_pad;
+            }
+        }
+    }
+}
+
+static void push_handler(const std::vector<Statement*>* finally_block, std::vector<llvm::Constant*> tags) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    assign_calls(function);
+    handlers.push_back({function, finally_block, std::move(tags),
+                        llvm::BasicBlock::Create(context, "lpad"), llvm::BasicBlock::Create(context, "catch.dispatch"),
+                        create_entry_block_alloca(function, "exn.slot", builder.getInt8PtrTy()),
+                        create_entry_block_alloca(function, "sel.slot", builder.getInt32Ty())});
+}
+
+static Handler pop_handler() {
+    assign_calls(handlers.back().function);
+    Handler handler = handlers.back();
+    handlers.pop_back();
+    return handler;
+}
+
+static void codegen_block(const std::vector<Statement*>& block) {
+    for (Statement* statement : block) {
+        codegen_statement(statement);
+    }
+}
+
+// The handlers of the current function around the one being generated, from the innermost
+static std::vector<const Handler*> enclosing_handlers(llvm::Function* function) {
+    std::vector<const Handler*> enclosing;
+    for (auto handler = handlers.rbegin(); handler != handlers.rend() && handler->function == function; ++handler) {
+        enclosing.push_back(&*handler);
+    }
+    return enclosing;
+}
+
+// Emits the popped handler's landing pad, which lists the catches of the try blocks around it too, so the
+// unwinder stops at this frame if any of them catches the exception. It is a cleanup as well: the finally blocks
+// run, and shadow-stack GC roots are popped, even if none of them does. The builder is left in the dispatch block
+// with the selector of the catch.
+static llvm::Value* codegen_landing_pad(const Handler& handler) {
+    llvm::Function* function = handler.function;
+    function->getBasicBlockList().push_back(handler.landing_pad);
+    builder.SetInsertPoint(handler.landing_pad);
+
+    std::vector<llvm::Constant*> clauses = handler.tags;
+    for (const Handler* enclosing : enclosing_handlers(function)) {
+        clauses.insert(clauses.end(), enclosing->tags.begin(), enclosing->tags.end());
+    }
+    std::set<llvm::Constant*> seen;
+    llvm::Type* landing_pad_type = llvm::StructType::get(context, {builder.getInt8PtrTy(), builder.getInt32Ty()});
+    llvm::LandingPadInst* landing_pad = builder.CreateLandingPad(landing_pad_type, clauses.size(), "lpad");
+    landing_pad->setCleanup(true);
+    for (llvm::Constant* tag : clauses) {
+        if (seen.insert(tag).second) {
+            landing_pad->addClause(tag != nullptr ? llvm::ConstantExpr::getBitCast(tag, builder.getInt8PtrTy())
+                                                  : llvm::ConstantPointerNull::get(builder.getInt8PtrTy()));
+        }
+    }
+    builder.CreateStore(builder.CreateExtractValue(landing_pad, 0, "exn"), handler.exception_slot);
+    builder.CreateStore(builder.CreateExtractValue(landing_pad, 1, "sel"), handler.selector_slot);
+    builder.CreateBr(handler.dispatch);
+
+    function->getBasicBlockList().push_back(handler.dispatch);
+    builder.SetInsertPoint(handler.dispatch);
+    return builder.CreateLoad(builder.getInt32Ty(), handler.selector_slot, "sel");
+}
+
+// An exception the popped handler does not catch: its finally block runs and the exception goes on to the
+// dispatch of the enclosing try block of the function, or to the caller
+static void codegen_rethrow(const Handler& handler) {
+    if (handler.finally_block != nullptr) {
+        codegen_block(*handler.finally_block);
+    }
+    llvm::Value* exception = builder.CreateLoad(builder.getInt8PtrTy(), handler.exception_slot, "exn");
+    llvm::Value* selector = builder.CreateLoad(builder.getInt32Ty(), handler.selector_slot, "sel");
+    std::vector<const Handler*> enclosing = enclosing_handlers(handler.function);
+    if (!enclosing.empty()) {
+        builder.CreateStore(exception, enclosing[0]->exception_slot);
+        builder.CreateStore(selector, enclosing[0]->selector_slot);
+        builder.CreateBr(enclosing[0]->dispatch);
+        return;
+    }
+    llvm::Value* resumed = llvm::UndefValue::get(
+            llvm::StructType::get(context, {builder.getInt8PtrTy(), builder.getInt32Ty()}));
+    resumed = builder.CreateInsertValue(resumed, exception, 0);
+    resumed = builder.CreateInsertValue(resumed, selector, 1);
+    builder.CreateResume(resumed);
+}
+
+void ThrowStatement::codegen() {
+    Type type = _expr->type();
+    check_exception_class(type, "thrown");
+    const ClassInfo& info = class_info(type);
+    llvm::Value* value = _expr->codegen();
+
+    llvm::Type* i8_ptr = builder.getInt8PtrTy();
+    llvm::Value* memory = builder.CreateCall(
+            module->getOrInsertFunction("kt_allocate_exception", i8_ptr, builder.getInt64Ty()),
+            {llvm::ConstantExpr::getSizeOf(info.llvm_type)}, "exception");
+    builder.CreateStore(value, builder.CreateBitCast(memory, info.llvm_type->getPointerTo()));
+    llvm::FunctionCallee throw_function = module->getOrInsertFunction(
+            "kt_throw", builder.getVoidTy(), i8_ptr, exception_type_struct()->getPointerTo());
+    llvm::cast<llvm::Function>(throw_function.getCallee())->setDoesNotReturn();
+    builder.CreateCall(throw_function, {memory, exception_tag(type)});
+    builder.CreateUnreachable();
+    // Statements after the throw are unreachable
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "afterthrow", builder.GetInsertBlock()->getParent()));
+}
+
+TryStatement::~TryStatement() {
+    for (Statement* statement : *_block) {
+        delete statement;
+    }
+    delete _block;
+    for (CatchClause& clause : _catches) {
+        for (Statement* statement : *clause.block) {
+            delete statement;
+        }
+        delete clause.block;
+    }
+    if (_finally_block != nullptr) {
+        for (Statement* statement : *_finally_block) {
+            delete statement;
+        }
+        delete _finally_block;
+    }
+}
+
+// The value of the caught exception, the copy in the exception object is freed
+static llvm::Value* catch_value(Type type, llvm::Value* exception) {
+    llvm::Type* i8_ptr = builder.getInt8PtrTy();
+    const ClassInfo& info = class_info(type);
+    llvm::Value* value;
+    if (info.name == "Exception" && builtin_exceptions.count(type) != 0) {
+        llvm::Value* message = builder.CreateCall(
+                module->getOrInsertFunction("kt_exception_message", i8_ptr, i8_ptr), {exception}, "message");
+        value = builder.CreateInsertValue(llvm::UndefValue::get(info.llvm_type), message, 0, info.name);
+    } else {
+        llvm::Value* memory = builder.CreateCall(
+                module->getOrInsertFunction("kt_begin_catch", i8_ptr, i8_ptr), {exception}, "caught");
+        value = builder.CreateLoad(info.llvm_type, builder.CreateBitCast(memory, info.llvm_type->getPointerTo()),
+                                   info.name);
+    }
+    builder.CreateCall(module->getOrInsertFunction("kt_end_catch", builder.getVoidTy(), i8_ptr), {exception});
+    return value;
+}
+
+void TryStatement::codegen() {
+    if (current_coroutine != nullptr) {
+        yyerror("try is not supported in suspend functions");
+    }
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    std::vector<llvm::Constant*> tags;
+    for (const CatchClause& clause : _catches) {
+        check_exception_class(clause.type, "caught");
+        bool catches_all = builtin_exceptions.count(clause.type) != 0 && class_info(clause.type).name == "Exception";
+        tags.push_back(catches_all ? nullptr : exception_tag(clause.type));
+    }
+
+    push_handler(_finally_block, tags);
+    codegen_block(*_block);
+    Handler handler = pop_handler();
+    if (_finally_block != nullptr) {
+        codegen_block(*_finally_block);
+    }
+    llvm::BasicBlock* end_block = llvm::BasicBlock::Create(context, "try.end");
+    builder.CreateBr(end_block);
+
+    llvm::Value* selector = codegen_landing_pad(handler);
+    std::vector<llvm::BasicBlock*> catch_blocks;
+    bool catches_all = false;
+    for (size_t i = 0; i < _catches.size() && !catches_all; i++) {
+        catch_blocks.push_back(llvm::BasicBlock::Create(context, "catch." + _catches[i].id, function));
+        if (tags[i] == nullptr) {
+            // Every exception, the catches after it are never reached
+            builder.CreateBr(catch_blocks[i]);
+            catches_all = true;
+            continue;
+        }
+        llvm::Value* type_id = builder.CreateCall(
+                llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::eh_typeid_for),
+                {llvm::ConstantExpr::getBitCast(tags[i], builder.getInt8PtrTy())}, "typeid");
+        llvm::BasicBlock* next_block = llvm::BasicBlock::Create(context, "catch.next", function);
+        builder.CreateCondBr(builder.CreateICmpEQ(selector, type_id, "matches"), catch_blocks[i], next_block);
+        builder.SetInsertPoint(next_block);
+    }
+    if (!catches_all) {
+        codegen_rethrow(handler);
+    }
+
+    for (size_t i = 0; i < catch_blocks.size(); i++) {
+        const CatchClause& clause = _catches[i];
+        builder.SetInsertPoint(catch_blocks[i]);
+        llvm::Value* exception = builder.CreateLoad(builder.getInt8PtrTy(), handler.exception_slot, "exn");
+        llvm::Value* value = catch_value(clause.type, exception);
+        llvm::AllocaInst* variable = create_entry_block_alloca(function, clause.id, value->getType());
+        builder.CreateStore(value, variable);
+        named_values[clause.id] = variable;
+        named_types[clause.id] = clause.type;
+
+        // The finally block runs when the catch block throws too
+        if (_finally_block != nullptr) {
+            push_handler(_finally_block, {});
+        }
+        codegen_block(*clause.block);
+        if (_finally_block != nullptr) {
+            Handler catch_handler = pop_handler();
+            codegen_block(*_finally_block);
+            builder.CreateBr(end_block);
+            codegen_landing_pad(catch_handler);
+            codegen_rethrow(catch_handler);
+        } else {
+            builder.CreateBr(end_block);
+        }
+    }
+
+    function->getBasicBlockList().push_back(end_block);
+    builder.SetInsertPoint(end_block);
+}
+
+void codegen_finally_blocks() {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    size_t depth = current_inline_frame != nullptr ? current_inline_frame->handler_depth : 0;
+    std::vector<Handler> saved = handlers;
+    // A finally block is outside of its own try block
+    while (handlers.size() > depth && handlers.back().function == function) {
+        Handler handler = pop_handler();
+        if (handler.finally_block != nullptr) {
+            codegen_block(*handler.finally_block);
+        }
+    }
+    assign_calls(function);
+    handlers = saved;
+}
+
+void clone_unwind_destinations(const llvm::ValueToValueMapTy& value_map) {
+    std::vector<std::pair<const llvm::Value*, llvm::BasicBlock*>> cloned;
+    for (const auto& entry : unwind_destinations) {
+        auto call = value_map.find(entry.first);
+        if (call == value_map.end()) {
+            continue;
+        }
+        llvm::BasicBlock* landing_pad = nullptr;
+        if (entry.second != nullptr) {
+            landing_pad = llvm::cast<llvm::BasicBlock>(value_map.lookup(entry.second));
+        }
+        cloned.emplace_back(call->second, landing_pad);
+    }
+    for (const auto& entry : cloned) {
+        unwind_destinations[entry.first] = entry.second;
+    }
+}
+
+// The landing pad a call can unwind to, nullptr when an exception leaves the function
+static llvm::BasicBlock* unwind_destination(const llvm::CallInst* call) {
+    auto found = unwind_destinations.find(call);
+    if (found == unwind_destinations.end() || call->isInlineAsm() ||
+        (call->getCalledFunction() != nullptr && call->getCalledFunction()->isIntrinsic())) {
+        return nullptr;
+    }
+    return found->second;
+}
+
+static bool callee_may_throw(const llvm::CallInst* call, const std::set<const llvm::Function*>& throwing) {
+    if (call->isInlineAsm()) {
+        return false;
+    }
+    const llvm::Function* callee = call->getCalledFunction();
+    if (callee == nullptr) {
+        // Closures and function pointers
+        return true;
+    }
+    if (callee->isIntrinsic()) {
+        return !callee->doesNotThrow();
+    }
+    return throwing.count(callee) != 0;
+}
+
+void finish_exceptions() {
+    // Kotlin functions of other modules may throw, the rest of the runtime and C functions do not
+    std::set<const llvm::Function*> throwing;
+    for (const char* name : throwing_runtime_functions) {
+        if (llvm::Function* function = module->getFunction(name)) {
+            throwing.insert(function);
+        }
+    }
+    for (llvm::Function& function : *module) {
+        if (function.isDeclaration() && !function.isIntrinsic() &&
+            function_signatures.count(function.getName().str()) != 0) {
+            throwing.insert(&function);
+        }
+        // The legacy pass manager does not come back to split a nounwind suspend function
+        if (function.hasFnAttribute("coroutine.presplit")) {
+            throwing.insert(&function);
+        }
+    }
+
+    // A function throws if it resumes an exception or calls a function that throws outside of a try block,
+    // until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (llvm::Function& function : *module) {
+            if (function.isDeclaration() || throwing.count(&function) != 0) {
+                continue;
+            }
+            bool may_throw = false;
+            for (llvm::BasicBlock& block : function) {
+                for (llvm::Instruction& instruction : block) {
+                    auto* call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+                    may_throw = may_throw || llvm::isa<llvm::ResumeInst>(instruction) ||
+                                (call != nullptr && unwind_destination(call) == nullptr &&
+                                 callee_may_throw(call, throwing));
+                }
+            }
+            if (may_throw) {
+                throwing.insert(&function);
+                changed = true;
+            }
+        }
+    }
+
+    for (llvm::Function& function : *module) {
+        // Declarations keep their attributes, which the optimizer would otherwise spread to the suspend functions
+        if (function.isDeclaration()) {
+            continue;
+        }
+        if (throwing.count(&function) == 0) {
+            function.setDoesNotThrow();
+        }
+        std::vector<std::pair<llvm::CallInst*, llvm::BasicBlock*>> invokes;
+        bool has_landing_pads = false;
+        for (llvm::BasicBlock& block : function) {
+            has_landing_pads = has_landing_pads || block.isLandingPad();
+            for (llvm::Instruction& instruction : block) {
+                auto* call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+                if (call != nullptr && unwind_destination(call) != nullptr && callee_may_throw(call, throwing)) {
+                    invokes.emplace_back(call, unwind_destination(call));
+                }
+            }
+        }
+        if (!has_landing_pads) {
+            continue;
+        }
+        function.setPersonalityFn(llvm::cast<llvm::Constant>(module->getOrInsertFunction(
+                "kt_personality", llvm::FunctionType::get(builder.getInt32Ty(), true)).getCallee()));
+        for (const auto& invoke : invokes) {
+            llvm::changeToInvokeAndSplitBasicBlock(invoke.first, invoke.second);
+        }
+        // Landing pads of try blocks that call nothing that throws
+        llvm::removeUnreachableBlocks(function);
+        if (invokes.empty()) {
+            function.setPersonalityFn(nullptr);
+        }
+    }
+    unwind_destinations.clear();
+}
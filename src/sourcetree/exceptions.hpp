@@ -0,0 +1,38 @@
+#ifndef KOTLIN_LLVM_EXCEPTIONS_HPP
+#define KOTLIN_LLVM_EXCEPTIONS_HPP
+
+#include <string>
+
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+// throw, try, catch and finally, with the zero-cost model of the Itanium C++ ABI: see runtime/exceptions.cpp.
+//
+// Calls are generated as calls and remember the try block they are in. Once the whole program is generated,
+// finish_exceptions works out which functions may throw; the others are marked nounwind, and only the calls of
+// functions that may throw become invokes of the landing pad of their try block, so the code that does not throw
+// runs exactly as without exceptions.
+//
+// Any class without identity can be thrown, its value is copied into the exception. A catch matches its class
+// exactly, except `catch (e: Exception)`, which catches every exception and gets its message. The runtime checks
+// throw ArithmeticException, IndexOutOfBoundsException and NoSuchElementException; these and Exception,
+// RuntimeException, IllegalArgumentException and IllegalStateException are classes with a `message: String`
+// property declared the first time they are used.
+
+// Declares the built-in exception class with that name. False for other names.
+bool declare_builtin_exception(const std::string& name);
+
+// Number of try blocks being generated, an inline function records it where its expansion starts
+size_t handler_depth();
+
+// Runs the finally blocks a return statement leaves, from the innermost: those of the function, or of the inline
+// function being expanded
+void codegen_finally_blocks();
+
+// The clone of a function keeps the try blocks of its calls
+void clone_unwind_destinations(const llvm::ValueToValueMapTy& value_map);
+
+// Turns the calls in try blocks into invokes and marks the functions that cannot throw nounwind, once the
+// whole program is generated
+void finish_exceptions();
+
+#endif //KOTLIN_LLVM_EXCEPTIONS_HPP
@@ -0,0 +1,565 @@
+#include "imports.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Path.h"
+
+#include "classes.hpp"
+#include "collections.hpp"
+#include "interpreter.hpp"
+#include "lambdas.hpp"
+#include "driver/options.hpp"
+#include "parser.tab.hpp"
+
+extern llvm::LLVMContext context;
+
+extern void yyerror(std::string msg);
+extern int yylex();
+
+// Token numbers and Type values are stored as they are in this build of the compiler, so any change to the grammar
+// or to the primitive types has to bump the version
+static const char interface_magic[4] = {'K', 'T', 'I', 'F'};
+static const uint32_t interface_version = 1;
+
+enum EntryKind : uint32_t {
+    CLASS_ENTRY, FUNCTION_ENTRY, INLINE_FUNCTION_ENTRY, CONST_ENTRY
+};
+
+// The file is the header, the entries sorted by name, and the names and data they point to
+struct InterfaceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+};
+
+struct InterfaceEntry {
+    uint32_t name_offset;
+    uint32_t name_length;
+    EntryKind kind;
+    uint32_t data_offset;
+    uint32_t data_length;
+};
+
+enum TokenValue : uint8_t {
+    NO_VALUE, STRING_VALUE, INTEGER_VALUE, REAL_VALUE
+};
+
+struct RecordedToken {
+    int token;
+    SourceLocation location;
+    TokenValue value_kind;
+    std::string text;
+    long long integer;
+    double real;
+};
+
+// An interface mapped by import_module, it stays mapped until the compiler exits
+struct ImportedModule {
+    std::string path;
+    const char* data;
+    size_t size;
+};
+
+static std::vector<ImportedModule> imported_modules;
+// Statements of imported inline functions, which calls expand until the compiler exits
+static std::vector<Statement*> imported_statements;
+
+// All tokens of the input with --emit-interface, and where each inline function starts and ends among them
+static std::vector<RecordedToken> recorded_tokens;
+static std::map<std::string, std::pair<SourceLocation, SourceLocation>> inline_function_ranges;
+
+// The tokens of the imported inline function being parsed
+static std::vector<RecordedToken> replayed_tokens;
+static size_t replay_position = 0;
+static bool replaying = false;
+
+// Reads the data of an entry, every read is checked against its end
+class Reader {
+public:
+    Reader(const ImportedModule& module, llvm::StringRef data) : _module(module), _cursor(data.begin()), _end(data.end()) {}
+
+    template<typename T>
+    T read() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string read_string() {
+        auto length = read<uint32_t>();
+        const char* text = take(length);
+        return std::string(text, length);
+    }
+
+private:
+    const char* take(size_t size) {
+        if (static_cast<size_t>(_end - _cursor) < size) {
+            yyerror("Corrupt interface file: " + _module.path);
+        }
+        const char* begin = _cursor;
+        _cursor += size;
+        return begin;
+    }
+
+    const ImportedModule& _module;
+    const char* _cursor;
+    const char* _end;
+};
+
+template<typename T>
+static void write(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void write_string(std::string& out, const std::string& text) {
+    write<uint32_t>(out, text.size());
+    out += text;
+}
+
+// A primitive is its Type; a class is FIRST_CLASS plus its kind, followed by its name for declared classes, or by
+// its type arguments for the generic ones
+static void write_type(std::string& out, Type type) {
+    if (!is_class(type)) {
+        write<uint8_t>(out, type);
+        return;
+    }
+    const ClassInfo& info = class_info(type);
+    write<uint8_t>(out, FIRST_CLASS + info.kind);
+    if (info.kind == PLAIN_CLASS || info.kind == DATA_CLASS || info.kind == VALUE_CLASS) {
+        write_string(out, info.name);
+        return;
+    }
+    write<uint8_t>(out, info.fields.size());
+    for (const ClassField& field : info.fields) {
+        write_type(out, field.type);
+    }
+}
+
+static Type read_type(Reader& reader) {
+    auto tag = reader.read<uint8_t>();
+    if (tag < FIRST_CLASS) {
+        return static_cast<Type>(tag);
+    }
+    auto kind = static_cast<ClassKind>(tag - FIRST_CLASS);
+    if (kind == PLAIN_CLASS || kind == DATA_CLASS || kind == VALUE_CLASS) {
+        return find_class(reader.read_string());
+    }
+    std::vector<Type> arguments(reader.read<uint8_t>());
+    for (Type& argument : arguments) {
+        argument = read_type(reader);
+    }
+    if (arguments.empty()) {
+        yyerror("Corrupt interface type");
+    }
+    switch (kind) {
+        case DEFERRED_CLASS:
+            return deferred_type(arguments[0]);
+        case LIST_CLASS:
+            return collection_type("ArrayList", arguments);
+        case SET_CLASS:
+            return collection_type("HashSet", arguments);
+        case MAP_CLASS:
+            return collection_type("HashMap", arguments);
+        case FUNCTION_CLASS: {
+            Type result_type = arguments.back();
+            arguments.pop_back();
+            return function_type(arguments, result_type);
+        }
+        default:
+            yyerror("Corrupt interface type");
+            return INT;
+    }
+}
+
+static bool map_interface(const std::string& path, ImportedModule& imported) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(InterfaceHeader)) {
+        close(fd);
+        yyerror("Corrupt interface file: " + path);
+    }
+    void* mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        yyerror("Cannot map interface file: " + path);
+    }
+    imported = ImportedModule{path, static_cast<const char*>(mapped), static_cast<size_t>(file_stat.st_size)};
+
+    InterfaceHeader header{};
+    std::memcpy(&header, imported.data, sizeof(header));
+    if (std::memcmp(header.magic, interface_magic, sizeof(interface_magic)) != 0) {
+        yyerror("Not an interface file: " + path);
+    }
+    if (header.version != interface_version) {
+        yyerror("Interface file was written by another version of the compiler: " + path);
+    }
+    if ((imported.size - sizeof(header)) / sizeof(InterfaceEntry) < header.entry_count) {
+        yyerror("Corrupt interface file: " + path);
+    }
+    return true;
+}
+
+void import_module(const std::string& path) {
+    std::string file_name = path;
+    std::replace(file_name.begin(), file_name.end(), '.', '/');
+    file_name += ".ktif";
+
+    std::vector<std::string> dirs;
+    dirs.push_back(options.input_file == "-" ? "." : llvm::sys::path::parent_path(options.input_file).str());
+    dirs.insert(dirs.end(), options.import_dirs.begin(), options.import_dirs.end());
+    for (const std::string& dir : dirs) {
+        llvm::SmallString<128> candidate(dir.empty() ? "." : dir);
+        llvm::sys::path::append(candidate, file_name);
+        for (const ImportedModule& imported : imported_modules) {
+            if (imported.path == candidate.str()) {
+                return;
+            }
+        }
+        ImportedModule imported{};
+        if (map_interface(candidate.str().str(), imported)) {
+            imported_modules.push_back(imported);
+            return;
+        }
+    }
+    yyerror("Cannot find interface of imported module: " + path);
+}
+
+// Binary search of the sorted entries, then the one of the right kind among those with the name. Returns the module
+// with the entry, or nullptr.
+static const ImportedModule* find_entry(const std::string& name, EntryKind kind, llvm::StringRef& data) {
+    for (const ImportedModule& imported : imported_modules) {
+        InterfaceHeader header{};
+        std::memcpy(&header, imported.data, sizeof(header));
+        auto entry_at = [&](uint32_t index) {
+            InterfaceEntry entry{};
+            std::memcpy(&entry, imported.data + sizeof(header) + index * sizeof(InterfaceEntry), sizeof(entry));
+            if (entry.name_offset > imported.size || imported.size - entry.name_offset < entry.name_length ||
+                entry.data_offset > imported.size || imported.size - entry.data_offset < entry.data_length) {
+                yyerror("Corrupt interface file: " + imported.path);
+            }
+            return entry;
+        };
+        auto entry_name = [&](const InterfaceEntry& entry) {
+            return llvm::StringRef(imported.data + entry.name_offset, entry.name_length);
+        };
+
+        uint32_t low = 0;
+        uint32_t high = header.entry_count;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            if (entry_name(entry_at(middle)) < name) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (uint32_t index = low; index < header.entry_count; ++index) {
+            InterfaceEntry entry = entry_at(index);
+            if (entry_name(entry) != name) {
+                break;
+            }
+            if (entry.kind == kind) {
+                data = llvm::StringRef(imported.data + entry.data_offset, entry.data_length);
+                return &imported;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool import_class(const std::string& name) {
+    llvm::StringRef data;
+    const ImportedModule* imported = find_entry(name, CLASS_ENTRY, data);
+    if (imported == nullptr) {
+        return false;
+    }
+    Reader reader(*imported, data);
+    auto kind = static_cast<ClassKind>(reader.read<uint8_t>());
+    // Properties can have the class's own type
+    declare_class_name(name);
+    std::vector<Param*> properties(reader.read<uint32_t>());
+    for (Param*& property : properties) {
+        std::string property_name = reader.read_string();
+        bool is_var = reader.read<uint8_t>() != 0;
+        property = new Param(property_name, read_type(reader), is_var);
+    }
+    declare_class(name, kind, properties);
+    for (Param* property : properties) {
+        delete property;
+    }
+    return true;
+}
+
+bool import_function(const std::string& name) {
+    llvm::StringRef data;
+    const ImportedModule* imported = find_entry(name, INLINE_FUNCTION_ENTRY, data);
+    if (imported != nullptr) {
+        Reader reader(*imported, data);
+        replayed_tokens.resize(reader.read<uint32_t>());
+        for (RecordedToken& token : replayed_tokens) {
+            token.token = reader.read<int32_t>();
+            token.value_kind = static_cast<TokenValue>(reader.read<uint8_t>());
+            if (token.value_kind == STRING_VALUE) {
+                token.text = reader.read_string();
+            } else if (token.value_kind == INTEGER_VALUE) {
+                token.integer = reader.read<int64_t>();
+            } else if (token.value_kind == REAL_VALUE) {
+                token.real = reader.read<double>();
+            }
+        }
+        replay_position = 0;
+        replaying = true;
+        Statement* statement = parse_replayed_statement();
+        replaying = false;
+
+        auto* function = dynamic_cast<FunctionAST*>(statement);
+        if (function == nullptr || function->getPrototype()->getId() != name) {
+            yyerror("Corrupt inline function " + name + " in interface file: " + imported->path);
+        }
+        function->declare();
+        imported_statements.push_back(statement);
+        return true;
+    }
+
+    imported = find_entry(name, FUNCTION_ENTRY, data);
+    if (imported == nullptr) {
+        return false;
+    }
+    Reader reader(*imported, data);
+    bool is_suspend = reader.read<uint8_t>() != 0;
+    Type return_type = read_type(reader);
+    std::vector<Param*> params(reader.read<uint32_t>());
+    for (Param*& param : params) {
+        std::string param_name = reader.read_string();
+        param = new Param(param_name, read_type(reader));
+    }
+    FunctionPrototypeAST prototype(name, params, return_type);
+    prototype.setSuspend(is_suspend);
+    prototype.codegen();
+    return true;
+}
+
+bool import_const(const std::string& name) {
+    llvm::StringRef data;
+    const ImportedModule* imported = find_entry(name, CONST_ENTRY, data);
+    if (imported == nullptr) {
+        return false;
+    }
+    Reader reader(*imported, data);
+    Type type = read_type(reader);
+    llvm::Type* llvm_type = type_to_llvm_type(type);
+    llvm::Constant* value;
+    if (llvm_type->isFloatingPointTy()) {
+        value = llvm::ConstantFP::get(llvm_type, reader.read<double>());
+    } else {
+        value = llvm::ConstantInt::get(llvm_type, reader.read<int64_t>(), true);
+    }
+    const_values[name] = ConstValue{type, value};
+    return true;
+}
+
+int next_token() {
+    if (replaying) {
+        if (replay_position == replayed_tokens.size()) {
+            return 0;
+        }
+        // Statements of imported functions have no location in the input
+        const RecordedToken& token = replayed_tokens[replay_position++];
+        yylloc = YYLTYPE{0, 0, 0, 0};
+        switch (token.token) {
+            case id_token:
+            case collection_token:
+            case str_token:
+                yylval.string_value = new std::string(token.text);
+                break;
+            case int_token:
+            case char_token:
+                yylval.int_value = static_cast<int>(token.integer);
+                break;
+            case long_token:
+                yylval.long_value = token.integer;
+                break;
+            case boolean_token:
+                yylval.boolean_value = token.integer != 0;
+                break;
+            case double_token:
+                yylval.double_value = token.real;
+                break;
+            case float_token:
+                yylval.float_value = static_cast<float>(token.real);
+                break;
+            default:
+                break;
+        }
+        return token.token;
+    }
+
+    int token = yylex();
+    if (options.emit_interface.empty()) {
+        return token;
+    }
+    RecordedToken recorded{token, {yylloc.first_line, yylloc.first_column}, NO_VALUE, "", 0, 0};
+    switch (token) {
+        case id_token:
+        case collection_token:
+        case str_token:
+            recorded.value_kind = STRING_VALUE;
+            recorded.text = *yylval.string_value;
+            break;
+        case int_token:
+        case char_token:
+            recorded.value_kind = INTEGER_VALUE;
+            recorded.integer = yylval.int_value;
+            break;
+        case long_token:
+            recorded.value_kind = INTEGER_VALUE;
+            recorded.integer = yylval.long_value;
+            break;
+        case boolean_token:
+            recorded.value_kind = INTEGER_VALUE;
+            recorded.integer = yylval.boolean_value;
+            break;
+        case double_token:
+            recorded.value_kind = REAL_VALUE;
+            recorded.real = yylval.double_value;
+            break;
+        case float_token:
+            recorded.value_kind = REAL_VALUE;
+            recorded.real = yylval.float_value;
+            break;
+        default:
+            break;
+    }
+    recorded_tokens.push_back(recorded);
+    return token;
+}
+
+void record_inline_function(const std::string& name, SourceLocation first, SourceLocation last) {
+    if (!options.emit_interface.empty()) {
+        inline_function_ranges[name] = {first, last};
+    }
+}
+
+static bool before(SourceLocation a, SourceLocation b) {
+    return a.line < b.line || (a.line == b.line && a.column < b.column);
+}
+
+struct PendingEntry {
+    std::string name;
+    EntryKind kind;
+    std::string data;
+};
+
+void write_interface(const std::string& path) {
+    std::vector<PendingEntry> entries;
+
+    for (const ClassInfo& info : registered_classes()) {
+        if (info.kind != PLAIN_CLASS && info.kind != DATA_CLASS && info.kind != VALUE_CLASS) {
+            continue;
+        }
+        PendingEntry entry{info.name, CLASS_ENTRY, ""};
+        write<uint8_t>(entry.data, info.kind);
+        write<uint32_t>(entry.data, info.fields.size());
+        for (const ClassField& field : info.fields) {
+            write_string(entry.data, field.name);
+            write<uint8_t>(entry.data, field.is_var);
+            write_type(entry.data, field.type);
+        }
+        entries.push_back(entry);
+    }
+
+    for (const auto& function : function_signatures) {
+        const FunctionSignature& signature = function.second;
+        auto range = inline_function_ranges.find(function.first);
+        if (signature.inline_function != nullptr && range != inline_function_ranges.end()) {
+            std::vector<const RecordedToken*> tokens;
+            for (const RecordedToken& token : recorded_tokens) {
+                if (!before(token.location, range->second.first) && !before(range->second.second, token.location)) {
+                    tokens.push_back(&token);
+                }
+            }
+            PendingEntry entry{function.first, INLINE_FUNCTION_ENTRY, ""};
+            write<uint32_t>(entry.data, tokens.size());
+            for (const RecordedToken* token : tokens) {
+                write<int32_t>(entry.data, token->token);
+                write<uint8_t>(entry.data, token->value_kind);
+                if (token->value_kind == STRING_VALUE) {
+                    write_string(entry.data, token->text);
+                } else if (token->value_kind == INTEGER_VALUE) {
+                    write<int64_t>(entry.data, token->integer);
+                } else if (token->value_kind == REAL_VALUE) {
+                    write<double>(entry.data, token->real);
+                }
+            }
+            entries.push_back(entry);
+        } else if (signature.function != nullptr && !signature.function->isDeclaration()) {
+            PendingEntry entry{function.first, FUNCTION_ENTRY, ""};
+            write<uint8_t>(entry.data, signature.is_suspend);
+            write_type(entry.data, signature.return_type);
+            write<uint32_t>(entry.data, signature.param_types.size());
+            for (llvm::Argument& param : signature.function->args()) {
+                write_string(entry.data, param.getName().str());
+                write_type(entry.data, signature.param_types[param.getArgNo()]);
+            }
+            entries.push_back(entry);
+        }
+    }
+
+    for (const auto& constant : const_values) {
+        PendingEntry entry{constant.first, CONST_ENTRY, ""};
+        write_type(entry.data, constant.second.type);
+        if (auto* real = llvm::dyn_cast<llvm::ConstantFP>(constant.second.value)) {
+            write<double>(entry.data, real->getValueAPF().convertToDouble());
+        } else {
+            write<int64_t>(entry.data, llvm::cast<llvm::ConstantInt>(constant.second.value)->getSExtValue());
+        }
+        entries.push_back(entry);
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](const PendingEntry& a, const PendingEntry& b) {
+        return a.name < b.name;
+    });
+
+    InterfaceHeader header{};
+    std::memcpy(header.magic, interface_magic, sizeof(interface_magic));
+    header.version = interface_version;
+    header.entry_count = entries.size();
+
+    std::string table;
+    std::string blob;
+    size_t blob_offset = sizeof(header) + entries.size() * sizeof(InterfaceEntry);
+    for (const PendingEntry& pending : entries) {
+        InterfaceEntry entry{};
+        entry.name_offset = blob_offset + blob.size();
+        entry.name_length = pending.name.size();
+        blob += pending.name;
+        entry.kind = pending.kind;
+        entry.data_offset = blob_offset + blob.size();
+        entry.data_length = pending.data.size();
+        blob += pending.data;
+        write(table, entry);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out << table << blob;
+    if (!out) {
+        yyerror("Cannot write interface file: " + path);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef KOTLIN_LLVM_IMPORTS_HPP
+#define KOTLIN_LLVM_IMPORTS_HPP
+
+#include <string>
+
+#include "ast.hpp"
+#include "statement.hpp"
+
+// Module interfaces and `import`.
+//
+// --emit-interface writes what other files can use of the module: the prototypes of its functions, the tokens of
+// its inline functions, its const vals and the properties of its classes. `import a.b` maps a/b.ktif into memory;
+// its entries are sorted by name, and a declaration is only materialized the first time the importing file uses
+// the name, so neither the source of the module nor its unused declarations are ever parsed. The functions
+// themselves are linked from the module's own object file.
+
+// Maps the interface, searched in the directory of the input file and then in the -I directories
+void import_module(const std::string& path);
+
+// Declare the class, function or const val from the first imported interface that has it, the first time the name
+// is used. False when no interface has it.
+bool import_class(const std::string& name);
+bool import_function(const std::string& name);
+bool import_const(const std::string& name);
+
+// The parser's lexer: records the tokens of the input for --emit-interface, and replays the tokens of an imported
+// inline function while it is parsed
+int next_token();
+// The top-level inline function spans the tokens from first to last
+void record_inline_function(const std::string& name, SourceLocation first, SourceLocation last);
+// Parses the tokens being replayed into a single top-level statement, defined by the parser
+Statement* parse_replayed_statement();
+
+// Writes the interface of the classes, functions and const vals declared so far
+void write_interface(const std::string& path);
+
+#endif //KOTLIN_LLVM_IMPORTS_HPP
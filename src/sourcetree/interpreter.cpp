@@ -0,0 +1,494 @@
+#include "interpreter.hpp"
+
+#include <utility>
+
+#include "llvm/ADT/APSInt.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+
+#include "classes.hpp"
+#include "conversion.hpp"
+#include "imports.hpp"
+#include "intrinsics.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern std::map<std::string, llvm::AllocaInst*> named_values;
+extern std::map<std::string, Type> named_types;
+
+extern void yyerror(std::string msg);
+
+std::map<std::string, ConstValue> const_values;
+
+const ConstValue* find_const(const std::string& name) {
+    auto constant = const_values.find(name);
+    if (constant == const_values.end() && import_const(name)) {
+        constant = const_values.find(name);
+    }
+    return constant != const_values.end() ? &constant->second : nullptr;
+}
+
+// Statements, loop iterations and calls one evaluation may take before the interpreter gives up
+static const long max_steps = 1000000;
+// Nested interpreted calls, the interpreter recurses on the compiler's own stack
+static const int max_depth = 256;
+
+struct Frame {
+    std::map<std::string, llvm::Constant*> values;
+    Type return_type;
+    llvm::Constant* return_value;
+};
+
+static std::map<std::string, FunctionAST*> interpretable_functions;
+static Frame* current_frame = nullptr;
+static long steps_left = 0;
+static int depth = 0;
+// Calls evaluated so far. Failures are only remembered for calls made from generated code, a nested call may
+// have failed because the steps of the outer one ran out.
+static std::map<std::pair<std::string, std::vector<llvm::Constant*>>, llvm::Constant*> call_results;
+
+void register_interpretable_function(FunctionAST* function) {
+    const FunctionPrototypeAST* prototype = function->getPrototype();
+    if (prototype->isSuspend() || is_class(prototype->getReturnType()) || prototype->getReturnType() == UNIT) {
+        return;
+    }
+    for (const Param* param : prototype->getParams()) {
+        if (is_class(param->getType())) {
+            return;
+        }
+    }
+    interpretable_functions[prototype->getId()] = function;
+}
+
+bool retained_by_interpreter(const Statement* statement) {
+    auto* function = dynamic_cast<const FunctionAST*>(statement);
+    if (function == nullptr) {
+        return false;
+    }
+    auto found = interpretable_functions.find(function->getPrototype()->getId());
+    return found != interpretable_functions.end() && found->second == function;
+}
+
+// Only numbers, Booleans and Chars: undef and poison (division by zero, Int.MIN_VALUE / -1) are left to run time
+static llvm::Constant* folded(llvm::Value* value) {
+    if (llvm::isa<llvm::ConstantInt>(value) || llvm::isa<llvm::ConstantFP>(value)) {
+        return llvm::cast<llvm::Constant>(value);
+    }
+    return nullptr;
+}
+
+llvm::Constant* convert_constant(llvm::Constant* value, Type from, Type to) {
+    if (is_floating_point(from) && is_integral(to)) {
+        // Saturates like the llvm.fpto*i.sat call convert_value generates, NaN becomes 0
+        const llvm::APFloat& real = llvm::cast<llvm::ConstantFP>(value)->getValueAPF();
+        llvm::APSInt integer(type_to_llvm_type(to)->getIntegerBitWidth(), is_unsigned(to));
+        bool exact;
+        if (!real.isNaN()) {
+            real.convertToInteger(integer, llvm::APFloat::rmTowardZero, &exact);
+        }
+        return llvm::ConstantInt::get(context, integer);
+    }
+    return folded(convert_value(value, from, to));
+}
+
+static Execution execute_block(const std::vector<Statement*>& block) {
+    for (Statement* statement : block) {
+        if (--steps_left < 0) {
+            return Execution::Failed;
+        }
+        Execution execution = statement->execute();
+        if (execution != Execution::Normal) {
+            return execution;
+        }
+    }
+    return Execution::Normal;
+}
+
+llvm::Constant* interpret_call(const std::string& name, const std::vector<llvm::Constant*>& args) {
+    auto found = interpretable_functions.find(name);
+    if (found == interpretable_functions.end()) {
+        return nullptr;
+    }
+    auto key = std::make_pair(name, args);
+    auto cached = call_results.find(key);
+    if (cached != call_results.end()) {
+        return cached->second;
+    }
+    bool outermost = depth == 0;
+    if (outermost) {
+        steps_left = max_steps;
+    }
+    if (depth == max_depth || --steps_left < 0) {
+        return nullptr;
+    }
+
+    const FunctionPrototypeAST* prototype = found->second->getPrototype();
+    Frame frame{{}, prototype->getReturnType(), nullptr};
+    // Expressions look up the types of variables in named_types, so the callee gets its own
+    std::map<std::string, Type> saved_types = named_types;
+    named_types.clear();
+    for (unsigned i = 0; i < args.size(); i++) {
+        const Param* param = prototype->getParams()[i];
+        frame.values[param->getId()] = args[i];
+        named_types[param->getId()] = param->getType();
+    }
+    Frame* saved_frame = current_frame;
+    current_frame = &frame;
+    depth++;
+    Execution execution = execute_block(found->second->getBody());
+    depth--;
+    current_frame = saved_frame;
+    named_types = saved_types;
+
+    llvm::Constant* result = execution == Execution::Returned ? frame.return_value : nullptr;
+    if (result != nullptr || outermost) {
+        call_results[key] = result;
+    }
+    return result;
+}
+
+llvm::Constant* IntExprAST::evaluate() {
+    return llvm::cast<llvm::Constant>(codegen());
+}
+
+llvm::Constant* LongExprAST::evaluate() {
+    return llvm::cast<llvm::Constant>(codegen());
+}
+
+llvm::Constant* DoubleExprAST::evaluate() {
+    return llvm::cast<llvm::Constant>(codegen());
+}
+
+llvm::Constant* FloatExprAST::evaluate() {
+    return llvm::cast<llvm::Constant>(codegen());
+}
+
+llvm::Constant* CharExprAST::evaluate() {
+    return llvm::cast<llvm::Constant>(codegen());
+}
+
+llvm::Constant* ConstBooleanExprAST::evaluate() {
+    return llvm::cast<llvm::Constant>(codegen());
+}
+
+llvm::Value* ConstantExprAST::codegen() {
+    return _value;
+}
+
+llvm::Constant* VarExprAST::evaluate() {
+    if (current_frame != nullptr) {
+        auto found = current_frame->values.find(_id);
+        if (found != current_frame->values.end()) {
+            return found->second;
+        }
+    } else {
+        // A local of the function being generated hides the constant
+        auto local = named_values.find(_id);
+        if (local != named_values.end() && local->second != nullptr) {
+            return nullptr;
+        }
+    }
+    const ConstValue* constant = find_const(_id);
+    return constant != nullptr ? constant->value : nullptr;
+}
+
+// The operations themselves are generated by codegen() on constant operands, which the IRBuilder folds, so they
+// cannot come out differently at compile time and at run time
+llvm::Constant* UnaryExprAST::evaluate() {
+    llvm::Constant* first = _first->evaluate();
+    if (first == nullptr) {
+        return nullptr;
+    }
+    ConstantExprAST first_constant(first, _first->type());
+    ExprAST* saved_first = _first;
+    _first = &first_constant;
+    llvm::Value* result = codegen();
+    _first = saved_first;
+    return folded(result);
+}
+
+llvm::Constant* BinaryExprAST::evaluate() {
+    llvm::Constant* first = _first->evaluate();
+    llvm::Constant* second = first != nullptr ? _second->evaluate() : nullptr;
+    if (second == nullptr) {
+        return nullptr;
+    }
+    return fold(first, second);
+}
+
+llvm::Constant* BinaryExprAST::evaluate_division() {
+    llvm::Constant* first = _first->evaluate();
+    llvm::Constant* second = first != nullptr ? _second->evaluate() : nullptr;
+    if (second == nullptr ||
+        (is_integral(arithmetic_type(_first->type(), _second->type())) && second->isNullValue())) {
+        return nullptr;
+    }
+    return fold(first, second);
+}
+
+llvm::Constant* DivExprAST::evaluate() {
+    return evaluate_division();
+}
+
+llvm::Constant* ModExprAST::evaluate() {
+    return evaluate_division();
+}
+
+llvm::Constant* BinaryExprAST::fold(llvm::Constant* first, llvm::Constant* second) {
+    ConstantExprAST first_constant(first, _first->type());
+    ConstantExprAST second_constant(second, _second->type());
+    ExprAST* saved_first = _first;
+    ExprAST* saved_second = _second;
+    _first = &first_constant;
+    _second = &second_constant;
+    llvm::Value* result = codegen();
+    _first = saved_first;
+    _second = saved_second;
+    return folded(result);
+}
+
+static llvm::Constant* evaluate_short_circuit(ExprAST* first, ExprAST* second, bool is_and) {
+    if (first->type() != BOOLEAN || second->type() != BOOLEAN) {
+        return nullptr;
+    }
+    llvm::Constant* value_first = first->evaluate();
+    if (value_first == nullptr || value_first->isOneValue() != is_and) {
+        return value_first;
+    }
+    return second->evaluate();
+}
+
+llvm::Constant* AndLExprAST::evaluate() {
+    return evaluate_short_circuit(_first, _second, true);
+}
+
+llvm::Constant* OrLExprAST::evaluate() {
+    return evaluate_short_circuit(_first, _second, false);
+}
+
+llvm::Constant* IfElseExprAST::evaluate() {
+    // Mismatched branches are reported by codegen()
+    if (_cond->type() != BOOLEAN || _then_expr->type() != _else_expr->type()) {
+        return nullptr;
+    }
+    llvm::Constant* cond = _cond->evaluate();
+    if (cond == nullptr) {
+        return nullptr;
+    }
+    return cond->isOneValue() ? _then_expr->evaluate() : _else_expr->evaluate();
+}
+
+llvm::Constant* CallExprAST::evaluate() {
+    if (calls_function_value()) {
+        return nullptr;
+    }
+    if (is_intrinsic_call()) {
+        return intrinsic_evaluate(_callee_id, _args);
+    }
+    if (_callee == nullptr || interpretable_functions.count(_callee_id) == 0) {
+        return nullptr;
+    }
+    const FunctionSignature& signature = *_callee;
+    if (signature.param_types.size() != _args.size()) {
+        return nullptr;
+    }
+    std::vector<llvm::Constant*> args;
+    for (unsigned i = 0; i < _args.size(); i++) {
+        llvm::Constant* arg = _args[i]->evaluate();
+        if (arg == nullptr || (arg = convert_constant(arg, _args[i]->type(), signature.param_types[i])) == nullptr) {
+            return nullptr;
+        }
+        args.push_back(arg);
+    }
+    return interpret_call(_callee_id, args);
+}
+
+static bool evaluate_condition(ExprAST* cond, bool& result) {
+    if (cond->type() != BOOLEAN) {
+        return false;
+    }
+    llvm::Constant* value = cond->evaluate();
+    if (value == nullptr) {
+        return false;
+    }
+    result = value->isOneValue();
+    return true;
+}
+
+static bool is_local(const std::string& id) {
+    return current_frame != nullptr && current_frame->values.count(id) != 0;
+}
+
+Execution ExpressionStatement::execute() {
+    return expr->evaluate() != nullptr ? Execution::Normal : Execution::Failed;
+}
+
+Execution ReturnStatement::execute() {
+    llvm::Constant* value = current_frame != nullptr && _expr != nullptr ? _expr->evaluate() : nullptr;
+    if (value == nullptr) {
+        return Execution::Failed;
+    }
+    current_frame->return_value = convert_constant(value, _expr->type(), current_frame->return_type);
+    return current_frame->return_value != nullptr ? Execution::Returned : Execution::Failed;
+}
+
+Execution VarDeclarationStatement::execute() {
+    if (current_frame == nullptr || is_class(_type) || _type == STRING) {
+        return Execution::Failed;
+    }
+    current_frame->values[_id] = llvm::Constant::getNullValue(type_to_llvm_type(_type));
+    named_types[_id] = _type;
+    return Execution::Normal;
+}
+
+Execution AssignStatement::execute() {
+    llvm::Constant* value = is_local(_id) ? _expr->evaluate() : nullptr;
+    if (value == nullptr || (value = convert_constant(value, _expr->type(), named_types[_id])) == nullptr) {
+        return Execution::Failed;
+    }
+    current_frame->values[_id] = value;
+    return Execution::Normal;
+}
+
+// Computed in the promoted type and narrowed back, like the generated compound assignments
+static Execution compound_assign(const std::string& id, ExprAST* expr, llvm::Instruction::BinaryOps integer_operation,
+                                 llvm::Instruction::BinaryOps floating_point_operation) {
+    llvm::Constant* value = is_local(id) ? expr->evaluate() : nullptr;
+    if (value == nullptr) {
+        return Execution::Failed;
+    }
+    Type variable_type = named_types[id];
+    Type operation_type = arithmetic_type(variable_type, expr->type());
+    llvm::Constant* first = convert_constant(current_frame->values[id], variable_type, operation_type);
+    llvm::Constant* second = convert_constant(value, expr->type(), operation_type);
+    if (first == nullptr || second == nullptr) {
+        return Execution::Failed;
+    }
+    llvm::Constant* result = folded(builder.CreateBinOp(
+            is_floating_point(operation_type) ? floating_point_operation : integer_operation, first, second));
+    if (result == nullptr || (result = convert_constant(result, operation_type, variable_type)) == nullptr) {
+        return Execution::Failed;
+    }
+    current_frame->values[id] = result;
+    return Execution::Normal;
+}
+
+Execution PlusAssignStatement::execute() {
+    return compound_assign(_id, _expr, llvm::Instruction::Add, llvm::Instruction::FAdd);
+}
+
+Execution MinusAssignStatement::execute() {
+    return compound_assign(_id, _expr, llvm::Instruction::Sub, llvm::Instruction::FSub);
+}
+
+Execution TimesAssignStatement::execute() {
+    return compound_assign(_id, _expr, llvm::Instruction::Mul, llvm::Instruction::FMul);
+}
+
+Execution DivAssignStatement::execute() {
+    return compound_assign(_id, _expr, llvm::Instruction::SDiv, llvm::Instruction::FDiv);
+}
+
+Execution ModAssignStatement::execute() {
+    return compound_assign(_id, _expr, llvm::Instruction::SRem, llvm::Instruction::FRem);
+}
+
+Execution DeclareAndAssignStatement::execute() {
+    Execution execution = _decl_statement->execute();
+    return execution == Execution::Normal ? _assign_statement->execute() : execution;
+}
+
+Execution IfStatement::execute() {
+    bool condition;
+    if (!evaluate_condition(_cond, condition)) {
+        return Execution::Failed;
+    }
+    return condition ? execute_block(*_then_stat) : Execution::Normal;
+}
+
+Execution IfElseStatement::execute() {
+    bool condition;
+    if (!evaluate_condition(_cond, condition)) {
+        return Execution::Failed;
+    }
+    return execute_block(condition ? *_then_stat : *_else_stat);
+}
+
+Execution WhileStatement::execute() {
+    for (;;) {
+        bool condition;
+        if (--steps_left < 0 || !evaluate_condition(_cond, condition)) {
+            return Execution::Failed;
+        }
+        if (!condition) {
+            return Execution::Normal;
+        }
+        Execution execution = execute_block(*_then_stat);
+        if (execution != Execution::Normal) {
+            return execution;
+        }
+    }
+}
+
+// The loop variable hides a variable of the same name until the loop ends, like in codegen()
+static Execution execute_for(const std::string& id, int start, int end, bool inclusive, ExprAST* inc,
+                             const std::vector<Statement*>& block) {
+    if (current_frame == nullptr) {
+        return Execution::Failed;
+    }
+    bool shadows = is_local(id);
+    llvm::Constant* old_value = shadows ? current_frame->values[id] : nullptr;
+    Type old_type = shadows ? named_types[id] : INT;
+    current_frame->values[id] = builder.getInt32(start);
+    named_types[id] = INT;
+
+    Execution execution = Execution::Normal;
+    for (;;) {
+        int64_t current = llvm::cast<llvm::ConstantInt>(current_frame->values[id])->getSExtValue();
+        if (inclusive ? current > end : current >= end) {
+            break;
+        }
+        execution = --steps_left < 0 ? Execution::Failed : execute_block(block);
+        if (execution != Execution::Normal) {
+            break;
+        }
+        llvm::Constant* step = inc->evaluate();
+        if (step == nullptr || (step = convert_constant(step, inc->type(), INT)) == nullptr) {
+            execution = Execution::Failed;
+            break;
+        }
+        current_frame->values[id] = folded(builder.CreateAdd(current_frame->values[id], step));
+    }
+
+    if (shadows) {
+        current_frame->values[id] = old_value;
+        named_types[id] = old_type;
+    } else {
+        current_frame->values.erase(id);
+        named_types.erase(id);
+    }
+    return execution;
+}
+
+Execution ForStatement::execute() {
+    return execute_for(_id, _start, _end, true, _inc, *_block);
+}
+
+Execution ForUStatement::execute() {
+    return execute_for(_id, _start, _end, false, _inc, *_block);
+}
+
+void ConstValStatement::codegen() {
+    if (is_class(_type) || _type == STRING) {
+        yyerror("Only numbers, Booleans and Chars can be const: " + _id);
+    }
+    if (const_values.count(_id) != 0) {
+        yyerror("Conflicting declarations: const val " + _id);
+    }
+    llvm::Constant* value = _expr->evaluate();
+    if (value == nullptr || (value = convert_constant(value, _expr->type(), _type)) == nullptr) {
+        yyerror("Const 'val' initializer should be a constant value: " + _id);
+    }
+    const_values[_id] = ConstValue{_type, value};
+}
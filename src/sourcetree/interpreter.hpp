@@ -0,0 +1,38 @@
+#ifndef KOTLIN_LLVM_INTERPRETER_HPP
+#define KOTLIN_LLVM_INTERPRETER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Constant.h"
+
+#include "ast.hpp"
+#include "statement.hpp"
+
+// Compile-time evaluation. `const val` initializers, and with -O1 and above calls with constant arguments, are run
+// by an interpreter over the AST of the called functions and folded into constants. The interpreter gives up on
+// anything with side effects and after a fixed number of steps, and the call is then generated as usual.
+
+struct ConstValue {
+    Type type;
+    llvm::Constant* value;
+};
+
+extern std::map<std::string, ConstValue> const_values;
+
+// The const val declared or imported with that name, or nullptr
+const ConstValue* find_const(const std::string& name);
+
+// Keeps the AST of a function whose parameters and result are primitive, so calls to it can be interpreted
+void register_interpretable_function(FunctionAST* function);
+// Whether the interpreter owns the statement, the parser must not free it then
+bool retained_by_interpreter(const Statement* statement);
+
+// Result of calling the function with the given (converted) arguments, or nullptr when the interpreter gave up
+llvm::Constant* interpret_call(const std::string& name, const std::vector<llvm::Constant*>& args);
+
+// convert_value for constants
+llvm::Constant* convert_constant(llvm::Constant* value, Type from, Type to);
+
+#endif //KOTLIN_LLVM_INTERPRETER_HPP
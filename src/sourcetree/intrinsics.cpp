@@ -0,0 +1,208 @@
+#include "intrinsics.hpp"
+
+#include <map>
+
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+
+#include "conversion.hpp"
+#include "statement.hpp"
+#include "driver/options.hpp"
+
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+extern void yyerror(std::string msg);
+
+enum class IntrinsicKind {
+    // Double or Float, integers are converted to Double
+    FloatingPoint,
+    // Any numeric type, promoted like the operands of arithmetic
+    Numeric,
+    // Int, Long, Short or Byte at their own width
+    Bits
+};
+
+struct Intrinsic {
+    IntrinsicKind kind;
+    unsigned arity;
+    llvm::Intrinsic::ID integer_id;
+    llvm::Intrinsic::ID floating_point_id;
+    // The count operations return Int whatever the width of their operand
+    bool int_result;
+};
+
+static const std::map<std::string, Intrinsic> intrinsics = {
+        {"sqrt", {IntrinsicKind::FloatingPoint, 1, llvm::Intrinsic::not_intrinsic, llvm::Intrinsic::sqrt, false}},
+        {"floor", {IntrinsicKind::FloatingPoint, 1, llvm::Intrinsic::not_intrinsic, llvm::Intrinsic::floor, false}},
+        {"ceil", {IntrinsicKind::FloatingPoint, 1, llvm::Intrinsic::not_intrinsic, llvm::Intrinsic::ceil, false}},
+        {"truncate", {IntrinsicKind::FloatingPoint, 1, llvm::Intrinsic::not_intrinsic, llvm::Intrinsic::trunc, false}},
+        // Kotlin rounds halves to even
+        {"round", {IntrinsicKind::FloatingPoint, 1, llvm::Intrinsic::not_intrinsic, llvm::Intrinsic::roundeven, false}},
+        {"abs", {IntrinsicKind::Numeric, 1, llvm::Intrinsic::abs, llvm::Intrinsic::fabs, false}},
+        {"min", {IntrinsicKind::Numeric, 2, llvm::Intrinsic::smin, llvm::Intrinsic::minnum, false}},
+        {"minOf", {IntrinsicKind::Numeric, 2, llvm::Intrinsic::smin, llvm::Intrinsic::minnum, false}},
+        {"max", {IntrinsicKind::Numeric, 2, llvm::Intrinsic::smax, llvm::Intrinsic::maxnum, false}},
+        {"maxOf", {IntrinsicKind::Numeric, 2, llvm::Intrinsic::smax, llvm::Intrinsic::maxnum, false}},
+        {"countOneBits", {IntrinsicKind::Bits, 1, llvm::Intrinsic::ctpop, llvm::Intrinsic::not_intrinsic, true}},
+        {"countLeadingZeroBits", {IntrinsicKind::Bits, 1, llvm::Intrinsic::ctlz, llvm::Intrinsic::not_intrinsic, true}},
+        {"countTrailingZeroBits", {IntrinsicKind::Bits, 1, llvm::Intrinsic::cttz, llvm::Intrinsic::not_intrinsic, true}},
+        {"rotateLeft", {IntrinsicKind::Bits, 2, llvm::Intrinsic::fshl, llvm::Intrinsic::not_intrinsic, false}},
+        {"rotateRight", {IntrinsicKind::Bits, 2, llvm::Intrinsic::fshr, llvm::Intrinsic::not_intrinsic, false}},
+};
+
+// Set by intrinsic_evaluate, an intrinsic call that does not fold then fails the evaluation instead of being emitted
+static bool evaluating = false;
+static bool evaluation_failed = false;
+
+bool is_intrinsic(const std::string& name) {
+    return intrinsics.count(name) > 0 && function_signatures.count(name) == 0;
+}
+
+static const Intrinsic& find_intrinsic(const std::string& name, const std::vector<ExprAST*>& args) {
+    const Intrinsic& intrinsic = intrinsics.at(name);
+    if (args.size() != intrinsic.arity) {
+        yyerror("Wrong number of arguments: " + name);
+    }
+    return intrinsic;
+}
+
+// The type the operation is done in
+static Type operand_type(const std::string& name, const Intrinsic& intrinsic, const std::vector<ExprAST*>& args) {
+    Type type = args[0]->type();
+    switch (intrinsic.kind) {
+        case IntrinsicKind::FloatingPoint:
+            if (type == FLOAT || type == DOUBLE) {
+                return type;
+            }
+            if (!is_integral(type)) {
+                yyerror(name + " is not defined for " + type_name(type));
+            }
+            return DOUBLE;
+        case IntrinsicKind::Numeric:
+            return args.size() == 1 ? arithmetic_type(type, type) : arithmetic_type(type, args[1]->type());
+        case IntrinsicKind::Bits:
+            if (type != INT && type != LONG && type != SHORT && type != BYTE) {
+                yyerror(name + " is not defined for " + type_name(type));
+            }
+            if (args.size() == 2 && !is_integral(args[1]->type())) {
+                yyerror("The bit count of " + name + " must be an integer");
+            }
+            return type;
+    }
+    return type;
+}
+
+Type intrinsic_type(const std::string& name, const std::vector<ExprAST*>& args) {
+    const Intrinsic& intrinsic = find_intrinsic(name, args);
+    return intrinsic.int_result ? INT : operand_type(name, intrinsic, args);
+}
+
+static llvm::Value* call_intrinsic(llvm::Intrinsic::ID id, llvm::Type* type, const std::vector<llvm::Value*>& args) {
+    llvm::Function* function = llvm::Intrinsic::getDeclaration(module, id, {type});
+    std::vector<llvm::Constant*> constants;
+    for (llvm::Value* arg : args) {
+        if (auto* constant = llvm::dyn_cast<llvm::Constant>(arg)) {
+            constants.push_back(constant);
+        }
+    }
+    if (constants.size() == args.size()) {
+        llvm::CallInst* call = llvm::CallInst::Create(function, args);
+        llvm::Constant* result = llvm::ConstantFoldCall(call, function, constants);
+        call->deleteValue();
+        if (result != nullptr) {
+            return result;
+        }
+    }
+    if (evaluating) {
+        evaluation_failed = true;
+        return llvm::UndefValue::get(type);
+    }
+    return builder.CreateCall(function, args);
+}
+
+// Kotlin's min and max return NaN when either operand is NaN and order -0.0 below 0.0. llvm.minimum and
+// llvm.maximum mean exactly that but x86 cannot select them, so that is only left out under -ffast-math.
+static llvm::Value* floating_point_min_max(const Intrinsic& intrinsic, llvm::Value* first, llvm::Value* second) {
+    bool min = intrinsic.floating_point_id == llvm::Intrinsic::minnum;
+    if (options.fast_math) {
+        return call_intrinsic(intrinsic.floating_point_id, first->getType(), {first, second});
+    }
+    llvm::Value* ordered = min ? builder.CreateFCmpOLT(first, second) : builder.CreateFCmpOGT(first, second);
+    llvm::Value* result = builder.CreateSelect(ordered, first, second);
+    // Equal operands only differ in the sign of zero, which the sign bit of either decides
+    llvm::Type* bits_type = builder.getIntNTy(first->getType()->getPrimitiveSizeInBits());
+    llvm::Value* first_bits = builder.CreateBitCast(first, bits_type);
+    llvm::Value* second_bits = builder.CreateBitCast(second, bits_type);
+    llvm::Value* zero = builder.CreateBitCast(min ? builder.CreateOr(first_bits, second_bits)
+                                                  : builder.CreateAnd(first_bits, second_bits), first->getType());
+    result = builder.CreateSelect(builder.CreateFCmpOEQ(first, second), zero, result);
+    return builder.CreateSelect(builder.CreateFCmpUNO(first, second), builder.CreateFAdd(first, second), result,
+                                min ? "min" : "max");
+}
+
+llvm::Value* intrinsic_codegen(const std::string& name, const std::vector<ExprAST*>& args) {
+    const Intrinsic& intrinsic = find_intrinsic(name, args);
+    Type type = operand_type(name, intrinsic, args);
+    llvm::Type* llvm_type = type_to_llvm_type(type);
+    llvm::Value* first = convert_value(args[0]->codegen(), args[0]->type(), type);
+
+    if (intrinsic.kind == IntrinsicKind::Bits) {
+        llvm::Value* result;
+        if (args.size() == 2) {
+            // Only the low bits of the count matter, a rotation by the width or a negative count wraps around
+            llvm::Value* count = builder.CreateSExtOrTrunc(args[1]->codegen(), llvm_type);
+            result = call_intrinsic(intrinsic.integer_id, llvm_type, {first, first, count});
+        } else if (intrinsic.integer_id == llvm::Intrinsic::ctpop) {
+            result = call_intrinsic(intrinsic.integer_id, llvm_type, {first});
+        } else {
+            // The count of a zero is its width
+            result = call_intrinsic(intrinsic.integer_id, llvm_type, {first, builder.getFalse()});
+        }
+        return intrinsic.int_result ? builder.CreateZExtOrTrunc(result, builder.getInt32Ty(), name) : result;
+    }
+
+    if (!is_floating_point(type)) {
+        if (args.size() == 1) {
+            // abs of the minimum value is the minimum value, as in Kotlin
+            return call_intrinsic(intrinsic.integer_id, llvm_type, {first, builder.getFalse()});
+        }
+        llvm::Value* second = convert_value(args[1]->codegen(), args[1]->type(), type);
+        return call_intrinsic(intrinsic.integer_id, llvm_type, {first, second});
+    }
+    if (args.size() == 2) {
+        llvm::Value* second = convert_value(args[1]->codegen(), args[1]->type(), type);
+        return floating_point_min_max(intrinsic, first, second);
+    }
+    return call_intrinsic(intrinsic.floating_point_id, llvm_type, {first});
+}
+
+llvm::Constant* intrinsic_evaluate(const std::string& name, const std::vector<ExprAST*>& args) {
+    std::vector<ConstantExprAST*> constant_args;
+    for (ExprAST* arg : args) {
+        llvm::Constant* value = arg->evaluate();
+        if (value == nullptr) {
+            break;
+        }
+        constant_args.push_back(new ConstantExprAST(value, arg->type()));
+    }
+    llvm::Value* result = nullptr;
+    if (constant_args.size() == args.size()) {
+        evaluating = true;
+        evaluation_failed = false;
+        result = intrinsic_codegen(name, std::vector<ExprAST*>(constant_args.begin(), constant_args.end()));
+        evaluating = false;
+    }
+    for (ConstantExprAST* constant_arg : constant_args) {
+        delete constant_arg;
+    }
+    if (result == nullptr || evaluation_failed ||
+        !(llvm::isa<llvm::ConstantInt>(result) || llvm::isa<llvm::ConstantFP>(result))) {
+        return nullptr;
+    }
+    return llvm::cast<llvm::Constant>(result);
+}
@@ -0,0 +1,24 @@
+#ifndef KOTLIN_LLVM_INTRINSICS_HPP
+#define KOTLIN_LLVM_INTRINSICS_HPP
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Constant.h"
+#include "llvm/IR/Value.h"
+
+#include "ast.hpp"
+
+// Functions of kotlin.math (sqrt, abs, min, max, floor, ...) and the bit operations of the integer types
+// (countOneBits, rotateLeft, ...), called like any other function. They are generated as LLVM intrinsics instead
+// of external calls, so they lower to single instructions and the vectorizer can widen them. A function the program
+// declares with the same name takes precedence.
+
+bool is_intrinsic(const std::string& name);
+
+Type intrinsic_type(const std::string& name, const std::vector<ExprAST*>& args);
+llvm::Value* intrinsic_codegen(const std::string& name, const std::vector<ExprAST*>& args);
+// The folded result for constant arguments, or nullptr
+llvm::Constant* intrinsic_evaluate(const std::string& name, const std::vector<ExprAST*>& args);
+
+#endif //KOTLIN_LLVM_INTRINSICS_HPP
@@ -0,0 +1,595 @@
+#include "lambdas.hpp"
+
+#include <algorithm>
+#include <set>
+
+#include "llvm/Analysis/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "allocation.hpp"
+#include "classes.hpp"
+#include "conversion.hpp"
+#include "coroutine.hpp"
+#include "debug_info.hpp"
+#include "exceptions.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+extern std::map<std::string, llvm::AllocaInst*> named_values;
+extern std::map<std::string, Type> named_types;
+
+extern void yyerror(std::string msg);
+
+std::map<std::string, InlinedFunction*> inline_functions;
+InlineFrame* current_inline_frame = nullptr;
+
+// Inline functions being expanded, innermost last
+static std::vector<const FunctionAST*> inline_stack;
+// Nesting depth of the closure bodies being generated
+static int closure_body_depth = 0;
+
+static Scope current_scope() {
+    return Scope{named_values, named_types, inline_functions, current_inline_frame, inline_stack.size()};
+}
+
+static void set_scope(const Scope& scope) {
+    named_values = scope.values;
+    named_types = scope.types;
+    inline_functions = scope.functions;
+    current_inline_frame = scope.frame;
+}
+
+bool is_function_type(Type type) {
+    return is_class(type) && class_info(type).kind == FUNCTION_CLASS;
+}
+
+static std::vector<Type> function_param_types(Type type) {
+    const std::vector<ClassField>& fields = class_info(type).fields;
+    std::vector<Type> param_types;
+    for (unsigned i = 0; i + 1 < fields.size(); i++) {
+        param_types.push_back(fields[i].type);
+    }
+    return param_types;
+}
+
+static Type function_result_type(Type type) {
+    return class_info(type).fields.back().type;
+}
+
+// The function of a closure takes the closure first
+static llvm::FunctionType* closure_function_type(Type type) {
+    std::vector<llvm::Type*> params = {builder.getInt8PtrTy()};
+    for (Type param_type : function_param_types(type)) {
+        params.push_back(type_to_llvm_type(param_type));
+    }
+    return llvm::FunctionType::get(type_to_llvm_type(function_result_type(type)), params, false);
+}
+
+Type function_type(const std::vector<Type>& param_types, Type result_type) {
+    std::string name = "(";
+    for (unsigned i = 0; i < param_types.size(); i++) {
+        if (param_types[i] == UNIT) {
+            yyerror("Parameters cannot have type Unit");
+        }
+        name += (i > 0 ? ", " : "") + type_name(param_types[i]);
+    }
+    name += ") -> " + type_name(result_type);
+    if (is_class_name(name)) {
+        return find_class(name);
+    }
+
+    std::vector<Type> fields = param_types;
+    fields.push_back(result_type);
+    std::vector<llvm::Type*> params = {builder.getInt8PtrTy()};
+    for (Type param_type : param_types) {
+        params.push_back(type_to_llvm_type(param_type));
+    }
+    llvm::FunctionType* function = llvm::FunctionType::get(type_to_llvm_type(result_type), params, false);
+    return generic_class_type(name, FUNCTION_CLASS, fields,
+                              llvm::StructType::create(context, {function->getPointerTo()}, name));
+}
+
+void expect_function(ExprAST* expression, Type type) {
+    auto* lambda = dynamic_cast<LambdaExprAST*>(expression);
+    if (lambda != nullptr && is_function_type(type)) {
+        lambda->expect(type);
+    }
+}
+
+bool is_function_value(const std::string& name) {
+    if (inline_functions.count(name) != 0) {
+        return true;
+    }
+    auto value = named_values.find(name);
+    return value != named_values.end() && value->second != nullptr && is_function_type(named_types[name]);
+}
+
+Type function_value_type(const std::string& name) {
+    return function_result_type(named_types[name]);
+}
+
+static llvm::Value* call_closure(llvm::Value* closure, Type type, const std::vector<llvm::Value*>& args) {
+    const ClassInfo& info = class_info(type);
+    llvm::FunctionType* function_type = closure_function_type(type);
+    llvm::Value* function = builder.CreateLoad(function_type->getPointerTo(),
+                                               builder.CreateStructGEP(info.struct_type, closure, 0), "function");
+    std::vector<llvm::Value*> call_args = {builder.CreateBitCast(closure, builder.getInt8PtrTy())};
+    call_args.insert(call_args.end(), args.begin(), args.end());
+    llvm::CallInst* call = builder.CreateCall(function_type, function, call_args);
+    call->addParamAttr(0, llvm::Attribute::NoCapture);
+    Type result_type = function_result_type(type);
+    if (result_type == UNIT) {
+        return nullptr;
+    }
+    call->setName("call");
+    return is_reference(result_type) ? root_temporary(call) : call;
+}
+
+llvm::Value* call_function_value(const std::string& name, const std::vector<ExprAST*>& args) {
+    Type type = named_types[name];
+    std::vector<Type> param_types = function_param_types(type);
+    if (args.size() != param_types.size()) {
+        yyerror("Wrong number of arguments: " + name);
+    }
+    std::vector<llvm::Value*> values;
+    for (unsigned i = 0; i < args.size(); i++) {
+        expect_function(args[i], param_types[i]);
+        values.push_back(convert_value(args[i]->codegen(), args[i]->type(), param_types[i]));
+    }
+
+    auto inlined = inline_functions.find(name);
+    if (inlined != inline_functions.end()) {
+        return invoke_function(*inlined->second, values);
+    }
+    llvm::AllocaInst* variable = named_values[name];
+    return call_closure(builder.CreateLoad(variable->getAllocatedType(), variable, name), type, values);
+}
+
+InlinedFunction bind_function(ExprAST* function, Type type) {
+    expect_function(function, type);
+    if (function->type() != type) {
+        yyerror("Type mismatch: cannot convert " + type_name(function->type()) + " to " + type_name(type));
+    }
+    if (auto* lambda = dynamic_cast<LambdaExprAST*>(function)) {
+        return InlinedFunction{type, lambda, current_scope(), nullptr};
+    }
+    // A parameter bound to a lambda passes the lambda on
+    if (auto* variable = dynamic_cast<VarExprAST*>(function)) {
+        auto inlined = inline_functions.find(variable->getId());
+        if (inlined != inline_functions.end()) {
+            return *inlined->second;
+        }
+    }
+    return InlinedFunction{type, nullptr, Scope{}, function->codegen()};
+}
+
+llvm::Value* invoke_function(const InlinedFunction& function, const std::vector<llvm::Value*>& args) {
+    if (function.lambda == nullptr) {
+        return call_closure(function.closure, function.type, args);
+    }
+    Scope saved_scope = current_scope();
+    std::vector<const FunctionAST*> saved_stack = inline_stack;
+    set_scope(function.scope);
+    // The lambda was written outside of the inline functions expanded since, so it can call them again
+    inline_stack.resize(function.scope.inline_depth);
+    llvm::Value* result = function.lambda->codegen_inline(args);
+    inline_stack = saved_stack;
+    set_scope(saved_scope);
+    return result;
+}
+
+llvm::Value* function_value(const InlinedFunction& function) {
+    if (function.lambda == nullptr) {
+        return function.closure;
+    }
+    Scope saved_scope = current_scope();
+    set_scope(function.scope);
+    llvm::Value* closure = function.lambda->codegen();
+    set_scope(saved_scope);
+    return closure;
+}
+
+void declare_inline_function(FunctionAST* function) {
+    const FunctionPrototypeAST* prototype = function->getPrototype();
+    if (prototype->isSuspend()) {
+        yyerror("Suspend function " + prototype->getId() + " cannot be inline");
+    }
+    if (function_signatures.count(prototype->getId()) != 0) {
+        yyerror("Cannot redefine function: " + prototype->getId());
+    }
+    FunctionSignature signature{{}, prototype->getReturnType(), false, nullptr, function};
+    for (const Param* param : prototype->getParams()) {
+        signature.param_types.push_back(param->getType());
+    }
+    function_signatures[prototype->getId()] = signature;
+}
+
+bool retained_for_inlining(const Statement* statement) {
+    auto* function = dynamic_cast<const FunctionAST*>(statement);
+    return function != nullptr && function->getPrototype()->isInline();
+}
+
+llvm::Value* inline_call(const std::string& name, const FunctionSignature& signature, const std::vector<ExprAST*>& args) {
+    FunctionAST* callee = signature.inline_function;
+    if (std::find(inline_stack.begin(), inline_stack.end(), callee) != inline_stack.end()) {
+        yyerror("Inline function " + name + " cannot call itself");
+    }
+    if (args.size() != signature.param_types.size()) {
+        yyerror("Wrong number of arguments: " + name);
+    }
+
+    // Arguments are evaluated in order before the body runs, like those of any other call
+    std::vector<llvm::Value*> values(args.size(), nullptr);
+    std::vector<InlinedFunction> functions(args.size());
+    for (unsigned i = 0; i < args.size(); i++) {
+        Type param_type = signature.param_types[i];
+        if (is_function_type(param_type)) {
+            functions[i] = bind_function(args[i], param_type);
+        } else {
+            values[i] = convert_value(args[i]->codegen(), args[i]->type(), param_type);
+        }
+    }
+
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    Scope saved_scope = current_scope();
+    named_values.clear();
+    named_types.clear();
+    inline_functions.clear();
+    const std::vector<Param*>& params = callee->getPrototype()->getParams();
+    for (unsigned i = 0; i < params.size(); i++) {
+        const std::string& id = params[i]->getId();
+        Type param_type = signature.param_types[i];
+        named_types[id] = param_type;
+        if (is_function_type(param_type)) {
+            inline_functions[id] = &functions[i];
+            continue;
+        }
+        llvm::Type* llvm_type = type_to_llvm_type(param_type);
+        llvm::AllocaInst* alloca = is_reference(param_type) ? create_gc_root(function, id, llvm_type)
+                                                            : create_entry_block_alloca(function, id, llvm_type);
+        builder.CreateStore(values[i], alloca);
+        named_values[id] = alloca;
+    }
+
+    Type return_type = signature.return_type;
+    InlineFrame frame{return_type, nullptr, llvm::BasicBlock::Create(context, name + ".exit"), handler_depth()};
+    if (return_type != UNIT) {
+        llvm::Type* llvm_type = type_to_llvm_type(return_type);
+        frame.result = is_reference(return_type) ? create_gc_root(function, name + ".result", llvm_type)
+                                                 : create_entry_block_alloca(function, name + ".result", llvm_type);
+    }
+    current_inline_frame = &frame;
+    inline_stack.push_back(callee);
+    for (Statement* statement : callee->getBody()) {
+        codegen_statement(statement);
+    }
+    builder.CreateBr(frame.exit_block);
+    function->getBasicBlockList().push_back(frame.exit_block);
+    builder.SetInsertPoint(frame.exit_block);
+    inline_stack.pop_back();
+    set_scope(saved_scope);
+
+    if (frame.result == nullptr) {
+        return nullptr;
+    }
+    return builder.CreateLoad(frame.result->getAllocatedType(), frame.result, name);
+}
+
+bool codegen_inline_return(ExprAST* value) {
+    InlineFrame* frame = current_inline_frame;
+    if (frame == nullptr) {
+        if (closure_body_depth > 0) {
+            yyerror("Cannot return from a lambda that is not inlined");
+        }
+        return false;
+    }
+    if (value == nullptr && frame->return_type != UNIT) {
+        yyerror("Missing return value");
+    }
+    if (value != nullptr) {
+        if (frame->return_type == UNIT) {
+            yyerror("A function returning Unit cannot return a value");
+        }
+        expect_function(value, frame->return_type);
+        builder.CreateStore(convert_value(value->codegen(), value->type(), frame->return_type), frame->result);
+    }
+    codegen_finally_blocks();
+    builder.CreateBr(frame->exit_block);
+    // Statements after the return are unreachable
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "afterreturn", builder.GetInsertBlock()->getParent()));
+    return true;
+}
+
+bool is_repeat_call(const std::string& name) {
+    return name == "repeat";
+}
+
+llvm::Value* repeat_codegen(const std::vector<ExprAST*>& args) {
+    if (args.size() != 2) {
+        yyerror("Wrong number of arguments: repeat");
+    }
+    llvm::Value* times = convert_value(args[0]->codegen(), args[0]->type(), INT);
+    InlinedFunction action = bind_function(args[1], function_type({INT}, UNIT));
+
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    llvm::AllocaInst* index = create_entry_block_alloca(function, "index", builder.getInt32Ty());
+    builder.CreateStore(builder.getInt32(0), index);
+    llvm::BasicBlock* cond_block = llvm::BasicBlock::Create(context, "repeat.cond", function);
+    llvm::BasicBlock* loop_block = llvm::BasicBlock::Create(context, "repeat.loop", function);
+    llvm::BasicBlock* after_loop_block = llvm::BasicBlock::Create(context, "repeat.end", function);
+    builder.CreateBr(cond_block);
+
+    builder.SetInsertPoint(cond_block);
+    llvm::Value* current = builder.CreateLoad(builder.getInt32Ty(), index, "index");
+    builder.CreateCondBr(builder.CreateICmpSLT(current, times, "slt"), loop_block, after_loop_block);
+
+    builder.SetInsertPoint(loop_block);
+    invoke_function(action, {current});
+    builder.CreateStore(builder.CreateAdd(current, builder.getInt32(1), "nextvar"), index);
+    builder.CreateBr(cond_block);
+
+    builder.SetInsertPoint(after_loop_block);
+    return nullptr;
+}
+
+// Lambdas
+
+LambdaExprAST::~LambdaExprAST() {
+    for (Statement* statement : *_body) {
+        delete statement;
+    }
+    delete _body;
+}
+
+void LambdaExprAST::expect(Type function_type) {
+    std::vector<Type> param_types = function_param_types(function_type);
+    if (_params.empty() ? param_types.size() > 1 : _params.size() != param_types.size()) {
+        yyerror("Expected a lambda with " + std::to_string(param_types.size()) + " parameters for " +
+                type_name(function_type));
+    }
+    for (unsigned i = 0; i < _params.size(); i++) {
+        if (_params[i].typed && _params[i].type != param_types[i]) {
+            yyerror("Lambda parameter " + _params[i].id + " has type " + type_name(_params[i].type) + ", expected " +
+                    type_name(param_types[i]));
+        }
+    }
+    _expected = function_type;
+    _has_expected = true;
+}
+
+Type LambdaExprAST::type() {
+    if (_has_expected) {
+        return _expected;
+    }
+    std::vector<Type> param_types;
+    for (const LambdaParam& param : _params) {
+        if (!param.typed) {
+            yyerror("Cannot infer the type of lambda parameter " + param.id);
+        }
+        param_types.push_back(param.type);
+    }
+    Type result_type = UNIT;
+    if (block_result(*_body) != nullptr) {
+        std::map<std::string, Type> saved_types = named_types;
+        for (const LambdaParam& param : _params) {
+            named_types[param.id] = param.type;
+        }
+        result_type = block_result_type(*_body);
+        named_types = saved_types;
+    }
+    return function_type(param_types, result_type);
+}
+
+std::vector<std::string> LambdaExprAST::param_names() {
+    std::vector<std::string> names;
+    for (const LambdaParam& param : _params) {
+        names.push_back(param.id);
+    }
+    if (names.empty() && function_param_types(type()).size() == 1) {
+        names.emplace_back("it");
+    }
+    return names;
+}
+
+void LambdaExprAST::bind_params(const std::vector<llvm::Value*>& values) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    std::vector<std::string> names = param_names();
+    std::vector<Type> param_types = function_param_types(type());
+    for (unsigned i = 0; i < names.size(); i++) {
+        llvm::Type* llvm_type = type_to_llvm_type(param_types[i]);
+        llvm::AllocaInst* alloca = is_reference(param_types[i]) ? create_gc_root(function, names[i], llvm_type)
+                                                                : create_entry_block_alloca(function, names[i], llvm_type);
+        builder.CreateStore(values[i], alloca);
+        declare_debug_variable(alloca, names[i], param_types[i]);
+        named_values[names[i]] = alloca;
+        named_types[names[i]] = param_types[i];
+    }
+}
+
+llvm::Value* LambdaExprAST::codegen_body() {
+    Type result_type = function_result_type(type());
+    ExprAST* result = result_type == UNIT ? nullptr : block_result(*_body);
+    if (result_type != UNIT && result == nullptr) {
+        yyerror("The lambda must end with a value of type " + type_name(result_type));
+    }
+    llvm::Value* value = nullptr;
+    for (Statement* statement : *_body) {
+        auto* expression = dynamic_cast<ExpressionStatement*>(statement);
+        if (expression == nullptr || expression->getExpr() != result) {
+            codegen_statement(statement);
+            continue;
+        }
+        llvm::DebugLoc saved_location = builder.getCurrentDebugLocation();
+        set_debug_location(statement->getLocation());
+        expect_function(result, result_type);
+        value = convert_value(result->codegen(), result->type(), result_type);
+        builder.SetCurrentDebugLocation(saved_location);
+    }
+    return value;
+}
+
+llvm::Value* LambdaExprAST::codegen_inline(const std::vector<llvm::Value*>& args) {
+    bind_params(args);
+    return codegen_body();
+}
+
+// A variable a closure copied, and the load that copied it
+struct Capture {
+    llvm::LoadInst* copy;
+    llvm::AllocaInst* variable;
+    std::string name;
+};
+
+static std::vector<Capture> captures;
+static std::set<const llvm::StoreInst*> assignments;
+
+void record_assignment(llvm::StoreInst* store) {
+    assignments.insert(store);
+}
+
+static bool is_assignment_of(const llvm::User* user, const llvm::AllocaInst* variable) {
+    auto* store = llvm::dyn_cast<llvm::StoreInst>(user);
+    return store != nullptr && store->getPointerOperand() == variable && assignments.count(store) != 0;
+}
+
+// Declarations, for loops and lambda parameters store new variables, which closures created before do not share
+void check_captured_assignments() {
+    for (const Capture& capture : captures) {
+        for (const llvm::User* user : capture.variable->users()) {
+            if (is_assignment_of(user, capture.variable) &&
+                llvm::isPotentiallyReachable(capture.copy, llvm::cast<llvm::Instruction>(user))) {
+                yyerror("Variable " + capture.name + " is captured by a lambda and cannot be assigned after it");
+            }
+        }
+    }
+    captures.clear();
+    assignments.clear();
+}
+
+// The body is outlined into `result (i8* closure, params...)`. Every variable in scope gets a copy in the body,
+// loaded from the closure on entry; the copies the body does not use are removed again and the others become the
+// fields of the closure. So a lambda captures exactly the variables it uses, by value like a parallelFor body.
+llvm::Value* LambdaExprAST::codegen() {
+    Type function_type = type();
+    const ClassInfo& info = class_info(function_type);
+    llvm::FunctionType* body_type = closure_function_type(function_type);
+    llvm::Function* parent = builder.GetInsertBlock()->getParent();
+    llvm::Function* body = llvm::Function::Create(body_type, llvm::Function::InternalLinkage,
+                                                  parent->getName() + ".lambda", module);
+    set_function_attributes(body);
+    body->addParamAttr(0, llvm::Attribute::NoCapture);
+
+    llvm::BasicBlock* saved_block = builder.GetInsertBlock();
+    llvm::DebugLoc saved_location = builder.getCurrentDebugLocation();
+    Scope saved_scope = current_scope();
+    CoroutineState* saved_coroutine = current_coroutine;
+    current_coroutine = nullptr;
+    inline_functions.clear();
+    current_inline_frame = nullptr;
+    closure_body_depth++;
+
+    llvm::BasicBlock* entry_block = llvm::BasicBlock::Create(context, "entry", body);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "body", body));
+    begin_outlined_function_debug_info(body);
+
+    std::vector<std::pair<std::string, llvm::AllocaInst*>> copies;
+    for (auto& variable : saved_scope.values) {
+        if (variable.second == nullptr) {
+            continue;
+        }
+        llvm::AllocaInst* copy = create_entry_block_alloca(body, variable.first, variable.second->getAllocatedType());
+        copies.emplace_back(variable.first, copy);
+        named_values[variable.first] = copy;
+    }
+    auto arg = body->arg_begin() + 1;
+    std::vector<llvm::Value*> args;
+    for (; arg != body->arg_end(); ++arg) {
+        args.push_back(&*arg);
+    }
+    bind_params(args);
+    llvm::Value* result = codegen_body();
+    for (auto& copy : copies) {
+        for (const llvm::User* user : copy.second->users()) {
+            if (is_assignment_of(user, copy.second)) {
+                yyerror("Variable " + copy.first + " is captured by the lambda and cannot be assigned in it");
+            }
+        }
+    }
+    if (result == nullptr) {
+        builder.CreateRetVoid();
+    } else {
+        builder.CreateRet(result);
+    }
+
+    std::vector<llvm::Type*> fields = {body_type->getPointerTo()};
+    std::vector<unsigned> reference_fields;
+    std::vector<std::string> captured_names;
+    std::vector<llvm::AllocaInst*> captured;
+    std::vector<llvm::AllocaInst*> captured_copies;
+    for (auto& copy : copies) {
+        if (copy.second->use_empty()) {
+            copy.second->eraseFromParent();
+            continue;
+        }
+        if (is_reference(saved_scope.types[copy.first])) {
+            register_gc_root(copy.second);
+            reference_fields.push_back(fields.size());
+        }
+        fields.push_back(copy.second->getAllocatedType());
+        captured_names.push_back(copy.first);
+        captured.push_back(saved_scope.values[copy.first]);
+        captured_copies.push_back(copy.second);
+    }
+    llvm::StructType* closure_type = llvm::StructType::create(context, fields, body->getName());
+
+    builder.SetInsertPoint(entry_block);
+    llvm::Value* closure = builder.CreateBitCast(body->getArg(0), closure_type->getPointerTo(), "closure");
+    for (unsigned i = 0; i < captured_copies.size(); i++) {
+        llvm::Type* type = captured_copies[i]->getAllocatedType();
+        builder.CreateStore(builder.CreateLoad(type, builder.CreateStructGEP(closure_type, closure, i + 1)),
+                            captured_copies[i]);
+    }
+    builder.CreateBr(entry_block->getNextNode());
+
+    closure_body_depth--;
+    current_coroutine = saved_coroutine;
+    set_scope(saved_scope);
+    builder.SetInsertPoint(saved_block);
+    builder.SetCurrentDebugLocation(saved_location);
+
+    llvm::GlobalVariable* type_info = create_type_info(body->getName().str(), closure_type, reference_fields);
+    if (captured.empty()) {
+        // Laid out like a heap object that the compiler placed on the stack (an object header with size 0). The
+        // collector does not touch those when they hold no references, so the function pointer is a constant
+        // that calls through it are folded to.
+        llvm::Type* i8_ptr = builder.getInt8PtrTy();
+        llvm::StructType* object_type = llvm::StructType::get(
+                context, {i8_ptr, builder.getInt32Ty(), builder.getInt32Ty(), closure_type});
+        auto* object = new llvm::GlobalVariable(
+                *module, object_type, true, llvm::GlobalValue::PrivateLinkage,
+                llvm::ConstantStruct::get(object_type, {llvm::ConstantExpr::getBitCast(type_info, i8_ptr),
+                                                        builder.getInt32(0), builder.getInt32(0),
+                                                        llvm::ConstantStruct::get(closure_type, {body})}),
+                body->getName() + ".closure");
+        llvm::Constant* zero = builder.getInt32(0);
+        return llvm::ConstantExpr::getBitCast(
+                llvm::ConstantExpr::getInBoundsGetElementPtr(object_type, object,
+                                                             llvm::ArrayRef<llvm::Constant*>{zero, builder.getInt32(3)}),
+                info.llvm_type);
+    }
+
+    llvm::FunctionCallee alloc = module->getOrInsertFunction("kt_alloc", builder.getInt8PtrTy(), type_info->getType());
+    llvm::Value* memory = builder.CreateCall(alloc, {type_info}, "closure_memory");
+    llvm::Value* object = root_temporary(builder.CreateBitCast(memory, closure_type->getPointerTo(), "closure"));
+    builder.CreateStore(body, builder.CreateStructGEP(closure_type, object, 0));
+    for (unsigned i = 0; i < captured.size(); i++) {
+        llvm::LoadInst* copy = builder.CreateLoad(captured[i]->getAllocatedType(), captured[i], captured[i]->getName());
+        builder.CreateStore(copy, builder.CreateStructGEP(closure_type, object, i + 1));
+        captures.push_back(Capture{copy, captured[i], captured_names[i]});
+    }
+    return builder.CreateBitCast(object, info.llvm_type);
+}
@@ -0,0 +1,100 @@
+#ifndef KOTLIN_LLVM_LAMBDAS_HPP
+#define KOTLIN_LLVM_LAMBDAS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Instructions.h"
+
+#include "ast.hpp"
+#include "statement.hpp"
+
+// Function types, lambdas and `inline fun`.
+//
+// A value of a function type is a closure: a heap object whose first field is the function and whose other fields
+// are copies of the variables the lambda uses, which the function gets as its first argument. Kotlin shares those
+// variables instead, so a captured variable must not be assigned where the closure could see the change. The call does not
+// keep that argument (it is nocapture), so a closure that is only called and passed to functions that call it
+// does not escape and escape_analysis.hpp moves it to the stack; a lambda without captures is a static object.
+//
+// An inline function has no LLVM function, its body is generated at every call. A lambda passed to it is not
+// turned into a closure at all: each call of the parameter generates the lambda's body in place, in the scope the
+// lambda was written in, so it uses and assigns the caller's variables directly and its `return` leaves the
+// function it was written in. repeat and forEach treat their lambda the same way.
+
+struct InlinedFunction;
+
+// Where a return statement goes while the body of an inline function is generated
+struct InlineFrame {
+    Type return_type;
+    // Holds the result, nullptr for Unit
+    llvm::AllocaInst* result;
+    llvm::BasicBlock* exit_block;
+    // handler_depth() where the expansion starts, a return leaves the try blocks above it, see exceptions.hpp
+    size_t handler_depth;
+};
+
+// Everything a name refers to at a point of the code being generated
+struct Scope {
+    std::map<std::string, llvm::AllocaInst*> values;
+    std::map<std::string, Type> types;
+    std::map<std::string, InlinedFunction*> functions;
+    InlineFrame* frame;
+    // Number of inline functions being expanded, which must not call themselves
+    size_t inline_depth;
+};
+
+// A function argument of an inline function, repeat or forEach: a lambda with the scope it was written in, or any
+// other function value, evaluated once into its closure
+struct InlinedFunction {
+    Type type;
+    LambdaExprAST* lambda;
+    Scope scope;
+    llvm::Value* closure;
+};
+
+// Parameters of the inline functions being expanded that are bound to the functions passed for them
+extern std::map<std::string, InlinedFunction*> inline_functions;
+// The innermost inline function being expanded, nullptr outside of them
+extern InlineFrame* current_inline_frame;
+
+// The type `(params) -> result`, registered the first time it is used
+Type function_type(const std::vector<Type>& param_types, Type result_type);
+bool is_function_type(Type type);
+
+// Gives a lambda the function type it is used as, which types its parameters. Does nothing for other expressions.
+void expect_function(ExprAST* expression, Type type);
+
+// Whether the name is a parameter or variable of a function type, which shadows functions with that name
+bool is_function_value(const std::string& name);
+Type function_value_type(const std::string& name);
+llvm::Value* call_function_value(const std::string& name, const std::vector<ExprAST*>& args);
+
+// Binds a function argument in the current scope, a value that is not a lambda is generated right away
+InlinedFunction bind_function(ExprAST* function, Type type);
+// Calls the function with arguments of its parameter types, the result is nullptr for Unit
+llvm::Value* invoke_function(const InlinedFunction& function, const std::vector<llvm::Value*>& args);
+// The closure of the function, for a parameter of an inline function that is used as a value
+llvm::Value* function_value(const InlinedFunction& function);
+
+void declare_inline_function(FunctionAST* function);
+// Inline functions are expanded by calls generated after their own statement, the parser must not free them
+bool retained_for_inlining(const Statement* statement);
+llvm::Value* inline_call(const std::string& name, const FunctionSignature& signature, const std::vector<ExprAST*>& args);
+
+// A return statement in the body of an inline function or of a lambda, which leaves the inline function or the
+// function the lambda was inlined into. False when the statement is in neither, a lambda that is not inlined
+// cannot return.
+bool codegen_inline_return(ExprAST* value);
+
+// Records a store that assigns a variable after its declaration
+void record_assignment(llvm::StoreInst* store);
+// Reports an assignment of a variable that a closure created in the function just generated (or in its lambdas)
+// captured, when the assignment can run after the closure was created
+void check_captured_assignments();
+
+bool is_repeat_call(const std::string& name);
+llvm::Value* repeat_codegen(const std::vector<ExprAST*>& args);
+
+#endif //KOTLIN_LLVM_LAMBDAS_HPP
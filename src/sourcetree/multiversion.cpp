@@ -0,0 +1,88 @@
+#include "multiversion.hpp"
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/GlobalIFunc.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "exceptions.hpp"
+
+#include "driver/options.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::Module* module;
+
+// The levels kt_cpu_level returns, from the highest
+static const char* const levels[] = {"x86-64-v4", "x86-64-v3", "x86-64-v2"};
+static const unsigned level_numbers[] = {4, 3, 2};
+
+struct Multiversioned {
+    llvm::Function* function;
+    // One per entry of levels
+    std::vector<llvm::Function*> clones;
+};
+
+static std::vector<Multiversioned> multiversioned;
+
+void multiversion_function(llvm::Function* function) {
+    llvm::Triple triple(module->getTargetTriple());
+    if (options.run || triple.getArch() != llvm::Triple::x86_64 || !triple.isOSBinFormatELF()) {
+        return;
+    }
+    Multiversioned entry{function, {}};
+    for (const char* level : levels) {
+        llvm::ValueToValueMapTy value_map;
+        llvm::Function* clone = llvm::CloneFunction(function, value_map);
+        clone_unwind_destinations(value_map);
+        // Recursive calls stay in the clone
+        for (llvm::BasicBlock& block : *clone) {
+            for (llvm::Instruction& instruction : block) {
+                instruction.replaceUsesOfWith(function, clone);
+            }
+        }
+        clone->setName(function->getName() + "." + level);
+        clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+        clone->addFnAttr("target-cpu", level);
+        entry.clones.push_back(clone);
+    }
+    multiversioned.push_back(entry);
+}
+
+void finish_multiversioning() {
+    llvm::FunctionType* level_type = llvm::FunctionType::get(llvm::Type::getInt32Ty(context), false);
+    for (const Multiversioned& entry : multiversioned) {
+        llvm::Function* function = entry.function;
+        std::string name = function->getName().str();
+        function->setName(name + ".default");
+        function->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+        llvm::PointerType* function_pointer = function->getType();
+        llvm::Function* resolver = llvm::Function::Create(llvm::FunctionType::get(function_pointer, false),
+                                                          llvm::Function::InternalLinkage, name + ".resolver",
+                                                          module);
+        llvm::GlobalIFunc* ifunc = llvm::GlobalIFunc::create(function->getFunctionType(), 0,
+                                                             llvm::GlobalValue::ExternalLinkage, name, resolver,
+                                                             module);
+        // Except its own recursive calls, like in the clones
+        function->replaceUsesWithIf(ifunc, [function](llvm::Use& use) {
+            auto* instruction = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+            return instruction == nullptr || instruction->getFunction() != function;
+        });
+
+        // Runs before the program's own code, only the best clone the CPU supports is picked here
+        llvm::IRBuilder<> resolver_builder(llvm::BasicBlock::Create(context, "entry", resolver));
+        llvm::Value* level = resolver_builder.CreateCall(module->getOrInsertFunction("kt_cpu_level", level_type),
+                                                         {}, "level");
+        llvm::Value* selected = function;
+        for (size_t i = entry.clones.size(); i-- > 0;) {
+            llvm::Value* supported = resolver_builder.CreateICmpUGE(level, resolver_builder.getInt32(level_numbers[i]));
+            selected = resolver_builder.CreateSelect(supported, entry.clones[i], selected);
+        }
+        resolver_builder.CreateRet(selected);
+    }
+    multiversioned.clear();
+}
@@ -0,0 +1,20 @@
+#ifndef KOTLIN_LLVM_MULTIVERSION_HPP
+#define KOTLIN_LLVM_MULTIVERSION_HPP
+
+#include "llvm/IR/Function.h"
+
+// `@Multiversion fun`: the function is generated once and cloned for each x86-64 microarchitecture level (x86-64-v2,
+// x86-64-v3 with AVX2 and FMA, x86-64-v4 with AVX-512), and every clone is optimized and compiled for its level. The
+// symbol of the function is an ifunc: when the program is loaded, its resolver asks the runtime for the level of the
+// CPU (kt_cpu_level) and calls go straight to the best clone. The original function, compiled for -mcpu, is used
+// below x86-64-v2.
+//
+// With --run, and for targets other than x86-64 ELF, the function is only generated for the CPU it is compiled for.
+
+// Creates the clones of the function once its body is generated
+void multiversion_function(llvm::Function* function);
+
+// Turns every multiversioned function into an ifunc, once all calls to them are generated
+void finish_multiversioning();
+
+#endif //KOTLIN_LLVM_MULTIVERSION_HPP
@@ -0,0 +1,277 @@
+#include "parallel.hpp"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "allocation.hpp"
+#include "classes.hpp"
+#include "conversion.hpp"
+#include "coroutine.hpp"
+#include "debug_info.hpp"
+#include "lambdas.hpp"
+#include "statement.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+extern std::map<std::string, llvm::AllocaInst*> named_values;
+extern std::map<std::string, Type> named_types;
+
+extern void yyerror(std::string msg);
+
+int parallel_body_depth = 0;
+
+// Outlined loop bodies, their callees are only known once the whole module is generated
+static std::vector<llvm::Function*> parallel_bodies;
+
+// Upper bound on the chunks a range is split into. It does not depend on the core count, so parallelSum adds the
+// same partial sums in the same order on every machine.
+static const unsigned max_chunks = 256;
+
+bool is_parallel_loop(const std::string& name) {
+    return name == "parallelFor" || name == "parallelSum";
+}
+
+// A function reachable through direct calls that links a frame into the shadow stack or allocates. Functions of
+// other modules are not visible, the runtime refuses their allocations instead.
+static const llvm::Function* find_heap_user(const llvm::Function* function, std::set<const llvm::Function*>& visited) {
+    if (function->hasGC()) {
+        return function;
+    }
+    for (const llvm::BasicBlock& block : *function) {
+        for (const llvm::Instruction& instruction : block) {
+            auto* call = llvm::dyn_cast<llvm::CallBase>(&instruction);
+            const llvm::Function* callee = call != nullptr ? call->getCalledFunction() : nullptr;
+            if (callee == nullptr || !visited.insert(callee).second) {
+                continue;
+            }
+            if (callee->getName() == "kt_alloc" || callee->getName() == "kt_alloc_array") {
+                return function;
+            }
+            if (const llvm::Function* found = find_heap_user(callee, visited)) {
+                return found;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void finish_parallel_loops() {
+    for (llvm::Function* body : parallel_bodies) {
+        std::set<const llvm::Function*> visited;
+        if (const llvm::Function* found = find_heap_user(body, visited)) {
+            yyerror("Heap objects cannot be used in parallel loops, " + body->getName().str() + " calls " +
+                    found->getName().str() + ", which uses them");
+        }
+    }
+    parallel_bodies.clear();
+}
+
+ParallelLoopExprAST::~ParallelLoopExprAST() {
+    delete _range->start;
+    delete _range->end;
+    delete _range;
+    for (Statement* statement : *_block) {
+        delete statement;
+    }
+    delete _block;
+}
+
+ExprAST* ParallelLoopExprAST::summand() {
+    ExprAST* result = block_result(*_block);
+    if (result == nullptr) {
+        yyerror("The block of parallelSum must end with the expression to add up");
+    }
+    return result;
+}
+
+// The summand can use the loop variable and the variables declared in the block
+Type ParallelLoopExprAST::type() {
+    if (_name == "parallelFor") {
+        // There is no Unit, parallelFor evaluates to 0
+        return INT;
+    }
+    summand();
+    std::map<std::string, Type> saved_types = named_types;
+    named_types[_range->id] = INT;
+    Type summand_type = block_result_type(*_block);
+    named_types = saved_types;
+    return arithmetic_type(summand_type, summand_type);
+}
+
+// The block is outlined into `void body(i8* context, i64 start, i64 end, i32 chunk)`, which runs one chunk of the
+// range and is handed to kt_parallel_for in the runtime. Variables of the enclosing function are captured by value
+// through the context, assigning them in the body only changes the copy of that chunk. A parallelSum body stores
+// its partial sum in the context's array under the chunk index, the caller adds them up in order.
+llvm::Value* ParallelLoopExprAST::codegen() {
+    bool sum = _name == "parallelSum";
+    Type sum_type = type();
+    llvm::Type* sum_llvm_type = type_to_llvm_type(sum_type);
+    llvm::Type* int64_type = builder.getInt64Ty();
+    llvm::Type* int32_type = builder.getInt32Ty();
+    llvm::PointerType* i8_ptr = builder.getInt8PtrTy();
+    llvm::Function* parent = builder.GetInsertBlock()->getParent();
+
+    llvm::Value* start = builder.CreateSExt(convert_value(_range->start->codegen(), _range->start->type(), INT), int64_type, "start");
+    llvm::Value* end = builder.CreateSExt(convert_value(_range->end->codegen(), _range->end->type(), INT), int64_type, "end");
+    if (_range->inclusive) {
+        end = builder.CreateAdd(end, builder.getInt64(1), "end");
+    }
+
+    std::vector<std::pair<std::string, llvm::AllocaInst*>> captures;
+    std::vector<llvm::Type*> context_fields;
+    for (auto& variable : named_values) {
+        if (variable.second != nullptr && !is_reference(named_types[variable.first])) {
+            captures.emplace_back(variable.first, variable.second);
+            context_fields.push_back(variable.second->getAllocatedType());
+        }
+    }
+    llvm::ArrayType* partials_type = llvm::ArrayType::get(sum_llvm_type, max_chunks);
+    if (sum) {
+        context_fields.push_back(partials_type->getPointerTo());
+    }
+    llvm::StructType* context_type = llvm::StructType::get(context, context_fields);
+
+    llvm::AllocaInst* loop_context = create_entry_block_alloca(parent, "parallel.context", context_type);
+    llvm::AllocaInst* partials = sum ? create_entry_block_alloca(parent, "partials", partials_type) : nullptr;
+    for (unsigned i = 0; i < captures.size(); i++) {
+        llvm::AllocaInst* variable = captures[i].second;
+        builder.CreateStore(builder.CreateLoad(variable->getAllocatedType(), variable, captures[i].first),
+                            builder.CreateStructGEP(context_type, loop_context, i));
+    }
+    if (sum) {
+        builder.CreateStore(partials, builder.CreateStructGEP(context_type, loop_context, captures.size()));
+    }
+
+    llvm::FunctionType* body_type = llvm::FunctionType::get(builder.getVoidTy(), {i8_ptr, int64_type, int64_type, int32_type}, false);
+    llvm::Function* body = llvm::Function::Create(body_type, llvm::Function::InternalLinkage,
+                                                  parent->getName() + "." + _name, module);
+    set_function_attributes(body);
+    parallel_bodies.push_back(body);
+
+    llvm::BasicBlock* saved_block = builder.GetInsertBlock();
+    llvm::DebugLoc saved_location = builder.getCurrentDebugLocation();
+    std::map<std::string, llvm::AllocaInst*> saved_values = named_values;
+    std::map<std::string, Type> saved_types = named_types;
+    CoroutineState* saved_coroutine = current_coroutine;
+    // Lambdas passed to an inline function use the variables of the function they were written in
+    std::map<std::string, InlinedFunction*> saved_functions = inline_functions;
+    InlineFrame* saved_frame = current_inline_frame;
+    current_coroutine = nullptr;
+    inline_functions.clear();
+    current_inline_frame = nullptr;
+    parallel_body_depth++;
+
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", body));
+    begin_outlined_function_debug_info(body);
+    auto argument = body->arg_begin();
+    llvm::Value* body_context = builder.CreateBitCast(&*argument++, context_type->getPointerTo(), "context");
+    llvm::Value* chunk_start = &*argument++;
+    llvm::Value* chunk_end = &*argument++;
+    llvm::Value* chunk = &*argument;
+    for (unsigned i = 0; i < captures.size(); i++) {
+        llvm::Type* type = captures[i].second->getAllocatedType();
+        llvm::AllocaInst* copy = create_entry_block_alloca(body, captures[i].first, type);
+        builder.CreateStore(builder.CreateLoad(type, builder.CreateStructGEP(context_type, body_context, i)), copy);
+        named_values[captures[i].first] = copy;
+    }
+    llvm::AllocaInst* loop_variable = create_entry_block_alloca(body, _range->id, int32_type);
+    named_values[_range->id] = loop_variable;
+    named_types[_range->id] = INT;
+    llvm::AllocaInst* accumulator = nullptr;
+    if (sum) {
+        accumulator = create_entry_block_alloca(body, "accumulator", sum_llvm_type);
+        builder.CreateStore(llvm::Constant::getNullValue(sum_llvm_type), accumulator);
+    }
+    llvm::AllocaInst* index = create_entry_block_alloca(body, "index", int64_type);
+    builder.CreateStore(chunk_start, index);
+
+    llvm::BasicBlock* cond_block = llvm::BasicBlock::Create(context, "cond", body);
+    llvm::BasicBlock* loop_block = llvm::BasicBlock::Create(context, "loop", body);
+    llvm::BasicBlock* after_loop_block = llvm::BasicBlock::Create(context, "afterloop", body);
+    builder.CreateBr(cond_block);
+
+    builder.SetInsertPoint(cond_block);
+    llvm::Value* current = builder.CreateLoad(int64_type, index, "index");
+    builder.CreateCondBr(builder.CreateICmpSLT(current, chunk_end, "slt"), loop_block, after_loop_block);
+
+    builder.SetInsertPoint(loop_block);
+    builder.CreateStore(builder.CreateTrunc(current, int32_type), loop_variable);
+    ExprAST* summand_expr = sum ? summand() : nullptr;
+    for (Statement* statement : *_block) {
+        auto* expression = dynamic_cast<ExpressionStatement*>(statement);
+        if (expression != nullptr && expression->getExpr() == summand_expr) {
+            llvm::Value* value = convert_value(summand_expr->codegen(), summand_expr->type(), sum_type);
+            llvm::Value* total = builder.CreateLoad(sum_llvm_type, accumulator, "accumulator");
+            builder.CreateStore(is_floating_point(sum_type) ? builder.CreateFAdd(total, value, "add")
+                                                            : builder.CreateAdd(total, value, "add"), accumulator);
+        } else {
+            codegen_statement(statement);
+        }
+    }
+    builder.CreateStore(builder.CreateAdd(current, builder.getInt64(1), "nextvar"), index);
+    builder.CreateBr(cond_block);
+
+    builder.SetInsertPoint(after_loop_block);
+    if (sum) {
+        llvm::Value* body_partials = builder.CreateLoad(partials_type->getPointerTo(),
+                                                        builder.CreateStructGEP(context_type, body_context, captures.size()));
+        builder.CreateStore(builder.CreateLoad(sum_llvm_type, accumulator, "sum"),
+                            builder.CreateInBoundsGEP(partials_type, body_partials, {builder.getInt64(0), chunk}));
+    }
+    builder.CreateRetVoid();
+
+    parallel_body_depth--;
+    current_coroutine = saved_coroutine;
+    inline_functions = saved_functions;
+    current_inline_frame = saved_frame;
+    named_values = saved_values;
+    named_types = saved_types;
+    builder.SetInsertPoint(saved_block);
+    builder.SetCurrentDebugLocation(saved_location);
+
+    // Empty ranges have no chunks
+    llvm::Value* count = builder.CreateSub(end, start, "count");
+    llvm::Value* chunks = builder.CreateSelect(builder.CreateICmpSLT(count, builder.getInt64(max_chunks)), count,
+                                               builder.getInt64(max_chunks));
+    chunks = builder.CreateTrunc(builder.CreateSelect(builder.CreateICmpSGT(chunks, builder.getInt64(0)), chunks,
+                                                      builder.getInt64(0)), int32_type, "chunks");
+    llvm::FunctionCallee parallel_for = module->getOrInsertFunction("kt_parallel_for", llvm::FunctionType::get(
+            builder.getVoidTy(), {int64_type, int64_type, int32_type, body_type->getPointerTo(), i8_ptr}, false));
+    builder.CreateCall(parallel_for, {start, end, chunks, body, builder.CreateBitCast(loop_context, i8_ptr)});
+    if (!sum) {
+        return builder.getInt32(0);
+    }
+
+    llvm::BasicBlock* combine_block = llvm::BasicBlock::Create(context, "combine", parent);
+    llvm::BasicBlock* combine_body_block = llvm::BasicBlock::Create(context, "combine.body", parent);
+    llvm::BasicBlock* combined_block = llvm::BasicBlock::Create(context, "combined", parent);
+    llvm::BasicBlock* entry_block = builder.GetInsertBlock();
+    builder.CreateBr(combine_block);
+
+    builder.SetInsertPoint(combine_block);
+    llvm::PHINode* chunk_index = builder.CreatePHI(int32_type, 2, "chunk");
+    llvm::PHINode* total = builder.CreatePHI(sum_llvm_type, 2, "total");
+    chunk_index->addIncoming(builder.getInt32(0), entry_block);
+    total->addIncoming(llvm::Constant::getNullValue(sum_llvm_type), entry_block);
+    builder.CreateCondBr(builder.CreateICmpSLT(chunk_index, chunks), combine_body_block, combined_block);
+
+    builder.SetInsertPoint(combine_body_block);
+    llvm::Value* partial = builder.CreateLoad(sum_llvm_type, builder.CreateInBoundsGEP(
+            partials_type, partials, {builder.getInt64(0), chunk_index}), "partial");
+    llvm::Value* next_total = is_floating_point(sum_type) ? builder.CreateFAdd(total, partial, "add")
+                                                          : builder.CreateAdd(total, partial, "add");
+    chunk_index->addIncoming(builder.CreateAdd(chunk_index, builder.getInt32(1)), combine_body_block);
+    total->addIncoming(next_total, combine_body_block);
+    builder.CreateBr(combine_block);
+
+    builder.SetInsertPoint(combined_block);
+    return total;
+}
@@ -0,0 +1,15 @@
+#ifndef KOTLIN_LLVM_PARALLEL_HPP
+#define KOTLIN_LLVM_PARALLEL_HPP
+
+#include <string>
+
+// Nesting depth of the parallel loop bodies being generated, they run on other threads and cannot return or
+// use heap objects
+extern int parallel_body_depth;
+
+bool is_parallel_loop(const std::string& name);
+
+// Rejects parallel loops that call functions using heap objects, once all functions of the module are generated
+void finish_parallel_loops();
+
+#endif //KOTLIN_LLVM_PARALLEL_HPP
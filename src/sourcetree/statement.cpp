@@ -1,21 +1,111 @@
 #include "statement.hpp"
 
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Verifier.h"
 #include "allocation.hpp"
+#include "conversion.hpp"
+#include "classes.hpp"
+#include "coroutine.hpp"
+#include "debug_info.hpp"
+#include "interpreter.hpp"
+#include "lambdas.hpp"
+#include "multiversion.hpp"
+#include "driver/options.hpp"
 
 extern llvm::LLVMContext context;
 extern std::map<std::string, llvm::AllocaInst*> named_values;
+extern std::map<std::string, Type> named_types;
 extern llvm::IRBuilder<> builder;
 extern llvm::Module* module;
 llvm::Value* Str;
+std::map<std::string, FunctionSignature> function_signatures;
 extern llvm::Function *PrintFja;
 
 extern void yyerror(std::string msg);
 
+void set_function_attributes(llvm::Function* function) {
+    if (options.debug_info) {
+        // perf unwinds call graphs through frame pointers by default
+        function->addFnAttr("frame-pointer", "all");
+    }
+    if (options.fast_math) {
+        // Lets the backend and the vectorizer use the same freedoms the fast-math flags give the IR
+        function->addFnAttr("unsafe-fp-math", "true");
+        function->addFnAttr("no-infs-fp-math", "true");
+        function->addFnAttr("no-nans-fp-math", "true");
+        function->addFnAttr("no-signed-zeros-fp-math", "true");
+    }
+    if (!options.cpu.empty()) {
+        function->addFnAttr("target-cpu", options.cpu);
+    }
+    if (!options.features.empty()) {
+        function->addFnAttr("target-features", options.features);
+    }
+}
+
+ExprAST* block_result(const std::vector<Statement*>& block) {
+    for (auto statement = block.rbegin(); statement != block.rend(); ++statement) {
+        if (dynamic_cast<EmptyStatement*>(*statement) != nullptr) {
+            continue;
+        }
+        auto* expression = dynamic_cast<ExpressionStatement*>(*statement);
+        return expression != nullptr ? expression->getExpr() : nullptr;
+    }
+    return nullptr;
+}
+
+Type block_result_type(const std::vector<Statement*>& block) {
+    std::map<std::string, Type> saved_types = named_types;
+    for (Statement* statement : block) {
+        const VarDeclarationStatement* declaration = dynamic_cast<VarDeclarationStatement*>(statement);
+        if (auto* declare_and_assign = dynamic_cast<DeclareAndAssignStatement*>(statement)) {
+            declaration = declare_and_assign->getDeclaration();
+        }
+        if (declaration != nullptr) {
+            named_types[declaration->getId()] = declaration->getType();
+        }
+    }
+    Type result_type = block_result(block)->type();
+    named_types = saved_types;
+    return result_type;
+}
+
+void codegen_statement(Statement* statement) {
+    llvm::DebugLoc saved_location = builder.getCurrentDebugLocation();
+    set_debug_location(statement->getLocation());
+    statement->codegen();
+    builder.SetCurrentDebugLocation(saved_location);
+}
+
+// Functions can be called before their definition, and a prototype declared with `external fun` gets a body here
+void FunctionAST::declare() {
+    if (_prototype->isSuspend() && _prototype->getReturnType() == UNIT) {
+        yyerror("Suspend function " + _prototype->getId() + " must declare its result type");
+    }
+    if (_prototype->isMultiversion() && (_prototype->isInline() || _prototype->isSuspend())) {
+        yyerror("Inline and suspend functions cannot be multiversioned: " + _prototype->getId());
+    }
+    if (_prototype->isInline()) {
+        declare_inline_function(this);
+        return;
+    }
+    auto inline_function = function_signatures.find(_prototype->getId());
+    if (inline_function != function_signatures.end() && inline_function->second.inline_function != nullptr) {
+        yyerror("Cannot redefine function: " + _prototype->getId());
+    }
+    if (module->getFunction(_prototype->getId()) == nullptr) {
+        _prototype->codegen();
+    }
+    register_interpretable_function(this);
+}
+
 void FunctionAST::codegen() {
+    if (_prototype->isInline()) {
+        return;
+    }
     llvm::Function *function = module->getFunction(_prototype->getId());
 
     if (function == nullptr) {
@@ -30,44 +120,84 @@ void FunctionAST::codegen() {
     if (!function->empty()) {
         yyerror("Cannot redefine function: " + _prototype->getId());
     }
+    register_interpretable_function(this);
+
+    set_function_attributes(function);
 
     llvm::BasicBlock* basic_block = llvm::BasicBlock::Create(context, "entry", function);
     builder.SetInsertPoint(basic_block);
+    begin_function_debug_info(function, getLocation());
 
     named_values.clear();
+    named_types.clear();
+    const FunctionSignature& signature = function_signatures[_prototype->getId()];
+    if (signature.is_suspend) {
+        // Arguments are stored after coro.begin, so the ones used across suspend points move into the frame
+        begin_coroutine(function, signature.return_type);
+    }
     for (auto &arg : function->args()) {
-        llvm::AllocaInst* alloca = create_entry_block_alloca(function, arg.getName(), arg.getType());
+        Type arg_type = signature.param_types[arg.getArgNo()];
+        const std::string name = arg.getName().str();
+        llvm::AllocaInst* alloca = is_reference(arg_type) ? create_gc_root(function, name, arg.getType())
+                                                          : create_entry_block_alloca(function, name, arg.getType());
 
         builder.CreateStore(&arg, alloca);
+        declare_debug_variable(alloca, name, arg_type, arg.getArgNo() + 1);
 
-        named_values[arg.getName()] = alloca;
+        named_values[name] = alloca;
+        named_types[name] = arg_type;
     }
 
     for (Statement* statement : *_body) {
-        statement->codegen();
+        codegen_statement(statement);
+    }
+
+    if (signature.is_suspend) {
+        finish_coroutine();
+    } else {
+        // The block a final return statement leaves behind is unreachable, a function returning Unit may end
+        // without one
+        llvm::BasicBlock* last_block = builder.GetInsertBlock();
+        if (last_block->empty() && last_block != basic_block && llvm::pred_empty(last_block)) {
+            last_block->eraseFromParent();
+        } else if (signature.return_type == UNIT && last_block->getTerminator() == nullptr) {
+            builder.CreateRetVoid();
+        }
     }
+    builder.SetCurrentDebugLocation(llvm::DebugLoc());
 
+    check_captured_assignments();
     llvm::verifyFunction(*function);
+    if (_prototype->isMultiversion()) {
+        multiversion_function(function);
+    }
 }
 
 FunctionAST::~FunctionAST() {
     delete _prototype;
+    for (Statement* statement : *_body) {
+        delete statement;
+    }
     delete _body;
 }
 
 llvm::Function* FunctionPrototypeAST::codegen() {
     std::vector<llvm::Type *> param_types;
+    FunctionSignature signature{{}, _return_type, _suspend, nullptr, nullptr};
 
     for (Param *param : _params) {
         llvm::Type *type = type_to_llvm_type(param->getType());
         param_types.push_back(type);
+        signature.param_types.push_back(param->getType());
     }
 
-    llvm::Type *return_type = type_to_llvm_type(_return_type);
+    llvm::Type *return_type = _suspend ? llvm::Type::getInt8PtrTy(context) : type_to_llvm_type(_return_type);
 
     llvm::FunctionType *function_type = llvm::FunctionType::get(return_type, param_types, false);
 
     llvm::Function *function = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, _id, module);
+    signature.function = function;
+    function_signatures[_id] = signature;
 
     unsigned i = 0;
     for (auto &param : function->args()) {
@@ -76,7 +206,7 @@ llvm::Function* FunctionPrototypeAST::codegen() {
     return function;
 }
 
-void ExternalFunctionStatement::codegen() {
+void ExternalFunctionStatement::declare() {
     _prototype->codegen();
 }
 
@@ -85,90 +215,161 @@ ExternalFunctionStatement::~ExternalFunctionStatement() {
 }
 
 void AssignStatement::codegen() {
+    record_assignment(codegen_store());
+}
+
+void AssignStatement::codegen_initializer() {
+    codegen_store();
+}
+
+llvm::StoreInst* AssignStatement::codegen_store() {
     llvm::Value* lhs = named_values[_id];
     if (lhs == nullptr) {
         yyerror("Unknown variable: " + _id);
     }
-    llvm::Value* rhs = _expr->codegen();
+    expect_function(_expr, named_types[_id]);
+    llvm::Value* rhs = convert_value(_expr->codegen(), _expr->type(), named_types[_id]);
 
-    builder.CreateStore(rhs, lhs);
+    return builder.CreateStore(rhs, lhs);
 }
 
 void PlusAssignStatement::codegen() {
-    llvm::Value* lhs = named_values[_id];
+    llvm::AllocaInst* lhs = named_values[_id];
     if (lhs == nullptr) {
         yyerror("Unknown variable: " + _id);
     }
-    llvm::Value* rhs = _expr->codegen();
-
-    llvm::Value* lh = builder.CreateLoad(lhs, _id);
-    llvm::Value* res = builder.CreateAdd(lh, rhs, "add");
+    // Computed in the promoted type and narrowed back, so `b += 1` on a Byte wraps like in Kotlin
+    Type variable_type = named_types[_id];
+    Type operation_type = arithmetic_type(variable_type, _expr->type());
+    llvm::Value* rhs = convert_value(_expr->codegen(), _expr->type(), operation_type);
+
+    llvm::Value* lh = convert_value(builder.CreateLoad(lhs->getAllocatedType(), lhs, _id), variable_type, operation_type);
+    llvm::Value* res;
+    if (is_floating_point(operation_type))
+        res = builder.CreateFAdd(lh, rhs, "add");
+    else
+        res = builder.CreateAdd(lh, rhs, "add");
 
-    builder.CreateStore(res, lhs);
+    record_assignment(builder.CreateStore(convert_value(res, operation_type, variable_type), lhs));
 }
 
 void MinusAssignStatement::codegen() {
-    llvm::Value* lhs = named_values[_id];
+    llvm::AllocaInst* lhs = named_values[_id];
     if (lhs == nullptr) {
         yyerror("Unknown variable: " + _id);
     }
-    llvm::Value* rhs = _expr->codegen();
-
-    llvm::Value* lh = builder.CreateLoad(lhs, _id);
-    llvm::Value* res = builder.CreateSub(lh, rhs);
+    // Computed in the promoted type and narrowed back, so `b += 1` on a Byte wraps like in Kotlin
+    Type variable_type = named_types[_id];
+    Type operation_type = arithmetic_type(variable_type, _expr->type());
+    llvm::Value* rhs = convert_value(_expr->codegen(), _expr->type(), operation_type);
+
+    llvm::Value* lh = convert_value(builder.CreateLoad(lhs->getAllocatedType(), lhs, _id), variable_type, operation_type);
+    llvm::Value* res;
+    if (is_floating_point(operation_type))
+        res = builder.CreateFSub(lh, rhs, "sub");
+    else
+        res = builder.CreateSub(lh, rhs, "sub");
 
-    builder.CreateStore(res, lhs);
+    record_assignment(builder.CreateStore(convert_value(res, operation_type, variable_type), lhs));
 }
 
 void TimesAssignStatement::codegen() {
-    llvm::Value* lhs = named_values[_id];
+    llvm::AllocaInst* lhs = named_values[_id];
     if (lhs == nullptr) {
         yyerror("Unknown variable: " + _id);
     }
-    llvm::Value* rhs = _expr->codegen();
-
-    llvm::Value* lh = builder.CreateLoad(lhs, _id);
-    llvm::Value* res = builder.CreateMul(lh, rhs);
+    // Computed in the promoted type and narrowed back, so `b += 1` on a Byte wraps like in Kotlin
+    Type variable_type = named_types[_id];
+    Type operation_type = arithmetic_type(variable_type, _expr->type());
+    llvm::Value* rhs = convert_value(_expr->codegen(), _expr->type(), operation_type);
+
+    llvm::Value* lh = convert_value(builder.CreateLoad(lhs->getAllocatedType(), lhs, _id), variable_type, operation_type);
+    llvm::Value* res;
+    if (is_floating_point(operation_type))
+        res = builder.CreateFMul(lh, rhs, "mul");
+    else
+        res = builder.CreateMul(lh, rhs, "mul");
 
-    builder.CreateStore(res, lhs);
+    record_assignment(builder.CreateStore(convert_value(res, operation_type, variable_type), lhs));
 }
 
 void DivAssignStatement::codegen() {
-    llvm::Value* lhs = named_values[_id];
+    llvm::AllocaInst* lhs = named_values[_id];
     if (lhs == nullptr) {
         yyerror("Unknown variable: " + _id);
     }
-    llvm::Value* rhs = _expr->codegen();
-
-    llvm::Value* lh = builder.CreateLoad(lhs, _id);
-    llvm::Value* res = builder.CreateUDiv(lh, rhs);
+    // Computed in the promoted type and narrowed back, so `b += 1` on a Byte wraps like in Kotlin
+    Type variable_type = named_types[_id];
+    Type operation_type = arithmetic_type(variable_type, _expr->type());
+    llvm::Value* rhs = convert_value(_expr->codegen(), _expr->type(), operation_type);
+
+    llvm::Value* lh = convert_value(builder.CreateLoad(lhs->getAllocatedType(), lhs, _id), variable_type, operation_type);
+    llvm::Value* res;
+    if (is_floating_point(operation_type))
+        res = builder.CreateFDiv(lh, rhs, "div");
+    else
+        res = integer_division(lh, rhs, false, "div");
 
-    builder.CreateStore(res, lhs);
+    record_assignment(builder.CreateStore(convert_value(res, operation_type, variable_type), lhs));
 }
 
 void ModAssignStatement::codegen() {
-    llvm::Value* lhs = named_values[_id];
+    llvm::AllocaInst* lhs = named_values[_id];
     if (lhs == nullptr) {
         yyerror("Unknown variable: " + _id);
     }
-    llvm::Value* rhs = _expr->codegen();
+    // Computed in the promoted type and narrowed back, so `b += 1` on a Byte wraps like in Kotlin
+    Type variable_type = named_types[_id];
+    Type operation_type = arithmetic_type(variable_type, _expr->type());
+    llvm::Value* rhs = convert_value(_expr->codegen(), _expr->type(), operation_type);
+
+    llvm::Value* lh = convert_value(builder.CreateLoad(lhs->getAllocatedType(), lhs, _id), variable_type, operation_type);
+    llvm::Value* res;
+    if (is_floating_point(operation_type))
+        res = builder.CreateFRem(lh, rhs, "mod");
+    else
+        res = integer_division(lh, rhs, true, "mod");
 
-    llvm::Value* lh = builder.CreateLoad(lhs, _id);
-    llvm::Value* res = builder.CreateURem(lh, rhs);
+    record_assignment(builder.CreateStore(convert_value(res, operation_type, variable_type), lhs));
+}
+
+void FieldAssignStatement::codegen() {
+    Type object_type = _object->type();
+    if (!is_class(object_type)) {
+        yyerror(type_name(object_type) + " has no property " + _name);
+    }
+    const ClassInfo& info = class_info(object_type);
+    unsigned index = field_index(info, _name);
+    if (!info.fields[index].is_var) {
+        yyerror("Val cannot be reassigned: " + info.name + "." + _name);
+    }
 
-    builder.CreateStore(res, lhs);
+    llvm::Value* object = _object->codegen();
+    expect_function(_expr, info.fields[index].type);
+    llvm::Value* value = convert_value(_expr->codegen(), _expr->type(), info.fields[index].type);
+    builder.CreateStore(value, builder.CreateStructGEP(info.struct_type, object, index, _name + "_addr"));
 }
 
 void VarDeclarationStatement::codegen() {
+    if (_type == UNIT) {
+        yyerror("Variable " + _id + " cannot have type Unit");
+    }
     llvm::Type* llvm_type = type_to_llvm_type(_type);
-    llvm::AllocaInst* alloca = builder.CreateAlloca(llvm_type, nullptr, _id);
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+    llvm::AllocaInst* alloca = is_reference(_type) ? create_gc_root(function, _id, llvm_type)
+                                                   : create_entry_block_alloca(function, _id, llvm_type);
+    // A reference declared without a value holds no object, which can end a linked structure
+    if (is_reference(_type)) {
+        builder.CreateStore(llvm::Constant::getNullValue(llvm_type), alloca);
+    }
     named_values[_id] = alloca;
-
+    named_types[_id] = _type;
+    declare_debug_variable(alloca, _id, _type);
 }
 
 void DeclareAndAssignStatement::codegen() {
     _decl_statement->codegen();
-    _assign_statement->codegen();
+    _assign_statement->codegen_initializer();
 }
 
 void IfStatement::codegen() {
@@ -188,7 +389,7 @@ void IfStatement::codegen() {
     builder.SetInsertPoint(then_block);
 
     for(auto &i: *_then_stat)
-        i->codegen();
+        codegen_statement(i);
 
     builder.CreateBr(merge_block);
 
@@ -216,7 +417,7 @@ void IfElseStatement::codegen() {
     builder.SetInsertPoint(then_block);
 
     for(auto &i: *_then_stat)
-        i->codegen();
+        codegen_statement(i);
 
     builder.CreateBr(merge_block);
 
@@ -226,7 +427,7 @@ void IfElseStatement::codegen() {
     builder.SetInsertPoint(else_block);
 
     for(auto &i: *_else_stat)
-        i->codegen();
+        codegen_statement(i);
 
     builder.CreateBr(merge_block);
 
@@ -234,16 +435,77 @@ void IfElseStatement::codegen() {
     builder.SetInsertPoint(merge_block);
 }
 
+// Appends the printf conversion for a value of the given type, data and value classes print their
+// properties like Kotlin's generated toString()
+static void append_print_format(Type type, llvm::Value* value, std::string& format, std::vector<llvm::Value*>& args) {
+    switch (type) {
+        case INT:
+        case SHORT:
+        case BYTE:
+            format += "%d";
+            args.push_back(convert_value(value, type, INT));
+            break;
+        case LONG:
+            format += "%lld";
+            args.push_back(value);
+            break;
+        case CHAR:
+            format += "%c";
+            args.push_back(convert_value(value, type, INT));
+            break;
+        case BOOLEAN:
+            format += "%s";
+            args.push_back(builder.CreateSelect(value, builder.CreateGlobalStringPtr("true"),
+                                                builder.CreateGlobalStringPtr("false")));
+            break;
+        case FLOAT:
+        case DOUBLE:
+            // Varargs promote float to double
+            format += "%f";
+            args.push_back(convert_value(value, type, DOUBLE));
+            break;
+        case STRING:
+            format += "%s";
+            args.push_back(value);
+            break;
+        case UNIT:
+            format += "kotlin.Unit";
+            break;
+        default: {
+            const ClassInfo& info = class_info(type);
+            if (info.kind != DATA_CLASS && info.kind != VALUE_CLASS) {
+                yyerror("Cannot print " + info.name + ", only data and value classes have a toString()");
+            }
+            format += info.name + "(";
+            for (unsigned i = 0; i < info.fields.size(); ++i) {
+                llvm::Value* field;
+                if (info.kind == VALUE_CLASS)
+                    field = value;
+                else if (info.heap)
+                    field = builder.CreateLoad(type_to_llvm_type(info.fields[i].type),
+                                               builder.CreateStructGEP(info.struct_type, value, i));
+                else
+                    field = builder.CreateExtractValue(value, i);
+                format += (i > 0 ? ", " : "") + info.fields[i].name + "=";
+                append_print_format(info.fields[i].type, field, format, args);
+            }
+            format += ")";
+        }
+    }
+}
+
 void PrintStatement::codegen() {
+    Type type = _e->type();
     llvm::Value *l = _e->codegen();
-    if(l == nullptr)
+    if(l == nullptr && type != UNIT)
         return;
 
-    Str = builder.CreateGlobalStringPtr("%u\n");
-
+    std::string format;
     std::vector<llvm::Value*> ArgsV;
-    ArgsV.push_back(Str);
-    ArgsV.push_back(l);
+    ArgsV.push_back(nullptr);
+    append_print_format(type, l, format, ArgsV);
+    Str = builder.CreateGlobalStringPtr(format + "\n");
+    ArgsV[0] = Str;
     builder.CreateCall(PrintFja, ArgsV, "println");
 }
 
@@ -267,7 +529,7 @@ void WhileStatement::codegen() {
 
     builder.SetInsertPoint(loop1_block);
     for(auto &i: *_then_stat)
-        i->codegen();
+        codegen_statement(i);
 
     builder.CreateBr(loop_block);
     builder.SetInsertPoint(after_loop_block);
@@ -281,7 +543,9 @@ void ForStatement::codegen() {
 
     llvm::AllocaInst* alloca = create_entry_block_alloca(function, _id, llvm::Type::getInt32Ty(context));
     llvm::AllocaInst* old_value = named_values[_id];
+    Type old_type = named_types[_id];
     named_values[_id] = alloca;
+    named_types[_id] = INT;
 
     llvm::Value* start_value = llvm::ConstantInt::get(context, llvm::APInt(32, _start));
     if(start_value == nullptr)
@@ -294,7 +558,7 @@ void ForStatement::codegen() {
 
     llvm::Value* end_value = llvm::ConstantInt::get(context, llvm::APInt(32, _end));
 
-    llvm::Value* bool_tmp = builder.CreateLoad(alloca, _id);
+    llvm::Value* bool_tmp = builder.CreateLoad(alloca->getAllocatedType(), alloca, _id);
     llvm::Value* loop_cond_value = builder.CreateICmpSLE(bool_tmp, end_value, "sle");
 
     builder.CreateCondBr(loop_cond_value, loop_block, after_loop_block);
@@ -303,13 +567,14 @@ void ForStatement::codegen() {
     builder.SetInsertPoint(loop_block);
 
     for(auto &i: *_block)
-        i->codegen();
+        codegen_statement(i);
 
     llvm::Value* inc_value = _inc->codegen();
     if(inc_value == nullptr)
         return;
+    inc_value = convert_value(inc_value, _inc->type(), INT);
 
-    llvm::Value* tmp = builder.CreateLoad(alloca, _id);
+    llvm::Value* tmp = builder.CreateLoad(alloca->getAllocatedType(), alloca, _id);
     llvm::Value* next_var = builder.CreateAdd(tmp, inc_value, "nextvar");
     builder.CreateStore(next_var, alloca);
     builder.CreateBr(cond_block);
@@ -317,10 +582,13 @@ void ForStatement::codegen() {
     function->getBasicBlockList().push_back(after_loop_block);
     builder.SetInsertPoint(after_loop_block);
 
-    if(old_value != nullptr)
+    if(old_value != nullptr) {
         named_values[_id] = old_value;
-    else
+        named_types[_id] = old_type;
+    } else {
         named_values.erase(_id);
+        named_types.erase(_id);
+    }
 }
 
 void ForUStatement::codegen() {
@@ -331,7 +599,9 @@ void ForUStatement::codegen() {
 
     llvm::AllocaInst* alloca = create_entry_block_alloca(function, _id, llvm::Type::getInt32Ty(context));
     llvm::AllocaInst* old_value = named_values[_id];
+    Type old_type = named_types[_id];
     named_values[_id] = alloca;
+    named_types[_id] = INT;
 
     llvm::Value* start_value = llvm::ConstantInt::get(context, llvm::APInt(32, _start));
     if(start_value == nullptr)
@@ -344,7 +614,7 @@ void ForUStatement::codegen() {
 
     llvm::Value* end_value = llvm::ConstantInt::get(context, llvm::APInt(32, _end));
 
-    llvm::Value* bool_tmp = builder.CreateLoad(alloca, _id);
+    llvm::Value* bool_tmp = builder.CreateLoad(alloca->getAllocatedType(), alloca, _id);
     llvm::Value* loop_cond_value = builder.CreateICmpSLT(bool_tmp, end_value, "slt");
 
     builder.CreateCondBr(loop_cond_value, loop_block, after_loop_block);
@@ -353,13 +623,14 @@ void ForUStatement::codegen() {
     builder.SetInsertPoint(loop_block);
 
     for(auto &i: *_block)
-        i->codegen();
+        codegen_statement(i);
 
     llvm::Value* inc_value = _inc->codegen();
     if(inc_value == nullptr)
         return;
+    inc_value = convert_value(inc_value, _inc->type(), INT);
 
-    llvm::Value* tmp = builder.CreateLoad(alloca, _id);
+    llvm::Value* tmp = builder.CreateLoad(alloca->getAllocatedType(), alloca, _id);
     llvm::Value* next_var = builder.CreateAdd(tmp, inc_value, "nextvar");
     builder.CreateStore(next_var, alloca);
     builder.CreateBr(cond_block);
@@ -367,8 +638,11 @@ void ForUStatement::codegen() {
     function->getBasicBlockList().push_back(after_loop_block);
     builder.SetInsertPoint(after_loop_block);
 
-    if(old_value != nullptr)
+    if(old_value != nullptr) {
         named_values[_id] = old_value;
-    else
+        named_types[_id] = old_type;
+    } else {
         named_values.erase(_id);
+        named_types.erase(_id);
+    }
 }
\ No newline at end of file
@@ -1,20 +1,71 @@
 #ifndef KOTLIN_LLVM_STATEMENT_HPP
 #define KOTLIN_LLVM_STATEMENT_HPP
 
+#include <map>
 #include <utility>
 #include <vector>
 #include <string>
 
 #include "sourcetree/ast.hpp"
 
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Value.h"
 
+// Outcome of running a statement in the interpreter
+enum class Execution {
+    Normal, Returned, Failed
+};
+
 class Statement {
 public:
+    Statement() { ++created_ast_nodes; }
     virtual ~Statement() = default;
     virtual void codegen() = 0;
+    // Registers what a top-level statement declares before any statement is generated
+    virtual void declare() {}
+    // Runs the statement at compile time, see interpreter.hpp. Fails for anything with side effects.
+    virtual Execution execute() { return Execution::Failed; }
+
+    SourceLocation getLocation() const {
+        return _location;
+    }
+
+    void setLocation(int line, int column) {
+        _location = {line, column};
+    }
+
+private:
+    SourceLocation _location;
+};
+
+// Generates a statement nested in a function, with its location attached to the code for -g
+void codegen_statement(Statement* statement);
+
+class FunctionAST;
+
+struct FunctionSignature {
+    std::vector<Type> param_types;
+    Type return_type;
+    // The LLVM function returns the handle of a coroutine that produces return_type, see coroutine.hpp
+    bool is_suspend;
+    // nullptr for inline functions
+    llvm::Function* function;
+    // The definition of an inline function, expanded at every call, see lambdas.hpp
+    FunctionAST* inline_function;
 };
 
+// Kotlin types of every declared function, registered when its prototype is generated. Entries are never
+// removed, so calls keep pointers to them.
+extern std::map<std::string, FunctionSignature> function_signatures;
+
+// Attributes every generated function gets from the command line options
+void set_function_attributes(llvm::Function* function);
+
+// The expression statement a block ends with, which is the value of the block, or nullptr
+ExprAST* block_result(const std::vector<Statement*>& block);
+// Type of block_result, with the variables declared in the block visible
+Type block_result_type(const std::vector<Statement*>& block);
+
 class FunctionPrototypeAST {
 public:
     FunctionPrototypeAST(std::string id, std::vector<Param*> params, Type return_type) :
@@ -25,10 +76,51 @@ public:
         return _id;
     }
 
+    const std::vector<Param*>& getParams() const {
+        return _params;
+    }
+
+    Type getReturnType() const {
+        return _return_type;
+    }
+
+    bool isSuspend() const {
+        return _suspend;
+    }
+
+    void setSuspend(bool suspend) {
+        _suspend = suspend;
+    }
+
+    bool isInline() const {
+        return _inline;
+    }
+
+    void setInline(bool is_inline) {
+        _inline = is_inline;
+    }
+
+    // @Multiversion, see multiversion.hpp
+    bool isMultiversion() const {
+        return _multiversion;
+    }
+
+    void setMultiversion(bool multiversion) {
+        _multiversion = multiversion;
+    }
+
+    ~FunctionPrototypeAST() {
+        for(auto &i : _params)
+            delete i;
+    }
+
 private:
     std::string _id;
     std::vector<Param*> _params;
     Type _return_type;
+    bool _suspend = false;
+    bool _inline = false;
+    bool _multiversion = false;
 };
 
 class FunctionAST : public Statement {
@@ -37,6 +129,19 @@ public:
             _prototype(prototype), _body(body) {
     };
     void codegen() override;
+    void declare() override;
+
+    const FunctionPrototypeAST* getPrototype() const {
+        return _prototype;
+    }
+
+    FunctionPrototypeAST* getPrototype() {
+        return _prototype;
+    }
+
+    const std::vector<Statement*>& getBody() const {
+        return *_body;
+    }
 
     ~FunctionAST() override;
 
@@ -48,7 +153,8 @@ private:
 class ExternalFunctionStatement : public Statement {
 public:
     explicit ExternalFunctionStatement(FunctionPrototypeAST* prototype) : _prototype(prototype) {};
-    void codegen() override;
+    void codegen() override {}
+    void declare() override;
     ~ExternalFunctionStatement() override;
 
 private:
@@ -62,6 +168,11 @@ public:
     void codegen() override {
         expr->codegen();
     }
+    Execution execute() override;
+
+    ExprAST* getExpr() const {
+        return expr;
+    }
 
     ~ExpressionStatement() override {
         delete expr;
@@ -72,15 +183,58 @@ private:
 
 class ReturnStatement : public Statement {
 public:
+    // expr is nullptr for a return from a function returning Unit
     explicit ReturnStatement(ExprAST* expr) : _expr(expr) {};
 
     void codegen() override;
+    Execution execute() override;
+
+    ~ReturnStatement() override {
+        delete _expr;
+    }
 private:
     ExprAST* _expr;
 };
 
 class EmptyStatement : public Statement {
     void codegen() override {}
+    Execution execute() override { return Execution::Normal; }
+};
+
+class FieldAssignStatement : public Statement {
+public:
+    FieldAssignStatement(ExprAST* object, std::string name, ExprAST* expr) :
+            _object(object), _name(std::move(name)), _expr(expr) {};
+    void codegen() override;
+
+    ~FieldAssignStatement() override {
+        delete _object;
+        delete _expr;
+    }
+
+private:
+    ExprAST* _object;
+    std::string _name;
+    ExprAST* _expr;
+};
+
+// `object[index] = value`, a call of the collection's set method
+class IndexAssignStatement : public Statement {
+public:
+    IndexAssignStatement(ExprAST* object, ExprAST* index, ExprAST* expr) :
+            _object(object), _index(index), _expr(expr) {};
+    void codegen() override;
+
+    ~IndexAssignStatement() override {
+        delete _object;
+        delete _index;
+        delete _expr;
+    }
+
+private:
+    ExprAST* _object;
+    ExprAST* _index;
+    ExprAST* _expr;
 };
 
 class VarDeclarationStatement: public Statement {
@@ -88,26 +242,51 @@ public:
     VarDeclarationStatement(std::string id, Type type, bool mut = true) :
     _id(std::move(id)), _type(type), _mut(mut) {};
     void codegen() override;
+    Execution execute() override;
 
     const std::string &getId() const {
         return _id;
     }
 
+    Type getType() const {
+        return _type;
+    }
+
 private:
     std::string _id;
     Type _type;
     bool _mut;
 };
 
+// `const val id: Type = E`, evaluated when it is declared and folded into every use
+class ConstValStatement : public Statement {
+public:
+    ConstValStatement(std::string id, Type type, ExprAST* expr) : _id(std::move(id)), _type(type), _expr(expr) {};
+    void codegen() override;
+
+    ~ConstValStatement() override {
+        delete _expr;
+    }
+private:
+    std::string _id;
+    Type _type;
+    ExprAST* _expr;
+};
+
 class AssignStatement : public Statement {
 public:
     AssignStatement(std::string id, ExprAST* expr) : _id(std::move(id)), _expr(expr) {};
     void codegen() override;
+    // The store of a declaration, which gives a new variable its value rather than assigning it
+    void codegen_initializer();
+    Execution execute() override;
 
     ~AssignStatement() override {
         delete _expr;
     }
 private:
+    llvm::StoreInst* codegen_store();
+
     std::string _id;
     ExprAST* _expr;
 };
@@ -116,6 +295,7 @@ class PlusAssignStatement : public Statement {
 public:
     PlusAssignStatement(std::string id, ExprAST* expr) : _id(std::move(id)), _expr(expr) {};
     void codegen() override;
+    Execution execute() override;
 
     ~PlusAssignStatement() override {
         delete _expr;
@@ -129,6 +309,7 @@ class MinusAssignStatement : public Statement {
 public:
     MinusAssignStatement(std::string id, ExprAST* expr) : _id(std::move(id)), _expr(expr) {};
     void codegen() override;
+    Execution execute() override;
 
     ~MinusAssignStatement() override {
         delete _expr;
@@ -142,6 +323,7 @@ class TimesAssignStatement : public Statement {
 public:
     TimesAssignStatement(std::string id, ExprAST* expr) : _id(std::move(id)), _expr(expr) {};
     void codegen() override;
+    Execution execute() override;
 
     ~TimesAssignStatement() override {
         delete _expr;
@@ -155,6 +337,7 @@ class DivAssignStatement : public Statement {
 public:
     DivAssignStatement(std::string id, ExprAST* expr) : _id(std::move(id)), _expr(expr) {};
     void codegen() override;
+    Execution execute() override;
 
     ~DivAssignStatement() override {
         delete _expr;
@@ -168,6 +351,7 @@ class ModAssignStatement : public Statement {
 public:
     ModAssignStatement(std::string id, ExprAST* expr) : _id(std::move(id)), _expr(expr) {};
     void codegen() override;
+    Execution execute() override;
 
     ~ModAssignStatement() override {
         delete _expr;
@@ -183,6 +367,11 @@ public:
     : _decl_statement(decl_statement), _assign_statement(assign_statement) {};
 
     void codegen() override;
+    Execution execute() override;
+
+    const VarDeclarationStatement* getDeclaration() const {
+        return _decl_statement;
+    }
 
     ~DeclareAndAssignStatement() override {
         delete _decl_statement;
@@ -198,11 +387,13 @@ public:
     IfStatement(ExprAST* cond, std::vector<Statement*>* then_stat)
             : _cond(cond), _then_stat(then_stat) {};
     void codegen() override;
+    Execution execute() override;
 
     ~IfStatement() override {
         delete _cond;
         for(auto &i : *_then_stat)
             delete i;
+        delete _then_stat;
     }
 
 private:
@@ -215,6 +406,7 @@ public:
     IfElseStatement(ExprAST* cond, std::vector<Statement*>* then_stat, std::vector<Statement*>*  else_stat)
             : _cond(cond), _then_stat(then_stat), _else_stat(else_stat) {};
     void codegen() override;
+    Execution execute() override;
 
     ~IfElseStatement() override {
         delete _cond;
@@ -222,6 +414,8 @@ public:
             delete i;
         for(auto &i : *_else_stat)
             delete i;
+        delete _then_stat;
+        delete _else_stat;
     }
 
 private:
@@ -249,11 +443,13 @@ public:
     WhileStatement(ExprAST* cond, std::vector<Statement*>* then_stat)
             : _cond(cond), _then_stat(then_stat) {};
     void codegen() override;
+    Execution execute() override;
 
     ~WhileStatement() override {
         delete _cond;
         for(auto &i : *_then_stat)
             delete i;
+        delete _then_stat;
     }
 
 private:
@@ -266,10 +462,13 @@ public:
     ForStatement(std::string id, int start, int end, ExprAST* inc, std::vector<Statement*>* block)
     :_id(id), _start(start), _end(end), _inc(inc), _block(block) {};
     void codegen() override;
+    Execution execute() override;
 
     ~ForStatement() override {
+        delete _inc;
         for(auto &i : *_block)
             delete i;
+        delete _block;
     }
 private:
     std::string _id;
@@ -284,10 +483,13 @@ public:
     ForUStatement(std::string id, int start, int end, ExprAST* inc, std::vector<Statement*>* block)
             :_id(id), _start(start), _end(end), _inc(inc), _block(block) {};
     void codegen() override;
+    Execution execute() override;
 
     ~ForUStatement() override {
+        delete _inc;
         for(auto &i : *_block)
             delete i;
+        delete _block;
     }
 private:
     std::string _id;
@@ -297,4 +499,38 @@ private:
     std::vector<Statement*>* _block;
 };
 
+// `throw E` and `try { } catch (id: Type) { } finally { }`, see exceptions.hpp
+class ThrowStatement : public Statement {
+public:
+    explicit ThrowStatement(ExprAST* expr) : _expr(expr) {};
+    void codegen() override;
+
+    ~ThrowStatement() override {
+        delete _expr;
+    }
+private:
+    ExprAST* _expr;
+};
+
+struct CatchClause {
+    std::string id;
+    Type type;
+    std::vector<Statement*>* block;
+};
+
+class TryStatement : public Statement {
+public:
+    // finally_block is nullptr without a finally block
+    TryStatement(std::vector<Statement*>* block, std::vector<CatchClause> catches,
+                 std::vector<Statement*>* finally_block) :
+            _block(block), _catches(std::move(catches)), _finally_block(finally_block) {};
+    void codegen() override;
+
+    ~TryStatement() override;
+private:
+    std::vector<Statement*>* _block;
+    std::vector<CatchClause> _catches;
+    std::vector<Statement*>* _finally_block;
+};
+
 #endif //KOTLIN_LLVM_STATEMENT_HPP
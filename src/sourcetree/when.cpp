@@ -0,0 +1,436 @@
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "ast.hpp"
+#include "classes.hpp"
+#include "conversion.hpp"
+#include "statement.hpp"
+
+extern llvm::LLVMContext context;
+extern llvm::IRBuilder<> builder;
+extern llvm::Module* module;
+
+extern void yyerror(std::string msg);
+
+// Ranges with at most this many values become switch cases, longer ones are compared against their bounds
+static const int64_t max_range_cases = 64;
+
+WhenExprAST::~WhenExprAST() {
+    delete _subject;
+    for (WhenBranch* branch : _branches) {
+        for (WhenCondition& condition : branch->conditions) {
+            delete condition.value;
+            delete condition.range_end;
+        }
+        for (Statement* statement : *branch->body) {
+            delete statement;
+        }
+        delete branch->body;
+        delete branch;
+    }
+}
+
+bool WhenExprAST::has_value() {
+    bool has_else = false;
+    for (WhenBranch* branch : _branches) {
+        has_else |= branch->conditions.empty();
+        if (block_result(*branch->body) == nullptr) {
+            return false;
+        }
+    }
+    return has_else;
+}
+
+// Branches of numeric types are promoted like the operands of arithmetic, other types have to match
+Type WhenExprAST::type() {
+    if (!has_value()) {
+        // Used as a statement, like parallelFor it evaluates to 0
+        return INT;
+    }
+    Type result_type = block_result_type(*_branches[0]->body);
+    for (WhenBranch* branch : _branches) {
+        Type branch_type = block_result_type(*branch->body);
+        if (branch_type == result_type) {
+            continue;
+        }
+        bool numeric = (is_integral(branch_type) || is_floating_point(branch_type)) &&
+                       (is_integral(result_type) || is_floating_point(result_type));
+        if (!numeric) {
+            yyerror("The branches of when have different types: " + type_name(result_type) + " and " +
+                    type_name(branch_type));
+        }
+        result_type = arithmetic_type(result_type, branch_type);
+    }
+    return result_type;
+}
+
+static bool is_numeric(Type type) {
+    return is_integral(type) || is_floating_point(type);
+}
+
+// Value of an Int, Long, Char or Boolean literal
+static bool constant_value(ExprAST* expr, int64_t& value) {
+    if (auto* literal = dynamic_cast<IntExprAST*>(expr)) {
+        value = literal->getValue();
+    } else if (auto* long_literal = dynamic_cast<LongExprAST*>(expr)) {
+        value = long_literal->getValue();
+    } else if (auto* char_literal = dynamic_cast<CharExprAST*>(expr)) {
+        value = char_literal->getValue();
+    } else if (auto* boolean_literal = dynamic_cast<ConstBooleanExprAST*>(expr)) {
+        value = boolean_literal->getValue() ? 1 : 0;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Whether the subject can hold the value at all, a case it cannot hold never matches
+static bool fits(Type type, int64_t value) {
+    unsigned bits = type_to_llvm_type(type)->getIntegerBitWidth();
+    if (is_unsigned(type)) {
+        return value >= 0 && (bits == 64 || value < (int64_t(1) << bits));
+    }
+    return llvm::isIntN(bits, value);
+}
+
+static void check_comparable(Type subject, Type value) {
+    if (subject != value && !(is_numeric(subject) && is_numeric(value))) {
+        yyerror("Incompatible types in when: " + type_name(subject) + " and " + type_name(value));
+    }
+}
+
+static llvm::FunctionCallee strcmp_function() {
+    llvm::Type* i8_ptr = builder.getInt8PtrTy();
+    return module->getOrInsertFunction("strcmp", llvm::FunctionType::get(builder.getInt32Ty(), {i8_ptr, i8_ptr}, false));
+}
+
+static llvm::Value* equal(llvm::Value* subject, Type subject_type, llvm::Value* value, Type value_type) {
+    check_comparable(subject_type, value_type);
+    if (subject_type == STRING) {
+        return builder.CreateICmpEQ(builder.CreateCall(strcmp_function(), {subject, value}), builder.getInt32(0), "streq");
+    }
+    if (is_class(subject_type)) {
+        yyerror("Cannot use " + type_name(subject_type) + " as the subject of when");
+    }
+    if (subject_type == BOOLEAN) {
+        return builder.CreateICmpEQ(subject, value, "eq");
+    }
+    Type common = arithmetic_type(subject_type, value_type);
+    subject = convert_value(subject, subject_type, common);
+    value = convert_value(value, value_type, common);
+    return is_floating_point(common) ? builder.CreateFCmpOEQ(subject, value, "eq") : builder.CreateICmpEQ(subject, value, "eq");
+}
+
+static llvm::Value* in_range(llvm::Value* subject, Type subject_type, const WhenCondition& condition) {
+    Type start_type = condition.value->type();
+    Type end_type = condition.range_end->type();
+    if (!is_numeric(subject_type) || !is_numeric(start_type) || !is_numeric(end_type)) {
+        yyerror("Ranges in when need numeric bounds and a numeric subject");
+    }
+    Type common = arithmetic_type(arithmetic_type(subject_type, start_type), end_type);
+    llvm::Value* value = convert_value(subject, subject_type, common);
+    llvm::Value* start = convert_value(condition.value->codegen(), start_type, common);
+    llvm::Value* end = convert_value(condition.range_end->codegen(), end_type, common);
+    if (is_floating_point(common)) {
+        llvm::Value* above = builder.CreateFCmpOGE(value, start, "ge");
+        llvm::Value* below = condition.inclusive ? builder.CreateFCmpOLE(value, end, "le") : builder.CreateFCmpOLT(value, end, "lt");
+        return builder.CreateAnd(above, below, "inrange");
+    }
+    llvm::Value* above = builder.CreateICmpSGE(value, start, "ge");
+    llvm::Value* below = condition.inclusive ? builder.CreateICmpSLE(value, end, "le") : builder.CreateICmpSLT(value, end, "lt");
+    return builder.CreateAnd(above, below, "inrange");
+}
+
+// Collects the constant conditions of an integral subject into switch cases, within a switch the first branch a
+// value appears in wins. Anything else ends the switch and is tested on its own before the next one starts, so the
+// conditions are still checked in source order. The backend turns dense switches into jump tables and sparse ones
+// into balanced compare trees.
+class SwitchBuilder {
+public:
+    SwitchBuilder(llvm::Value* subject, Type subject_type, llvm::Function* function)
+    : _subject(subject), _subject_type(subject_type), _function(function) {}
+
+    void add(int64_t value, llvm::BasicBlock* target) {
+        if (fits(_subject_type, value) && _seen.insert(value).second) {
+            _cases.emplace_back(llvm::ConstantInt::get(llvm::cast<llvm::IntegerType>(_subject->getType()), value, true), target);
+        }
+    }
+
+    // The cases so far go into a switch whose default continues in a new block
+    void flush() {
+        if (_cases.empty()) {
+            return;
+        }
+        llvm::BasicBlock* next = llvm::BasicBlock::Create(context, "whennext", _function);
+        finish(next);
+        builder.SetInsertPoint(next);
+        _seen.clear();
+    }
+
+    void finish(llvm::BasicBlock* default_block) {
+        if (_cases.empty()) {
+            builder.CreateBr(default_block);
+            return;
+        }
+        llvm::SwitchInst* switch_inst = builder.CreateSwitch(_subject, default_block, _cases.size());
+        for (auto& switch_case : _cases) {
+            switch_inst->addCase(switch_case.first, switch_case.second);
+        }
+        _cases.clear();
+    }
+
+private:
+    llvm::Value* _subject;
+    Type _subject_type;
+    llvm::Function* _function;
+    std::vector<std::pair<llvm::ConstantInt*, llvm::BasicBlock*>> _cases;
+    std::set<int64_t> _seen;
+};
+
+// Branches to target when the condition holds and continues in a new block otherwise
+static void branch_if(llvm::Value* condition, llvm::BasicBlock* target, llvm::Function* function) {
+    llvm::BasicBlock* next = llvm::BasicBlock::Create(context, "whennext", function);
+    builder.CreateCondBr(condition, target, next);
+    builder.SetInsertPoint(next);
+}
+
+static void dispatch_integral(llvm::Value* subject, Type subject_type, const std::vector<WhenBranch*>& branches,
+                              const std::vector<llvm::BasicBlock*>& targets, llvm::BasicBlock* default_block,
+                              llvm::Function* function) {
+    SwitchBuilder switch_builder(subject, subject_type, function);
+    for (unsigned i = 0; i < branches.size(); i++) {
+        for (const WhenCondition& condition : branches[i]->conditions) {
+            int64_t start;
+            int64_t end;
+            if (condition.range_end == nullptr && constant_value(condition.value, start)) {
+                check_comparable(subject_type, condition.value->type());
+                switch_builder.add(start, targets[i]);
+                continue;
+            }
+            if (condition.range_end != nullptr && subject_type != BOOLEAN && constant_value(condition.value, start) &&
+                constant_value(condition.range_end, end)) {
+                if (!condition.inclusive) {
+                    end--;
+                }
+                if (end < start || static_cast<uint64_t>(end) - static_cast<uint64_t>(start) < max_range_cases) {
+                    for (int64_t value = start; value <= end; value++) {
+                        switch_builder.add(value, targets[i]);
+                    }
+                    continue;
+                }
+            }
+            switch_builder.flush();
+            llvm::Value* matches = condition.range_end != nullptr
+                    ? in_range(subject, subject_type, condition)
+                    : equal(subject, subject_type, condition.value->codegen(), condition.value->type());
+            branch_if(matches, targets[i], function);
+        }
+    }
+    switch_builder.finish(default_block);
+}
+
+// FNV-1a over the bytes of a string, emitted once per module
+static uint64_t string_hash(const std::string& value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : value) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static llvm::Function* string_hash_function() {
+    if (llvm::Function* function = module->getFunction("kt.string_hash")) {
+        return function;
+    }
+    llvm::Type* int64_type = builder.getInt64Ty();
+    llvm::Type* int8_type = builder.getInt8Ty();
+    llvm::Function* function = llvm::Function::Create(
+            llvm::FunctionType::get(int64_type, {builder.getInt8PtrTy()}, false), llvm::Function::InternalLinkage,
+            "kt.string_hash", module);
+    set_function_attributes(function);
+    llvm::BasicBlock* saved_block = builder.GetInsertBlock();
+    // It has no debug info of its own
+    llvm::DebugLoc saved_location = builder.getCurrentDebugLocation();
+    builder.SetCurrentDebugLocation(llvm::DebugLoc());
+
+    llvm::BasicBlock* entry_block = llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* loop_block = llvm::BasicBlock::Create(context, "loop", function);
+    llvm::BasicBlock* body_block = llvm::BasicBlock::Create(context, "body", function);
+    llvm::BasicBlock* done_block = llvm::BasicBlock::Create(context, "done", function);
+    builder.SetInsertPoint(entry_block);
+    builder.CreateBr(loop_block);
+
+    builder.SetInsertPoint(loop_block);
+    llvm::PHINode* pointer = builder.CreatePHI(builder.getInt8PtrTy(), 2, "pointer");
+    llvm::PHINode* hash = builder.CreatePHI(int64_type, 2, "hash");
+    pointer->addIncoming(&*function->arg_begin(), entry_block);
+    hash->addIncoming(builder.getInt64(14695981039346656037ULL), entry_block);
+    llvm::Value* byte = builder.CreateLoad(int8_type, pointer, "byte");
+    builder.CreateCondBr(builder.CreateICmpEQ(byte, builder.getInt8(0), "end"), done_block, body_block);
+
+    builder.SetInsertPoint(body_block);
+    llvm::Value* mixed = builder.CreateMul(builder.CreateXor(hash, builder.CreateZExt(byte, int64_type)),
+                                           builder.getInt64(1099511628211ULL), "mixed");
+    pointer->addIncoming(builder.CreateInBoundsGEP(int8_type, pointer, builder.getInt64(1), "next"), body_block);
+    hash->addIncoming(mixed, body_block);
+    builder.CreateBr(loop_block);
+
+    builder.SetInsertPoint(done_block);
+    builder.CreateRet(hash);
+
+    builder.SetInsertPoint(saved_block);
+    builder.SetCurrentDebugLocation(saved_location);
+    return function;
+}
+
+// When every condition is a string literal the subject is hashed once and switched on, a strcmp confirms the
+// literals that share a hash. Otherwise the conditions are compared one by one.
+static void dispatch_string(llvm::Value* subject, const std::vector<WhenBranch*>& branches,
+                            const std::vector<llvm::BasicBlock*>& targets, llvm::BasicBlock* default_block,
+                            llvm::Function* function) {
+    bool literals = true;
+    for (WhenBranch* branch : branches) {
+        for (const WhenCondition& condition : branch->conditions) {
+            literals &= condition.range_end == nullptr && dynamic_cast<ConstStringExprAST*>(condition.value) != nullptr;
+        }
+    }
+    if (!literals) {
+        for (unsigned i = 0; i < branches.size(); i++) {
+            for (const WhenCondition& condition : branches[i]->conditions) {
+                if (condition.range_end != nullptr) {
+                    yyerror("Ranges in when need numeric bounds and a numeric subject");
+                }
+                branch_if(equal(subject, STRING, condition.value->codegen(), condition.value->type()), targets[i], function);
+            }
+        }
+        builder.CreateBr(default_block);
+        return;
+    }
+
+    // Literals by hash, in source order
+    std::map<uint64_t, std::vector<std::pair<ConstStringExprAST*, llvm::BasicBlock*>>> buckets;
+    std::set<std::string> seen;
+    std::vector<uint64_t> hashes;
+    for (unsigned i = 0; i < branches.size(); i++) {
+        for (const WhenCondition& condition : branches[i]->conditions) {
+            auto* literal = static_cast<ConstStringExprAST*>(condition.value);
+            if (!seen.insert(literal->getValue()).second) {
+                continue;
+            }
+            uint64_t hash = string_hash(literal->getValue());
+            if (buckets[hash].empty()) {
+                hashes.push_back(hash);
+            }
+            buckets[hash].emplace_back(literal, targets[i]);
+        }
+    }
+    llvm::Value* subject_hash = builder.CreateCall(string_hash_function(), {subject}, "hash");
+    llvm::SwitchInst* switch_inst = builder.CreateSwitch(subject_hash, default_block, hashes.size());
+    for (uint64_t hash : hashes) {
+        llvm::BasicBlock* bucket_block = llvm::BasicBlock::Create(context, "whenhash", function);
+        switch_inst->addCase(builder.getInt64(hash), bucket_block);
+        builder.SetInsertPoint(bucket_block);
+        for (auto& candidate : buckets[hash]) {
+            branch_if(equal(subject, STRING, candidate.first->codegen(), STRING), candidate.second, function);
+        }
+        builder.CreateBr(default_block);
+    }
+}
+
+// A subjectless when tests its Boolean conditions in order
+static void dispatch_conditions(const std::vector<WhenBranch*>& branches, const std::vector<llvm::BasicBlock*>& targets,
+                                llvm::BasicBlock* default_block, llvm::Function* function) {
+    for (unsigned i = 0; i < branches.size(); i++) {
+        for (const WhenCondition& condition : branches[i]->conditions) {
+            if (condition.range_end != nullptr) {
+                yyerror("A when without a subject cannot test ranges");
+            }
+            if (condition.value->type() != BOOLEAN) {
+                yyerror("The conditions of a when without a subject must be boolean");
+            }
+            branch_if(condition.value->codegen(), targets[i], function);
+        }
+    }
+    builder.CreateBr(default_block);
+}
+
+llvm::Value* WhenExprAST::codegen() {
+    bool value = has_value();
+    Type result_type = type();
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+
+    llvm::BasicBlock* merge_block = llvm::BasicBlock::Create(context, "whenend");
+    std::vector<llvm::BasicBlock*> targets;
+    llvm::BasicBlock* default_block = merge_block;
+    for (WhenBranch* branch : _branches) {
+        targets.push_back(llvm::BasicBlock::Create(context, branch->conditions.empty() ? "whenelse" : "whenbranch"));
+        if (branch->conditions.empty() && default_block == merge_block) {
+            default_block = targets.back();
+        }
+    }
+
+    if (_subject == nullptr) {
+        dispatch_conditions(_branches, targets, default_block, function);
+    } else {
+        Type subject_type = _subject->type();
+        llvm::Value* subject = _subject->codegen();
+        if (is_integral(subject_type) || subject_type == BOOLEAN) {
+            dispatch_integral(subject, subject_type, _branches, targets, default_block, function);
+        } else if (subject_type == STRING) {
+            dispatch_string(subject, _branches, targets, default_block, function);
+        } else {
+            // Floating point subjects, and classes which equal() reports
+            for (unsigned i = 0; i < _branches.size(); i++) {
+                for (const WhenCondition& condition : _branches[i]->conditions) {
+                    llvm::Value* matches = condition.range_end != nullptr
+                            ? in_range(subject, subject_type, condition)
+                            : equal(subject, subject_type, condition.value->codegen(), condition.value->type());
+                    branch_if(matches, targets[i], function);
+                }
+            }
+            builder.CreateBr(default_block);
+        }
+    }
+
+    std::vector<std::pair<llvm::Value*, llvm::BasicBlock*>> incoming;
+    for (unsigned i = 0; i < _branches.size(); i++) {
+        function->getBasicBlockList().push_back(targets[i]);
+        builder.SetInsertPoint(targets[i]);
+        ExprAST* result = value ? block_result(*_branches[i]->body) : nullptr;
+        llvm::Value* branch_value = nullptr;
+        for (Statement* statement : *_branches[i]->body) {
+            auto* expression = dynamic_cast<ExpressionStatement*>(statement);
+            if (result != nullptr && expression != nullptr && expression->getExpr() == result) {
+                branch_value = convert_value(result->codegen(), block_result_type(*_branches[i]->body), result_type);
+            } else {
+                codegen_statement(statement);
+            }
+        }
+        // A branch that returns does not reach the end of the when
+        if (builder.GetInsertBlock()->getTerminator() == nullptr) {
+            incoming.emplace_back(branch_value, builder.GetInsertBlock());
+            builder.CreateBr(merge_block);
+        }
+    }
+
+    function->getBasicBlockList().push_back(merge_block);
+    builder.SetInsertPoint(merge_block);
+    if (!value) {
+        return builder.getInt32(0);
+    }
+    if (incoming.empty()) {
+        return llvm::UndefValue::get(type_to_llvm_type(result_type));
+    }
+    llvm::PHINode* phi_node = builder.CreatePHI(type_to_llvm_type(result_type), incoming.size(), "whentmp");
+    for (auto& branch : incoming) {
+        phi_node->addIncoming(branch.first, branch.second);
+    }
+    return phi_node;
+}
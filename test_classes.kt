@@ -0,0 +1,30 @@
+data class Point(val x: Int, val y: Int)
+class Size(val width: Double, val height: Double)
+value class Meters(val value: Double)
+data class Segment(val from: Point, val to: Point)
+
+fun add(a: Point, b: Point): Point = Point(a.x + b.x, a.y + b.y)
+
+fun area(s: Size): Double = s.width * s.height
+
+fun length(s: Segment): Int {
+    var dx: Int = s.to.x - s.from.x
+    var dy: Int = s.to.y - s.from.y
+    return dx * dx + dy * dy
+}
+
+fun main(): Int {
+    var p: Point = Point(1, 2)
+    var q: Point = add(p, Point(3, 4))
+    println(q.x)
+    println(q.y)
+    println(q)
+    println(area(Size(1.5, 4.0)))
+    var m: Meters = Meters(2.5)
+    println(m.value * 2)
+    println(m)
+    var s: Segment = Segment(p, q)
+    println(length(s))
+    println(s.to.y)
+    return 0
+}
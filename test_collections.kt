@@ -0,0 +1,43 @@
+fun main(): Int {
+    var list: ArrayList<Int> = ArrayList<Int>()
+    for (i in 0 until 100) {
+        list.add(i * i)
+    }
+    println(list.size)
+    println(list[10])
+    list[10] = 7
+    println(list.get(10))
+    println(list.set(10, 8))
+    println(list.removeLast())
+    println(list.size)
+    println(list.isEmpty())
+
+    var map: HashMap<Long, Double> = HashMap<Long, Double>()
+    var j: Int = 0
+    while (j < 10000) {
+        map[j * 7L] = j * 0.5
+        j += 1
+    }
+    println(map.size)
+    println(map[700L])
+    println(map.getOrDefault(3L, 1.5))
+    println(map.containsKey(14L))
+    println(map.containsKey(15L))
+    j = 0
+    while (j < 5000) {
+        map.remove(j * 7L)
+        j += 1
+    }
+    println(map.size)
+    println(map.containsKey(7L))
+
+    var set: HashSet<Char> = HashSet<Char>()
+    println(set.add('a'))
+    println(set.add('a'))
+    println(set.add('b'))
+    println(set.contains('b'))
+    println(set.remove('b'))
+    println(set.contains('b'))
+    println(set.size)
+    return 0
+}
@@ -0,0 +1,57 @@
+fun wrapByte(x: Int): Byte {
+    var b: Byte = 100
+    b += x
+    return b
+}
+fun shifts(x: Int, s: Int): Long = (x shl s) + (x ushr s) + (x shr s)
+fun nextChar(c: Char): Char = c + 2
+fun dist(a: Char, b: Char): Int = b - a
+fun toInt(d: Double): Int = d
+fun bits(x: Long): Long = (x and 255L) xor (x or 7L)
+fun fdiv(x: Float, y: Float): Float = x / y
+fun cmp(a: Char, b: Char): Boolean = a < b
+fun loop(n: Int): Int {
+    var s: Int = 0
+    for (i in 0 until 10 step 3) {
+        s = s * 31 + i + n
+    }
+    var k: Int = 0
+    while (k < n) {
+        s %= 1000
+        k += 1
+        if (s > 500) {
+            s -= 7
+        } else {
+            s += 13
+        }
+    }
+    return s
+}
+fun overflow(x: Int): Int = x * 1000000 * 1000
+const val C0: Byte = wrapByte(200)
+const val C1: Long = shifts(123456, 35)
+const val C2: Long = shifts(0 - 5, 3)
+const val C3: Char = nextChar('a')
+const val C4: Int = dist('a', 'z')
+const val C5: Int = toInt(100000000000000000000.0)
+const val C6: Int = toInt(2.9)
+const val C7: Long = bits(1000L)
+const val C8: Float = fdiv(1.0f, 3.0f)
+const val C9: Boolean = cmp('b', 'a')
+const val C10: Int = loop(17)
+const val C11: Int = overflow(7)
+fun main(): Int {
+    println(C0)
+    println(C1)
+    println(C2)
+    println(C3)
+    println(C4)
+    println(C5)
+    println(C6)
+    println(C7)
+    println(C8)
+    println(C9)
+    println(C10)
+    println(C11)
+    return 0
+}
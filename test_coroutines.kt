@@ -0,0 +1,33 @@
+suspend fun square(x: Int): Int = x * x
+
+suspend fun fetch(id: Int, ms: Int): Int {
+    delay(ms)
+    println(id)
+    return id * 10
+}
+
+suspend fun worker(name: Int): Int {
+    var i: Int = 0
+    while (i < 3) {
+        println(name * 100 + i)
+        yield()
+        i += 1
+    }
+    return name
+}
+
+suspend fun app(): Int {
+    var total: Int = square(7)
+    launch(worker(1))
+    launch(worker(2))
+    var a: Deferred<Int> = async(fetch(5, 60))
+    var b: Deferred<Int> = async(fetch(6, 10))
+    total += await(a) + await(b)
+    total += fetch(7, 0)
+    return total
+}
+
+fun main(): Int {
+    println(runBlocking(app()))
+    return 0
+}
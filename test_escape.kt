@@ -0,0 +1,14 @@
+class Box(var v: Int)
+
+fun main(): Int {
+    var a: Box
+    var b: Box
+    for (i in 1..4) {
+        b = a
+        a = Box(i)
+        if (i > 1) {
+            println(b.v * 100 + a.v)
+        }
+    }
+    return 0
+}
@@ -0,0 +1,106 @@
+class MyError(val message: String, val code: Int)
+data class Plain(val x: Int)
+
+fun fail(n: Int): Int {
+    if (n > 2) {
+        throw MyError("too big", n)
+    }
+    return n * 10
+}
+
+fun divide(a: Int, b: Int): Int = a / b
+
+fun plain(): Int {
+    throw Plain(7)
+}
+
+fun withFinally(n: Int): Int {
+    try {
+        return fail(n)
+    } finally {
+        println("finally in withFinally")
+    }
+}
+
+fun nested(n: Int): Int {
+    var r: Int = 0
+    try {
+        try {
+            r = fail(n)
+        } catch (e: Plain) {
+            println("wrong catch")
+        } finally {
+            println("inner finally")
+        }
+    } catch (e: MyError) {
+        println(e.message)
+        r = e.code
+    }
+    return r
+}
+
+fun rethrow(n: Int): Int {
+    try {
+        return fail(n)
+    } catch (e: MyError) {
+        println("rethrowing")
+        throw IllegalStateException("rethrown")
+    } finally {
+        println("rethrow finally")
+    }
+}
+
+fun main(): Int {
+    try {
+        println(fail(1))
+        println(fail(5))
+        println("not reached")
+    } catch (e: MyError) {
+        println(e.message)
+        println(e.code)
+    }
+    try {
+        println(divide(7, 0))
+    } catch (e: ArithmeticException) {
+        println(e.message)
+    }
+    try {
+        plain()
+    } catch (e: Plain) {
+        println(e.x)
+    }
+    println(withFinally(1))
+    println(nested(9))
+    println(nested(1))
+    try {
+        rethrow(4)
+    } catch (e: Exception) {
+        println(e.message)
+    }
+    var l: ArrayList<Int> = ArrayList<Int>()
+    l.add(3)
+    try {
+        println(l[5])
+    } catch (e: IndexOutOfBoundsException) {
+        println(e.message)
+    }
+    try {
+        println(divide(8, 2))
+    } finally {
+        println("done")
+    }
+    var m: HashMap<Int, Int> = HashMap<Int, Int>()
+    try {
+        println(m[1])
+    } catch (e: NoSuchElementException) {
+        println(e.message)
+    }
+    var zero: Int = 0
+    var g: (Int) -> Int = { x: Int -> 10 / x }
+    try {
+        println(g(zero))
+    } catch (e: ArithmeticException) {
+        println(e.message)
+    }
+    return 0
+}
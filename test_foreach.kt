@@ -0,0 +1,23 @@
+fun main(): Int {
+    var list: ArrayList<Int> = ArrayList<Int>()
+    list.add(3)
+    list.add(4)
+    list.add(5)
+    list.forEach { println(it) }
+
+    var set: HashSet<Long> = HashSet<Long>()
+    set.add(10L)
+    set.add(20L)
+    set.add(10L)
+    var setSum: Long = 0L
+    set.forEach { x: Long -> setSum += x }
+    println(setSum)
+
+    var map: HashMap<Int, Double> = HashMap<Int, Double>()
+    map[1] = 0.5
+    map[2] = 1.5
+    var mapSum: Double = 0.0
+    map.forEach { key, value -> mapSum += key * value }
+    println(mapSum)
+    return 0
+}
@@ -0,0 +1,31 @@
+fun main(): Int {
+    println(isEven(10))
+    println(twice(3))
+    println(square(4))
+    println(K)
+    return 0
+}
+
+inline fun twice(x: Int): Int {
+    return helper(x) * 2
+}
+
+fun isEven(n: Int): Boolean {
+    if (n < 1) {
+        return true
+    }
+    return isOdd(n - 1)
+}
+
+fun isOdd(n: Int): Boolean {
+    if (n < 1) {
+        return false
+    }
+    return isEven(n - 1)
+}
+
+const val K: Int = 7
+
+fun helper(x: Int): Int = x + 1
+
+fun square(x: Int): Int = x * x
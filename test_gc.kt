@@ -0,0 +1,84 @@
+class Counter(var n: Int)
+class Pair(var first: Counter, var second: Counter)
+
+fun churn(keep: Pair, rounds: Int): Long {
+    var total: Long = 0L
+    var i: Int = 0
+    while (i < rounds) {
+        var garbage: Pair = Pair(Counter(i), Counter(i + 1))
+        total += garbage.first.n + garbage.second.n
+        if (i % 100000 < 1) {
+            keep.second = Counter(keep.second.n + 1)
+        }
+        i += 1
+    }
+    return total
+}
+
+class Node(val value: Int, var next: Node)
+data class Tree(val value: Int, val left: Tree, val right: Tree)
+
+fun prepend(list: Node, count: Int): Node {
+    var head: Node = list
+    var i: Int = 0
+    while (i < count) {
+        head = Node(i, head)
+        var garbage: Counter = Counter(i)
+        i += 1
+    }
+    return head
+}
+
+fun build(depth: Int, leaf: Tree): Tree {
+    if (depth < 1) {
+        return leaf
+    }
+    return Tree(depth, build(depth - 1, leaf), build(depth - 1, leaf))
+}
+
+fun sum(tree: Tree, depth: Int): Long {
+    if (depth < 1) {
+        return 0L
+    }
+    return tree.value + sum(tree.left, depth - 1) + sum(tree.right, depth - 1)
+}
+
+fun second(a: Counter, b: Counter): Counter = b
+
+fun main(): Int {
+    var keep: Pair = Pair(Counter(7), Counter(0))
+    var alias: Pair = keep
+    println(churn(keep, 1000000))
+    println(alias.first.n)
+    println(alias.second.n)
+    alias.first.n = 42
+    println(keep.first.n)
+
+    var end: Node
+    var list: Node = prepend(end, 200000)
+    println(churn(keep, 1000000))
+    var total: Long = 0L
+    var node: Node = list
+    var length: Int = 0
+    while (length < 200000) {
+        total += node.value
+        node = node.next
+        length += 1
+    }
+    println(total)
+
+    var leaf: Tree
+    var tree: Tree = build(16, leaf)
+    println(churn(keep, 1000000))
+    println(sum(tree, 16))
+    println(sum(tree.left.right, 14))
+
+    var last: Counter = Counter(0)
+    var j: Int = 0
+    while (j < 4) {
+        last = second(Counter(j * 2), Counter(j))
+        j += 1
+    }
+    println(last.n)
+    return 0
+}
@@ -0,0 +1,16 @@
+import geo.shapes
+
+fun main(): Int {
+    var p: Point = Point(1, 2)
+    var q: Point = Point(4, 6)
+    println(dist2(p, q))
+    var c: Counter = Counter(1)
+    bump(c)
+    println(c.n)
+    println(SCALE * 2)
+    println(RATIO)
+    println(twice({ v -> v * SCALE }, 2))
+    var offset: Int = 10
+    println(repeatSum(4) { i -> i + offset })
+    return 0
+}
@@ -0,0 +1,28 @@
+data class Point(val x: Int, val y: Int)
+class Counter(var n: Int)
+const val SCALE: Int = 3
+const val RATIO: Double = 1.5
+
+fun dist2(a: Point, b: Point): Int {
+    var dx: Int = a.x - b.x
+    var dy: Int = a.y - b.y
+    return dx * dx + dy * dy
+}
+
+fun bump(c: Counter) {
+    c.n = c.n + SCALE
+}
+
+inline fun twice(f: (Int) -> Int, x: Int): Int = f(f(x))
+
+inline fun repeatSum(n: Int, body: (Int) -> Int): Int {
+    var total: Int = 0
+    var i: Int = 0
+    while (i < n) {
+        total = total + body(i)
+        i = i + 1
+    }
+    return total
+}
+
+fun unused(x: Int): Int = x + 1
@@ -0,0 +1,22 @@
+fun main(): Int {
+    var two: Double = 2.0
+    var x: Double = 0.0 - 1.5
+    println(sqrt(two))
+    println(floor(x))
+    println(ceil(1.2))
+    println(round(2.5))
+    println(round(3.5))
+    println(truncate(0.0 - 2.7))
+    var n: Int = 0 - 5
+    println(abs(n))
+    println(min(3, 7))
+    println(maxOf(2.5, 1.0))
+    println(min(0.0, (0.0 - 1.0) * 0.0))
+    var bits: Int = 255
+    println(countOneBits(bits))
+    println(countLeadingZeroBits(1))
+    println(countTrailingZeroBits(8L))
+    println(rotateLeft(1, 31))
+    println(rotateRight(6, 1))
+    return 0
+}
@@ -0,0 +1,63 @@
+inline fun twice(f: (Int) -> Int, x: Int): Int {
+    return f(f(x))
+}
+
+inline fun findFirst(limit: Int, pred: (Int) -> Boolean): Int {
+    var i: Int = 0
+    while (i < limit) {
+        if (pred(i)) {
+            return i
+        }
+        i += 1
+    }
+    return limit
+}
+
+fun firstSquareAbove(n: Int): Int {
+    repeat(100) {
+        if (it * it > n) {
+            return it
+        }
+    }
+    return 0
+}
+
+fun apply(f: (Int) -> Int, x: Int): Int = f(x)
+
+fun adder(n: Int): (Int) -> Int {
+    return { x: Int -> x + n }
+}
+
+fun sayHello() {
+    println("hello")
+}
+
+fun countdown(n: Int) {
+    var i: Int = n
+    while (i > 0) {
+        if (i < 2) {
+            return
+        }
+        println(i)
+        i -= 1
+    }
+}
+
+fun main(): Int {
+    var sum: Int = 0
+    repeat(10) { sum += it }
+    println(sum)
+    println(twice({ it * 3 }, 2))
+    var k: Int = 5
+    println(twice({ x -> x + k }, 1))
+    println(findFirst(100) { it * it > 50 })
+    println(firstSquareAbove(30))
+    println(apply({ it + 100 }, 1))
+    println(apply({ it * k }, 3))
+    var add5: (Int) -> Int = adder(5)
+    println(add5(10))
+    println(apply(add5, 1))
+    sayHello()
+    countdown(4)
+    return 0
+}
@@ -0,0 +1,27 @@
+@Multiversion
+fun dot(n: Int, seed: Double): Double {
+    var s: Double = 0.0
+    var i: Int = 0
+    while (i < n) {
+        var x: Double = seed + i
+        s = s + x * x
+        i = i + 1
+    }
+    return s
+}
+
+@Multiversion fun fib(n: Int): Int {
+    if (n < 2) {
+        return n
+    }
+    return fib(n - 1) + fib(n - 2)
+}
+
+fun main(): Int {
+    var n: Int = 1000
+    var seed: Double = 0.5
+    println(dot(n, seed))
+    n = 20
+    println(fib(n))
+    return 0
+}
@@ -0,0 +1,30 @@
+fun collatz(start: Int): Int {
+    var n: Long = start * 1L
+    var steps: Int = 0
+    while (n > 1L) {
+        if (n % 2L < 1L) {
+            n = n / 2L
+        } else {
+            n = 3L * n + 1L
+        }
+        steps += 1
+    }
+    return steps
+}
+
+fun main(): Int {
+    var n: Int = 300000
+    var scale: Double = 0.5
+    var total: Long = parallelSum(i in 1 until n) {
+        var s: Int = collatz(i)
+        s * 1L
+    }
+    println(total)
+    println(parallelSum(i in 1..1000) { i * scale })
+    println(parallelSum(i in 10 until 0) { i })
+    parallelFor(i in 0 until 4) {
+        n = i
+    }
+    println(n)
+    return 0
+}
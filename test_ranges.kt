@@ -0,0 +1,37 @@
+fun harmonic(scale: Int): Int {
+    var s: Int = 0
+    for (i in 1..10) {
+        s += scale / i
+    }
+    return s
+}
+
+fun squares(list: ArrayList<Int>): Long {
+    var s: Long = 0L
+    for (i in 0 until 5) {
+        s += list[i] * list[i]
+    }
+    return s
+}
+
+fun divide(a: Int, b: Int): Int = a / b
+
+fun main(): Int {
+    var scale: Int = 100
+    println(harmonic(scale))
+    var list: ArrayList<Int> = ArrayList<Int>()
+    for (i in 1..5) {
+        list.add(i)
+    }
+    println(squares(list))
+    var big: Int = 2147483647
+    println(big + 1)
+    var zero: Int = 0
+    try {
+        println(divide(scale, zero))
+    } catch (e: ArithmeticException) {
+        println(e.message)
+    }
+    println(divide(0 - 2147483647 - 1, 0 - 1))
+    return 0
+}
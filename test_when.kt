@@ -0,0 +1,69 @@
+fun dense(x: Int): Int = when (x) {
+    0 -> 10
+    1 -> 11
+    2, 3 -> 12
+    4 -> 14
+    5 -> 15
+    6 -> 16
+    in 7..9 -> 17
+    else -> 99
+}
+fun sparse(x: Long): Long {
+    return when (x) {
+        1L -> 1
+        1000 -> 2
+        100000 -> 3
+        in 200..100000000 -> 4
+        else -> 0
+    }
+}
+fun name(s: String): Int = when (s) {
+    "apple" -> 1
+    "pear", "plum" -> 2
+    else -> 0
+}
+fun sign(d: Double): Int = when {
+    d < 0 -> 2
+    d > 0 -> 1
+    else -> 0
+}
+fun mixed(x: Int, y: Int): Double {
+    var r: Double = when (x) {
+        1 -> 1
+        y -> {
+            var z: Int = y * 2
+            z + 0.5
+        }
+        2 -> 3.0
+        else -> 0
+    }
+    return r
+}
+fun grade(c: Char): Int = when (c) {
+    'a' -> 1
+    'b', 'c' -> 2
+    else -> 3
+}
+fun main(): Int {
+    for (i in 0..10) {
+        println(dense(i))
+    }
+    println(sparse(1000L))
+    println(sparse(555L))
+    println(sparse(7L))
+    println(name("pear"))
+    println(name("apple"))
+    println(name("kiwi"))
+    println(sign(2.0))
+    println(sign(0.0))
+    println(mixed(2, 2))
+    println(mixed(2, 5))
+    println(grade('c'))
+    var t: Int = 0
+    when (t) {
+        0 -> t = 5
+        1 -> println(1)
+    }
+    println(t)
+    return 0
+}